@@ -112,6 +112,7 @@ typedef NS_ENUM(NSInteger, KernPageState) {
 @property(nonatomic, assign) BOOL accessed;
 @property(nonatomic, assign) BOOL swapped;
 @property(nonatomic, assign) uint64_t swapOffset;
+@property(nonatomic, assign) uint32_t memcgID; // Cgroup charged, 0 if none
 @end
 
 // TLB Entry
@@ -125,6 +126,10 @@ typedef NS_ENUM(NSInteger, KernPageState) {
 @property(nonatomic, assign) uint32_t asid; // Address Space ID
 @end
 
+@class KernInode;
+@class KernVMAPages;
+@class KernSharedMemory;
+
 // Virtual Memory Area (VMA)
 @interface KernVMA : NSObject
 @property(nonatomic, assign) uint64_t startAddress;
@@ -139,6 +144,9 @@ typedef NS_ENUM(NSInteger, KernPageState) {
 @property(nonatomic, assign) BOOL isStack;
 @property(nonatomic, assign) BOOL isHeap;
 @property(nonatomic, assign) uint32_t processID;
+@property(nonatomic, strong) KernInode *file;     // Backing file, if mapped
+@property(nonatomic, strong) KernVMAPages *pages; // Created on first access
+@property(nonatomic, strong) KernSharedMemory *shm; // Attached segment
 @end
 
 // Slab Allocator Cache
@@ -248,6 +256,8 @@ typedef NS_ENUM(NSInteger, KernSignal) {
 @property(nonatomic, strong) NSData *vectorState; // NEON/SVE state
 @end
 
+@class KernFDTable;
+
 // Advanced Process Control Block (PCB)
 @interface KernProcess : NSObject
 @property(nonatomic, assign) uint32_t pid;
@@ -286,7 +296,7 @@ typedef NS_ENUM(NSInteger, KernSignal) {
 @property(nonatomic, assign) uint32_t gid;
 @property(nonatomic, assign) uint32_t euid;
 @property(nonatomic, assign) uint32_t egid;
-@property(nonatomic, strong) NSMutableArray *openFileDescriptors;
+@property(nonatomic, strong) KernFDTable *fdTable; // Shared by CLONE_FILES
 @property(nonatomic, assign) uint32_t maxFDs;
 @property(nonatomic, strong) NSMutableDictionary *signalHandlers;
 @property(nonatomic, assign) uint64_t pendingSignals;
@@ -383,14 +393,23 @@ typedef NS_ENUM(NSInteger, KernIPCType) {
 @property(nonatomic, assign) uint64_t receiveCount;
 @property(nonatomic, strong) NSMutableArray *waitingReaders;
 @property(nonatomic, strong) NSMutableArray *waitingWriters;
+@property(nonatomic, assign) uint32_t namespaceID; // IPC namespace
 @end
 
-// Shared Memory
+// Shared Memory — backed by a host memfd (Linux) or POSIX shm object, mapped
+// MAP_SHARED so external tools can open backingPath and read it zero-copy.
 @interface KernSharedMemory : NSObject
 @property(nonatomic, assign) uint32_t shmID;
 @property(nonatomic, strong) NSString *name;
-@property(nonatomic, strong) NSMutableData *data;
+@property(nonatomic, assign) void *mapping;     // Host mapping of the segment
+@property(nonatomic, assign) int backingFD;     // memfd / shm_open descriptor
+@property(nonatomic, strong) NSString *backingPath; // Host path for tooling
 @property(nonatomic, assign) NSUInteger size;
+@property(nonatomic, assign) NSUInteger mappedSize; // size rounded to pageSize
+@property(nonatomic, assign) NSUInteger pageSize;   // 4 KB or 2 MB
+@property(nonatomic, assign) BOOL hugePages;
+@property(nonatomic, strong)
+    NSMutableDictionary<NSNumber *, NSNumber *> *attachAddresses; // pid -> VA
 @property(nonatomic, assign) uint32_t ownerPID;
 @property(nonatomic, assign) uint32_t permissions;
 @property(nonatomic, assign) NSUInteger attachCount;
@@ -399,6 +418,7 @@ typedef NS_ENUM(NSInteger, KernIPCType) {
 @property(nonatomic, assign) uint64_t lastAttachTime;
 @property(nonatomic, assign) uint64_t lastDetachTime;
 @property(nonatomic, assign) BOOL markedForDeletion;
+@property(nonatomic, assign) uint32_t namespaceID; // IPC namespace
 @end
 
 // Semaphore
@@ -411,6 +431,7 @@ typedef NS_ENUM(NSInteger, KernIPCType) {
 @property(nonatomic, strong) NSMutableArray *waitQueue;
 @property(nonatomic, assign) uint64_t waitCount;
 @property(nonatomic, assign) uint64_t postCount;
+@property(nonatomic, assign) uint32_t lockClass;
 @end
 
 // ==========================================================================
@@ -441,6 +462,53 @@ typedef NS_ENUM(NSInteger, KernRWLockState) {
   KernRWLockWriteLocked
 };
 
+typedef NS_ENUM(NSInteger, KernLockKind) {
+  KernLockKindMutex = 0,
+  KernLockKindRWLockRead,
+  KernLockKindRWLockWrite,
+  KernLockKindSpinlock,
+  KernLockKindSemaphore
+};
+
+// Lock dependency validator (lockdep) and contention profiler. The hooks are
+// compiled in only when KERN_LOCKDEP is non-zero (the debug target defines
+// DEBUG, which turns it on); release builds carry no instrumentation at all.
+#ifndef KERN_LOCKDEP
+#ifdef DEBUG
+#define KERN_LOCKDEP 1
+#else
+#define KERN_LOCKDEP 0
+#endif
+#endif
+
+#if KERN_LOCKDEP
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t KernLockdepClass(NSString *name);
+void KernLockdepContended(uint32_t lockClass, KernLockKind kind);
+void KernLockdepAcquired(uint32_t lockClass, KernLockKind kind, void *site);
+void KernLockdepReleased(uint32_t lockClass, KernLockKind kind);
+#ifdef __cplusplus
+}
+#endif
+
+// Lock classes are keyed by lock name and cached on the lock object.
+#define KERN_LOCKDEP_CLASS(lock)                                               \
+  ((lock).lockClass ?: ((lock).lockClass = KernLockdepClass((lock).name)))
+#define KERN_LOCKDEP_CONTENDED(lock, kind)                                     \
+  KernLockdepContended(KERN_LOCKDEP_CLASS(lock), (kind))
+#define KERN_LOCKDEP_ACQUIRED(lock, kind)                                      \
+  KernLockdepAcquired(KERN_LOCKDEP_CLASS(lock), (kind),                        \
+                      __builtin_return_address(0))
+#define KERN_LOCKDEP_RELEASED(lock, kind)                                      \
+  KernLockdepReleased(KERN_LOCKDEP_CLASS(lock), (kind))
+#else
+#define KERN_LOCKDEP_CONTENDED(lock, kind) ((void)0)
+#define KERN_LOCKDEP_ACQUIRED(lock, kind) ((void)0)
+#define KERN_LOCKDEP_RELEASED(lock, kind) ((void)0)
+#endif
+
 // Thread
 @interface KernThread : NSObject
 @property(nonatomic, assign) uint32_t threadID;
@@ -473,6 +541,7 @@ typedef NS_ENUM(NSInteger, KernRWLockState) {
 @property(nonatomic, assign) BOOL usePriorityInheritance;
 @property(nonatomic, assign) uint64_t lockCount;
 @property(nonatomic, assign) uint64_t contentionCount;
+@property(nonatomic, assign) uint32_t lockClass; // lockdep class, 0 = unset
 @end
 
 // Read-Write Lock
@@ -485,6 +554,7 @@ typedef NS_ENUM(NSInteger, KernRWLockState) {
 @property(nonatomic, strong) NSMutableArray *readWaitQueue;
 @property(nonatomic, strong) NSMutableArray *writeWaitQueue;
 @property(nonatomic, assign) BOOL preferWriters;
+@property(nonatomic, assign) uint32_t lockClass;
 @end
 
 // Condition Variable
@@ -499,10 +569,12 @@ typedef NS_ENUM(NSInteger, KernRWLockState) {
 // Spinlock
 @interface KernSpinlock : NSObject
 @property(nonatomic, assign) uint32_t spinlockID;
+@property(nonatomic, strong) NSString *name;
 @property(nonatomic, assign) volatile BOOL locked;
 @property(nonatomic, assign) uint32_t ownerCPU;
 @property(nonatomic, assign) uint64_t spinCount;
 @property(nonatomic, assign) BOOL interruptsDisabled;
+@property(nonatomic, assign) uint32_t lockClass;
 @end
 
 // Barrier
@@ -700,6 +772,135 @@ typedef NS_ENUM(NSInteger, KernSyscallNumber) {
 @property(nonatomic, assign) BOOL success;
 @end
 
+// Register-style syscall entry. Handlers receive up to six raw argument
+// words (pointers and C strings passed as addresses) and return a value or
+// -errno; the table dispatch path allocates nothing.
+#define KERN_SYSCALL_MAX_ARGS 6
+
+#ifdef __cplusplus
+#include <atomic>
+
+// Static key: a counted switch for rarely enabled instrumentation. While
+// disabled the check is a single relaxed load on an unlikely branch.
+struct KernStaticKey {
+  std::atomic<int32_t> enabled{0};
+};
+#define KERN_STATIC_BRANCH(key)                                                \
+  __builtin_expect((key).enabled.load(std::memory_order_relaxed) > 0, 0)
+static inline void KernStaticKeyEnable(KernStaticKey &key) {
+  key.enabled.fetch_add(1, std::memory_order_relaxed);
+}
+static inline void KernStaticKeyDisable(KernStaticKey &key) {
+  key.enabled.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Seccomp-style syscall filters (AdvancedKernel_Seccomp.mm). Filters stack
+// per process and are inherited by children; the entry check is skipped
+// entirely while no process has one installed.
+extern KernStaticKey gKernSeccompKey;
+bool KernSeccompReject(uint32_t pid, KernSyscallNumber number,
+                       const uint64_t *args, int64_t *ret);
+void KernSeccompFork(uint32_t ppid, uint32_t pid);
+void KernSeccompExit(uint32_t pid);
+
+// Landlock-style path rulesets and sandbox process/thread limits
+// (AdvancedKernel_Landlock.mm). Checks apply to the current process and are
+// skipped while no process is sandboxed. KernLandlockFork and
+// KernLandlockThreadCreate return false when a limit refuses the new task.
+@class KernDentry;
+extern KernStaticKey gKernLandlockKey;
+bool KernLandlockAllows(KernDentry *dentry);
+bool KernLandlockAllowsPath(const char *path);
+bool KernLandlockFork(uint32_t ppid, uint32_t pid);
+void KernLandlockExit(uint32_t pid);
+bool KernLandlockThreadCreate(uint32_t pid);
+void KernLandlockThreadExit(uint32_t pid);
+
+// PID, mount and IPC namespaces (AdvancedKernel_Namespace.mm). KernPidAlloc
+// numbers a new child of ppid in every PID namespace it will be visible in
+// and returns its global PID, or 0 if a namespace has none free.
+// KernPidNr and KernPidFind translate between global PIDs and numbers as
+// seen from a viewer process's PID namespace; both are O(1) and lock-free.
+uint32_t KernPidAlloc(uint32_t ppid);
+void KernPidInstall(uint32_t pid, KernProcess *proc);
+void KernPidFree(uint32_t pid);
+KernProcess *KernPidProcess(uint32_t pid);
+uint32_t KernPidNr(uint32_t pid, uint32_t viewer);
+uint32_t KernPidFind(uint32_t nr, uint32_t viewer);
+uint32_t KernPidParentNr(uint32_t pid);
+@class KernMountPoint;
+// The current process's mount table. IPC objects are registered by name in
+// the current process's IPC namespace, whose ID KernIpcRegister returns.
+NSMutableArray<KernMountPoint *> *KernMountTable(void);
+uint32_t KernIpcRegister(NSString *name, id object, bool segment);
+void KernIpcUnregister(uint32_t nsID, NSString *name, id object, bool segment);
+
+// The calling thread's current process (AdvancedKernel_Syscall.mm)
+uint32_t KernCurrentPID(void);
+#endif
+
+// Asynchronous syscall rings (io_uring-style). A ring lives in a shared
+// memory segment laid out as [SQ header][CQ header][SQEs][CQEs]; the
+// submitter fills SQEs and advances sq.tail, workers post CQEs and advance
+// cq.tail. Head/tail are accessed with acquire/release atomics.
+typedef NS_ENUM(uint8_t, KernRingOp) {
+  KernRingOpNop = 0,
+  KernRingOpRead,       // fd, addr=buffer, len, off (UINT64_MAX = cursor)
+  KernRingOpWrite,      // fd, addr=buffer, len, off (UINT64_MAX = cursor)
+  KernRingOpOpen,       // addr=C path, opFlags=flags, len=mode
+  KernRingOpClose,      // fd
+  KernRingOpMmap,       // addr, len, opFlags=protection, off=KernMmapFlags;
+                        // maps into the ring owner, pid must be 0 or it
+  KernRingOpFutexWait,  // addr=uint32_t *, off=expected value, timeoutNs;
+                        // a timeout is required, 0 fails with -EINVAL
+  KernRingOpFutexWake,  // addr=uint32_t *, len=max waiters to wake
+  KernRingOpTimeout     // completes with -ETIME after timeoutNs
+};
+
+#define KERN_SQE_IO_LINK (1u << 0) // Next SQE runs only if this one succeeds
+
+typedef struct KernRingSQE {
+  uint8_t opcode;
+  uint8_t flags;
+  uint16_t ioprio;
+  int32_t fd;
+  uint64_t off;
+  uint64_t addr;
+  uint32_t len;
+  uint32_t opFlags;
+  uint64_t userData;
+  uint64_t timeoutNs;
+  uint32_t pid; // 0 or the ring owner; anything else fails with -EPERM
+  uint32_t reserved[3];
+} KernRingSQE; // 64 bytes
+
+typedef struct KernRingCQE {
+  uint64_t userData;
+  int32_t res; // Result, or -errno
+  uint32_t flags;
+} KernRingCQE; // 16 bytes
+
+typedef struct KernRingHeader {
+  uint32_t head;
+  uint32_t tail;
+  uint32_t ringMask;
+  uint32_t ringEntries;
+  uint32_t overflow; // CQEs dropped because the CQ was full
+  uint32_t reserved[11];
+} KernRingHeader; // 64 bytes, one cache line
+
+@interface KernIORing : NSObject
+@property(nonatomic, assign) uint32_t ringID;
+@property(nonatomic, assign) uint32_t ownerPID;
+@property(nonatomic, strong) KernSharedMemory *memory;
+@property(nonatomic, assign) KernRingHeader *sq;
+@property(nonatomic, assign) KernRingHeader *cq;
+@property(nonatomic, assign) KernRingSQE *sqes;
+@property(nonatomic, assign) KernRingCQE *cqes;
+@property(nonatomic, assign) uint64_t submittedCount;
+@property(nonatomic, assign) uint64_t completedCount;
+@end
+
 // ==========================================================================
 // SECTION 6: VIRTUAL FILE SYSTEM (VFS) LAYER
 // ==========================================================================
@@ -741,6 +942,108 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
   KernInodeSocket
 };
 
+// Page cache of one inode (address_space): 4 KB pages indexed by file page
+// number in a radix tree with dirty and writeback tags. Implemented in
+// AdvancedKernel_PageCache.mm.
+@interface KernAddressSpace : NSObject
+@property(nonatomic, readonly) uint64_t nrPages;
+@property(nonatomic, readonly) uint64_t nrDirty;
+@property(nonatomic, readonly) uint64_t nrWriteback;
+@end
+
+typedef NS_ENUM(NSInteger, KernIOScheduler) {
+  KernIOSchedulerNone = 0, // Submission order
+  KernIOSchedulerDeadline, // Sorted batches with read/write expiry
+  KernIOSchedulerBFQ       // Weighted fair share between cgroups
+};
+
+// Simulated block device of 4 KB blocks, backed by a sparse host file or by
+// memory when hostPath is nil, with merging, a pluggable scheduler, and
+// parallel dispatch contexts. Implemented in AdvancedKernel_Block.mm.
+@interface KernBlockDevice : NSObject
+@property(nonatomic, readonly) NSString *name;
+@property(nonatomic, readonly) NSString *hostPath;
+@property(nonatomic, readonly) uint64_t capacityBlocks;
+@property(nonatomic, readonly) uint32_t hardwareQueues;
+@property(nonatomic, readonly) uint32_t queueDepth;
+@property(nonatomic, assign) KernIOScheduler scheduler; // Default deadline
+@end
+
+// Free-space map of one superblock over its block device. Implemented in
+// AdvancedKernel_Extent.mm.
+@interface KernBlockStore : NSObject
+@property(nonatomic, readonly) KernBlockDevice *device;
+@property(nonatomic, readonly) uint64_t allocatedBlocks;
+@property(nonatomic, readonly) NSUInteger freeExtents;
+@end
+
+// Block map of one inode: extents of contiguous logical blocks mapped to
+// contiguous physical blocks, ordered by logical start. Unmapped ranges are
+// holes. Implemented in AdvancedKernel_Extent.mm.
+@interface KernExtentTree : NSObject
+@property(nonatomic, readonly) NSUInteger extentCount;
+@property(nonatomic, readonly) uint64_t mappedBlocks;
+@end
+
+// Dirty-page accounting and flusher of one superblock (bdi_writeback).
+// Counts are pages. Implemented in AdvancedKernel_Writeback.mm.
+@interface KernWriteback : NSObject
+@property(nonatomic, readonly) uint64_t dirtyPages;
+@property(nonatomic, readonly) uint64_t writebackPages;
+@property(nonatomic, readonly) uint64_t writtenPages;
+@property(nonatomic, readonly) uint64_t writeRequests; // Batched writes
+@property(nonatomic, readonly) uint64_t flusherWakeups;
+@property(nonatomic, readonly) uint64_t throttledNs; // Writers paused
+@property(nonatomic, readonly) NSUInteger dirtyInodes;
+@end
+
+// Filesystem notification events and watch flags (inotify values)
+typedef NS_OPTIONS(uint32_t, KernNotifyMask) {
+  KernNotifyAccess = 0x00000001,
+  KernNotifyModify = 0x00000002,
+  KernNotifyAttrib = 0x00000004,
+  KernNotifyCloseWrite = 0x00000008,
+  KernNotifyCloseNoWrite = 0x00000010,
+  KernNotifyOpen = 0x00000020,
+  KernNotifyCreate = 0x00000100,
+  KernNotifyDelete = 0x00000200,
+  KernNotifyDeleteSelf = 0x00000400,
+  KernNotifyAllEvents = 0x00000fff,
+  KernNotifyOverflow = 0x00004000, // Events were dropped; wd is -1
+  KernNotifyIgnored = 0x00008000,  // Watch removed
+  KernNotifyMaskAdd = 0x20000000,  // Add to an existing watch's mask
+  KernNotifyIsDir = 0x40000000
+};
+
+// Marks on one inode or superblock, one per watching group. Implemented in
+// AdvancedKernel_Notify.mm.
+@interface KernNotifyMarks : NSObject
+@property(nonatomic, readonly) KernNotifyMask mask; // Union of the marks
+@property(nonatomic, readonly) NSUInteger count;
+@end
+
+@interface KernNotifyEvent : NSObject
+@property(nonatomic, assign) int32_t wd;
+@property(nonatomic, assign) KernNotifyMask mask;
+@property(nonatomic, strong) NSString *name; // Entry in a watched directory
+@end
+
+// A listener (inotify instance): watch descriptors and a bounded event
+// ring that writers fill without locks. Repeated modify events for an inode
+// merge while one is still unread; when the ring is full further events are
+// dropped and the reader gets a KernNotifyOverflow event instead.
+@interface KernNotifyGroup : NSObject
+@property(nonatomic, readonly) uint32_t capacity; // Events
+@property(nonatomic, readonly) NSUInteger watchCount;
+@property(nonatomic, readonly) uint64_t queuedEvents;
+@property(nonatomic, readonly) uint64_t deliveredEvents;
+@property(nonatomic, readonly) uint64_t coalescedEvents;
+@property(nonatomic, readonly) uint64_t droppedEvents;
+@end
+
+@class KernSuperblock;
+@class KernDirIndex;
+
 // Inode
 @interface KernInode : NSObject
 @property(nonatomic, assign) uint64_t inodeNumber;
@@ -757,9 +1060,13 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
 @property(nonatomic, assign) uint64_t createTime;
 @property(nonatomic, assign) uint32_t deviceMajor;
 @property(nonatomic, assign) uint32_t deviceMinor;
-@property(nonatomic, strong) NSMutableArray *dataBlocks;
+@property(nonatomic, weak) KernSuperblock *superblock;
+@property(nonatomic, strong) KernExtentTree *extents; // Set on first write
 @property(nonatomic, strong) NSMutableDictionary *extendedAttributes;
 @property(nonatomic, assign) KernFileSystemType fsType;
+@property(nonatomic, strong) KernAddressSpace *mapping;    // Set on first I/O
+@property(nonatomic, assign) uint64_t dirtiedWhen;         // 0 while clean
+@property(nonatomic, strong) KernNotifyMarks *notifyMarks; // First watch
 @end
 
 // Directory Entry (dentry)
@@ -767,10 +1074,27 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
 @property(nonatomic, strong) NSString *name;
 @property(nonatomic, strong) KernInode *inode;
 @property(nonatomic, weak) KernDentry *parent;
-@property(nonatomic, strong) NSMutableArray<KernDentry *> *children;
+@property(nonatomic, strong) KernDirIndex *index; // First entry linked in
 @property(nonatomic, assign) BOOL isMountPoint;
 @property(nonatomic, assign) uint32_t referenceCount;
 @property(nonatomic, assign) BOOL isNegative; // Cached negative lookup
+// Last path ruleset verdict: the stack's serial << 1 | allowed
+@property(nonatomic, assign) uint64_t landlockVerdict;
+@end
+
+// Hashed directory index (AdvancedKernel_DirIndex.mm): a B+tree of a
+// directory's entries keyed by name hash.
+@interface KernDirIndex : NSObject
+@property(nonatomic, readonly) NSUInteger count;
+@property(nonatomic, readonly) NSUInteger height; // Levels, 1 for a leaf
+@end
+
+// Readdir position. Resumes after the last entry returned, so it survives
+// concurrent creates and unlinks; entries changed meanwhile are returned
+// at most once.
+@interface KernDirCursor : NSObject
+@property(nonatomic, strong, readonly) KernDentry *directory;
+@property(nonatomic, assign, readonly) BOOL finished;
 @end
 
 // Superblock
@@ -790,6 +1114,10 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
 @property(nonatomic, assign) uint32_t mountFlags;
 @property(nonatomic, assign) BOOL readOnly;
 @property(nonatomic, strong) KernDentry *rootDentry;
+@property(nonatomic, strong) KernBlockDevice *blockDevice; // nil: RAM disk
+@property(nonatomic, strong) KernBlockStore *blockStore;   // First allocation
+@property(nonatomic, strong) KernWriteback *writeback;     // First dirty page
+@property(nonatomic, strong) KernNotifyMarks *notifyMarks; // First watch
 @end
 
 // Mount Point
@@ -803,6 +1131,31 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
 @property(nonatomic, assign) uint32_t parentMountID;
 @end
 
+// Readahead state of one open file, in 4 KB page indexes. Reading past
+// start + size - asyncSize issues the next window in the background.
+// prevIndex is UINT64_MAX until the first read.
+@interface KernReadaheadState : NSObject
+@property(nonatomic, assign) uint64_t start; // Current window
+@property(nonatomic, assign) uint64_t size;
+@property(nonatomic, assign) uint64_t asyncSize;
+// Background windows not yet waited for: [pendingStart, pendingEnd)
+@property(nonatomic, strong) dispatch_group_t pending;
+@property(nonatomic, assign) uint64_t pendingStart;
+@property(nonatomic, assign) uint64_t pendingEnd;
+@property(nonatomic, assign) uint64_t prevStart;   // First page of last read
+@property(nonatomic, assign) uint64_t prevIndex;   // Last page of last read
+@property(nonatomic, assign) int64_t stride;       // Gap between read starts
+@property(nonatomic, assign) uint32_t strideCount; // Repeats of that gap
+@end
+
+// Pages present in one VMA, indexed by page within it. File pages are page
+// cache pages; private copies and anonymous pages belong to the VMA alone.
+// Implemented in AdvancedKernel_Mmap.mm.
+@interface KernVMAPages : NSObject
+@property(nonatomic, readonly) uint64_t residentPages;
+@property(nonatomic, readonly) uint64_t privatePages;
+@end
+
 // File Descriptor
 @interface KernFileDescriptor : NSObject
 @property(nonatomic, assign) int32_t fd;
@@ -810,13 +1163,181 @@ typedef NS_ENUM(NSInteger, KernInodeType) {
 @property(nonatomic, assign) uint64_t offset;
 @property(nonatomic, assign) uint32_t flags;
 @property(nonatomic, assign) uint32_t mode;
-@property(nonatomic, assign) uint32_t referenceCount;
-@property(nonatomic, assign) BOOL closeOnExec;
+@property(nonatomic, readonly) uint32_t referenceCount; // Table slots
+@property(nonatomic, assign) BOOL closeOnExec;          // O_CLOEXEC at open
 @property(nonatomic, assign) BOOL nonBlocking;
 @property(nonatomic, assign) BOOL append;
 @property(nonatomic, strong) KernPipe *pipe; // If fd is a pipe
+@property(nonatomic, strong) KernReadaheadState *readahead; // First read
+@property(nonatomic, strong) KernDentry *dentry;            // Opened through
+- (void)acquireReference;
+- (BOOL)dropReference; // YES when the last reference is gone
 @end
 
+// Descriptor table of one process (files_struct): open files indexed by
+// number, with two-level bitmaps for lowest-free allocation. Implemented in
+// AdvancedKernel_FDTable.mm.
+@interface KernFDTable : NSObject
+@property(nonatomic, readonly) NSUInteger openCount;
+@property(nonatomic, readonly) NSUInteger capacity; // Slots allocated
+@property(nonatomic, readonly) uint32_t users;      // Processes sharing it
+@end
+
+// Dentry cache hooks (AdvancedKernel_Dcache.mm). Call after a dentry is
+// linked into or unlinked from its parent so hashed lookups stay in step
+// with the tree; removal leaves a negative entry behind.
+#ifdef __cplusplus
+extern "C" {
+#endif
+void KernDcacheAdd(KernDentry *dentry);
+void KernDcacheRemove(KernDentry *dentry);
+#ifdef __cplusplus
+}
+#endif
+
+// Directory index hooks (AdvancedKernel_DirIndex.mm). KernDirInsert links
+// an entry into its directory and returns nil, or returns the entry that
+// already holds the name and leaves the directory unchanged.
+#ifdef __cplusplus
+extern "C" {
+#endif
+KernDentry *KernDirLookup(KernDentry *dir, NSString *name);
+KernDentry *KernDirInsert(KernDentry *dir, KernDentry *dentry);
+BOOL KernDirRemove(KernDentry *dir, KernDentry *dentry);
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+// Block device I/O (AdvancedKernel_Block.mm). Each KernBlockIO is one
+// physically contiguous run; the call submits every run and returns once
+// all complete.
+struct KernBlockIO {
+  uint64_t block;
+  uint32_t count;
+  uint8_t *const *pages; // count 4 KB buffers
+};
+int KernBlockRW(KernBlockDevice *dev, bool write, const KernBlockIO *ios,
+                size_t count);
+void KernBlockDiscard(KernBlockDevice *dev, uint64_t block, uint64_t count);
+
+// Cgroup pids and io controllers (AdvancedKernel_Cgroup.mm). Charges apply to
+// a cgroup and all its ancestors. KernPidsCharge fails when any level would
+// pass pidsMax; KernCgroupThrottleIO accounts a completed VFS transfer to the
+// current process's cgroup and sleeps while it is over its io limits. The
+// KernCgroup io limit setters report changes with KernCgroupSetIOLimits.
+struct KernCgroupStats {
+  uint32_t pids; // Including descendants
+  uint64_t pidsRejected; // Creations refused by pidsMax
+  uint64_t readBytes;
+  uint64_t writeBytes;
+  uint64_t readIOs;
+  uint64_t writeIOs;
+  uint64_t throttledNs;
+};
+void KernCgroupCreate(KernCgroup *cgroup);
+uint32_t KernCurrentCgroupID(void);
+void KernCgroupProcessMoved(void);
+bool KernPidsCharge(uint32_t cgroupID);
+void KernPidsUncharge(uint32_t cgroupID);
+void KernPidsMove(uint32_t fromID, uint32_t toID);
+void KernPidsSetMax(uint32_t cgroupID, uint32_t max);
+void KernCgroupSetIOLimits(uint32_t cgroupID);
+void KernCgroupThrottleIO(bool write, uint64_t bytes);
+void KernCgroupStat(uint32_t cgroupID, KernCgroupStats *out);
+
+// Memory cgroup charging (AdvancedKernel_Memcg.mm). Pages are charged to a
+// cgroup and all its ancestors through per-CPU precharge stocks. A charge
+// that would pass a limit reclaims the cgroup's page cache and, if mayOOM,
+// OOM-kills its largest process; false means it still did not fit.
+struct KernMemcg;
+enum KernMemcgItem : unsigned {
+  KernMemcgAnon = 0, // Frames from allocatePage
+  KernMemcgFile,     // Page cache pages
+  KernMemcgItemCount
+};
+struct KernMemcgStats {
+  uint64_t usage; // Bytes
+  uint64_t peak;
+  uint64_t limit;
+  uint64_t anon;
+  uint64_t file;
+  uint64_t eventsMax; // Charges that reached a limit
+  uint64_t eventsOOM;
+  uint64_t eventsOOMKill;
+  uint64_t reclaimed; // Pages
+};
+KernMemcg *KernMemcgCurrent(void);
+KernMemcg *KernMemcgLookup(uint32_t cgroupID);
+uint32_t KernMemcgID(const KernMemcg *memcg);
+bool KernMemcgIsDescendant(const KernMemcg *memcg, const KernMemcg *root);
+bool KernMemcgCharge(KernMemcg *memcg, uint64_t pages, KernMemcgItem item,
+                     bool mayOOM);
+void KernMemcgUncharge(KernMemcg *memcg, uint64_t pages, KernMemcgItem item);
+void KernMemcgCreate(uint32_t cgroupID, uint32_t parentID);
+void KernMemcgSetLimit(uint32_t cgroupID, uint64_t bytes);
+void KernMemcgStat(uint32_t cgroupID, KernMemcgStats *out);
+// Reclaim up to pages inactive page cache pages charged within memcg's
+// subtree (AdvancedKernel_PageCache.mm)
+NSUInteger KernPageCacheReclaimMemcg(KernMemcg *memcg, NSUInteger pages);
+
+// Extent-mapped block I/O (AdvancedKernel_Extent.mm), the backing store
+// behind the page cache. Holes read as zeros; writes allocate from the
+// inode's superblock, or from an anonymous store if it has none.
+int KernInodeReadBlocks(KernInode *inode, uint64_t block,
+                        uint8_t *const *data, size_t count);
+// Write count contiguous blocks; only tailLength bytes of the last are data.
+int KernInodeWriteBlocks(KernInode *inode, uint64_t block,
+                         const uint8_t *const *data, size_t count,
+                         size_t tailLength);
+// First block at or after block that is mapped (data) or a hole (!data).
+// Returns UINT64_MAX when there is no further mapped block.
+uint64_t KernInodeNextBlock(KernInode *inode, uint64_t block, bool data);
+
+// Writeback accounting (AdvancedKernel_Writeback.mm). The page cache reports
+// page state changes against the host superblock; an inode's first dirty
+// page queues it for that superblock's flusher. Writers call
+// KernBalanceDirtyPages after dirtying pages and may be paused there.
+KernWriteback *KernInodeWriteback(KernInode *inode);
+void KernWritebackAccount(KernWriteback *wb, int64_t dirty, int64_t writeback);
+void KernWritebackCompleted(KernWriteback *wb, uint64_t pages);
+void KernWritebackInodeDirtied(KernWriteback *wb, KernInode *inode);
+uint64_t KernWritebackDirtyPages(void);
+void KernBalanceDirtyPages(KernWriteback *wb, uint64_t cachePages);
+
+// Address space layout (AdvancedKernel_Memory.mm). Mappings placed by the
+// kernel grow down from KERN_STACK_GAP below the stack towards the heap.
+#define KERN_STACK_GAP KERN_PAGE_SIZE_1G // Kept free for stack growth
+uint64_t KernVMAPlacement(KernProcess *proc, uint64_t top, uint64_t bottom,
+                          uint64_t len, uint64_t align);
+
+// Cached pages mapped into address spaces (AdvancedKernel_PageCache.mm).
+// KernPageCacheGetMapped pins the page at index if it is cached, or returns
+// null; a pinned page is never reclaimed or invalidated. Stores through a
+// shared mapping report the page with KernPageCacheDirtyMapped afterwards;
+// when that dirtied it, the writer calls KernPageCacheBalanceMapped once it
+// holds no locks, since it may be paused there.
+void *KernPageCacheGetMapped(KernInode *inode, uint64_t index,
+                             uint8_t **data);
+void KernPageCachePutMapped(void *page);
+bool KernPageCacheDirtyMapped(KernInode *inode, void *page);
+void KernPageCacheBalanceMapped(KernInode *inode);
+
+// Filesystem notification (AdvancedKernel_Notify.mm). VFS operations report
+// an event on inode (its own watches) and dentry (its parent directory's
+// watches, with the entry name); both reach watches on the superblock. The
+// check is one load while nothing is watched.
+extern KernStaticKey gKernNotifyKey;
+void KernFsnotifyDeliver(KernInode *inode, KernDentry *dentry, uint32_t mask);
+// The inode's last link is gone: KernNotifyDeleteSelf, then its watches go.
+void KernFsnotifyInodeRemoved(KernInode *inode);
+static inline void KernFsnotify(KernInode *inode, KernDentry *dentry,
+                                uint32_t mask) {
+  if (KERN_STATIC_BRANCH(gKernNotifyKey))
+    KernFsnotifyDeliver(inode, dentry, mask);
+}
+#endif
+
 // ==========================================================================
 // SECTION 7: SECURITY & SANDBOXING
 // ==========================================================================
@@ -908,13 +1429,14 @@ typedef NS_ENUM(NSInteger, KernNamespaceType) {
 @property(nonatomic, assign) int64_t cpuShares;
 @property(nonatomic, assign) uint64_t memoryLimitBytes;
 @property(nonatomic, assign) uint64_t memorySwapLimit;
-@property(nonatomic, assign) uint64_t memoryUsage;
+@property(nonatomic, readonly) uint64_t memoryUsage; // Bytes charged
 @property(nonatomic, assign) uint64_t ioReadBps;
 @property(nonatomic, assign) uint64_t ioWriteBps;
 @property(nonatomic, assign) uint64_t ioReadIOps;
 @property(nonatomic, assign) uint64_t ioWriteIOps;
+@property(nonatomic, assign) uint32_t ioWeight; // 1-1000, default 100
 @property(nonatomic, assign) uint32_t pidsMax;
-@property(nonatomic, assign) uint32_t pidsCurrent;
+@property(nonatomic, readonly) uint32_t pidsCurrent; // Incl. descendants
 @end
 
 // ==========================================================================
@@ -966,6 +1488,326 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
 @property(nonatomic, assign) uint32_t lineNumber;
 @end
 
+// Log query and tailing cursor (AdvancedKernel_Log.mm). Every predicate
+// left at its default matches everything. Times are mach absolute time,
+// as in KernLogEntry.timestampNs.
+@interface KernLogQuery : NSObject
+@property(nonatomic, assign) KernLogLevel maxLevel; // Most verbose matched
+@property(nonatomic, assign) NSInteger facility;    // KernLogFacility, or -1
+@property(nonatomic, copy) NSString *subsystem;     // nil matches any
+@property(nonatomic, assign) uint64_t startTime;
+@property(nonatomic, assign) uint64_t endTime;  // Inclusive
+@property(nonatomic, copy) NSString *substring; // Case-sensitive, in message
+// Cursor: the next index position to examine. A new query starts at the
+// oldest retained record; logEndPosition skips to new records only.
+@property(nonatomic, assign) uint64_t position;
+@property(nonatomic, assign) uint64_t missed; // Aged out before reached
+@end
+
+// Static tracepoints (AdvancedKernel_Trace.mm). Each event carries four
+// argument words, listed here per tracepoint.
+typedef NS_ENUM(NSInteger, KernTracepoint) {
+  KernTraceSchedule = 0,  // prev pid, next pid, runnable tasks, clock tick
+  KernTraceContextSwitch, // from pid, to pid, switches on the run queue
+  KernTraceAllocatePage,  // frame address, pages left free
+  KernTracePageFault,     // address, KernPageFaultReason, faulting pid
+  KernTracePipeWrite,     // pipe id, bytes, bytes buffered, result
+  KernTraceDentryLookup,  // path length, resolved, mach ticks taken
+  KernTraceSyscallEnter,  // number, first three arguments
+  KernTraceSyscallExit,   // number, return value, mach ticks taken
+  KernTracepointCount
+};
+
+typedef NS_ENUM(NSInteger, KernTraceFieldSelector) {
+  KernTraceFieldPID = 0,
+  KernTraceFieldCPU,
+  KernTraceFieldArg0,
+  KernTraceFieldArg1,
+  KernTraceFieldArg2,
+  KernTraceFieldArg3
+};
+
+typedef NS_ENUM(NSInteger, KernTraceOp) {
+  KernTraceEqual = 0,
+  KernTraceNotEqual,
+  KernTraceLess,
+  KernTraceGreaterEqual,
+  KernTraceMaskSet // (field & value) != 0
+};
+
+@interface KernTraceEvent : NSObject
+@property(nonatomic, assign) KernTracepoint tracepoint;
+@property(nonatomic, strong) NSString *name;
+@property(nonatomic, assign) uint64_t timestampNs; // mach absolute time
+@property(nonatomic, assign) uint32_t processID;
+@property(nonatomic, assign) uint32_t cpuID;
+@property(nonatomic, strong) NSArray<NSNumber *> *args;
+@end
+
+// Tracepoint programs (AdvancedKernel_BPF.mm): eBPF-style bytecode checked
+// by a verifier on load and interpreted on every event of the tracepoints
+// it is attached to. Instructions use the eBPF encoding. There are eleven
+// 64-bit registers: r1 points at a read-only KernBPFContext on entry, r10
+// at the top of a 512-byte stack, and r0 holds the return value.
+typedef struct {
+  uint8_t code;
+  uint8_t dst : 4;
+  uint8_t src : 4;
+  int16_t off;
+  int32_t imm;
+} KernBPFInsn;
+
+typedef struct {
+  uint64_t tracepoint;
+  uint64_t timestamp; // mach absolute time
+  uint64_t pid;
+  uint64_t cpu;
+  uint64_t args[4];
+} KernBPFContext;
+
+// Opcode fields: class | size | mode for loads and stores,
+// class | op | source for arithmetic and jumps
+enum {
+  KERN_BPF_LD = 0x00,
+  KERN_BPF_LDX = 0x01,
+  KERN_BPF_ST = 0x02,
+  KERN_BPF_STX = 0x03,
+  KERN_BPF_JMP = 0x05,
+  KERN_BPF_ALU64 = 0x07,
+
+  KERN_BPF_W = 0x00,
+  KERN_BPF_H = 0x08,
+  KERN_BPF_B = 0x10,
+  KERN_BPF_DW = 0x18,
+  KERN_BPF_IMM = 0x00,
+  KERN_BPF_MEM = 0x60,
+  KERN_BPF_XADD = 0xc0, // Atomic add, W or DW only
+
+  KERN_BPF_K = 0x00, // Source is the immediate
+  KERN_BPF_X = 0x08, // Source is the src register
+
+  KERN_BPF_ADD = 0x00,
+  KERN_BPF_SUB = 0x10,
+  KERN_BPF_MUL = 0x20,
+  KERN_BPF_DIV = 0x30, // Unsigned; x / 0 is 0
+  KERN_BPF_OR = 0x40,
+  KERN_BPF_AND = 0x50,
+  KERN_BPF_LSH = 0x60,
+  KERN_BPF_RSH = 0x70,
+  KERN_BPF_NEG = 0x80,
+  KERN_BPF_MOD = 0x90, // Unsigned; x % 0 is x
+  KERN_BPF_XOR = 0xa0,
+  KERN_BPF_MOV = 0xb0,
+  KERN_BPF_ARSH = 0xc0,
+
+  KERN_BPF_JA = 0x00,
+  KERN_BPF_JEQ = 0x10,
+  KERN_BPF_JGT = 0x20,
+  KERN_BPF_JGE = 0x30,
+  KERN_BPF_JSET = 0x40,
+  KERN_BPF_JNE = 0x50,
+  KERN_BPF_JSGT = 0x60,
+  KERN_BPF_JSGE = 0x70,
+  KERN_BPF_CALL = 0x80,
+  KERN_BPF_EXIT = 0x90,
+  KERN_BPF_JLT = 0xa0,
+  KERN_BPF_JLE = 0xb0,
+  KERN_BPF_JSLT = 0xc0,
+  KERN_BPF_JSLE = 0xd0,
+
+  KERN_BPF_PSEUDO_MAP = 1 // src of a wide load whose imm is a map id
+};
+
+#define KERN_BPF_INSN(code, dst, src, off, imm)                                \
+  ((KernBPFInsn){(uint8_t)(code), (uint8_t)(dst), (uint8_t)(src),              \
+                 (int16_t)(off), (int32_t)(imm)})
+#define KERN_BPF_ALU_IMM(op, dst, imm)                                         \
+  KERN_BPF_INSN(KERN_BPF_ALU64 | (op) | KERN_BPF_K, dst, 0, 0, imm)
+#define KERN_BPF_ALU_REG(op, dst, src)                                         \
+  KERN_BPF_INSN(KERN_BPF_ALU64 | (op) | KERN_BPF_X, dst, src, 0, 0)
+#define KERN_BPF_MOV_IMM(dst, imm) KERN_BPF_ALU_IMM(KERN_BPF_MOV, dst, imm)
+#define KERN_BPF_MOV_REG(dst, src) KERN_BPF_ALU_REG(KERN_BPF_MOV, dst, src)
+#define KERN_BPF_LDX_MEM(size, dst, src, off)                                  \
+  KERN_BPF_INSN(KERN_BPF_LDX | (size) | KERN_BPF_MEM, dst, src, off, 0)
+#define KERN_BPF_STX_MEM(size, dst, src, off)                                  \
+  KERN_BPF_INSN(KERN_BPF_STX | (size) | KERN_BPF_MEM, dst, src, off, 0)
+#define KERN_BPF_ST_MEM(size, dst, off, imm)                                   \
+  KERN_BPF_INSN(KERN_BPF_ST | (size) | KERN_BPF_MEM, dst, 0, off, imm)
+#define KERN_BPF_XADD_MEM(size, dst, src, off)                                 \
+  KERN_BPF_INSN(KERN_BPF_STX | (size) | KERN_BPF_XADD, dst, src, off, 0)
+#define KERN_BPF_JMP_IMM(op, dst, imm, off)                                    \
+  KERN_BPF_INSN(KERN_BPF_JMP | (op) | KERN_BPF_K, dst, 0, off, imm)
+#define KERN_BPF_JMP_REG(op, dst, src, off)                                    \
+  KERN_BPF_INSN(KERN_BPF_JMP | (op) | KERN_BPF_X, dst, src, off, 0)
+#define KERN_BPF_JA(off) KERN_BPF_INSN(KERN_BPF_JMP | KERN_BPF_JA, 0, 0, off, 0)
+#define KERN_BPF_CALL_HELPER(helper)                                           \
+  KERN_BPF_INSN(KERN_BPF_JMP | KERN_BPF_CALL, 0, 0, 0, helper)
+#define KERN_BPF_EXIT_INSN()                                                   \
+  KERN_BPF_INSN(KERN_BPF_JMP | KERN_BPF_EXIT, 0, 0, 0, 0)
+// Two instruction slots: loads a map reference for the helper calls
+#define KERN_BPF_LD_MAP(dst, map)                                              \
+  KERN_BPF_INSN(KERN_BPF_LD | KERN_BPF_DW | KERN_BPF_IMM, dst,                 \
+                KERN_BPF_PSEUDO_MAP, 0, map),                                  \
+      KERN_BPF_INSN(0, 0, 0, 0, 0)
+
+typedef NS_ENUM(uint32_t, KernBPFMapType) {
+  KernBPFMapHash = 1,
+  KernBPFMapArray,       // u32 keys below maxEntries, always present
+  KernBPFMapPerCPUArray, // One array per CPU; programs see the event's CPU
+  KernBPFMapRingBuffer   // maxEntries bytes of records, read out in order
+};
+
+typedef NS_ENUM(int32_t, KernBPFHelper) {
+  KernBPFHelperMapLookup = 1, // (map, key) -> value pointer or NULL
+  KernBPFHelperMapUpdate,     // (map, key, value, flags) -> 0 or -errno
+  KernBPFHelperMapDelete,     // (map, key) -> 0 or -errno
+  KernBPFHelperKtime,         // () -> mach absolute time
+  KernBPFHelperCurrentPID,    // () -> pid of the event
+  KernBPFHelperCurrentCPU,    // () -> CPU of the event
+  KernBPFHelperRingOutput,    // (ring, data, constant size, 0) -> 0 or -errno
+  KernBPFHelperLog2,          // (value) -> floor(log2(value)), 0 for 0
+  KernBPFHelperCount
+};
+
+// Map update flags
+#define KERN_BPF_ANY 0
+#define KERN_BPF_NOEXIST 1
+#define KERN_BPF_EXIST 2
+
+#ifdef __cplusplus
+#include <type_traits>
+
+// Binary log rings (AdvancedKernel_Log.mm). KERN_LOG stores a static
+// printf-style format and up to four integer, floating point, pointer or
+// C string arguments in a fixed-size record on the calling CPU's ring; the
+// text is only produced when the log is read. C strings are copied when
+// the record is written, up to KERN_LOG_STRING_MAX bytes each, so any
+// buffer may be passed. The per-facility level check runs before anything
+// else, so a filtered call is one load and a compare. Objects cannot be
+// recorded; log those through kernelLog:facility:message:.
+#define KERN_LOG_MAX_ARGS 4
+#define KERN_LOG_STRING_MAX 128 // Bytes kept per C string argument
+#define KERN_LOG_FACILITIES 16 // Power of two above KernLogAudit
+extern std::atomic<uint8_t> gKernLogLevels[KERN_LOG_FACILITIES];
+static inline bool KernLogEnabled(KernLogLevel level,
+                                  KernLogFacility facility) {
+  return (uint8_t)level <=
+         gKernLogLevels[facility & (KERN_LOG_FACILITIES - 1)].load(
+             std::memory_order_relaxed);
+}
+// strings has bit i set when args[i] is a C string to copy
+void KernLogWrite(KernLogLevel level, KernLogFacility facility,
+                  const char *format, const uint64_t *args, unsigned count,
+                  unsigned strings);
+
+template <typename T> static inline uint64_t KernLogArg(T value) {
+  static_assert(!std::is_convertible<T, id>::value ||
+                    std::is_null_pointer<T>::value,
+                "log records hold raw words; objects need kernelLog:");
+  if constexpr (std::is_floating_point<T>::value) {
+    double bits = value;
+    uint64_t word;
+    __builtin_memcpy(&word, &bits, sizeof(word));
+    return word;
+  } else if constexpr (std::is_pointer<T>::value) {
+    return (uint64_t)(uintptr_t)value;
+  } else {
+    return (uint64_t)(int64_t)value;
+  }
+}
+template <typename T>
+using KernLogIsString =
+    std::integral_constant<bool, std::is_same<T, const char *>::value ||
+                                     std::is_same<T, char *>::value>;
+template <typename... Args> static constexpr unsigned KernLogStringMask() {
+  unsigned mask = 0, bit = 1;
+  ((mask |= KernLogIsString<Args>::value ? bit : 0, bit <<= 1), ...);
+  return mask;
+}
+template <typename... Args>
+static inline void KernLogRecordArgs(KernLogLevel level,
+                                     KernLogFacility facility,
+                                     const char *format, Args... args) {
+  static_assert(sizeof...(Args) <= KERN_LOG_MAX_ARGS, "too many arguments");
+  const uint64_t words[sizeof...(Args) + 1] = {KernLogArg(args)..., 0};
+  KernLogWrite(level, facility, format, words, sizeof...(Args),
+               KernLogStringMask<Args...>());
+}
+#define KERN_LOG(level, facility, format, ...)                                 \
+  do {                                                                         \
+    if (KernLogEnabled(level, facility))                                       \
+      KernLogRecordArgs(level, facility, format, ##__VA_ARGS__);               \
+  } while (0)
+
+// Tracepoint sites. Arguments are only evaluated while the tracepoint is
+// on; KERN_TRACE_ENABLED guards any extra work a site needs, such as taking
+// a start time for a latency argument.
+#define KERN_TRACE_ARGS 4
+extern KernStaticKey gKernTraceKeys[KernTracepointCount];
+void KernTraceEmit(KernTracepoint tp, uint64_t a0, uint64_t a1, uint64_t a2,
+                   uint64_t a3);
+#define KERN_TRACE_ENABLED(tp) KERN_STATIC_BRANCH(gKernTraceKeys[tp])
+#define KERN_TRACE(tp, a0, a1, a2, a3)                                         \
+  do {                                                                         \
+    if (KERN_TRACE_ENABLED(tp))                                                \
+      KernTraceEmit(tp, (uint64_t)(a0), (uint64_t)(a1), (uint64_t)(a2),        \
+                    (uint64_t)(a3));                                           \
+  } while (0)
+
+// Programs attached to a tracepoint run from KernTraceEmit, before the event
+// is recorded, whether or not the tracepoint is recording.
+extern std::atomic<uint32_t> gKernBPFAttached[KernTracepointCount];
+void KernBPFRun(KernTracepoint tp, const KernBPFContext *ctx);
+
+// Performance counters (AdvancedKernel_Perf.mm). KERN_PERF_SCOPE("name")
+// charges the counters of the enclosing block to a named region; while
+// counting is off the guard is one relaxed load. setCurrentPID charges
+// processes with counters attached through KernPerfSwitchProcess.
+typedef NS_ENUM(uint32_t, KernPerfEvent) {
+  KernPerfCycles = 0,
+  KernPerfInstructions,
+  KernPerfCacheReferences,
+  KernPerfCacheMisses,
+  KernPerfBranches,
+  KernPerfBranchMisses,
+  KernPerfTaskClock,
+  KernPerfPageFaults,
+  KernPerfContextSwitches,
+  KernPerfEventCount
+};
+struct KernPerfReading {
+  uint64_t value[KernPerfEventCount];
+  uint64_t enabled[KernPerfEventCount]; // Nanoseconds enabled
+  uint64_t running[KernPerfEventCount]; // Nanoseconds on the PMU
+};
+extern KernStaticKey gKernPerfKey;
+bool KernPerfScopeBegin(KernPerfReading &start);
+void KernPerfScopeEnd(const char *region, const KernPerfReading &start);
+void KernPerfSwitchProcess(uint32_t from);
+class KernPerfScope {
+public:
+  explicit KernPerfScope(const char *region) : region_(region) {
+    if (KERN_STATIC_BRANCH(gKernPerfKey))
+      started_ = KernPerfScopeBegin(start_);
+  }
+  ~KernPerfScope() {
+    if (started_)
+      KernPerfScopeEnd(region_, start_);
+  }
+  KernPerfScope(const KernPerfScope &) = delete;
+  KernPerfScope &operator=(const KernPerfScope &) = delete;
+
+private:
+  const char *region_;
+  bool started_ = false;
+  KernPerfReading start_;
+};
+#define KERN_PERF_CONCAT_(a, b) a##b
+#define KERN_PERF_CONCAT(a, b) KERN_PERF_CONCAT_(a, b)
+#define KERN_PERF_SCOPE(region)                                                \
+  KernPerfScope KERN_PERF_CONCAT(kernPerfScope, __LINE__)(region)
+#endif
+
 // ==========================================================================
 // SECTION 9: ADVANCED KERNEL MANAGER
 // ==========================================================================
@@ -1002,6 +1844,41 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
                    address:(uint64_t)addr
                     length:(uint64_t)len
                 protection:(KernMemoryProtection)prot;
+// File mappings share pages with the page cache: MAP_SHARED stores dirty
+// the cached page, MAP_PRIVATE stores copy it first. addr 0 places the
+// mapping in the highest free range below the stack gap, or fails with
+// -ENOMEM; an explicit addr that overlaps a mapping fails with -EEXIST
+// unless KernMmapFixed replaces it. Returns the address or -errno.
+- (int64_t)mmapFD:(int32_t)fd
+       forProcess:(uint32_t)pid
+          address:(uint64_t)addr
+           length:(uint64_t)len
+       protection:(KernMemoryProtection)prot
+            flags:(KernMmapFlags)flags
+           offset:(uint64_t)offset;
+- (int64_t)msyncForProcess:(uint32_t)pid
+                   address:(uint64_t)addr
+                    length:(uint64_t)len
+                      sync:(BOOL)sync;
+// Faults in a file mapping's page; NO if address isn't in one.
+- (BOOL)handleFileMappingFault:(uint64_t)address
+                         write:(BOOL)write
+                    forProcess:(KernProcess *)proc;
+// Process memory, faulted in page by page as it is walked. The block sees
+// each page's bytes in place. Returns bytes covered or -errno.
+- (int64_t)accessUserMemory:(uint64_t)address
+                     length:(NSUInteger)length
+                 forProcess:(uint32_t)pid
+                      write:(BOOL)write
+                 usingBlock:(void (^)(uint8_t *data, NSUInteger length))block;
+- (int64_t)readUserMemory:(uint64_t)address
+                     into:(void *)buffer
+                   length:(NSUInteger)length
+               forProcess:(uint32_t)pid;
+- (int64_t)writeUserMemory:(uint64_t)address
+                      from:(const void *)buffer
+                    length:(NSUInteger)length
+                forProcess:(uint32_t)pid;
 
 // Slab allocator
 - (KernSlabCache *)createSlabCache:(NSString *)name
@@ -1057,6 +1934,9 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
 - (void)destroyMessageQueue:(KernMessageQueue *)queue;
 
 - (KernSharedMemory *)createSharedMemory:(NSString *)name size:(NSUInteger)size;
+- (KernSharedMemory *)createSharedMemory:(NSString *)name
+                                    size:(NSUInteger)size
+                               hugePages:(BOOL)hugePages;
 - (void *)attachSharedMemory:(KernSharedMemory *)shm forProcess:(uint32_t)pid;
 - (void)detachSharedMemory:(KernSharedMemory *)shm fromProcess:(uint32_t)pid;
 - (void)destroySharedMemory:(KernSharedMemory *)shm;
@@ -1102,11 +1982,47 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
 - (void)barrierWait:(KernBarrier *)barrier;
 - (void)destroyBarrier:(KernBarrier *)barrier;
 
+- (int32_t)futexWait:(uint32_t *)address
+            expected:(uint32_t)value
+           timeoutNs:(uint64_t)timeout; // 0 = no timeout
+- (int32_t)futexWake:(uint32_t *)address count:(uint32_t)count;
+
+- (KernSpinlock *)createSpinlock:(NSString *)name;
+- (BOOL)spinlockLock:(KernSpinlock *)lock;
+- (void)spinlockUnlock:(KernSpinlock *)lock;
+
+// --- Lock Validation (lockdep) ---
+// Available when built with KERN_LOCKDEP; otherwise these report nothing.
+- (void)setLockdepEnabled:(BOOL)enabled;
+- (BOOL)isLockdepEnabled;
+- (NSArray<NSDictionary *> *)lockdepViolations;
+- (NSDictionary *)lockContentionProfile;
+- (NSData *)lockContentionProfileJSON;
+- (void)resetLockStatistics;
+
 // --- Syscall Interface ---
 - (KernSyscallResult *)executeSyscall:(KernSyscallNumber)number
                                  args:(NSArray *)args;
+- (int64_t)invokeSyscall:(KernSyscallNumber)number
+                    args:(const uint64_t *)args; // KERN_SYSCALL_MAX_ARGS words
 - (NSString *)syscallName:(KernSyscallNumber)number;
 - (NSUInteger)totalSyscallCount;
+- (void)setSyscallTracingEnabled:(BOOL)enabled;
+- (BOOL)isSyscallTracingEnabled;
+// Simulated process issuing syscalls from the calling thread (default 1)
+- (uint32_t)currentPID;
+- (void)setCurrentPID:(uint32_t)pid;
+
+// Asynchronous rings
+- (KernIORing *)ioRingSetup:(uint32_t)entries forProcess:(uint32_t)pid;
+- (KernRingSQE *)ioRingGetSQE:(KernIORing *)ring; // NULL when the SQ is full
+- (NSInteger)ioRingEnter:(KernIORing *)ring
+                toSubmit:(uint32_t)toSubmit
+             minComplete:(uint32_t)minComplete;
+- (uint32_t)ioRingReapCompletions:(KernIORing *)ring
+                             into:(KernRingCQE *)cqes
+                              max:(uint32_t)max;
+- (void)ioRingDestroy:(KernIORing *)ring;
 
 // --- VFS ---
 - (void)initializeVFS;
@@ -1116,23 +2032,123 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
                             options:(NSDictionary *)options;
 - (BOOL)unmountFileSystem:(NSString *)mountPoint;
 - (KernInode *)lookupPath:(NSString *)path;
+- (KernDentry *)dentryForPath:(NSString *)path;
+- (NSUInteger)shrinkDentryCache:(NSUInteger)count;
+- (NSDictionary *)dentryCacheStatistics;
 - (KernInode *)createFile:(NSString *)path mode:(uint32_t)mode;
 - (KernInode *)createDirectory:(NSString *)path mode:(uint32_t)mode;
 - (BOOL)deleteInode:(NSString *)path;
 - (BOOL)linkPath:(NSString *)target to:(NSString *)linkPath;
 - (BOOL)symlinkPath:(NSString *)target to:(NSString *)linkPath;
 - (NSArray<KernDentry *> *)readDirectory:(NSString *)path;
+// Streaming readdir: hands up to count entries to the block in hash order
+// without copying the directory, and returns how many (0 at the end).
+- (KernDirCursor *)openDirectory:(NSString *)path;
+- (NSUInteger)readDirectory:(KernDirCursor *)cursor
+                      count:(NSUInteger)count
+                 usingBlock:(void (^)(KernDentry *entry))block;
 - (KernFileDescriptor *)openFile:(NSString *)path
                            flags:(uint32_t)flags
                             mode:(uint32_t)mode;
 - (void)closeFile:(KernFileDescriptor *)fd;
+- (KernFileDescriptor *)fileDescriptorForNumber:(int32_t)fd;
+// Descriptor tables. Numbers resolve in the current process's table; new
+// descriptors take the lowest free number (from 3 for opens, 0-2 being
+// stdio) below the process's maxFDs. Return the descriptor or -errno.
+- (int32_t)installFileDescriptor:(KernFileDescriptor *)file
+                     closeOnExec:(BOOL)cloexec;
+- (int32_t)closeFD:(int32_t)fd;
+- (int32_t)dupFD:(int32_t)fd
+         minimum:(int32_t)minimum
+     closeOnExec:(BOOL)cloexec;
+- (int32_t)dup2FD:(int32_t)fd to:(int32_t)target closeOnExec:(BOOL)cloexec;
+- (int32_t)descriptorFlags:(int32_t)fd; // FD_CLOEXEC
+- (int32_t)setDescriptorFlags:(int32_t)flags forFD:(int32_t)fd;
+- (int32_t)closeRangeFrom:(uint32_t)first
+                       to:(uint32_t)last
+              closeOnExec:(BOOL)cloexecOnly;
+- (NSUInteger)closeExecDescriptorsForProcess:(uint32_t)pid;
+// fork copies the parent's table; share (CLONE_FILES) makes it common.
+- (void)forkFileTable:(KernProcess *)parent
+            toProcess:(KernProcess *)child
+                share:(BOOL)share;
+- (void)exitFileTable:(KernProcess *)proc;
+// Descriptor-number I/O for the syscall paths. offset UINT64_MAX uses and
+// advances the descriptor's cursor; returns bytes transferred or -errno.
+- (int64_t)readFD:(int32_t)fd
+             into:(void *)buffer
+           length:(NSUInteger)length
+           offset:(uint64_t)offset;
+- (int64_t)writeFD:(int32_t)fd
+              from:(const void *)buffer
+            length:(NSUInteger)length
+            offset:(uint64_t)offset;
 - (NSData *)readFile:(KernFileDescriptor *)fd length:(NSUInteger)length;
 - (NSInteger)writeFile:(KernFileDescriptor *)fd data:(NSData *)data;
 - (BOOL)seekFile:(KernFileDescriptor *)fd
           offset:(int64_t)offset
           whence:(int32_t)whence;
 - (NSArray<KernMountPoint *> *)mountedFileSystems;
+// Filesystem watches. A watch on a directory also reports events on its
+// entries; filesystem-wide watches (fanotify marks) report every event on
+// the path's superblock. Return a watch descriptor or -errno.
+- (KernNotifyGroup *)notifyInit:(uint32_t)capacity;
+- (int32_t)notifyGroup:(KernNotifyGroup *)group
+          addWatchPath:(NSString *)path
+                  mask:(KernNotifyMask)mask
+            filesystem:(BOOL)filesystem;
+- (int32_t)notifyGroup:(KernNotifyGroup *)group removeWatch:(int32_t)wd;
+// Up to maximum events, waiting up to timeoutNs for the first (0 polls).
+- (NSArray<KernNotifyEvent *> *)readNotifyEvents:(KernNotifyGroup *)group
+                                         maximum:(NSUInteger)maximum
+                                       timeoutNs:(uint64_t)timeoutNs;
+
+// Page cache. Reads and writes copy through cached pages; dirty pages reach
+// the inode's backing store on writeback or when reclaimed.
+- (int64_t)pageCacheRead:(KernInode *)inode
+                    into:(void *)buffer
+                  length:(NSUInteger)length
+                  offset:(uint64_t)offset;
+- (int64_t)pageCacheWrite:(KernInode *)inode
+                     from:(const void *)buffer
+                   length:(NSUInteger)length
+                   offset:(uint64_t)offset;
+- (NSInteger)writebackInode:(KernInode *)inode;
+// Read missing pages in [index, index + count) into the cache, clamped to
+// EOF. Returns the number of pages added.
+- (NSUInteger)pageCachePopulate:(KernInode *)inode
+                          index:(uint64_t)index
+                          count:(NSUInteger)count;
+// Drop an inode's clean cached pages (POSIX_FADV_DONTNEED).
+- (NSUInteger)invalidateInodePages:(KernInode *)inode;
+// Adaptive readahead, called before a read of length bytes at offset.
+- (void)readaheadFile:(KernFileDescriptor *)fd
+               offset:(uint64_t)offset
+               length:(NSUInteger)length;
+// SEEK_DATA / SEEK_HOLE: next data or hole offset at or after offset,
+// counting dirty cached pages as data. -ENXIO at or past end of file.
+- (int64_t)pageCacheSeek:(KernInode *)inode
+                  offset:(uint64_t)offset
+                    hole:(BOOL)hole;
+- (NSUInteger)shrinkPageCache:(NSUInteger)pages;
+- (void)setPageCacheLimit:(uint64_t)bytes;
+- (NSDictionary *)pageCacheStatistics;
+// Writeback. Flushers write inodes dirty for over 3 s every 500 ms, and
+// everything once dirty pages pass backgroundRatio percent of the cache;
+// writers pause above ratio percent. Defaults are 20 and 10.
+- (void)setDirtyRatio:(NSUInteger)ratio
+      backgroundRatio:(NSUInteger)backgroundRatio;
+- (int64_t)syncFD:(int32_t)fd dataOnly:(BOOL)dataOnly;
+- (NSInteger)syncFileSystem:(KernSuperblock *)sb;
 - (NSDictionary *)fileSystemStatistics:(NSString *)mountPoint;
+// Block devices. mountFileSystem: options @"hostPath", @"blocks" and
+// @"scheduler" (@"none", @"mq-deadline", @"bfq") give a mount its own.
+- (KernBlockDevice *)createBlockDevice:(NSString *)name
+                              hostPath:(NSString *)path
+                                blocks:(uint64_t)blocks
+                             scheduler:(KernIOScheduler)scheduler;
+- (void)removeBlockDevice:(KernBlockDevice *)device;
+- (NSDictionary *)blockDeviceStatistics:(KernBlockDevice *)device;
 
 // --- Security ---
 - (BOOL)checkCapability:(KernCapability)cap forProcess:(uint32_t)pid;
@@ -1141,26 +2157,159 @@ typedef NS_ENUM(NSInteger, KernLogFacility) {
 - (KernNamespace *)createNamespace:(KernNamespaceType)type
                         forProcess:(uint32_t)pid;
 - (void)joinNamespace:(KernNamespace *)ns process:(uint32_t)pid;
+// A process's number in a PID namespace (0 if not visible there), and the
+// process with a given number in one. A nil namespace means the initial one.
+- (uint32_t)pidOfProcess:(uint32_t)pid inNamespace:(KernNamespace *)ns;
+- (KernProcess *)processForPID:(uint32_t)nr inNamespace:(KernNamespace *)ns;
+- (NSUInteger)processCountInNamespace:(KernNamespace *)ns;
+// Named IPC objects in the current process's IPC namespace
+- (KernMessageQueue *)messageQueueNamed:(NSString *)name;
+- (KernSharedMemory *)sharedMemoryNamed:(NSString *)name;
 - (KernSandboxProfile *)createSandboxProfile:(NSString *)name;
+// Installs the profile's syscall filter and path ruleset. Both stack on
+// any the process already has and are inherited by its children.
 - (void)applySandbox:(KernSandboxProfile *)profile toProcess:(uint32_t)pid;
+- (void)applyPathRuleset:(KernSandboxProfile *)profile
+               toProcess:(uint32_t)pid;
+- (NSUInteger)syscallFilterCountForProcess:(uint32_t)pid;
 - (KernCgroup *)createCgroup:(NSString *)name parent:(KernCgroup *)parent;
 - (void)addProcess:(uint32_t)pid toCgroup:(KernCgroup *)cgroup;
 - (void)setCgroupCPULimit:(KernCgroup *)cgroup
                   quotaUs:(uint64_t)quota
                  periodUs:(uint64_t)period;
+// Bounds the anonymous and page cache pages charged to the cgroup and its
+// descendants. Lowering it reclaims page cache down to the new limit.
 - (void)setCgroupMemoryLimit:(KernCgroup *)cgroup bytes:(uint64_t)limit;
+// 0 removes a limit. Enforced on VFS reads and writes; a limit also bounds
+// the cgroup's descendants, which share it in proportion to ioWeight.
+- (void)setCgroupIOLimit:(KernCgroup *)cgroup
+                 readBps:(uint64_t)readBps
+                writeBps:(uint64_t)writeBps
+                readIOps:(uint64_t)readIOps
+               writeIOps:(uint64_t)writeIOps;
+- (KernCgroup *)cgroupForProcess:(uint32_t)pid;
 - (NSDictionary *)cgroupStatistics:(KernCgroup *)cgroup;
 
 // --- Logging ---
 - (void)kernelLog:(KernLogLevel)level
          facility:(KernLogFacility)facility
           message:(NSString *)message;
+- (void)kernelLog:(KernLogLevel)level
+         facility:(KernLogFacility)facility
+        subsystem:(NSString *)subsystem
+          message:(NSString *)message;
 - (NSArray<KernLogEntry *> *)logEntriesWithLevel:(KernLogLevel)minLevel
                                         facility:(KernLogFacility)facility
                                            count:(NSUInteger)count;
+// Returns up to limit matching entries after the query's cursor, oldest
+// first, and moves the cursor past them. Work is proportional to the
+// records the narrowest of the level, facility and subsystem predicates
+// admits, not to the size of the log.
+- (NSArray<KernLogEntry *> *)queryLog:(KernLogQuery *)query
+                                limit:(NSUInteger)limit;
+- (uint64_t)logEndPosition;
 - (void)clearLogs;
 - (NSUInteger)logCount;
 
+// --- Tracepoints ---
+// Enabled tracepoints record into per-CPU trace rings; readTraceEvents:
+// consumes up to maximum of them, oldest first. Filters (at most four per
+// tracepoint, all of which must match) apply before anything is written.
+- (NSArray<NSString *> *)tracepointNames;
+- (void)setTracepoint:(KernTracepoint)tp enabled:(BOOL)enabled;
+- (BOOL)isTracepointEnabled:(KernTracepoint)tp;
+- (BOOL)addTraceFilter:(KernTracepoint)tp
+                 field:(KernTraceFieldSelector)field
+                    op:(KernTraceOp)op
+                 value:(uint64_t)value;
+- (void)clearTraceFilters:(KernTracepoint)tp;
+- (NSArray<KernTraceEvent *> *)readTraceEvents:(NSUInteger)maximum;
+- (NSDictionary *)traceStatistics;
+// Messages above a facility's level are dropped before any formatting.
+// Every facility starts at KernLogDebug.
+- (void)setLogLevel:(KernLogLevel)level forFacility:(KernLogFacility)facility;
+- (KernLogLevel)logLevelForFacility:(KernLogFacility)facility;
+- (NSDictionary *)logStatistics;
+
+// --- Tracepoint Programs ---
+// Maps and programs are named by positive ids and stay loaded for the life
+// of the kernel. loadBPFProgram:log: takes packed KernBPFInsn and returns
+// the program id, or -EINVAL with the verifier's reason in log. Lookups on
+// a per-CPU array return every CPU's value, concatenated.
+- (int32_t)createBPFMap:(KernBPFMapType)type
+                keySize:(uint32_t)keySize
+              valueSize:(uint32_t)valueSize
+             maxEntries:(uint32_t)maxEntries;
+- (int32_t)loadBPFProgram:(NSData *)instructions
+                      log:(NSString *__autoreleasing *)log;
+- (int32_t)attachBPFProgram:(int32_t)program toTracepoint:(KernTracepoint)tp;
+- (int32_t)detachBPFProgram:(int32_t)program
+             fromTracepoint:(KernTracepoint)tp;
+- (NSData *)lookupBPFMap:(int32_t)map key:(NSData *)key;
+- (int32_t)updateBPFMap:(int32_t)map
+                    key:(NSData *)key
+                  value:(NSData *)value
+                  flags:(uint64_t)flags;
+- (int32_t)deleteBPFMap:(int32_t)map key:(NSData *)key;
+- (NSDictionary<NSData *, NSData *> *)dumpBPFMap:(int32_t)map;
+- (NSArray<NSData *> *)readBPFRingBuffer:(int32_t)map
+                                 maximum:(NSUInteger)maximum;
+- (NSDictionary *)bpfStatistics;
+
+// --- Sampling Profiler ---
+// Samples call stacks on SIGPROF at hz per second of CPU time, at most
+// 10 kHz. On Linux each thread has its own timer and joins through
+// profileCurrentThread (the starting thread joins itself). Darwin samples
+// every thread from one process timer. profileFoldedStacks symbolizes the
+// stacks collected so far as "root;...;leaf count" lines for flamegraph
+// tools.
+- (BOOL)startProfilerWithFrequency:(NSUInteger)hz;
+- (BOOL)profileCurrentThread;
+- (void)stopProfiler;
+- (void)resetProfile;
+- (NSString *)profileFoldedStacks;
+- (BOOL)writeProfileFoldedStacks:(NSString *)path;
+- (NSDictionary *)profilerStatus;
+
+// --- Performance Counters ---
+// Hardware and software counters from perf_event_open, or a software
+// fallback (thread CPU clock and rusage) where it is unavailable.
+// Multiplexed events are scaled by enabled / running time and reported
+// with the percentage of time they ran. Counters attached to a process
+// accumulate while it is the current PID on a counting thread; attach
+// returns 0, -ESRCH or -EEXIST.
+- (void)setPerfCountersEnabled:(BOOL)enabled;
+- (BOOL)perfCountersEnabled;
+- (int32_t)attachPerfCountersToProcess:(uint32_t)pid;
+- (int32_t)detachPerfCountersFromProcess:(uint32_t)pid;
+- (NSDictionary *)perfCountersForProcess:(uint32_t)pid;
+- (NSDictionary *)perfCountersForRegion:(NSString *)region;
+- (NSDictionary *)perfCounterReport;
+- (void)resetPerfCounters;
+- (NSDictionary *)perfCounterStatus;
+
+// --- Benchmarks ---
+- (NSDictionary *)benchmarkSyscallRings:(NSUInteger)operations;
+- (NSDictionary *)benchmarkSyscallDispatch:(NSUInteger)iterations;
+- (NSDictionary *)benchmarkSyscallFilter:(NSUInteger)iterations;
+- (NSDictionary *)benchmarkDentryCache:(NSUInteger)files
+                               lookups:(NSUInteger)lookups;
+- (NSDictionary *)benchmarkReadahead:(NSUInteger)reads;
+- (NSDictionary *)benchmarkBlockLayer:(NSUInteger)requests;
+- (NSDictionary *)benchmarkFileTable:(NSUInteger)operations;
+- (NSDictionary *)benchmarkMmapScan:(uint64_t)bytes;
+- (NSDictionary *)benchmarkDirectory:(NSUInteger)files;
+- (NSDictionary *)benchmarkLogging:(NSUInteger)calls;
+- (NSDictionary *)benchmarkLogQuery:(NSUInteger)records;
+- (NSDictionary *)benchmarkTracepoints:(NSUInteger)iterations;
+- (NSDictionary *)benchmarkBPF:(NSUInteger)events;
+- (NSDictionary *)benchmarkProfiler:(NSUInteger)iterations;
+- (NSDictionary *)benchmarkPerfCounters:(NSUInteger)operations;
+- (NSDictionary *)benchmarkPageAllocation:(NSUInteger)pages;
+- (NSDictionary *)benchmarkCgroupIsolation:(NSTimeInterval)seconds;
+- (NSDictionary *)benchmarkPathRuleset:(NSUInteger)lookups;
+- (NSDictionary *)benchmarkNamespaces:(NSUInteger)containers;
+
 // --- System Info ---
 - (NSDictionary *)kernelInfo;
 - (uint64_t)uptimeNanoseconds;
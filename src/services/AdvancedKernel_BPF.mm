@@ -0,0 +1,1362 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Tracepoint Programs
+// ============================================================================
+//
+// Small eBPF-style programs that aggregate tracepoint events in the kernel.
+// A program is verified once, when it is loaded, so that running it needs no
+// checks at all. Afterwards the interpreter trusts every pointer and branch.
+//
+// The verifier walks every path through the program with the type of each
+// register: uninitialised, scalar (a known constant or not), or a pointer
+// to the context, the stack, a map, a map value, or a map value that may be
+// NULL. Memory accesses must stay inside the object the pointer refers to.
+// Stack reads must hit bytes already written. The context is read only.
+// Pointers cannot be stored to memory or mixed with scalars beyond adding a
+// constant offset. A lookup result must be compared against zero before it
+// is dereferenced. Helper arguments are checked against each helper's
+// signature, and r0 must hold a scalar at exit.
+//
+// Loops are allowed if the verifier can walk them to the end. Branches on
+// known constants are followed one way only, so a counted loop is
+// unrolled during verification; a branch on an unknown value explores both
+// sides. A path that reaches a jump target in a state already seen there
+// is cut off if another path got there first, and rejected if it was
+// itself: that loop can run forever. A program that needs more than
+// KERN_BPF_MAX_PROCESSED steps to prove is rejected too.
+//
+// Maps are fixed size and allocated up front, so helpers never allocate
+// while an event is running. Hash lookups are lock-free. Updates and
+// deletes take the map's lock. A deleted slot is tombstoned so probes go on
+// past it, but no stored key lies beyond a run of tombstones that ends at an
+// empty slot, so delete turns such a run back to empty and misses stay
+// short under churn. Slots never move, so a value pointer held by a running
+// program always points at map memory. Ring buffers hold length-prefixed
+// records behind a spinlock. When a record does not fit, the ring drops it
+// and counts the drop.
+
+#define KERN_BPF_MAX_INSNS 4096
+#define KERN_BPF_STACK 512
+#define KERN_BPF_REGS 11
+#define KERN_BPF_MAX_CPUS 64 // CPU ids match the trace rings
+#define KERN_BPF_MAX_PROCESSED 131072
+#define KERN_BPF_MAX_ATTACH 8 // Programs per tracepoint
+#define KERN_BPF_MAX_OBJECTS 1024
+#define KERN_BPF_MAX_KEY 64
+#define KERN_BPF_MAX_VALUE 1024
+#define KERN_BPF_MAX_RECORD 256 // Largest ring buffer record
+
+std::atomic<uint32_t> gKernBPFAttached[KernTracepointCount];
+
+namespace {
+
+struct KernBPFSpinLock {
+  std::atomic<bool> busy{false};
+  void lock() {
+    while (busy.exchange(true, std::memory_order_acquire))
+      while (busy.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+  }
+  void unlock() { busy.store(false, std::memory_order_release); }
+};
+
+enum : uint32_t { KernBPFSlotEmpty = 0, KernBPFSlotUsed, KernBPFSlotDeleted };
+
+struct KernBPFMap {
+  int32_t id = 0;
+  KernBPFMapType type = KernBPFMapHash;
+  uint32_t keySize = 0;
+  uint32_t valueSize = 0;
+  uint32_t maxEntries = 0;
+  uint32_t stride = 0; // valueSize rounded up to 8, so atomics stay aligned
+  std::unique_ptr<uint8_t[]> values;
+
+  // Hash maps: open addressing over capacity slots, linear probing
+  uint32_t capacity = 0;
+  std::unique_ptr<std::atomic<uint32_t>[]> states;
+  std::unique_ptr<uint32_t[]> hashes;
+  std::unique_ptr<uint8_t[]> keys;
+  uint32_t count = 0; // Under lock
+  std::mutex lock;
+
+  // Ring buffers: byte offsets, records padded to 8 bytes
+  KernBPFSpinLock ringLock;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  uint64_t dropped = 0;
+
+  uint8_t *valueAt(uint32_t slot) {
+    return values.get() + (size_t)slot * stride;
+  }
+  uint8_t *keyAt(uint32_t slot) { return keys.get() + (size_t)slot * keySize; }
+};
+
+struct KernBPFProgram {
+  int32_t id = 0;
+  std::vector<KernBPFInsn> insns;
+  std::vector<uint64_t> wide;         // Wide-load values, maps resolved
+  std::vector<const void *> handlers; // Interpreter entry points by pc
+  uint32_t processed = 0;             // Verifier steps taken to prove it
+  uint32_t attached = 0;              // Tracepoint bitmask, under gBPFLock
+};
+
+std::mutex gBPFLock; // Object tables and attachment
+std::vector<std::unique_ptr<KernBPFMap>> gBPFMaps;
+std::vector<std::unique_ptr<KernBPFProgram>> gBPFPrograms;
+std::atomic<KernBPFProgram *> gBPFAttach[KernTracepointCount]
+                                        [KERN_BPF_MAX_ATTACH];
+
+KernBPFMap *KernBPFFindMap(int32_t id) {
+  if (id <= 0 || (size_t)id > gBPFMaps.size())
+    return nullptr;
+  return gBPFMaps[id - 1].get();
+}
+
+KernBPFProgram *KernBPFFindProgram(int32_t id) {
+  if (id <= 0 || (size_t)id > gBPFPrograms.size())
+    return nullptr;
+  return gBPFPrograms[id - 1].get();
+}
+
+// ----------------------------------------------------------------------------
+// Maps
+// ----------------------------------------------------------------------------
+
+uint32_t KernBPFHash(const uint8_t *key, uint32_t size) {
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < size; i++)
+    hash = (hash ^ key[i]) * 16777619u;
+  return hash;
+}
+
+int32_t KernBPFHashFind(KernBPFMap *map, const uint8_t *key, uint32_t hash) {
+  uint32_t mask = map->capacity - 1;
+  for (uint32_t i = 0; i < map->capacity; i++) {
+    uint32_t slot = (hash + i) & mask;
+    uint32_t state = map->states[slot].load(std::memory_order_acquire);
+    if (state == KernBPFSlotEmpty)
+      return -1;
+    if (state == KernBPFSlotUsed && map->hashes[slot] == hash &&
+        memcmp(map->keyAt(slot), key, map->keySize) == 0)
+      return (int32_t)slot;
+  }
+  return -1;
+}
+
+uint8_t *KernBPFMapLookup(KernBPFMap *map, const uint8_t *key, uint64_t cpu) {
+  switch (map->type) {
+  case KernBPFMapHash: {
+    int32_t slot = KernBPFHashFind(map, key, KernBPFHash(key, map->keySize));
+    return slot < 0 ? nullptr : map->valueAt((uint32_t)slot);
+  }
+  case KernBPFMapArray:
+  case KernBPFMapPerCPUArray: {
+    uint32_t index;
+    memcpy(&index, key, sizeof(index));
+    if (index >= map->maxEntries)
+      return nullptr;
+    if (map->type == KernBPFMapPerCPUArray)
+      index += (uint32_t)(cpu % KERN_BPF_MAX_CPUS) * map->maxEntries;
+    return map->valueAt(index);
+  }
+  case KernBPFMapRingBuffer:
+    break;
+  }
+  return nullptr;
+}
+
+int64_t KernBPFHashUpdate(KernBPFMap *map, const uint8_t *key,
+                          const uint8_t *value, uint64_t flags) {
+  std::lock_guard<std::mutex> guard(map->lock);
+  uint32_t hash = KernBPFHash(key, map->keySize);
+  int32_t found = KernBPFHashFind(map, key, hash);
+  if (found >= 0) {
+    if (flags == KERN_BPF_NOEXIST)
+      return -EEXIST;
+    memcpy(map->valueAt((uint32_t)found), value, map->valueSize);
+    return 0;
+  }
+  if (flags == KERN_BPF_EXIST)
+    return -ENOENT;
+  if (map->count >= map->maxEntries)
+    return -E2BIG;
+  uint32_t mask = map->capacity - 1;
+  for (uint32_t i = 0; i < map->capacity; i++) {
+    uint32_t slot = (hash + i) & mask;
+    if (map->states[slot].load(std::memory_order_relaxed) == KernBPFSlotUsed)
+      continue;
+    memcpy(map->keyAt(slot), key, map->keySize);
+    memcpy(map->valueAt(slot), value, map->valueSize);
+    map->hashes[slot] = hash;
+    map->states[slot].store(KernBPFSlotUsed, std::memory_order_release);
+    map->count++;
+    return 0;
+  }
+  return -E2BIG;
+}
+
+int64_t KernBPFMapUpdate(KernBPFMap *map, const uint8_t *key,
+                         const uint8_t *value, uint64_t flags, uint64_t cpu) {
+  if (flags > KERN_BPF_EXIST)
+    return -EINVAL;
+  if (map->type == KernBPFMapHash)
+    return KernBPFHashUpdate(map, key, value, flags);
+  if (flags == KERN_BPF_NOEXIST)
+    return -EEXIST;
+  uint8_t *slot = KernBPFMapLookup(map, key, cpu);
+  if (!slot)
+    return -E2BIG;
+  memcpy(slot, value, map->valueSize);
+  return 0;
+}
+
+int64_t KernBPFMapDelete(KernBPFMap *map, const uint8_t *key) {
+  if (map->type != KernBPFMapHash)
+    return -EINVAL;
+  std::lock_guard<std::mutex> guard(map->lock);
+  int32_t slot = KernBPFHashFind(map, key, KernBPFHash(key, map->keySize));
+  if (slot < 0)
+    return -ENOENT;
+  map->states[slot].store(KernBPFSlotDeleted, std::memory_order_release);
+  map->count--;
+  uint32_t mask = map->capacity - 1;
+  uint32_t next = ((uint32_t)slot + 1) & mask;
+  if (map->states[next].load(std::memory_order_relaxed) != KernBPFSlotEmpty)
+    return 0;
+  for (uint32_t i = (uint32_t)slot;
+       map->states[i].load(std::memory_order_relaxed) == KernBPFSlotDeleted;
+       i = (i - 1) & mask)
+    map->states[i].store(KernBPFSlotEmpty, std::memory_order_release);
+  return 0;
+}
+
+void KernBPFRingCopy(KernBPFMap *map, uint64_t offset, const void *data,
+                     uint64_t size) {
+  uint64_t mask = map->maxEntries - 1;
+  uint64_t first = std::min<uint64_t>(size, map->maxEntries - (offset & mask));
+  memcpy(map->values.get() + (offset & mask), data, first);
+  memcpy(map->values.get(), (const uint8_t *)data + first, size - first);
+}
+
+int64_t KernBPFRingOutput(KernBPFMap *map, const void *data, uint64_t size) {
+  uint64_t total = 8 + ((size + 7) & ~7ULL);
+  std::lock_guard<KernBPFSpinLock> guard(map->ringLock);
+  if (map->head - map->tail + total > map->maxEntries) {
+    map->dropped++;
+    return -ENOSPC;
+  }
+  uint64_t header = size;
+  KernBPFRingCopy(map, map->head, &header, sizeof(header));
+  KernBPFRingCopy(map, map->head + 8, data, size);
+  map->head += total;
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Interpreter
+// ----------------------------------------------------------------------------
+
+uint64_t KernBPFCall(int32_t helper, const uint64_t *reg,
+                     const KernBPFContext *ctx) {
+  auto *map = (KernBPFMap *)(uintptr_t)reg[1];
+  switch ((KernBPFHelper)helper) {
+  case KernBPFHelperMapLookup:
+    return (uintptr_t)KernBPFMapLookup(map, (const uint8_t *)reg[2], ctx->cpu);
+  case KernBPFHelperMapUpdate:
+    return (uint64_t)KernBPFMapUpdate(map, (const uint8_t *)reg[2],
+                                      (const uint8_t *)reg[3], reg[4],
+                                      ctx->cpu);
+  case KernBPFHelperMapDelete:
+    return (uint64_t)KernBPFMapDelete(map, (const uint8_t *)reg[2]);
+  case KernBPFHelperKtime:
+    return mach_absolute_time();
+  case KernBPFHelperCurrentPID:
+    return ctx->pid;
+  case KernBPFHelperCurrentCPU:
+    return ctx->cpu;
+  case KernBPFHelperRingOutput:
+    return (uint64_t)KernBPFRingOutput(map, (const void *)reg[2], reg[3]);
+  case KernBPFHelperLog2:
+    return reg[1] ? 63 - __builtin_clzll(reg[1]) : 0;
+  case KernBPFHelperCount:
+    break;
+  }
+  return 0;
+}
+
+template <typename T> inline uint64_t KernBPFLoad(uint64_t address) {
+  T value;
+  memcpy(&value, (const void *)(uintptr_t)address, sizeof(value));
+  return value;
+}
+
+template <typename T> inline void KernBPFStore(uint64_t address, uint64_t v) {
+  T value = (T)v;
+  memcpy((void *)(uintptr_t)address, &value, sizeof(value));
+}
+
+// Instruction semantics, shared by the interpreter and the verifier's
+// constant folding: a is the destination, b the source operand.
+#define KERN_BPF_ALU_OPS(X)                                                    \
+  X(ADD, a += b)                                                               \
+  X(SUB, a -= b)                                                               \
+  X(MUL, a *= b)                                                               \
+  X(DIV, a = b ? a / b : 0)                                                    \
+  X(OR, a |= b)                                                                \
+  X(AND, a &= b)                                                               \
+  X(LSH, a <<= (b & 63))                                                       \
+  X(RSH, a >>= (b & 63))                                                       \
+  X(MOD, a = b ? a % b : a)                                                    \
+  X(XOR, a ^= b)                                                               \
+  X(MOV, a = b)                                                                \
+  X(ARSH, a = (uint64_t)((int64_t)a >> (b & 63)))
+#define KERN_BPF_JMP_OPS(X)                                                    \
+  X(JEQ, a == b)                                                               \
+  X(JNE, a != b)                                                               \
+  X(JGT, a > b)                                                                \
+  X(JGE, a >= b)                                                               \
+  X(JLT, a < b)                                                                \
+  X(JLE, a <= b)                                                               \
+  X(JSET, (a & b) != 0)                                                        \
+  X(JSGT, (int64_t)a > (int64_t)b)                                             \
+  X(JSGE, (int64_t)a >= (int64_t)b)                                            \
+  X(JSLT, (int64_t)a < (int64_t)b)                                             \
+  X(JSLE, (int64_t)a <= (int64_t)b)
+#define KERN_BPF_MEM_OPS(X)                                                    \
+  X(B, uint8_t)                                                                \
+  X(H, uint16_t)                                                               \
+  X(W, uint32_t)                                                               \
+  X(DW, uint64_t)
+
+// Runs a verified program: no bounds, type or termination checks here.
+// Dispatch is direct-threaded: every instruction has the address of its
+// handler, resolved once at load by calling this with a null context
+// (handler labels are only visible inside this function), and each handler
+// jumps straight to the next one's.
+uint64_t KernBPFExecute(KernBPFProgram *prog, const KernBPFContext *ctx) {
+  const KernBPFInsn *insns = prog->insns.data();
+  if (!ctx) {
+    prog->handlers.resize(prog->insns.size());
+    for (size_t pc = 0; pc < prog->insns.size(); pc++) {
+      const void *handler = &&invalid;
+      switch (insns[pc].code) {
+#define KERN_BPF_DECODE_ALU(op, expr)                                          \
+  case KERN_BPF_ALU64 | KERN_BPF_##op | KERN_BPF_K:                            \
+    handler = &&alu_##op##_k;                                                  \
+    break;                                                                     \
+  case KERN_BPF_ALU64 | KERN_BPF_##op | KERN_BPF_X:                            \
+    handler = &&alu_##op##_x;                                                  \
+    break;
+#define KERN_BPF_DECODE_JMP(op, cond)                                          \
+  case KERN_BPF_JMP | KERN_BPF_##op | KERN_BPF_K:                              \
+    handler = &&jmp_##op##_k;                                                  \
+    break;                                                                     \
+  case KERN_BPF_JMP | KERN_BPF_##op | KERN_BPF_X:                              \
+    handler = &&jmp_##op##_x;                                                  \
+    break;
+#define KERN_BPF_DECODE_MEM(size, T)                                           \
+  case KERN_BPF_LDX | KERN_BPF_##size | KERN_BPF_MEM:                          \
+    handler = &&ldx_##size;                                                    \
+    break;                                                                     \
+  case KERN_BPF_STX | KERN_BPF_##size | KERN_BPF_MEM:                          \
+    handler = &&stx_##size;                                                    \
+    break;                                                                     \
+  case KERN_BPF_ST | KERN_BPF_##size | KERN_BPF_MEM:                           \
+    handler = &&st_##size;                                                     \
+    break;
+        KERN_BPF_ALU_OPS(KERN_BPF_DECODE_ALU)
+        KERN_BPF_JMP_OPS(KERN_BPF_DECODE_JMP)
+        KERN_BPF_MEM_OPS(KERN_BPF_DECODE_MEM)
+#undef KERN_BPF_DECODE_ALU
+#undef KERN_BPF_DECODE_JMP
+#undef KERN_BPF_DECODE_MEM
+      case KERN_BPF_ALU64 | KERN_BPF_NEG:
+        handler = &&neg;
+        break;
+      case KERN_BPF_JMP | KERN_BPF_JA:
+        handler = &&ja;
+        break;
+      case KERN_BPF_JMP | KERN_BPF_CALL:
+        handler = &&call;
+        break;
+      case KERN_BPF_JMP | KERN_BPF_EXIT:
+        handler = &&exit;
+        break;
+      case KERN_BPF_STX | KERN_BPF_W | KERN_BPF_XADD:
+        handler = &&xadd_w;
+        break;
+      case KERN_BPF_STX | KERN_BPF_DW | KERN_BPF_XADD:
+        handler = &&xadd_dw;
+        break;
+      case KERN_BPF_LD | KERN_BPF_DW | KERN_BPF_IMM:
+        handler = &&ld_wide;
+        break;
+      }
+      prog->handlers[pc] = handler;
+    }
+    return 0;
+  }
+
+  uint64_t reg[KERN_BPF_REGS] = {};
+  alignas(8) uint8_t stack[KERN_BPF_STACK];
+  reg[1] = (uintptr_t)ctx;
+  reg[10] = (uintptr_t)(stack + KERN_BPF_STACK);
+  const void *const *handlers = prog->handlers.data();
+  uint32_t pc = 0;
+#define KERN_BPF_DST reg[insns[pc].dst]
+#define KERN_BPF_SRC reg[insns[pc].src]
+#define KERN_BPF_IMM_VALUE ((uint64_t)(int64_t)insns[pc].imm)
+#define KERN_BPF_NEXT goto *handlers[++pc]
+  goto *handlers[0];
+
+#define KERN_BPF_RUN_ALU(op, expr)                                             \
+  alu_##op##_k : {                                                             \
+    uint64_t &a = KERN_BPF_DST;                                                \
+    const uint64_t b = KERN_BPF_IMM_VALUE;                                     \
+    expr;                                                                      \
+    KERN_BPF_NEXT;                                                             \
+  }                                                                            \
+  alu_##op##_x : {                                                             \
+    uint64_t &a = KERN_BPF_DST;                                                \
+    const uint64_t b = KERN_BPF_SRC;                                           \
+    expr;                                                                      \
+    KERN_BPF_NEXT;                                                             \
+  }
+#define KERN_BPF_RUN_JMP(op, cond)                                             \
+  jmp_##op##_k : {                                                             \
+    const uint64_t a = KERN_BPF_DST;                                           \
+    const uint64_t b = KERN_BPF_IMM_VALUE;                                     \
+    if (cond)                                                                  \
+      pc += insns[pc].off;                                                     \
+    KERN_BPF_NEXT;                                                             \
+  }                                                                            \
+  jmp_##op##_x : {                                                             \
+    const uint64_t a = KERN_BPF_DST;                                           \
+    const uint64_t b = KERN_BPF_SRC;                                           \
+    if (cond)                                                                  \
+      pc += insns[pc].off;                                                     \
+    KERN_BPF_NEXT;                                                             \
+  }
+#define KERN_BPF_RUN_MEM(size, T)                                              \
+  ldx_##size : KERN_BPF_DST = KernBPFLoad<T>(KERN_BPF_SRC + insns[pc].off);   \
+  KERN_BPF_NEXT;                                                               \
+  stx_##size : KernBPFStore<T>(KERN_BPF_DST + insns[pc].off, KERN_BPF_SRC);   \
+  KERN_BPF_NEXT;                                                               \
+  st_##size : KernBPFStore<T>(KERN_BPF_DST + insns[pc].off,                   \
+                              KERN_BPF_IMM_VALUE);                             \
+  KERN_BPF_NEXT;
+
+  KERN_BPF_ALU_OPS(KERN_BPF_RUN_ALU)
+  KERN_BPF_JMP_OPS(KERN_BPF_RUN_JMP)
+  KERN_BPF_MEM_OPS(KERN_BPF_RUN_MEM)
+#undef KERN_BPF_RUN_ALU
+#undef KERN_BPF_RUN_JMP
+#undef KERN_BPF_RUN_MEM
+
+neg:
+  KERN_BPF_DST = -KERN_BPF_DST;
+  KERN_BPF_NEXT;
+ja:
+  pc += insns[pc].off;
+  KERN_BPF_NEXT;
+call:
+  reg[0] = KernBPFCall(insns[pc].imm, reg, ctx);
+  KERN_BPF_NEXT;
+xadd_w:
+  __atomic_fetch_add((uint32_t *)(uintptr_t)(KERN_BPF_DST + insns[pc].off),
+                     (uint32_t)KERN_BPF_SRC, __ATOMIC_RELAXED);
+  KERN_BPF_NEXT;
+xadd_dw:
+  __atomic_fetch_add((uint64_t *)(uintptr_t)(KERN_BPF_DST + insns[pc].off),
+                     KERN_BPF_SRC, __ATOMIC_RELAXED);
+  KERN_BPF_NEXT;
+ld_wide:
+  KERN_BPF_DST = prog->wide[pc];
+  pc++;
+  KERN_BPF_NEXT;
+exit:
+  return reg[0];
+invalid:
+  return 0; // Unreachable once verified
+#undef KERN_BPF_DST
+#undef KERN_BPF_SRC
+#undef KERN_BPF_IMM_VALUE
+#undef KERN_BPF_NEXT
+}
+
+// ----------------------------------------------------------------------------
+// Verifier
+// ----------------------------------------------------------------------------
+
+enum KernBPFRegType : uint8_t {
+  KernBPFNotInit = 0,
+  KernBPFScalar,
+  KernBPFPtrCtx,
+  KernBPFPtrStack, // Offset from r10, so always negative when in bounds
+  KernBPFPtrMap,
+  KernBPFPtrValue,
+  KernBPFPtrValueOrNull
+};
+
+struct KernBPFReg {
+  KernBPFRegType type = KernBPFNotInit;
+  bool known = false; // Scalars: value is the constant
+  uint64_t value = 0; // Pointers: offset into the object
+  KernBPFMap *map = nullptr;
+};
+
+// The jump-target states a path has passed through, newest first. Keys
+// point into the verifier's seen sets, so equal states share a key.
+struct KernBPFPathNode {
+  const std::string *key;
+  std::shared_ptr<const KernBPFPathNode> parent;
+};
+
+struct KernBPFState {
+  uint32_t pc = 0;
+  KernBPFReg regs[KERN_BPF_REGS];
+  uint64_t stack[KERN_BPF_STACK / 64] = {}; // Bit per byte written
+  std::shared_ptr<const KernBPFPathNode> path;
+
+  bool stackWritten(int64_t offset, uint32_t size) const {
+    for (int64_t b = offset + KERN_BPF_STACK;
+         b < offset + KERN_BPF_STACK + size; b++)
+      if (!(stack[b / 64] & (1ULL << (b % 64))))
+        return false;
+    return true;
+  }
+  void markStack(int64_t offset, uint32_t size) {
+    for (int64_t b = offset + KERN_BPF_STACK;
+         b < offset + KERN_BPF_STACK + size; b++)
+      stack[b / 64] |= 1ULL << (b % 64);
+  }
+  std::string key() const {
+    std::string key;
+    key.reserve(KERN_BPF_REGS * 18 + sizeof(stack));
+    for (const KernBPFReg &reg : regs) {
+      key.push_back((char)reg.type);
+      key.push_back((char)reg.known);
+      key.append((const char *)&reg.value, sizeof(reg.value));
+      key.append((const char *)&reg.map, sizeof(reg.map));
+    }
+    key.append((const char *)stack, sizeof(stack));
+    return key;
+  }
+};
+
+enum KernBPFAccess { KernBPFRead, KernBPFWrite, KernBPFAtomic };
+
+uint32_t KernBPFSizeBytes(uint8_t code) {
+  switch (code & 0x18) {
+  case KERN_BPF_B:
+    return 1;
+  case KERN_BPF_H:
+    return 2;
+  case KERN_BPF_W:
+    return 4;
+  default:
+    return 8;
+  }
+}
+
+bool KernBPFKnownOpcode(uint8_t code) {
+  uint8_t op = code & 0xf0;
+  switch (code & 0x07) {
+  case KERN_BPF_ALU64:
+    if (op == KERN_BPF_NEG)
+      return code == (KERN_BPF_ALU64 | KERN_BPF_NEG);
+    return op <= KERN_BPF_ARSH;
+  case KERN_BPF_JMP:
+    if (op == KERN_BPF_JA || op == KERN_BPF_CALL || op == KERN_BPF_EXIT)
+      return (code & KERN_BPF_X) == 0;
+    return op <= KERN_BPF_JSLE;
+  case KERN_BPF_LDX:
+  case KERN_BPF_ST:
+    return (code & 0xe0) == KERN_BPF_MEM;
+  case KERN_BPF_STX:
+    if ((code & 0xe0) == KERN_BPF_XADD)
+      return (code & 0x18) == KERN_BPF_W || (code & 0x18) == KERN_BPF_DW;
+    return (code & 0xe0) == KERN_BPF_MEM;
+  case KERN_BPF_LD:
+    return code == (KERN_BPF_LD | KERN_BPF_DW | KERN_BPF_IMM);
+  }
+  return false;
+}
+
+uint64_t KernBPFFold(uint8_t op, uint64_t a, uint64_t b) {
+  switch (op) {
+#define KERN_BPF_FOLD(op, expr)                                                \
+  case KERN_BPF_##op:                                                          \
+    expr;                                                                      \
+    return a;
+    KERN_BPF_ALU_OPS(KERN_BPF_FOLD)
+#undef KERN_BPF_FOLD
+  }
+  return 0;
+}
+
+bool KernBPFBranch(uint8_t op, uint64_t a, uint64_t b) {
+  switch (op) {
+#define KERN_BPF_BRANCH(op, cond)                                              \
+  case KERN_BPF_##op:                                                          \
+    return cond;
+    KERN_BPF_JMP_OPS(KERN_BPF_BRANCH)
+#undef KERN_BPF_BRANCH
+  }
+  return false;
+}
+
+class KernBPFVerifier {
+public:
+  KernBPFVerifier(KernBPFProgram &prog) : prog_(prog) {}
+
+  bool verify() {
+    if (!checkLayout())
+      return false;
+    std::vector<KernBPFState> pending(1);
+    pending[0].regs[1].type = KernBPFPtrCtx;
+    pending[0].regs[10].type = KernBPFPtrStack;
+    std::vector<std::unordered_set<std::string>> seen(prog_.insns.size());
+    while (!pending.empty()) {
+      KernBPFState state = std::move(pending.back());
+      pending.pop_back();
+      for (;;) {
+        if (state.pc >= prog_.insns.size())
+          return fail(state.pc, "falls off the end of the program");
+        if (target_[state.pc]) {
+          auto inserted = seen[state.pc].insert(state.key());
+          const std::string *key = &*inserted.first;
+          if (!inserted.second) {
+            // Seen on this path: it can repeat forever. Seen on another:
+            // paths are walked depth first, so that one has been proven
+            // all the way from here already.
+            for (const KernBPFPathNode *node = state.path.get(); node;
+                 node = node->parent.get())
+              if (node->key == key)
+                return fail(state.pc, "loop with no provable bound");
+            break;
+          }
+          state.path = std::make_shared<const KernBPFPathNode>(
+              KernBPFPathNode{key, state.path});
+        }
+        if (++prog_.processed > KERN_BPF_MAX_PROCESSED)
+          return fail(state.pc, "too complex to verify");
+        bool done = false;
+        if (!step(state, pending, done))
+          return false;
+        if (done)
+          break;
+      }
+    }
+    return true;
+  }
+
+  const std::string &log() const { return log_; }
+
+private:
+  KernBPFProgram &prog_;
+  std::vector<bool> target_; // Jump targets, where paths are pruned
+  std::string log_;
+
+  bool fail(uint32_t pc, const char *format, ...)
+      __attribute__((format(printf, 3, 4))) {
+    char buffer[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    log_ = "insn " + std::to_string(pc) + ": " + buffer;
+    return false;
+  }
+
+  // Opcodes, registers, jump targets and wide loads, before any path walk
+  bool checkLayout() {
+    const std::vector<KernBPFInsn> &insns = prog_.insns;
+    uint32_t count = (uint32_t)insns.size();
+    target_.assign(count, false);
+    prog_.wide.assign(count, 0);
+    std::vector<bool> second(count, false);
+    for (uint32_t pc = 0; pc < count; pc++) {
+      const KernBPFInsn &in = insns[pc];
+      if (second[pc])
+        continue;
+      if (!KernBPFKnownOpcode(in.code))
+        return fail(pc, "unknown opcode 0x%02x", in.code);
+      if (in.dst >= KERN_BPF_REGS || in.src >= KERN_BPF_REGS)
+        return fail(pc, "invalid register");
+      if (in.code == (KERN_BPF_LD | KERN_BPF_DW | KERN_BPF_IMM)) {
+        if (pc + 1 >= count || insns[pc + 1].code != 0 ||
+            insns[pc + 1].dst != 0 || insns[pc + 1].src != 0 ||
+            insns[pc + 1].off != 0)
+          return fail(pc, "incomplete wide load");
+        second[pc + 1] = true;
+        if (in.src == KERN_BPF_PSEUDO_MAP) {
+          KernBPFMap *map = KernBPFFindMap(in.imm);
+          if (!map)
+            return fail(pc, "no map %d", in.imm);
+          prog_.wide[pc] = (uintptr_t)map;
+        } else if (in.src == 0) {
+          prog_.wide[pc] =
+              (uint32_t)in.imm | (uint64_t)(uint32_t)insns[pc + 1].imm << 32;
+        } else {
+          return fail(pc, "invalid wide load source");
+        }
+        continue;
+      }
+      if ((in.code & 0x07) != KERN_BPF_JMP)
+        continue;
+      uint8_t op = in.code & 0xf0;
+      if (op == KERN_BPF_CALL) {
+        if (in.imm <= 0 || in.imm >= KernBPFHelperCount)
+          return fail(pc, "unknown helper %d", in.imm);
+        continue;
+      }
+      if (op == KERN_BPF_EXIT)
+        continue;
+      int64_t target = (int64_t)pc + 1 + in.off;
+      if (target < 0 || target >= count)
+        return fail(pc, "jump out of range");
+      target_[target] = true;
+    }
+    for (uint32_t pc = 0; pc < count; pc++)
+      if (second[pc] && target_[pc])
+        return fail(pc, "jump into the middle of a wide load");
+    return true;
+  }
+
+  bool readable(uint32_t pc, const KernBPFReg &reg, uint8_t index) {
+    if (reg.type == KernBPFNotInit)
+      return fail(pc, "r%u is not initialised", index);
+    return true;
+  }
+
+  bool access(KernBPFState &state, const KernBPFReg &base, int64_t off,
+              uint32_t size, KernBPFAccess kind) {
+    uint32_t pc = state.pc;
+    int64_t at = (int64_t)base.value + off;
+    switch (base.type) {
+    case KernBPFPtrCtx:
+      if (kind != KernBPFRead)
+        return fail(pc, "the context is read only");
+      if (at < 0 || at + size > (int64_t)sizeof(KernBPFContext) ||
+          at % size != 0)
+        return fail(pc, "invalid context access at %lld", (long long)at);
+      return true;
+    case KernBPFPtrStack:
+      if (at < -KERN_BPF_STACK || at + size > 0)
+        return fail(pc, "stack access out of bounds at %lld", (long long)at);
+      if (kind == KernBPFAtomic && at % size != 0)
+        return fail(pc, "misaligned atomic");
+      if (kind == KernBPFWrite)
+        state.markStack(at, size);
+      else if (!state.stackWritten(at, size))
+        return fail(pc, "read of uninitialised stack at %lld",
+                    (long long)at);
+      return true;
+    case KernBPFPtrValue:
+      if (at < 0 || at + size > base.map->valueSize)
+        return fail(pc, "map value access out of bounds at %lld",
+                    (long long)at);
+      if (kind == KernBPFAtomic && at % size != 0)
+        return fail(pc, "misaligned atomic");
+      return true;
+    case KernBPFPtrValueOrNull:
+      return fail(pc, "possible NULL map value; compare it against 0 first");
+    default:
+      return fail(pc, "invalid memory access");
+    }
+  }
+
+  // Helper memory arguments: the stack or a map value, size bytes readable
+  bool region(KernBPFState &state, uint8_t index, uint32_t size) {
+    const KernBPFReg &reg = state.regs[index];
+    if (reg.type != KernBPFPtrStack && reg.type != KernBPFPtrValue)
+      return fail(state.pc, "r%u must point at the stack or a map value",
+                  index);
+    return access(state, reg, 0, size, KernBPFRead);
+  }
+
+  bool mapArg(KernBPFState &state, bool ring) {
+    const KernBPFReg &reg = state.regs[1];
+    if (reg.type != KernBPFPtrMap)
+      return fail(state.pc, "r1 must be a map");
+    if ((reg.map->type == KernBPFMapRingBuffer) != ring)
+      return fail(state.pc, ring ? "r1 must be a ring buffer"
+                                 : "ring buffers have no keys");
+    return true;
+  }
+
+  bool scalarArg(KernBPFState &state, uint8_t index) {
+    if (state.regs[index].type != KernBPFScalar)
+      return fail(state.pc, "r%u must be a scalar", index);
+    return true;
+  }
+
+  bool call(KernBPFState &state, int32_t helper) {
+    KernBPFReg result;
+    result.type = KernBPFScalar;
+    switch ((KernBPFHelper)helper) {
+    case KernBPFHelperMapLookup:
+      if (!mapArg(state, false) ||
+          !region(state, 2, state.regs[1].map->keySize))
+        return false;
+      result.type = KernBPFPtrValueOrNull;
+      result.map = state.regs[1].map;
+      break;
+    case KernBPFHelperMapUpdate:
+      if (!mapArg(state, false) ||
+          !region(state, 2, state.regs[1].map->keySize) ||
+          !region(state, 3, state.regs[1].map->valueSize) ||
+          !scalarArg(state, 4))
+        return false;
+      break;
+    case KernBPFHelperMapDelete:
+      if (!mapArg(state, false) ||
+          !region(state, 2, state.regs[1].map->keySize))
+        return false;
+      break;
+    case KernBPFHelperKtime:
+    case KernBPFHelperCurrentPID:
+    case KernBPFHelperCurrentCPU:
+      break;
+    case KernBPFHelperRingOutput: {
+      const KernBPFReg &size = state.regs[3];
+      if (!mapArg(state, true))
+        return false;
+      if (size.type != KernBPFScalar || !size.known || size.value == 0 ||
+          size.value > KERN_BPF_MAX_RECORD)
+        return fail(state.pc, "r3 must be a constant size up to %d",
+                    KERN_BPF_MAX_RECORD);
+      if (!region(state, 2, (uint32_t)size.value) || !scalarArg(state, 4))
+        return false;
+      break;
+    }
+    case KernBPFHelperLog2:
+      if (!scalarArg(state, 1))
+        return false;
+      break;
+    case KernBPFHelperCount:
+      return fail(state.pc, "unknown helper");
+    }
+    for (uint8_t r = 1; r <= 5; r++)
+      state.regs[r] = KernBPFReg();
+    state.regs[0] = result;
+    return true;
+  }
+
+  bool alu(KernBPFState &state, const KernBPFInsn &in) {
+    uint32_t pc = state.pc;
+    uint8_t op = in.code & 0xf0;
+    if (in.dst == 10)
+      return fail(pc, "r10 is read only");
+    KernBPFReg &dst = state.regs[in.dst];
+    KernBPFReg src;
+    if (in.code & KERN_BPF_X) {
+      src = state.regs[in.src];
+      if (!readable(pc, src, in.src))
+        return false;
+    } else {
+      src.type = KernBPFScalar;
+      src.known = true;
+      src.value = (uint64_t)(int64_t)in.imm;
+    }
+    if (op == KERN_BPF_MOV) {
+      dst = src;
+      return true;
+    }
+    if (!readable(pc, dst, in.dst))
+      return false;
+    if (op == KERN_BPF_NEG) {
+      if (dst.type != KernBPFScalar)
+        return fail(pc, "arithmetic on a pointer");
+      dst.value = dst.known ? -dst.value : 0;
+      return true;
+    }
+    if (dst.type == KernBPFPtrCtx || dst.type == KernBPFPtrStack ||
+        dst.type == KernBPFPtrValue) {
+      if ((op != KERN_BPF_ADD && op != KERN_BPF_SUB) ||
+          src.type != KernBPFScalar || !src.known)
+        return fail(pc, "pointers only move by constant offsets");
+      dst.value = KernBPFFold(op, dst.value, src.value);
+      if ((int64_t)dst.value < -(1 << 20) || (int64_t)dst.value > (1 << 20))
+        return fail(pc, "pointer offset out of range");
+      return true;
+    }
+    if (dst.type != KernBPFScalar)
+      return fail(pc, "arithmetic on a pointer");
+    if (src.type != KernBPFScalar)
+      return fail(pc, "pointer used as a scalar");
+    if (dst.known && src.known)
+      dst.value = KernBPFFold(op, dst.value, src.value);
+    else
+      dst = KernBPFReg{KernBPFScalar, false, 0, nullptr};
+    return true;
+  }
+
+  bool branch(KernBPFState &state, const KernBPFInsn &in,
+              std::vector<KernBPFState> &pending) {
+    uint32_t pc = state.pc;
+    uint8_t op = in.code & 0xf0;
+    uint32_t target = (uint32_t)((int64_t)pc + 1 + in.off);
+    KernBPFReg &dst = state.regs[in.dst];
+    if (!readable(pc, dst, in.dst))
+      return false;
+    KernBPFReg src;
+    if (in.code & KERN_BPF_X) {
+      src = state.regs[in.src];
+      if (!readable(pc, src, in.src))
+        return false;
+    } else {
+      src.type = KernBPFScalar;
+      src.known = true;
+      src.value = (uint64_t)(int64_t)in.imm;
+    }
+
+    // A lookup result compared against 0: NULL on one side, a value on the
+    // other
+    if (dst.type == KernBPFPtrValueOrNull && !(in.code & KERN_BPF_X) &&
+        in.imm == 0 && (op == KERN_BPF_JEQ || op == KERN_BPF_JNE)) {
+      KernBPFState other = state;
+      KernBPFReg null{KernBPFScalar, true, 0, nullptr};
+      KernBPFReg value{KernBPFPtrValue, false, 0, dst.map};
+      other.regs[in.dst] = op == KERN_BPF_JEQ ? null : value;
+      other.pc = target;
+      dst = op == KERN_BPF_JEQ ? value : null;
+      state.pc = pc + 1;
+      pending.push_back(std::move(other));
+      return true;
+    }
+    if (dst.type != KernBPFScalar || src.type != KernBPFScalar)
+      return fail(pc, "comparison involving a pointer");
+    if (dst.known && src.known) {
+      state.pc = KernBPFBranch(op, dst.value, src.value) ? target : pc + 1;
+      return true;
+    }
+    KernBPFState taken = state;
+    taken.pc = target;
+    if (op == KERN_BPF_JEQ && src.known)
+      taken.regs[in.dst] = src;
+    state.pc = pc + 1;
+    if (op == KERN_BPF_JNE && src.known)
+      dst = src;
+    pending.push_back(std::move(taken));
+    return true;
+  }
+
+  bool step(KernBPFState &state, std::vector<KernBPFState> &pending,
+            bool &done) {
+    const KernBPFInsn &in = prog_.insns[state.pc];
+    uint32_t pc = state.pc;
+    uint32_t size = KernBPFSizeBytes(in.code);
+    switch (in.code & 0x07) {
+    case KERN_BPF_ALU64:
+      if (!alu(state, in))
+        return false;
+      state.pc++;
+      return true;
+    case KERN_BPF_JMP:
+      switch (in.code & 0xf0) {
+      case KERN_BPF_JA:
+        state.pc = (uint32_t)((int64_t)pc + 1 + in.off);
+        return true;
+      case KERN_BPF_CALL:
+        if (!call(state, in.imm))
+          return false;
+        state.pc++;
+        return true;
+      case KERN_BPF_EXIT:
+        if (state.regs[0].type != KernBPFScalar)
+          return fail(pc, "r0 must be a scalar at exit");
+        done = true;
+        return true;
+      default:
+        return branch(state, in, pending);
+      }
+    case KERN_BPF_LDX: {
+      if (in.dst == 10)
+        return fail(pc, "r10 is read only");
+      const KernBPFReg base = state.regs[in.src];
+      if (!readable(pc, base, in.src) ||
+          !access(state, base, in.off, size, KernBPFRead))
+        return false;
+      state.regs[in.dst] = KernBPFReg{KernBPFScalar, false, 0, nullptr};
+      state.pc++;
+      return true;
+    }
+    case KERN_BPF_STX: {
+      const KernBPFReg base = state.regs[in.dst];
+      const KernBPFReg &value = state.regs[in.src];
+      if (!readable(pc, base, in.dst) || !readable(pc, value, in.src))
+        return false;
+      if (value.type != KernBPFScalar)
+        return fail(pc, "pointers cannot be stored");
+      bool atomic = (in.code & 0xe0) == KERN_BPF_XADD;
+      if (!access(state, base, in.off, size,
+                  atomic ? KernBPFAtomic : KernBPFWrite))
+        return false;
+      state.pc++;
+      return true;
+    }
+    case KERN_BPF_ST: {
+      const KernBPFReg base = state.regs[in.dst];
+      if (!readable(pc, base, in.dst) ||
+          !access(state, base, in.off, size, KernBPFWrite))
+        return false;
+      state.pc++;
+      return true;
+    }
+    case KERN_BPF_LD: {
+      if (in.dst == 10)
+        return fail(pc, "r10 is read only");
+      KernBPFReg &dst = state.regs[in.dst];
+      if (in.src == KERN_BPF_PSEUDO_MAP)
+        dst = KernBPFReg{KernBPFPtrMap, false, 0,
+                         (KernBPFMap *)(uintptr_t)prog_.wide[pc]};
+      else
+        dst = KernBPFReg{KernBPFScalar, true, prog_.wide[pc], nullptr};
+      state.pc += 2;
+      return true;
+    }
+    }
+    return fail(pc, "unknown opcode 0x%02x", in.code);
+  }
+};
+
+NSString *KernBPFMapTypeName(KernBPFMapType type) {
+  switch (type) {
+  case KernBPFMapHash:
+    return @"hash";
+  case KernBPFMapArray:
+    return @"array";
+  case KernBPFMapPerCPUArray:
+    return @"percpu_array";
+  case KernBPFMapRingBuffer:
+    return @"ringbuf";
+  }
+  return @"unknown";
+}
+
+} // namespace
+
+void KernBPFRun(KernTracepoint tp, const KernBPFContext *ctx) {
+  for (auto &slot : gBPFAttach[tp]) {
+    KernBPFProgram *prog = slot.load(std::memory_order_acquire);
+    if (prog)
+      KernBPFExecute(prog, ctx);
+  }
+}
+
+// ============================================================================
+// AdvancedKernel — Tracepoint Program Methods
+// ============================================================================
+
+@implementation AdvancedKernel (BPF)
+
+- (int32_t)createBPFMap:(KernBPFMapType)type
+                keySize:(uint32_t)keySize
+              valueSize:(uint32_t)valueSize
+             maxEntries:(uint32_t)maxEntries {
+  auto map = std::make_unique<KernBPFMap>();
+  map->type = type;
+  map->keySize = keySize;
+  map->valueSize = valueSize;
+  map->maxEntries = maxEntries;
+  map->stride = (valueSize + 7) & ~7u;
+  switch (type) {
+  case KernBPFMapHash:
+    if (keySize == 0 || keySize > KERN_BPF_MAX_KEY || valueSize == 0 ||
+        valueSize > KERN_BPF_MAX_VALUE || maxEntries == 0 ||
+        maxEntries > (1u << 20))
+      return -EINVAL;
+    map->capacity = 8;
+    while (map->capacity < maxEntries * 2)
+      map->capacity <<= 1;
+    map->states.reset(new std::atomic<uint32_t>[map->capacity]);
+    for (uint32_t i = 0; i < map->capacity; i++)
+      map->states[i].store(KernBPFSlotEmpty, std::memory_order_relaxed);
+    map->hashes.reset(new uint32_t[map->capacity]());
+    map->keys.reset(new uint8_t[(size_t)map->capacity * keySize]());
+    map->values.reset(new uint8_t[(size_t)map->capacity * map->stride]());
+    break;
+  case KernBPFMapArray:
+  case KernBPFMapPerCPUArray: {
+    if (keySize != sizeof(uint32_t) || valueSize == 0 ||
+        valueSize > KERN_BPF_MAX_VALUE || maxEntries == 0 ||
+        maxEntries > (1u << 20))
+      return -EINVAL;
+    size_t copies = type == KernBPFMapPerCPUArray ? KERN_BPF_MAX_CPUS : 1;
+    map->values.reset(
+        new uint8_t[copies * maxEntries * (size_t)map->stride]());
+    break;
+  }
+  case KernBPFMapRingBuffer:
+    if (keySize != 0 || valueSize != 0 || maxEntries < 4096 ||
+        maxEntries > (1u << 24) || (maxEntries & (maxEntries - 1)))
+      return -EINVAL;
+    map->values.reset(new uint8_t[maxEntries]());
+    break;
+  default:
+    return -EINVAL;
+  }
+  std::lock_guard<std::mutex> guard(gBPFLock);
+  if (gBPFMaps.size() >= KERN_BPF_MAX_OBJECTS)
+    return -EMFILE;
+  map->id = (int32_t)gBPFMaps.size() + 1;
+  gBPFMaps.push_back(std::move(map));
+  return gBPFMaps.back()->id;
+}
+
+- (int32_t)loadBPFProgram:(NSData *)instructions
+                      log:(NSString *__autoreleasing *)log {
+  if (log)
+    *log = @"";
+  if (instructions.length == 0 ||
+      instructions.length % sizeof(KernBPFInsn) != 0)
+    return -EINVAL;
+  size_t count = instructions.length / sizeof(KernBPFInsn);
+  if (count > KERN_BPF_MAX_INSNS)
+    return -E2BIG;
+  auto prog = std::make_unique<KernBPFProgram>();
+  prog->insns.resize(count);
+  memcpy(prog->insns.data(), instructions.bytes, instructions.length);
+
+  std::lock_guard<std::mutex> guard(gBPFLock);
+  if (gBPFPrograms.size() >= KERN_BPF_MAX_OBJECTS)
+    return -EMFILE;
+  KernBPFVerifier verifier(*prog);
+  if (!verifier.verify()) {
+    if (log)
+      *log = @(verifier.log().c_str());
+    KERN_LOG(KernLogNotice, KernLogKernel,
+             "bpf: program rejected after %u verifier steps", prog->processed);
+    return -EINVAL;
+  }
+  KernBPFExecute(prog.get(), nullptr);
+  prog->id = (int32_t)gBPFPrograms.size() + 1;
+  if (log)
+    *log = [NSString stringWithFormat:@"verified %zu instructions in %u steps",
+                                      count, prog->processed];
+  gBPFPrograms.push_back(std::move(prog));
+  return gBPFPrograms.back()->id;
+}
+
+- (int32_t)attachBPFProgram:(int32_t)program toTracepoint:(KernTracepoint)tp {
+  if ((NSUInteger)tp >= KernTracepointCount)
+    return -EINVAL;
+  std::lock_guard<std::mutex> guard(gBPFLock);
+  KernBPFProgram *prog = KernBPFFindProgram(program);
+  if (!prog)
+    return -ENOENT;
+  if (prog->attached & (1u << tp))
+    return -EEXIST;
+  for (auto &slot : gBPFAttach[tp]) {
+    if (slot.load(std::memory_order_relaxed))
+      continue;
+    slot.store(prog, std::memory_order_release);
+    prog->attached |= 1u << tp;
+    gKernBPFAttached[tp].fetch_add(1, std::memory_order_relaxed);
+    KernStaticKeyEnable(gKernTraceKeys[tp]);
+    return 0;
+  }
+  return -ENOSPC;
+}
+
+- (int32_t)detachBPFProgram:(int32_t)program
+             fromTracepoint:(KernTracepoint)tp {
+  if ((NSUInteger)tp >= KernTracepointCount)
+    return -EINVAL;
+  std::lock_guard<std::mutex> guard(gBPFLock);
+  KernBPFProgram *prog = KernBPFFindProgram(program);
+  if (!prog)
+    return -ENOENT;
+  if (!(prog->attached & (1u << tp)))
+    return -ENOENT;
+  for (auto &slot : gBPFAttach[tp]) {
+    if (slot.load(std::memory_order_relaxed) != prog)
+      continue;
+    slot.store(nullptr, std::memory_order_release);
+    break;
+  }
+  prog->attached &= ~(1u << tp);
+  gKernBPFAttached[tp].fetch_sub(1, std::memory_order_relaxed);
+  KernStaticKeyDisable(gKernTraceKeys[tp]);
+  return 0;
+}
+
+- (NSData *)lookupBPFMap:(int32_t)map key:(NSData *)key {
+  KernBPFMap *object;
+  {
+    std::lock_guard<std::mutex> guard(gBPFLock);
+    object = KernBPFFindMap(map);
+  }
+  if (!object || object->type == KernBPFMapRingBuffer ||
+      key.length != object->keySize)
+    return nil;
+  if (object->type == KernBPFMapPerCPUArray) {
+    if (!KernBPFMapLookup(object, (const uint8_t *)key.bytes, 0))
+      return nil;
+    NSMutableData *values = [NSMutableData data];
+    for (uint64_t cpu = 0; cpu < KERN_BPF_MAX_CPUS; cpu++)
+      [values appendBytes:KernBPFMapLookup(object, (const uint8_t *)key.bytes,
+                                           cpu)
+                   length:object->valueSize];
+    return values;
+  }
+  uint8_t *value = KernBPFMapLookup(object, (const uint8_t *)key.bytes, 0);
+  return value ? [NSData dataWithBytes:value length:object->valueSize] : nil;
+}
+
+- (int32_t)updateBPFMap:(int32_t)map
+                    key:(NSData *)key
+                  value:(NSData *)value
+                  flags:(uint64_t)flags {
+  KernBPFMap *object;
+  {
+    std::lock_guard<std::mutex> guard(gBPFLock);
+    object = KernBPFFindMap(map);
+  }
+  if (!object)
+    return -ENOENT;
+  if (object->type == KernBPFMapRingBuffer || key.length != object->keySize ||
+      value.length != object->valueSize)
+    return -EINVAL;
+  if (object->type != KernBPFMapPerCPUArray)
+    return (int32_t)KernBPFMapUpdate(object, (const uint8_t *)key.bytes,
+                                     (const uint8_t *)value.bytes, flags, 0);
+  for (uint64_t cpu = 0; cpu < KERN_BPF_MAX_CPUS; cpu++) {
+    int64_t ret = KernBPFMapUpdate(object, (const uint8_t *)key.bytes,
+                                   (const uint8_t *)value.bytes, flags, cpu);
+    if (ret < 0)
+      return (int32_t)ret;
+  }
+  return 0;
+}
+
+- (int32_t)deleteBPFMap:(int32_t)map key:(NSData *)key {
+  KernBPFMap *object;
+  {
+    std::lock_guard<std::mutex> guard(gBPFLock);
+    object = KernBPFFindMap(map);
+  }
+  if (!object)
+    return -ENOENT;
+  if (key.length != object->keySize)
+    return -EINVAL;
+  return (int32_t)KernBPFMapDelete(object, (const uint8_t *)key.bytes);
+}
+
+- (NSDictionary<NSData *, NSData *> *)dumpBPFMap:(int32_t)map {
+  KernBPFMap *object;
+  {
+    std::lock_guard<std::mutex> guard(gBPFLock);
+    object = KernBPFFindMap(map);
+  }
+  if (!object || object->type == KernBPFMapRingBuffer)
+    return @{};
+  NSMutableDictionary<NSData *, NSData *> *entries =
+      [NSMutableDictionary dictionary];
+  if (object->type == KernBPFMapHash) {
+    std::lock_guard<std::mutex> guard(object->lock);
+    for (uint32_t slot = 0; slot < object->capacity; slot++) {
+      if (object->states[slot].load(std::memory_order_relaxed) !=
+          KernBPFSlotUsed)
+        continue;
+      NSData *key = [NSData dataWithBytes:object->keyAt(slot)
+                                   length:object->keySize];
+      entries[key] = [NSData dataWithBytes:object->valueAt(slot)
+                                    length:object->valueSize];
+    }
+    return entries;
+  }
+  for (uint32_t index = 0; index < object->maxEntries; index++) {
+    NSData *key = [NSData dataWithBytes:&index length:sizeof(index)];
+    entries[key] = [self lookupBPFMap:map key:key];
+  }
+  return entries;
+}
+
+- (NSArray<NSData *> *)readBPFRingBuffer:(int32_t)map
+                                 maximum:(NSUInteger)maximum {
+  KernBPFMap *object;
+  {
+    std::lock_guard<std::mutex> guard(gBPFLock);
+    object = KernBPFFindMap(map);
+  }
+  if (!object || object->type != KernBPFMapRingBuffer)
+    return @[];
+  NSMutableArray<NSData *> *records = [NSMutableArray array];
+  std::lock_guard<KernBPFSpinLock> guard(object->ringLock);
+  uint64_t mask = object->maxEntries - 1;
+  while (records.count < maximum && object->tail != object->head) {
+    uint64_t size;
+    memcpy(&size, object->values.get() + (object->tail & mask), sizeof(size));
+    NSMutableData *record = [NSMutableData dataWithLength:size];
+    uint64_t start = (object->tail + 8) & mask;
+    uint64_t first = std::min<uint64_t>(size, object->maxEntries - start);
+    memcpy(record.mutableBytes, object->values.get() + start, first);
+    memcpy((uint8_t *)record.mutableBytes + first, object->values.get(),
+           size - first);
+    object->tail += 8 + ((size + 7) & ~7ULL);
+    [records addObject:record];
+  }
+  return records;
+}
+
+- (NSDictionary *)bpfStatistics {
+  NSArray<NSString *> *tracepoints = [self tracepointNames];
+  NSMutableArray *maps = [NSMutableArray array];
+  NSMutableArray *programs = [NSMutableArray array];
+  std::lock_guard<std::mutex> guard(gBPFLock);
+  for (const auto &map : gBPFMaps) {
+    NSMutableDictionary *info = [@{
+      @"id" : @(map->id),
+      @"type" : KernBPFMapTypeName(map->type),
+      @"key_size" : @(map->keySize),
+      @"value_size" : @(map->valueSize),
+      @"max_entries" : @(map->maxEntries)
+    } mutableCopy];
+    if (map->type == KernBPFMapHash) {
+      std::lock_guard<std::mutex> mapGuard(map->lock);
+      info[@"entries"] = @(map->count);
+    } else if (map->type == KernBPFMapRingBuffer) {
+      std::lock_guard<KernBPFSpinLock> ringGuard(map->ringLock);
+      info[@"pending_bytes"] = @(map->head - map->tail);
+      info[@"dropped"] = @(map->dropped);
+    }
+    [maps addObject:info];
+  }
+  for (const auto &prog : gBPFPrograms) {
+    NSMutableArray *attached = [NSMutableArray array];
+    for (NSUInteger tp = 0; tp < KernTracepointCount; tp++)
+      if (prog->attached & (1u << tp))
+        [attached addObject:tracepoints[tp]];
+    [programs addObject:@{
+      @"id" : @(prog->id),
+      @"instructions" : @(prog->insns.size()),
+      @"verifier_steps" : @(prog->processed),
+      @"attached" : attached
+    }];
+  }
+  return @{@"maps" : maps, @"programs" : programs};
+}
+
+@end
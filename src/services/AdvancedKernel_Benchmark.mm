@@ -0,0 +1,1587 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Kernel Microbenchmarks
+// ============================================================================
+//
+// Each benchmark drives the same workload through the interfaces it compares
+// and reports throughput in operations per second. Timing uses the monotonic
+// mach clock; results are only meaningful relative to each other.
+
+static double KernBenchSeconds(uint64_t start, uint64_t end) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info(&timebase);
+  });
+  return (double)(end - start) * timebase.numer / timebase.denom / 1e9;
+}
+
+static double KernBenchRate(NSUInteger operations, double seconds) {
+  return seconds > 0 ? operations / seconds : 0;
+}
+
+@implementation AdvancedKernel (Benchmark)
+
+// Mixed 40% write / 40% read / 20% futex-wake workload, issued one syscall
+// at a time and then in batches through a submission ring.
+- (NSDictionary *)benchmarkSyscallRings:(NSUInteger)operations {
+  const uint32_t batch = 256;
+  KernFileDescriptor *file = [self openFile:@"/tmp/.io_uring_bench"
+                                      flags:0x0200 | 0x0002 // O_CREAT|O_RDWR
+                                       mode:0644];
+  if (!file || operations == 0)
+    return @{};
+
+  char buffer[64];
+  memset(buffer, 'k', sizeof(buffer));
+  uint32_t futexWord = 0;
+
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < operations; i++) {
+    switch (i % 5) {
+    case 0:
+    case 1:
+      [self executeSyscall:KSYS_WRITE
+                      args:@[ @(file.fd), @((uintptr_t)buffer), @(64) ]];
+      break;
+    case 2:
+    case 3:
+      [self executeSyscall:KSYS_READ
+                      args:@[ @(file.fd), @((uintptr_t)buffer), @(64) ]];
+      break;
+    default:
+      [self executeSyscall:KSYS_FUTEX
+                      args:@[ @((uintptr_t)&futexWord), @1, @1 ]];
+      break;
+    }
+  }
+  double perCallSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  KernIORing *ring = [self ioRingSetup:batch forProcess:1];
+  if (!ring) {
+    [self closeFile:file];
+    return @{};
+  }
+  KernRingCQE cqes[batch];
+  start = mach_absolute_time();
+  for (NSUInteger done = 0; done < operations;) {
+    uint32_t count = (uint32_t)MIN((NSUInteger)batch, operations - done);
+    for (uint32_t i = 0; i < count; i++) {
+      KernRingSQE *sqe = [self ioRingGetSQE:ring];
+      if (!sqe) {
+        count = i;
+        break;
+      }
+      switch ((done + i) % 5) {
+      case 0:
+      case 1:
+        sqe->opcode = KernRingOpWrite;
+        break;
+      case 2:
+      case 3:
+        sqe->opcode = KernRingOpRead;
+        break;
+      default:
+        sqe->opcode = KernRingOpFutexWake;
+        break;
+      }
+      sqe->fd = file.fd;
+      if (sqe->opcode == KernRingOpFutexWake) {
+        sqe->addr = (uintptr_t)&futexWord;
+        sqe->len = 1;
+      } else {
+        sqe->addr = (uintptr_t)buffer;
+        sqe->len = 64;
+      }
+      sqe->userData = done + i;
+    }
+    if (!count)
+      break;
+    [self ioRingEnter:ring toSubmit:count minComplete:count];
+    for (uint32_t reaped = 0; reaped < count;)
+      reaped += [self ioRingReapCompletions:ring
+                                       into:cqes
+                                        max:count - reaped];
+    done += count;
+  }
+  double ringSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  [self ioRingDestroy:ring];
+  [self closeFile:file];
+
+  double perCallRate = KernBenchRate(operations, perCallSeconds);
+  double ringRate = KernBenchRate(operations, ringSeconds);
+  return @{
+    @"operations" : @(operations),
+    @"batch_size" : @(batch),
+    @"percall_ops_per_sec" : @(perCallRate),
+    @"ring_ops_per_sec" : @(ringRate),
+    @"speedup" : @(perCallRate > 0 ? ringRate / perCallRate : 0)
+  };
+}
+
+// getpid through the raw table, the boxed executeSyscall:args: shim, and the
+// shim with tracing on (the old path formatted a trace line on every call).
+- (NSDictionary *)benchmarkSyscallDispatch:(NSUInteger)iterations {
+  if (iterations == 0)
+    return @{};
+  BOOL wasTracing = [self isSyscallTracingEnabled];
+  [self setSyscallTracingEnabled:NO];
+
+  uint64_t args[KERN_SYSCALL_MAX_ARGS] = {0};
+  volatile int64_t sink = 0;
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++)
+    sink += [self invokeSyscall:KSYS_GETPID args:args];
+  double tableSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++) {
+    @autoreleasepool {
+      sink += [self executeSyscall:KSYS_GETPID args:@[]].returnValue;
+    }
+  }
+  double boxedSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  [self setSyscallTracingEnabled:YES];
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++) {
+    @autoreleasepool {
+      sink += [self executeSyscall:KSYS_GETPID args:@[]].returnValue;
+    }
+  }
+  double tracedSeconds = KernBenchSeconds(start, mach_absolute_time());
+  [self setSyscallTracingEnabled:wasTracing];
+  (void)sink;
+
+  double tableNs = tableSeconds * 1e9 / iterations;
+  double boxedNs = boxedSeconds * 1e9 / iterations;
+  double tracedNs = tracedSeconds * 1e9 / iterations;
+  return @{
+    @"iterations" : @(iterations),
+    @"table_ns_per_call" : @(tableNs),
+    @"boxed_ns_per_call" : @(boxedNs),
+    @"boxed_traced_ns_per_call" : @(tracedNs),
+    @"speedup_vs_boxed" : @(tableNs > 0 ? boxedNs / tableNs : 0),
+    @"speedup_vs_traced" : @(tableNs > 0 ? tracedNs / tableNs : 0)
+  };
+}
+
+// getpid and a non-creating open() predicate check from an unfiltered
+// process, then from one running under a two-deep filter stack.
+- (NSDictionary *)benchmarkSyscallFilter:(NSUInteger)iterations {
+  if (iterations == 0)
+    return @{};
+  KernProcess *proc = [self createProcess:@"seccomp-bench"
+                           executablePath:@""
+                                arguments:@[]
+                                parentPID:0];
+  KernSandboxProfile *outer = [self createSandboxProfile:@"bench-outer"];
+  outer.deniedSyscalls = @[ @"reboot", @"mount", @"umount" ];
+  KernSandboxProfile *inner = [self createSandboxProfile:@"bench-inner"];
+  inner.allowedSyscalls = @[ @"getpid", @"read", @"write", @"close", @"open" ];
+
+  uint32_t savedPID = [self currentPID];
+  uint64_t args[KERN_SYSCALL_MAX_ARGS] = {0};
+  volatile int64_t sink = 0;
+  double seconds[2];
+  for (int filtered = 0; filtered < 2; filtered++) {
+    if (filtered) {
+      [self applySandbox:outer toProcess:proc.pid];
+      [self applySandbox:inner toProcess:proc.pid];
+      [self setCurrentPID:proc.pid];
+    }
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger i = 0; i < iterations; i++)
+      sink += [self invokeSyscall:KSYS_GETPID args:args];
+    seconds[filtered] = KernBenchSeconds(start, mach_absolute_time());
+  }
+  // O_CREAT is rejected by the profile's open() argument predicate
+  uint64_t creat[KERN_SYSCALL_MAX_ARGS] = {
+      (uintptr_t)"/tmp/.seccomp_bench", 0x0200};
+  int64_t creatResult = [self invokeSyscall:KSYS_OPEN args:creat];
+
+  [self setCurrentPID:savedPID];
+  [self terminateProcess:proc.pid exitCode:0];
+  (void)sink;
+
+  double unfilteredRate = KernBenchRate(iterations, seconds[0]);
+  double filteredRate = KernBenchRate(iterations, seconds[1]);
+  return @{
+    @"iterations" : @(iterations),
+    @"filter_depth" : @2,
+    @"unfiltered_ops_per_sec" : @(unfilteredRate),
+    @"filtered_ops_per_sec" : @(filteredRate),
+    @"filter_ns_per_call" : @(seconds[1] > seconds[0]
+                                  ? (seconds[1] - seconds[0]) * 1e9 / iterations
+                                  : 0),
+    @"create_rejected" : @(creatResult == -EACCES)
+  };
+}
+
+// Random stats over a tree of `files` files spread across 100-entry
+// directories. One lookup in eight probes a name that does not exist.
+- (NSDictionary *)benchmarkDentryCache:(NSUInteger)files
+                               lookups:(NSUInteger)lookups {
+  if (files == 0 || lookups == 0)
+    return @{};
+  NSString *base = @"/tmp/dcache-bench";
+  [self createDirectory:base mode:0755];
+  NSUInteger dirs = (files + 99) / 100;
+  NSMutableArray<NSString *> *paths =
+      [NSMutableArray arrayWithCapacity:files];
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger d = 0; d < dirs; d++) {
+    NSString *dir =
+        [NSString stringWithFormat:@"%@/d%lu", base, (unsigned long)d];
+    [self createDirectory:dir mode:0755];
+    for (NSUInteger f = 0; f < 100 && paths.count < files; f++) {
+      NSString *path =
+          [NSString stringWithFormat:@"%@/f%lu", dir, (unsigned long)f];
+      [self createFile:path mode:0644];
+      [paths addObject:path];
+    }
+  }
+  double populateSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSMutableArray<NSString *> *missing = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 1024; i++)
+    [missing addObject:[paths[i % files] stringByAppendingString:@".missing"]];
+
+  NSDictionary *before = [self dentryCacheStatistics];
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  NSUInteger found = 0;
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < lookups; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    NSString *path = (seed & 7) == 0 ? missing[(seed >> 3) & 1023]
+                                     : paths[(seed >> 3) % files];
+    if ([self lookupPath:path])
+      found++;
+  }
+  double lookupSeconds = KernBenchSeconds(start, mach_absolute_time());
+  NSDictionary *after = [self dentryCacheStatistics];
+
+  [self deleteInode:base];
+  [self shrinkDentryCache:NSUIntegerMax];
+
+  uint64_t hits = [after[@"hits"] unsignedLongLongValue] -
+                  [before[@"hits"] unsignedLongLongValue];
+  uint64_t negativeHits = [after[@"negative_hits"] unsignedLongLongValue] -
+                          [before[@"negative_hits"] unsignedLongLongValue];
+  uint64_t misses = [after[@"misses"] unsignedLongLongValue] -
+                    [before[@"misses"] unsignedLongLongValue];
+  return @{
+    @"files" : @(files),
+    @"lookups" : @(lookups),
+    @"found" : @(found),
+    @"populate_seconds" : @(populateSeconds),
+    @"lookups_per_sec" : @(KernBenchRate(lookups, lookupSeconds)),
+    @"ns_per_lookup" : @(lookupSeconds * 1e9 / lookups),
+    @"component_hits" : @(hits),
+    @"negative_hits" : @(negativeHits),
+    @"component_misses" : @(misses),
+    @"dcache_entries" : after[@"entries"]
+  };
+}
+
+// Replays sequential, random and 8-page strided 4 KB read traces over a
+// 16 MB file, with a cold cache each time, once straight through the page
+// cache and once through readFD: with readahead. Device ops count batched
+// backing-store reads; readahead pages land asynchronously, so the last few
+// may complete after the counters are sampled.
+- (NSDictionary *)benchmarkReadahead:(NSUInteger)reads {
+  const uint64_t filePages = 4096;
+  if (reads == 0)
+    return @{};
+  KernFileDescriptor *file = [self openFile:@"/tmp/readahead-bench"
+                                      flags:0x0200 | 0x0002 // O_CREAT|O_RDWR
+                                       mode:0644];
+  if (!file)
+    return @{};
+  KernInode *inode = file.inode;
+  NSMutableData *chunk = [NSMutableData dataWithLength:64 * 1024];
+  memset(chunk.mutableBytes, 'r', chunk.length);
+  for (uint64_t off = 0; off < filePages * KERN_PAGE_SIZE; off += chunk.length)
+    [self pageCacheWrite:inode from:chunk.bytes length:chunk.length offset:off];
+  [self writebackInode:inode];
+
+  NSArray<NSString *> *traces = @[ @"sequential", @"random", @"strided" ];
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  uint8_t buffer[KERN_PAGE_SIZE];
+  for (NSUInteger trace = 0; trace < traces.count; trace++) {
+    NSMutableDictionary *report = [NSMutableDictionary dictionary];
+    for (int readahead = 0; readahead < 2; readahead++) {
+      [self invalidateInodePages:inode];
+      file.readahead = nil;
+      NSDictionary *before = [self pageCacheStatistics];
+      uint64_t seed = 0x9e3779b97f4a7c15ULL;
+      uint64_t start = mach_absolute_time();
+      for (NSUInteger i = 0; i < reads; i++) {
+        uint64_t page;
+        if (trace == 0) {
+          page = i % filePages;
+        } else if (trace == 1) {
+          seed ^= seed << 13;
+          seed ^= seed >> 7;
+          seed ^= seed << 17;
+          page = seed % filePages;
+        } else {
+          page = (i * 8) % filePages;
+        }
+        if (readahead)
+          [self readFD:file.fd
+                  into:buffer
+                length:sizeof(buffer)
+                offset:page * KERN_PAGE_SIZE];
+        else
+          [self pageCacheRead:inode
+                         into:buffer
+                       length:sizeof(buffer)
+                       offset:page * KERN_PAGE_SIZE];
+      }
+      double seconds = KernBenchSeconds(start, mach_absolute_time());
+      NSDictionary *after = [self pageCacheStatistics];
+
+      uint64_t hits = [after[@"hits"] unsignedLongLongValue] -
+                      [before[@"hits"] unsignedLongLongValue];
+      uint64_t misses = [after[@"misses"] unsignedLongLongValue] -
+                        [before[@"misses"] unsignedLongLongValue];
+      uint64_t deviceOps = [after[@"device_reads"] unsignedLongLongValue] -
+                           [before[@"device_reads"] unsignedLongLongValue];
+      NSString *mode = readahead ? @"readahead" : @"no_readahead";
+      report[mode] = @{
+        @"hit_rate" : @(hits + misses ? (double)hits / (hits + misses) : 0),
+        @"device_ops" : @(deviceOps),
+        @"reads_per_sec" : @(KernBenchRate(reads, seconds))
+      };
+    }
+    results[traces[trace]] = report;
+  }
+
+  [self closeFile:file];
+  [self deleteInode:@"/tmp/readahead-bench"];
+  results[@"reads"] = @(reads);
+  results[@"file_pages"] = @(filePages);
+  return results;
+}
+
+// Four concurrent streams on a RAM-backed device under each scheduler:
+// an interactive cgroup issuing sequential reads as plugs of single-block
+// bios (merged into one request) and random single-block reads, against a
+// bulk cgroup writing 64-block sequential and 16-block random runs.
+- (NSDictionary *)benchmarkBlockLayer:(NSUInteger)requests {
+  const uint64_t blocks = 1 << 18; // 1 GB
+  const uint32_t maxRun = 64;
+  if (requests == 0)
+    return @{};
+  KernProcess *interactive = [self createProcess:@"blk-interactive"
+                                  executablePath:@""
+                                       arguments:@[]
+                                       parentPID:0];
+  KernProcess *bulk = [self createProcess:@"blk-bulk"
+                           executablePath:@""
+                                arguments:@[]
+                                parentPID:0];
+  KernCgroup *fg = [self createCgroup:@"blk-bench-fg" parent:nil];
+  KernCgroup *bg = [self createCgroup:@"blk-bench-bg" parent:nil];
+  fg.ioWeight = 300;
+  [self addProcess:interactive.pid toCgroup:fg];
+  [self addProcess:bulk.pid toCgroup:bg];
+
+  // Blocks cannot capture arrays; streams index through these pointers
+  NSMutableData *memory =
+      [NSMutableData dataWithLength:4 * maxRun * KERN_PAGE_SIZE];
+  uint8_t *table[4 * maxRun];
+  for (uint32_t i = 0; i < 4 * maxRun; i++)
+    table[i] = (uint8_t *)memory.mutableBytes + i * KERN_PAGE_SIZE;
+  uint8_t **pages = table;
+
+  NSArray<NSString *> *streams =
+      @[ @"seq_read", @"random_read", @"seq_write", @"random_write" ];
+  const KernIOScheduler schedulers[] = {
+      KernIOSchedulerNone, KernIOSchedulerDeadline, KernIOSchedulerBFQ};
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  for (KernIOScheduler scheduler : schedulers) {
+    NSString *name =
+        [NSString stringWithFormat:@"blk-bench%ld", (long)scheduler];
+    KernBlockDevice *dev = [self createBlockDevice:name
+                                          hostPath:nil
+                                            blocks:blocks
+                                         scheduler:scheduler];
+    double latency[8] = {0};
+    double *latencyUs = latency;
+    double *maxUs = latency + 4;
+    uint64_t start = mach_absolute_time();
+    dispatch_apply(4, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                   ^(size_t s) {
+      uint32_t savedPID = [self currentPID];
+      [self setCurrentPID:s < 2 ? interactive.pid : bulk.pid];
+      uint64_t seed = 0x9e3779b97f4a7c15ULL * (s + 1);
+      uint8_t **buffers = pages + s * maxRun;
+      for (NSUInteger r = 0; r < requests; r++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        KernBlockIO ios[8];
+        size_t count = 1;
+        bool write = s >= 2;
+        if (s == 0) {
+          count = 8;
+          for (size_t i = 0; i < count; i++)
+            ios[i] = {(r * 8 + i) % blocks, 1, buffers + i};
+        } else if (s == 1) {
+          ios[0] = {seed % blocks, 1, buffers};
+        } else if (s == 2) {
+          ios[0] = {(blocks / 2 + r * maxRun) % (blocks - maxRun), maxRun,
+                    buffers};
+        } else {
+          ios[0] = {seed % (blocks - 16), 16, buffers};
+        }
+        uint64_t t0 = mach_absolute_time();
+        KernBlockRW(dev, write, ios, count);
+        double us = KernBenchSeconds(t0, mach_absolute_time()) * 1e6;
+        latencyUs[s] += us;
+        maxUs[s] = MAX(maxUs[s], us);
+      }
+      [self setCurrentPID:savedPID];
+    });
+    double seconds = KernBenchSeconds(start, mach_absolute_time());
+
+    NSMutableDictionary *report =
+        [[self blockDeviceStatistics:dev] mutableCopy];
+    for (int s = 0; s < 4; s++)
+      report[streams[s]] = @{
+        @"avg_latency_us" : @(latencyUs[s] / requests),
+        @"max_latency_us" : @(maxUs[s])
+      };
+    report[@"seconds"] = @(seconds);
+    report[@"submissions_per_sec"] = @(KernBenchRate(requests * 4, seconds));
+    results[report[@"scheduler"]] = report;
+    [self removeBlockDevice:dev];
+  }
+
+  [self terminateProcess:interactive.pid exitCode:0];
+  [self terminateProcess:bulk.pid exitCode:0];
+  results[@"submissions_per_stream"] = @(requests);
+  return results;
+}
+
+// Descriptor churn in a process holding 1000 descriptors with every
+// fourth one closed, so allocation has holes to find: dup/close pairs,
+// lookups by number, and full path open/close for comparison. Each dup and
+// each close counts as one operation.
+- (NSDictionary *)benchmarkFileTable:(NSUInteger)operations {
+  const int32_t populated = 1000;
+  if (operations < 2)
+    return @{};
+  KernProcess *proc = [self createProcess:@"fdtable-bench"
+                           executablePath:@""
+                                arguments:@[]
+                                parentPID:0];
+  uint32_t savedPID = [self currentPID];
+  [self setCurrentPID:proc.pid];
+  KernFileDescriptor *file = [self openFile:@"/tmp/.fdtable_bench"
+                                      flags:0x0200 | 0x0002 // O_CREAT|O_RDWR
+                                       mode:0644];
+  if (!file) {
+    [self setCurrentPID:savedPID];
+    [self terminateProcess:proc.pid exitCode:0];
+    return @{};
+  }
+  for (int32_t i = 0; i < populated; i++)
+    [self dupFD:file.fd minimum:0 closeOnExec:NO];
+  for (int32_t fd = file.fd + 4; fd < file.fd + populated; fd += 4)
+    [self closeFD:fd];
+
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < operations / 2; i++)
+    [self closeFD:[self dupFD:file.fd minimum:0 closeOnExec:NO]];
+  double churnSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  volatile uintptr_t sink = 0;
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < operations; i++)
+    sink += (uintptr_t)(__bridge void *)[self
+        fileDescriptorForNumber:file.fd + (int32_t)(i % populated)];
+  double lookupSeconds = KernBenchSeconds(start, mach_absolute_time());
+  (void)sink;
+
+  NSUInteger opens = MAX(operations / 100, (NSUInteger)1);
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < opens; i++)
+    [self closeFile:[self openFile:@"/tmp/.fdtable_bench"
+                             flags:0x0002 // O_RDWR
+                              mode:0]];
+  double openSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSDictionary *results = @{
+    @"operations" : @(operations),
+    @"dup_close_ops_per_sec" :
+        @(KernBenchRate(operations / 2 * 2, churnSeconds)),
+    @"lookups_per_sec" : @(KernBenchRate(operations, lookupSeconds)),
+    @"open_close_per_sec" : @(KernBenchRate(opens * 2, openSeconds)),
+    @"open_descriptors" : @(proc.fdTable.openCount),
+    @"table_capacity" : @(proc.fdTable.capacity)
+  };
+  [self setCurrentPID:savedPID];
+  [self terminateProcess:proc.pid exitCode:0];
+  [self deleteInode:@"/tmp/.fdtable_bench"];
+  return results;
+}
+
+// Scans a file of the given size (1 GB is the reference run) by read(2)
+// into a 128 KB buffer and through a shared mapping, summing every word.
+// Cold passes start with the file's pages dropped from the cache; the warm
+// mmap pass maps afresh, so every page still takes a minor fault, and the
+// resident pass rescans a mapping whose pages are already present.
+- (NSDictionary *)benchmarkMmapScan:(uint64_t)bytes {
+  const NSUInteger chunk = 128 * 1024;
+  bytes = bytes / KERN_PAGE_SIZE * KERN_PAGE_SIZE;
+  if (bytes == 0)
+    return @{};
+  KernProcess *proc = [self createProcess:@"mmap-bench"
+                           executablePath:@""
+                                arguments:@[]
+                                parentPID:0];
+  uint32_t savedPID = [self currentPID];
+  [self setCurrentPID:proc.pid];
+  KernFileDescriptor *file = [self openFile:@"/tmp/.mmap_bench"
+                                      flags:0x0200 | 0x0002 // O_CREAT|O_RDWR
+                                       mode:0644];
+  if (!file) {
+    [self setCurrentPID:savedPID];
+    [self terminateProcess:proc.pid exitCode:0];
+    return @{};
+  }
+  KernInode *inode = file.inode;
+  NSMutableData *buffer = [NSMutableData dataWithLength:chunk];
+  uint64_t *words = (uint64_t *)buffer.mutableBytes;
+  for (uint64_t off = 0; off < bytes; off += chunk) {
+    for (NSUInteger w = 0; w < chunk / sizeof(uint64_t); w++)
+      words[w] = off + w * sizeof(uint64_t);
+    [self writeFD:file.fd
+             from:words
+           length:(NSUInteger)MIN((uint64_t)chunk, bytes - off)
+           offset:off];
+  }
+  [self writebackInode:inode];
+
+  __block uint64_t sum = 0;
+  void (^sumWords)(uint8_t *, NSUInteger) = ^(uint8_t *data, NSUInteger n) {
+    const uint64_t *p = (const uint64_t *)data;
+    for (NSUInteger w = 0; w < n / sizeof(uint64_t); w++)
+      sum += p[w];
+  };
+  NSArray<NSString *> *passes =
+      @[ @"read_cold", @"read_warm", @"mmap_cold", @"mmap_warm",
+         @"mmap_resident" ];
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  uint64_t mapped = 0;
+  uint64_t expected = 0;
+  BOOL match = YES;
+  for (NSUInteger pass = 0; pass < passes.count; pass++) {
+    BOOL viaMmap = pass >= 2;
+    if (viaMmap && pass != 4) {
+      if (mapped)
+        [self munmapForProcess:proc.pid address:mapped length:bytes];
+      mapped = 0;
+    }
+    if (pass == 0 || pass == 2)
+      [self invalidateInodePages:inode];
+    file.readahead = nil;
+    if (viaMmap && !mapped) {
+      int64_t addr = [self mmapFD:file.fd
+                       forProcess:proc.pid
+                          address:0
+                           length:bytes
+                       protection:KernMemProtRead
+                            flags:KernMmapShared
+                           offset:0];
+      if (addr < 0)
+        break;
+      mapped = (uint64_t)addr;
+    }
+
+    sum = 0;
+    uint64_t majorBefore = proc.majorFaults;
+    uint64_t minorBefore = proc.minorFaults;
+    uint64_t start = mach_absolute_time();
+    if (viaMmap) {
+      [self accessUserMemory:mapped
+                      length:(NSUInteger)bytes
+                  forProcess:proc.pid
+                       write:NO
+                  usingBlock:sumWords];
+    } else {
+      for (uint64_t off = 0; off < bytes; off += chunk) {
+        int64_t n = [self readFD:file.fd into:words length:chunk offset:off];
+        if (n <= 0)
+          break;
+        sumWords((uint8_t *)words, (NSUInteger)n);
+      }
+    }
+    double seconds = KernBenchSeconds(start, mach_absolute_time());
+    if (pass == 0)
+      expected = sum;
+    match &= sum == expected;
+    results[passes[pass]] = @{
+      @"gb_per_sec" : @(seconds > 0 ? bytes / seconds / 1e9 : 0),
+      @"seconds" : @(seconds),
+      @"major_faults" : @(proc.majorFaults - majorBefore),
+      @"minor_faults" : @(proc.minorFaults - minorBefore)
+    };
+  }
+
+  if (mapped)
+    [self munmapForProcess:proc.pid address:mapped length:bytes];
+  [self closeFile:file];
+  [self setCurrentPID:savedPID];
+  [self terminateProcess:proc.pid exitCode:0];
+  [self deleteInode:@"/tmp/.mmap_bench"];
+  results[@"bytes"] = @(bytes);
+  results[@"checksums_match"] = @(match);
+  return results;
+}
+
+// Creates, stats, lists and unlinks `files` files (1M is the reference run)
+// in a single directory. Stats run with the dentry cache shrunk first so
+// every component is resolved through the directory index; the listing
+// streams entries through a readdir cursor in 4096-entry calls.
+- (NSDictionary *)benchmarkDirectory:(NSUInteger)files {
+  if (files == 0)
+    return @{};
+  NSString *base = @"/tmp/dirindex-bench";
+  if (![self createDirectory:base mode:0755])
+    return @{};
+  NSMutableArray<NSString *> *paths = [NSMutableArray arrayWithCapacity:files];
+  for (NSUInteger i = 0; i < files; i++)
+    [paths addObject:[NSString stringWithFormat:@"%@/f%lu", base,
+                                                (unsigned long)i]];
+
+  NSUInteger created = 0;
+  uint64_t start = mach_absolute_time();
+  for (NSString *path in paths)
+    if ([self createFile:path mode:0644])
+      created++;
+  double createSeconds = KernBenchSeconds(start, mach_absolute_time());
+  BOOL duplicateRejected = [self createFile:paths[0] mode:0644] == nil;
+
+  [self shrinkDentryCache:NSUIntegerMax];
+  NSUInteger found = 0;
+  start = mach_absolute_time();
+  for (NSString *path in paths)
+    if ([self lookupPath:path])
+      found++;
+  double statSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  KernDirCursor *cursor = [self openDirectory:base];
+  __block NSUInteger listed = 0;
+  start = mach_absolute_time();
+  while ([self readDirectory:cursor
+                       count:4096
+                  usingBlock:^(KernDentry *entry) {
+                    listed++;
+                  }])
+    ;
+  double listSeconds = KernBenchSeconds(start, mach_absolute_time());
+  NSUInteger height = cursor.directory.index.height;
+
+  NSUInteger removed = 0;
+  start = mach_absolute_time();
+  for (NSString *path in paths)
+    if ([self deleteInode:path])
+      removed++;
+  double unlinkSeconds = KernBenchSeconds(start, mach_absolute_time());
+  [self deleteInode:base];
+  [self shrinkDentryCache:NSUIntegerMax];
+
+  return @{
+    @"files" : @(files),
+    @"created" : @(created),
+    @"found" : @(found),
+    @"listed" : @(listed),
+    @"removed" : @(removed),
+    @"duplicate_rejected" : @(duplicateRejected),
+    @"index_height" : @(height),
+    @"creates_per_sec" : @(KernBenchRate(created, createSeconds)),
+    @"stats_per_sec" : @(KernBenchRate(found, statSeconds)),
+    @"entries_listed_per_sec" : @(KernBenchRate(listed, listSeconds)),
+    @"unlinks_per_sec" : @(KernBenchRate(removed, unlinkSeconds))
+  };
+}
+
+// Log calls per second into the binary rings from one thread and from one
+// thread per CPU, the cost of a call its level filters out, and the
+// NSString path for comparison. The log is cleared afterwards.
+- (NSDictionary *)benchmarkLogging:(NSUInteger)calls {
+  if (calls == 0)
+    return @{};
+  KernLogLevel savedLevel = [self logLevelForFacility:KernLogDriver];
+  [self setLogLevel:KernLogInfo forFacility:KernLogDriver];
+
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < calls; i++)
+    KERN_LOG(KernLogInfo, KernLogDriver, "bench %lu: value=%llu",
+             (unsigned long)i, (unsigned long long)i * 3);
+  double singleSeconds = KernBenchSeconds(start, mach_absolute_time());
+  NSArray<KernLogEntry *> *tail = [self logEntriesWithLevel:KernLogInfo
+                                                   facility:KernLogDriver
+                                                      count:1];
+  NSString *expected =
+      [NSString stringWithFormat:@"bench %lu: value=%llu",
+                                 (unsigned long)(calls - 1),
+                                 (unsigned long long)(calls - 1) * 3];
+  BOOL formatted = [tail.firstObject.message isEqualToString:expected];
+
+  NSUInteger cpus = [[NSProcessInfo processInfo] activeProcessorCount];
+  NSUInteger perCPU = calls / cpus + 1;
+  start = mach_absolute_time();
+  dispatch_apply(cpus, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                 ^(size_t cpu) {
+                   for (NSUInteger i = 0; i < perCPU; i++)
+                     KERN_LOG(KernLogInfo, KernLogDriver, "cpu %zu: %lu", cpu,
+                              (unsigned long)i);
+                 });
+  double parallelSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < calls; i++)
+    KERN_LOG(KernLogDebug, KernLogDriver, "filtered %lu", (unsigned long)i);
+  double filteredSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSUInteger messages = MAX(calls / 64, (NSUInteger)1);
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < messages; i++)
+    [self kernelLog:KernLogInfo
+           facility:KernLogDriver
+            message:[NSString stringWithFormat:@"bench %lu: value=%llu",
+                                               (unsigned long)i,
+                                               (unsigned long long)i * 3]];
+  double messageSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSDictionary *stats = [self logStatistics];
+  [self setLogLevel:savedLevel forFacility:KernLogDriver];
+  [self clearLogs];
+  return @{
+    @"calls" : @(calls),
+    @"cpus" : @(cpus),
+    @"calls_per_sec" : @(KernBenchRate(calls, singleSeconds)),
+    @"parallel_calls_per_sec" :
+        @(KernBenchRate(perCPU * cpus, parallelSeconds)),
+    @"ns_per_filtered_call" : @(filteredSeconds * 1e9 / calls),
+    @"message_calls_per_sec" : @(KernBenchRate(messages, messageSeconds)),
+    @"formatted_on_read" : @(formatted),
+    @"rings" : stats[@"rings"],
+    @"overwritten" : stats[@"overwritten"]
+  };
+}
+
+// Fills the log with `records` messages (one in 256 a security error, the
+// rest driver debug chatter) and times indexed queries against it: the
+// latest errors, a facility over the newest tenth of the time range, a
+// substring search among the errors, and tailing new records with a cursor.
+- (NSDictionary *)benchmarkLogQuery:(NSUInteger)records {
+  const NSUInteger rounds = 1000;
+  if (records == 0)
+    return @{};
+  KernLogLevel savedDriver = [self logLevelForFacility:KernLogDriver];
+  [self setLogLevel:KernLogDebug forFacility:KernLogDriver];
+  [self clearLogs];
+  uint64_t tenthTime = mach_absolute_time();
+  for (NSUInteger i = 0; i < records; i++) {
+    if (i % 256 == 0)
+      KERN_LOG(KernLogError, KernLogSecurity, "denied op %lu for uid %u",
+               (unsigned long)i, (unsigned)(i % 7 == 0 ? 0 : 501));
+    else
+      KERN_LOG(KernLogDebug, KernLogDriver, "irq %lu handled",
+               (unsigned long)i);
+    if (i % 4096 == 4095)
+      [self logEndPosition]; // Index before the rings wrap
+    if (i == records - records / 10)
+      tenthTime = mach_absolute_time();
+  }
+  [self logEndPosition];
+
+  NSUInteger errors = 0;
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++)
+    errors = [self logEntriesWithLevel:KernLogError
+                              facility:KernLogKernel
+                                 count:50]
+                 .count;
+  double latestSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSUInteger recent = 0;
+  start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++) {
+    KernLogQuery *query = [[KernLogQuery alloc] init];
+    query.facility = KernLogDriver;
+    query.startTime = tenthTime;
+    recent = [self queryLog:query limit:100].count;
+  }
+  double rangeSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSUInteger rootDenials = 0;
+  start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++) {
+    KernLogQuery *query = [[KernLogQuery alloc] init];
+    query.maxLevel = KernLogError;
+    query.substring = @"uid 0";
+    rootDenials = [self queryLog:query limit:NSUIntegerMax].count;
+  }
+  double substringSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  KernLogQuery *tail = [[KernLogQuery alloc] init];
+  tail.facility = KernLogDriver;
+  tail.position = [self logEndPosition];
+  NSUInteger tailed = 0;
+  start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++) {
+    for (NSUInteger i = 0; i < 16; i++)
+      KERN_LOG(KernLogDebug, KernLogDriver, "tail %lu", (unsigned long)i);
+    tailed += [self queryLog:tail limit:NSUIntegerMax].count;
+  }
+  double tailSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSDictionary *stats = [self logStatistics];
+  [self setLogLevel:savedDriver forFacility:KernLogDriver];
+  [self clearLogs];
+  return @{
+    @"records" : @(records),
+    @"indexed" : stats[@"indexed"],
+    @"latest_errors" : @(errors),
+    @"us_per_latest_errors" : @(latestSeconds * 1e6 / rounds),
+    @"recent_driver_entries" : @(recent),
+    @"us_per_time_range" : @(rangeSeconds * 1e6 / rounds),
+    @"root_denials" : @(rootDenials),
+    @"us_per_substring" : @(substringSeconds * 1e6 / rounds),
+    @"tailed" : @(tailed),
+    @"us_per_tail_poll" : @(tailSeconds * 1e6 / rounds)
+  };
+}
+
+// Scheduler ticks over eight runnable processes with the sched tracepoints
+// off, recording into the trace rings, and on behind a filter that rejects
+// every event, plus the cost of a disabled tracepoint site on its own.
+- (NSDictionary *)benchmarkTracepoints:(NSUInteger)iterations {
+  if (iterations == 0)
+    return @{};
+  NSMutableArray<KernProcess *> *procs = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 8; i++)
+    [procs addObject:[self createProcess:@"trace-bench"
+                          executablePath:@""
+                               arguments:@[]
+                               parentPID:0]];
+  const KernTracepoint sched[] = {KernTraceSchedule, KernTraceContextSwitch};
+  NSArray<NSString *> *modes = @[ @"disabled", @"recording", @"filtered" ];
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  NSUInteger events = 0;
+  for (NSUInteger mode = 0; mode < modes.count; mode++) {
+    for (KernTracepoint tp : sched) {
+      [self setTracepoint:tp enabled:mode > 0];
+      [self clearTraceFilters:tp];
+      if (mode == 2)
+        [self addTraceFilter:tp
+                       field:KernTraceFieldPID
+                          op:KernTraceEqual
+                       value:UINT32_MAX];
+    }
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger i = 0; i < iterations; i++)
+      [self schedule];
+    double seconds = KernBenchSeconds(start, mach_absolute_time());
+    results[[modes[mode] stringByAppendingString:@"_ns_per_schedule"]] =
+        @(seconds * 1e9 / iterations);
+    events += [self readTraceEvents:NSUIntegerMax].count;
+  }
+  for (KernTracepoint tp : sched) {
+    [self setTracepoint:tp enabled:NO];
+    [self clearTraceFilters:tp];
+  }
+
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < iterations; i++)
+    KERN_TRACE(KernTracePipeWrite, i, 0, 0, 0);
+  double siteSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  for (KernProcess *proc in procs)
+    [self terminateProcess:proc.pid exitCode:0];
+  results[@"iterations"] = @(iterations);
+  results[@"events_read"] = @(events);
+  results[@"ns_per_disabled_site"] = @(siteSeconds * 1e9 / iterations);
+  results[@"events_lost"] = [self traceStatistics][@"events_lost"];
+  return results;
+}
+
+// In-kernel aggregation: a log2 histogram of dentry lookup latency, the
+// same histogram computed by a bounded loop instead of the log2 helper, and
+// per-pid syscall counts. Each is timed as the extra cost per event over an
+// emit with nothing attached, and its map is checked against the events
+// driven through it.
+- (NSDictionary *)benchmarkBPF:(NSUInteger)events {
+  if (events == 0)
+    return @{};
+  const int32_t histogram = [self createBPFMap:KernBPFMapArray
+                                       keySize:sizeof(uint32_t)
+                                     valueSize:sizeof(uint64_t)
+                                    maxEntries:64];
+  const int32_t loopHistogram = [self createBPFMap:KernBPFMapArray
+                                           keySize:sizeof(uint32_t)
+                                         valueSize:sizeof(uint64_t)
+                                        maxEntries:64];
+  const int32_t counts = [self createBPFMap:KernBPFMapHash
+                                    keySize:sizeof(uint32_t)
+                                  valueSize:sizeof(uint64_t)
+                                 maxEntries:1024];
+  const int16_t latency = offsetof(KernBPFContext, args) + 2 * 8;
+  const KernBPFInsn helperProgram[] = {
+      KERN_BPF_LDX_MEM(KERN_BPF_DW, 1, 1, latency),
+      KERN_BPF_CALL_HELPER(KernBPFHelperLog2),
+      KERN_BPF_STX_MEM(KERN_BPF_W, 10, 0, -4),
+      KERN_BPF_LD_MAP(1, histogram),
+      KERN_BPF_MOV_REG(2, 10),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 2, -4),
+      KERN_BPF_CALL_HELPER(KernBPFHelperMapLookup),
+      KERN_BPF_JMP_IMM(KERN_BPF_JEQ, 0, 0, 2),
+      KERN_BPF_MOV_IMM(1, 1),
+      KERN_BPF_XADD_MEM(KERN_BPF_DW, 0, 1, 0),
+      KERN_BPF_MOV_IMM(0, 0),
+      KERN_BPF_EXIT_INSN(),
+  };
+  const KernBPFInsn loopProgram[] = {
+      KERN_BPF_LDX_MEM(KERN_BPF_DW, 6, 1, latency),
+      KERN_BPF_MOV_IMM(7, 0), // Bucket
+      KERN_BPF_MOV_IMM(8, 0), // Iterations, the loop's bound
+      KERN_BPF_JMP_IMM(KERN_BPF_JGE, 8, 63, 5),
+      KERN_BPF_JMP_IMM(KERN_BPF_JLE, 6, 1, 4),
+      KERN_BPF_ALU_IMM(KERN_BPF_RSH, 6, 1),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 7, 1),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 8, 1),
+      KERN_BPF_JA(-6),
+      KERN_BPF_STX_MEM(KERN_BPF_W, 10, 7, -4),
+      KERN_BPF_LD_MAP(1, loopHistogram),
+      KERN_BPF_MOV_REG(2, 10),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 2, -4),
+      KERN_BPF_CALL_HELPER(KernBPFHelperMapLookup),
+      KERN_BPF_JMP_IMM(KERN_BPF_JEQ, 0, 0, 2),
+      KERN_BPF_MOV_IMM(1, 1),
+      KERN_BPF_XADD_MEM(KERN_BPF_DW, 0, 1, 0),
+      KERN_BPF_MOV_IMM(0, 0),
+      KERN_BPF_EXIT_INSN(),
+  };
+  const KernBPFInsn countProgram[] = {
+      KERN_BPF_LDX_MEM(KERN_BPF_DW, 6, 1, offsetof(KernBPFContext, pid)),
+      KERN_BPF_STX_MEM(KERN_BPF_W, 10, 6, -4),
+      KERN_BPF_LD_MAP(1, counts),
+      KERN_BPF_MOV_REG(2, 10),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 2, -4),
+      KERN_BPF_CALL_HELPER(KernBPFHelperMapLookup),
+      KERN_BPF_JMP_IMM(KERN_BPF_JEQ, 0, 0, 3),
+      KERN_BPF_MOV_IMM(1, 1),
+      KERN_BPF_XADD_MEM(KERN_BPF_DW, 0, 1, 0),
+      KERN_BPF_JA(9),
+      KERN_BPF_ST_MEM(KERN_BPF_DW, 10, -16, 1), // First call from this pid
+      KERN_BPF_LD_MAP(1, counts),
+      KERN_BPF_MOV_REG(2, 10),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 2, -4),
+      KERN_BPF_MOV_REG(3, 10),
+      KERN_BPF_ALU_IMM(KERN_BPF_ADD, 3, -16),
+      KERN_BPF_MOV_IMM(4, KERN_BPF_NOEXIST),
+      KERN_BPF_CALL_HELPER(KernBPFHelperMapUpdate),
+      KERN_BPF_MOV_IMM(0, 0),
+      KERN_BPF_EXIT_INSN(),
+  };
+  NSString *helperLog, *loopLog, *countLog;
+  const int32_t helperID = [self
+      loadBPFProgram:[NSData dataWithBytes:helperProgram
+                                    length:sizeof(helperProgram)]
+                 log:&helperLog];
+  const int32_t loopID =
+      [self loadBPFProgram:[NSData dataWithBytes:loopProgram
+                                          length:sizeof(loopProgram)]
+                       log:&loopLog];
+  const int32_t countID =
+      [self loadBPFProgram:[NSData dataWithBytes:countProgram
+                                          length:sizeof(countProgram)]
+                       log:&countLog];
+  if (histogram < 0 || loopHistogram < 0 || counts < 0 || helperID < 0 ||
+      loopID < 0 || countID < 0)
+    return @{
+      @"helper_program" : helperLog ?: @"",
+      @"loop_program" : loopLog ?: @"",
+      @"count_program" : countLog ?: @""
+    };
+
+  // Latencies spread over twenty buckets
+  auto emitLookups = ^double {
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger i = 0; i < events; i++)
+      KernTraceEmit(KernTraceDentryLookup, 16, 1,
+                    1 + (i * 2654435761u) % 1048576, 0);
+    return KernBenchSeconds(start, mach_absolute_time());
+  };
+  double baseSeconds = emitLookups();
+  [self attachBPFProgram:helperID toTracepoint:KernTraceDentryLookup];
+  double helperSeconds = emitLookups();
+  [self detachBPFProgram:helperID fromTracepoint:KernTraceDentryLookup];
+  [self attachBPFProgram:loopID toTracepoint:KernTraceDentryLookup];
+  double loopSeconds = emitLookups();
+  [self detachBPFProgram:loopID fromTracepoint:KernTraceDentryLookup];
+
+  uint64_t args[KERN_SYSCALL_MAX_ARGS] = {0};
+  volatile int64_t sink = 0;
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < events; i++)
+    sink += [self invokeSyscall:KSYS_GETPID args:args];
+  double syscallSeconds = KernBenchSeconds(start, mach_absolute_time());
+  [self attachBPFProgram:countID toTracepoint:KernTraceSyscallEnter];
+  start = mach_absolute_time();
+  for (NSUInteger i = 0; i < events; i++)
+    sink += [self invokeSyscall:KSYS_GETPID args:args];
+  double countedSeconds = KernBenchSeconds(start, mach_absolute_time());
+  [self detachBPFProgram:countID fromTracepoint:KernTraceSyscallEnter];
+
+  uint64_t helperTotal = 0, loopTotal = 0, counted = 0;
+  BOOL bucketsMatch = YES;
+  for (uint32_t bucket = 0; bucket < 64; bucket++) {
+    NSData *key = [NSData dataWithBytes:&bucket length:sizeof(bucket)];
+    uint64_t a = *(const uint64_t *)[self lookupBPFMap:histogram key:key].bytes;
+    uint64_t b =
+        *(const uint64_t *)[self lookupBPFMap:loopHistogram key:key].bytes;
+    helperTotal += a;
+    loopTotal += b;
+    bucketsMatch = bucketsMatch && a == b;
+  }
+  for (NSData *value in [self dumpBPFMap:counts].allValues)
+    counted += *(const uint64_t *)value.bytes;
+
+  return @{
+    @"events" : @(events),
+    @"ns_per_emit" : @(baseSeconds * 1e9 / events),
+    @"ns_per_histogram_event" :
+        @((helperSeconds - baseSeconds) * 1e9 / events),
+    @"ns_per_loop_histogram_event" :
+        @((loopSeconds - baseSeconds) * 1e9 / events),
+    @"ns_per_syscall_count" :
+        @((countedSeconds - syscallSeconds) * 1e9 / events),
+    @"histogram_total" : @(helperTotal),
+    @"loop_histogram_total" : @(loopTotal),
+    @"histograms_match" : @(bucketsMatch),
+    @"syscalls_counted" : @(counted),
+    @"loop_verifier" : loopLog
+  };
+}
+
+// The same syscall, lookup and scheduling loop timed without the profiler
+// and sampling at 1 kHz, alternating three times and keeping the fastest
+// run of each so that machine noise does not read as overhead.
+- (NSDictionary *)benchmarkProfiler:(NSUInteger)iterations {
+  if (iterations == 0 || [[self profilerStatus][@"running"] boolValue])
+    return @{};
+  [self createDirectory:@"/tmp/profile-bench" mode:0755];
+  __block int64_t sink = 0;
+  auto workload = ^double {
+    uint64_t args[KERN_SYSCALL_MAX_ARGS] = {0};
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger i = 0; i < iterations; i++) {
+      sink += [self invokeSyscall:KSYS_GETPID args:args];
+      sink += [self dentryForPath:@"/tmp/profile-bench"] != nil;
+      if ((i & 63) == 0)
+        [self schedule];
+    }
+    return KernBenchSeconds(start, mach_absolute_time());
+  };
+  [self resetProfile];
+  double plain = DBL_MAX, sampled = DBL_MAX;
+  for (int round = 0; round < 3; round++) {
+    plain = MIN(plain, workload());
+    [self startProfilerWithFrequency:1000];
+    sampled = MIN(sampled, workload());
+    [self stopProfiler];
+  }
+  NSString *folded = [self profileFoldedStacks];
+  NSDictionary *status = [self profilerStatus];
+  return @{
+    @"iterations" : @(iterations),
+    @"seconds_unprofiled" : @(plain),
+    @"seconds_profiled" : @(sampled),
+    @"overhead_percent" : @(plain > 0 ? (sampled - plain) * 100 / plain : 0),
+    @"samples" : status[@"samples"],
+    @"dropped" : status[@"dropped"],
+    @"folded_lines" :
+        @([folded componentsSeparatedByString:@"\n"].count - 1)
+  };
+}
+
+// Slab and page-translation batches under scoped counters: a slab cache
+// cycled through a small working set, the same cache walked across a large
+// one, and translations that hit the simulated TLB against ones that miss
+// it. The per-operation figures show whether each path stays in cache. The
+// whole run is also charged to a process with counters attached.
+- (NSDictionary *)benchmarkPerfCounters:(NSUInteger)operations {
+  if (operations == 0)
+    return @{};
+  const BOOL wasEnabled = [self perfCountersEnabled];
+  [self setPerfCountersEnabled:YES];
+  [self resetPerfCounters];
+  KernProcess *proc = [self createProcess:@"perf-bench"
+                           executablePath:@"/bin/perf-bench"
+                                arguments:@[]
+                                parentPID:1];
+  const uint32_t previous = [self currentPID];
+  [self attachPerfCountersToProcess:proc.pid];
+  [self setCurrentPID:proc.pid];
+
+  KernSlabCache *cache = [self createSlabCache:@"perf-bench"
+                                    objectSize:128
+                                     alignment:64];
+  std::vector<void *> objects(MAX(operations, (NSUInteger)64));
+  NSUInteger hot = 0;
+  {
+    KERN_PERF_SCOPE("slab:hot");
+    for (NSUInteger i = 0; i < operations; i += 64) {
+      for (NSUInteger j = 0; j < 64; j++)
+        objects[j] = [self slabAlloc:cache];
+      for (NSUInteger j = 0; j < 64; j++)
+        [self slabFree:cache object:objects[j]];
+      hot += 64;
+    }
+  }
+  {
+    KERN_PERF_SCOPE("slab:cold");
+    for (NSUInteger i = 0; i < objects.size(); i++)
+      objects[i] = [self slabAlloc:cache];
+    for (NSUInteger i = 0; i < objects.size(); i++)
+      [self slabFree:cache object:objects[(i * 2654435761u) % objects.size()]];
+  }
+
+  // 64 pages stay resident in the 4096-entry TLB; 8192 pages alias it
+  const uint64_t base = 0x40000000;
+  for (uint64_t page = 0; page < 8192; page++)
+    [self mapVirtualAddress:base + page * KERN_PAGE_SIZE
+                 toPhysical:page * KERN_PAGE_SIZE
+                 protection:KernMemProtRead | KernMemProtWrite
+                 forProcess:proc.pid];
+  __block NSUInteger found = 0;
+  auto translate = ^(uint64_t pages) {
+    for (NSUInteger i = 0; i < operations; i++)
+      found += [self translateAddress:base + (i % pages) * KERN_PAGE_SIZE
+                           forProcess:proc.pid] != nil;
+  };
+  {
+    KERN_PERF_SCOPE("tlb:hit");
+    translate(64);
+  }
+  {
+    KERN_PERF_SCOPE("tlb:miss");
+    translate(8192);
+  }
+  const uint64_t start = mach_absolute_time();
+  for (NSUInteger i = 0; i < operations; i++) {
+    KERN_PERF_SCOPE("perf:empty");
+  }
+  const double scopeSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  [self setCurrentPID:previous];
+  NSDictionary *process = [self perfCountersForProcess:proc.pid];
+  [self detachPerfCountersFromProcess:proc.pid];
+  [self terminateProcess:proc.pid exitCode:0];
+  [self setPerfCountersEnabled:wasEnabled];
+
+  // Per-operation cycles and instructions for each region
+  NSMutableDictionary *regions = [NSMutableDictionary dictionary];
+  const NSUInteger counts[] = {hot, objects.size(), operations, operations};
+  const char *names[] = {"slab:hot", "slab:cold", "tlb:hit", "tlb:miss"};
+  for (int r = 0; r < 4; r++) {
+    NSDictionary *region = [self perfCountersForRegion:@(names[r])];
+    NSMutableDictionary *entry = [region mutableCopy];
+    for (NSString *event in @[ @"cycles", @"instructions", @"task_clock_ns" ])
+      if (region[@"events"][event])
+        entry[[event stringByAppendingString:@"_per_op"]] =
+            @([region[@"events"][event][@"value"] doubleValue] / counts[r]);
+    regions[@(names[r])] = entry;
+  }
+  return @{
+    @"operations" : @(operations),
+    @"backend" : [self perfCounterStatus][@"backend"],
+    @"regions" : regions,
+    @"process" : process ?: @{},
+    @"translations_found" : @(found),
+    @"ns_per_scope" : @(scopeSeconds * 1e9 / operations)
+  };
+}
+
+// allocatePage and freePage in batches of 32, for a process outside any
+// cgroup and for one two levels down a hierarchy, alternating three times
+// and keeping the fastest run of each. A last process in a cgroup limited
+// to 256 pages allocates until the limit stops it.
+- (NSDictionary *)benchmarkPageAllocation:(NSUInteger)pages {
+  if (pages == 0)
+    return @{};
+  KernCgroup *parent = [self createCgroup:@"alloc-bench" parent:nil];
+  KernCgroup *child = [self createCgroup:@"charged" parent:parent];
+  KernCgroup *limited = [self createCgroup:@"limited" parent:parent];
+  [self setCgroupMemoryLimit:limited bytes:256 * KERN_PAGE_SIZE];
+  NSMutableArray<KernProcess *> *procs = [NSMutableArray array];
+  for (NSString *name in @[ @"alloc-plain", @"alloc-charged", @"alloc-oom" ])
+    [procs addObject:[self createProcess:name
+                          executablePath:@"/bin/alloc-bench"
+                               arguments:@[]
+                               parentPID:1]];
+  [self addProcess:procs[1].pid toCgroup:child];
+  [self addProcess:procs[2].pid toCgroup:limited];
+  const uint32_t previous = [self currentPID];
+
+  auto run = ^double(uint32_t pid) {
+    [self setCurrentPID:pid];
+    KernPageTableEntry *batch[32];
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger done = 0; done < pages; done += 32) {
+      for (int i = 0; i < 32; i++)
+        batch[i] = [self allocatePage];
+      for (int i = 0; i < 32; i++)
+        [self freePage:batch[i]];
+    }
+    return KernBenchSeconds(start, mach_absolute_time());
+  };
+  double plain = DBL_MAX, charged = DBL_MAX;
+  for (int round = 0; round < 3; round++) {
+    plain = MIN(plain, run(procs[0].pid));
+    charged = MIN(charged, run(procs[1].pid));
+  }
+
+  [self setCurrentPID:procs[2].pid];
+  NSMutableArray<KernPageTableEntry *> *held = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 1024; i++) {
+    KernPageTableEntry *page = [self allocatePage];
+    if (!page)
+      break;
+    [held addObject:page];
+  }
+  NSDictionary *limitedStats = [self cgroupStatistics:limited];
+  for (KernPageTableEntry *page in held)
+    [self freePage:page];
+  [self setCurrentPID:previous];
+
+  return @{
+    @"pages" : @(pages),
+    @"ns_per_page_uncharged" : @(plain * 1e9 / pages),
+    @"ns_per_page_charged" : @(charged * 1e9 / pages),
+    @"charge_overhead_percent" :
+        @(plain > 0 ? (charged - plain) * 100 / plain : 0),
+    @"limited_pages_allocated" : @(held.count),
+    @"limited_memory_events" : limitedStats[@"memory_events"],
+    @"parent" : [self cgroupStatistics:parent]
+  };
+}
+
+// Three readers of a cached 1 MB file, 64 KB per readFile: for the given
+// time, a noisy neighbour at the default io weight and a victim at three
+// times it share a cgroup limited to 32 MB/s, so the victim should get
+// about three quarters; then a reader alone in a 16 MB/s cgroup shows how
+// closely the bucket holds its rate. Last, a process in a cgroup with
+// pids.max 4 forks until the limit refuses.
+- (NSDictionary *)benchmarkCgroupIsolation:(NSTimeInterval)seconds {
+  const uint64_t MB = 1 << 20;
+  if (seconds <= 0)
+    return @{};
+  KernFileDescriptor *file = [self openFile:@"/tmp/cgroup-io-bench"
+                                      flags:0x0200 | 0x0002 // O_CREAT|O_RDWR
+                                       mode:0644];
+  if (!file)
+    return @{};
+  NSMutableData *chunk = [NSMutableData dataWithLength:64 * 1024];
+  memset(chunk.mutableBytes, 'c', chunk.length);
+  for (uint64_t off = 0; off < MB; off += chunk.length)
+    [self pageCacheWrite:file.inode
+                    from:chunk.bytes
+                  length:chunk.length
+                  offset:off];
+  [self closeFile:file];
+
+  KernCgroup *shared = [self createCgroup:@"io-bench" parent:nil];
+  KernCgroup *noisy = [self createCgroup:@"noisy" parent:shared];
+  KernCgroup *victim = [self createCgroup:@"victim" parent:shared];
+  KernCgroup *capped = [self createCgroup:@"io-bench-capped" parent:nil];
+  [self setCgroupIOLimit:shared
+                 readBps:32 * MB
+                writeBps:0
+                readIOps:0
+               writeIOps:0];
+  [self setCgroupIOLimit:capped
+                 readBps:16 * MB
+                writeBps:0
+                readIOps:0
+               writeIOps:0];
+  victim.ioWeight = 300;
+  NSArray<KernCgroup *> *groups = @[ noisy, victim, capped ];
+  NSMutableArray<KernProcess *> *procs = [NSMutableArray array];
+  for (KernCgroup *cg in groups) {
+    KernProcess *proc = [self createProcess:cg.name
+                             executablePath:@"/bin/io-bench"
+                                  arguments:@[]
+                                  parentPID:0];
+    [self addProcess:proc.pid toCgroup:cg];
+    [procs addObject:proc];
+  }
+
+  // Each reader re-reads the file from the start until the time is up
+  auto readFor = ^uint64_t(KernProcess *proc) {
+    [self setCurrentPID:proc.pid];
+    KernFileDescriptor *fd = [self openFile:@"/tmp/cgroup-io-bench"
+                                      flags:0
+                                       mode:0];
+    uint64_t bytes = 0;
+    uint64_t start = mach_absolute_time();
+    while (KernBenchSeconds(start, mach_absolute_time()) < seconds) {
+      NSData *data = [self readFile:fd length:chunk.length];
+      if (data.length == 0)
+        [self seekFile:fd offset:0 whence:0];
+      bytes += data.length;
+    }
+    [self closeFile:fd];
+    [self setCurrentPID:1];
+    return bytes;
+  };
+  uint64_t sharedBytes[2] = {0, 0};
+  uint64_t *shares = sharedBytes;
+  dispatch_apply(2, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0),
+                 ^(size_t i) {
+    shares[i] = readFor(procs[i]);
+  });
+  uint64_t cappedBytes = readFor(procs[2]);
+
+  KernCgroup *pidsGroup = [self createCgroup:@"pids-bench" parent:nil];
+  pidsGroup.pidsMax = 4;
+  KernProcess *forker = [self createProcess:@"pids-bench"
+                             executablePath:@"/bin/pids-bench"
+                                  arguments:@[]
+                                  parentPID:0];
+  [self addProcess:forker.pid toCgroup:pidsGroup];
+  NSMutableArray<KernProcess *> *forked = [NSMutableArray array];
+  for (int i = 0; i < 8; i++) {
+    KernProcess *child = [self createProcess:@"pids-bench-child"
+                              executablePath:@"/bin/pids-bench"
+                                   arguments:@[]
+                                   parentPID:forker.pid];
+    if (!child)
+      break;
+    [forked addObject:child];
+  }
+  NSDictionary *pidsStats = [self cgroupStatistics:pidsGroup];
+  for (KernProcess *child in forked)
+    [self terminateProcess:child.pid exitCode:0];
+  [self terminateProcess:forker.pid exitCode:0];
+  for (KernProcess *proc in procs)
+    [self terminateProcess:proc.pid exitCode:0];
+
+  double total = sharedBytes[0] + sharedBytes[1];
+  return @{
+    @"seconds" : @(seconds),
+    @"shared_limit_mb_per_sec" : @32,
+    @"noisy_mb_per_sec" : @(sharedBytes[0] / seconds / MB),
+    @"victim_mb_per_sec" : @(sharedBytes[1] / seconds / MB),
+    @"victim_share_percent" : @(total > 0 ? sharedBytes[1] * 100 / total : 0),
+    @"noisy" : [self cgroupStatistics:noisy],
+    @"victim" : [self cgroupStatistics:victim],
+    @"capped_limit_mb_per_sec" : @16,
+    @"capped_mb_per_sec" : @(cappedBytes / seconds / MB),
+    @"capped_throttled_ns" : [self cgroupStatistics:capped][@"io_throttled_ns"],
+    @"pids_max" : @(pidsGroup.pidsMax),
+    @"pids_forked" : @(forked.count),
+    @"pids_events_max" : pidsStats[@"pids_events_max"]
+  };
+}
+
+// dentryForPath: over 128 files under /tmp/landlock-bench, half of them
+// named "secret", for an unsandboxed process and for one whose profile
+// allows the bench directory, denies "*/secret" beneath it and carries 256
+// unrelated rules. The first sandboxed pass computes every verdict; the
+// rest are answered from the dentries. The same process then forks and
+// creates threads until its maxProcesses and maxThreads refuse.
+- (NSDictionary *)benchmarkPathRuleset:(NSUInteger)lookups {
+  if (lookups == 0)
+    return @{};
+  [self createDirectory:@"/tmp/landlock-bench" mode:0755];
+  NSMutableArray<NSString *> *paths = [NSMutableArray array];
+  for (int i = 0; i < 64; i++) {
+    NSString *dir = [NSString stringWithFormat:@"/tmp/landlock-bench/d%d", i];
+    [self createDirectory:dir mode:0755];
+    for (NSString *name in @[ @"file", @"secret" ]) {
+      NSString *path = [dir stringByAppendingPathComponent:name];
+      [self createFile:path mode:0644];
+      [paths addObject:path];
+    }
+  }
+
+  KernSandboxProfile *profile = [self createSandboxProfile:@"landlock-bench"];
+  NSMutableArray<NSString *> *denied =
+      [NSMutableArray arrayWithObject:@"/tmp/landlock-bench/*/secret"];
+  for (int i = 0; i < 256; i++)
+    [denied addObject:[NSString stringWithFormat:@"/opt/rule%d/**/*.key", i]];
+  profile.allowedPaths = @[ @"/tmp/landlock-bench", @"/usr/lib/**/*.dylib" ];
+  profile.deniedPaths = denied;
+  profile.allowProcessCreation = YES;
+  profile.maxProcesses = 4;
+  profile.maxThreads = 8;
+  KernProcess *plain = [self createProcess:@"landlock-plain"
+                            executablePath:@"/bin/landlock-bench"
+                                 arguments:@[]
+                                 parentPID:0];
+  KernProcess *sandboxed = [self createProcess:@"landlock-sandboxed"
+                                executablePath:@"/bin/landlock-bench"
+                                     arguments:@[]
+                                     parentPID:0];
+  [self applySandbox:profile toProcess:sandboxed.pid];
+  const uint32_t previous = [self currentPID];
+
+  __block NSUInteger allowed = 0;
+  auto run = ^double(uint32_t pid, NSUInteger count) {
+    [self setCurrentPID:pid];
+    allowed = 0;
+    uint64_t start = mach_absolute_time();
+    for (NSUInteger i = 0; i < count; i++)
+      allowed += [self dentryForPath:paths[i % paths.count]] != nil;
+    return KernBenchSeconds(start, mach_absolute_time());
+  };
+  double plainSeconds = run(plain.pid, lookups);
+  double coldSeconds = run(sandboxed.pid, paths.count);
+  double warmSeconds = run(sandboxed.pid, lookups);
+  NSUInteger sandboxedAllowed = allowed;
+
+  NSMutableArray<KernProcess *> *children = [NSMutableArray array];
+  for (int i = 0; i < 8; i++) {
+    KernProcess *child = [self createProcess:@"landlock-child"
+                              executablePath:@"/bin/landlock-bench"
+                                   arguments:@[]
+                                   parentPID:sandboxed.pid];
+    if (!child)
+      break;
+    [children addObject:child];
+  }
+  NSUInteger threads = 0;
+  while (threads < 16 && [self createThread:sandboxed.pid
+                                       name:@"landlock-thread"
+                                   priority:0
+                                  stackSize:0])
+    threads++;
+  [self setCurrentPID:previous];
+  for (KernProcess *child in children)
+    [self terminateProcess:child.pid exitCode:0];
+  [self terminateProcess:sandboxed.pid exitCode:0];
+  [self terminateProcess:plain.pid exitCode:0];
+
+  return @{
+    @"lookups" : @(lookups),
+    @"rules" : @(profile.allowedPaths.count + denied.count),
+    @"ns_per_lookup_unsandboxed" : @(plainSeconds * 1e9 / lookups),
+    @"ns_per_lookup_first_check" : @(coldSeconds * 1e9 / paths.count),
+    @"ns_per_lookup_cached" : @(warmSeconds * 1e9 / lookups),
+    @"allowed_percent" : @(sandboxedAllowed * 100.0 / lookups),
+    @"max_processes" : @(profile.maxProcesses),
+    @"children_forked" : @(children.count),
+    @"max_threads" : @(profile.maxThreads),
+    @"threads_created" : @(threads)
+  };
+}
+
+// Starts the given number of containers, each an init process that unshares
+// PID, mount and IPC namespaces and then forks four children (the first
+// becomes PID 1 inside) and a message queue named "jobs" created from
+// inside it. Then times processForPID: and the global-to-local and
+// local-to-global PID translations over every container process, and
+// checks that each container's "jobs" resolves to its own queue.
+- (NSDictionary *)benchmarkNamespaces:(NSUInteger)containers {
+  const NSUInteger perContainer = 4;
+  if (containers == 0)
+    return @{};
+  const uint32_t previous = [self currentPID];
+  NSMutableArray<KernProcess *> *inits = [NSMutableArray array];
+  NSMutableArray<KernProcess *> *members = [NSMutableArray array];
+  NSMutableArray<KernMessageQueue *> *queues = [NSMutableArray array];
+  uint64_t start = mach_absolute_time();
+  for (NSUInteger c = 0; c < containers; c++) {
+    KernProcess *init = [self createProcess:@"container"
+                             executablePath:@"/sbin/container-init"
+                                  arguments:@[]
+                                  parentPID:1];
+    if (!init)
+      break;
+    [inits addObject:init];
+    for (KernNamespaceType type : {KernNSPID, KernNSMount, KernNSIPC})
+      [self createNamespace:type forProcess:init.pid];
+    for (NSUInteger i = 0; i < perContainer; i++) {
+      KernProcess *child = [self createProcess:@"container-task"
+                                executablePath:@"/bin/task"
+                                     arguments:@[]
+                                     parentPID:init.pid];
+      if (child)
+        [members addObject:child];
+    }
+    [self setCurrentPID:init.pid];
+    [queues addObject:[self createMessageQueue:@"jobs"
+                                   maxMessages:16
+                                       maxSize:256]];
+  }
+  double setupSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  const NSUInteger rounds = 16;
+  NSUInteger lookups = members.count * rounds;
+  NSUInteger found = 0;
+  start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++)
+    for (KernProcess *proc in members)
+      found += [self processForPID:proc.pid] == proc;
+  double lookupSeconds = KernBenchSeconds(start, mach_absolute_time());
+  NSUInteger mismatches = 0;
+  start = mach_absolute_time();
+  for (NSUInteger r = 0; r < rounds; r++)
+    for (KernProcess *proc in members) {
+      uint32_t local = KernPidNr(proc.pid, proc.pid);
+      mismatches += KernPidFind(local, proc.pid) != proc.pid;
+    }
+  double translateSeconds = KernBenchSeconds(start, mach_absolute_time());
+
+  NSUInteger isolated = 0;
+  for (NSUInteger c = 0; c < inits.count; c++) {
+    [self setCurrentPID:members[c * perContainer].pid];
+    isolated += [self messageQueueNamed:@"jobs"] == queues[c];
+  }
+  [self setCurrentPID:previous];
+  for (NSUInteger c = 0; c < inits.count; c++) {
+    [self setCurrentPID:inits[c].pid];
+    [self destroyMessageQueue:queues[c]];
+  }
+  [self setCurrentPID:previous];
+  for (KernProcess *proc in members)
+    [self terminateProcess:proc.pid exitCode:0];
+  for (KernProcess *proc in inits)
+    [self terminateProcess:proc.pid exitCode:0];
+
+  return @{
+    @"containers" : @(inits.count),
+    @"processes" : @(inits.count + members.count),
+    @"containers_per_sec" : @(KernBenchRate(inits.count, setupSeconds)),
+    @"first_child_local_pid" :
+        @(members.count ? KernPidNr(members[0].pid, members[0].pid) : 0),
+    @"ns_per_pid_lookup" : @(lookupSeconds * 1e9 / MAX(lookups, 1)),
+    @"ns_per_pid_round_trip" : @(translateSeconds * 1e9 / MAX(lookups, 1)),
+    @"lookup_mismatches" : @(lookups - found),
+    @"translation_mismatches" : @(mismatches),
+    @"isolated_ipc_namespaces" : @(isolated)
+  };
+}
+
+@end
@@ -0,0 +1,732 @@
+#import "AdvancedKernel.h"
+#include <fcntl.h>
+#include <mach/mach_time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Block Layer
+// ============================================================================
+//
+// A block device stores 4 KB blocks in a sparse host file, or in memory.
+// Callers submit a plug of bios (one per physically contiguous run),
+// tagged with the submitting process's cgroup; each is merged into a queued
+// request that ends or starts where it does, or queued as a new request.
+// Requests are capped at KERN_BLOCK_MAX_REQUEST blocks and only merge
+// within one cgroup. Cgroup rate limits are applied earlier, at the VFS
+// (AdvancedKernel_Cgroup.mm).
+//
+// The scheduler (elevator) picks the next request; several hardware
+// dispatch contexts, each a serial dispatch queue, pull from it in parallel
+// and issue each request as one vectored host I/O on a worker thread
+// without waiting for it, so up to the device's queue depth are in flight
+// at once. Each completion frees a slot and restarts stopped contexts.
+// The submitter sleeps until all its bios complete.
+//
+// Lock order is queue lock, then RAM data lock.
+
+#define KERN_BLOCK_MAX_REQUEST 256     // Blocks per merged request (1 MB)
+#define KERN_BLOCK_QUEUE_DEPTH 32      // Requests in flight per device
+#define KERN_BLOCK_HW_QUEUES 4         // Dispatch contexts per device
+#define KERN_BLOCK_LATENCY_BUCKETS 32  // log2 microsecond histogram
+#define KERN_DEADLINE_READ_EXPIRE_MS 500
+#define KERN_DEADLINE_WRITE_EXPIRE_MS 5000
+#define KERN_DEADLINE_FIFO_BATCH 16
+#define KERN_DEADLINE_WRITES_STARVED 2 // Read batches before a write batch
+#define KERN_BFQ_BUDGET 512            // Blocks served per queue turn
+
+namespace {
+
+uint64_t KernBlockTicks(uint64_t ms) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info(&timebase);
+  });
+  return ms * 1000000ULL * timebase.denom / timebase.numer;
+}
+
+uint64_t KernBlockNs(uint64_t ticks) {
+  return ticks * 1000000ULL / KernBlockTicks(1);
+}
+
+// Submitter-side completion: the last bio to finish wakes the caller
+struct KernBioWait {
+  std::mutex lock;
+  std::condition_variable done;
+  size_t pending = 0;
+  int error = 0;
+};
+
+struct KernBio {
+  bool write = false;
+  uint64_t block = 0;
+  uint32_t count = 0;
+  uint8_t *const *pages = nullptr; // One 4 KB buffer per block
+  uint32_t cgroupID = 0;
+  uint32_t weight = 100;
+  uint64_t submitted = 0;
+  KernBioWait *wait = nullptr;
+};
+
+struct KernRequest {
+  bool write = false;
+  uint64_t block = 0;
+  uint32_t count = 0;
+  uint32_t cgroupID = 0;
+  uint32_t weight = 100;
+  uint64_t seq = 0;      // Breaks ties between requests at one block
+  uint64_t deadline = 0; // Deadline scheduler only
+  std::vector<KernBio *> bios; // In block order
+  std::list<KernRequest *>::iterator fifo;
+
+  uint64_t end() const { return block + count; }
+};
+
+// Queued requests of one direction in block order, indexed by start and
+// end for back and front merges
+class KernRequestSet {
+public:
+  bool empty() const { return byStart.empty(); }
+
+  void add(KernRequest *rq) {
+    byStart[{rq->block, rq->seq}] = rq;
+    byEnd.emplace(rq->end(), rq); // Keeps the first on a collision
+  }
+
+  void remove(KernRequest *rq) {
+    byStart.erase({rq->block, rq->seq});
+    auto it = byEnd.find(rq->end());
+    if (it != byEnd.end() && it->second == rq)
+      byEnd.erase(it);
+  }
+
+  // The request bio joined, or nullptr
+  KernRequest *merge(KernBio *bio) {
+    auto back = byEnd.find(bio->block);
+    if (back != byEnd.end() && mergeable(back->second, bio)) {
+      KernRequest *rq = back->second;
+      byEnd.erase(back);
+      rq->count += bio->count;
+      rq->bios.push_back(bio);
+      byEnd.emplace(rq->end(), rq);
+      return rq;
+    }
+    uint64_t end = bio->block + bio->count;
+    auto front = byStart.lower_bound({end, 0});
+    if (front != byStart.end() && front->first.first == end &&
+        mergeable(front->second, bio)) {
+      KernRequest *rq = front->second;
+      byStart.erase(front);
+      rq->block = bio->block;
+      rq->count += bio->count;
+      rq->bios.insert(rq->bios.begin(), bio);
+      byStart[{rq->block, rq->seq}] = rq;
+      return rq;
+    }
+    return nullptr;
+  }
+
+  // First request starting at or after block, or nullptr
+  KernRequest *from(uint64_t block) const {
+    auto it = byStart.lower_bound({block, 0});
+    return it != byStart.end() ? it->second : nullptr;
+  }
+
+private:
+  static bool mergeable(const KernRequest *rq, const KernBio *bio) {
+    return rq->cgroupID == bio->cgroupID &&
+           rq->count + bio->count <= KERN_BLOCK_MAX_REQUEST;
+  }
+
+  std::map<std::pair<uint64_t, uint64_t>, KernRequest *> byStart;
+  std::unordered_map<uint64_t, KernRequest *> byEnd;
+};
+
+// Scheduler interface (elevator_mq_ops). All calls are under the queue lock.
+class KernElevator {
+public:
+  virtual ~KernElevator() = default;
+  virtual KernRequest *merge(KernBio *bio) = 0;
+  virtual void insert(KernRequest *rq, uint64_t now) = 0;
+  virtual KernRequest *dispatch(uint64_t now) = 0;
+  virtual bool empty() const = 0;
+};
+
+// none: submission order, merging only
+class KernNoopElevator : public KernElevator {
+public:
+  KernRequest *merge(KernBio *bio) override {
+    return sets[bio->write].merge(bio);
+  }
+
+  void insert(KernRequest *rq, uint64_t) override {
+    sets[rq->write].add(rq);
+    rq->fifo = fifo.insert(fifo.end(), rq);
+  }
+
+  KernRequest *dispatch(uint64_t) override {
+    if (fifo.empty())
+      return nullptr;
+    KernRequest *rq = fifo.front();
+    fifo.pop_front();
+    sets[rq->write].remove(rq);
+    return rq;
+  }
+
+  bool empty() const override { return fifo.empty(); }
+
+private:
+  KernRequestSet sets[2];
+  std::list<KernRequest *> fifo;
+};
+
+// mq-deadline: batches in ascending block order per direction, preferring
+// reads, unless the oldest request of the chosen direction has expired.
+// Writes get a batch after KERN_DEADLINE_WRITES_STARVED read batches.
+class KernDeadlineElevator : public KernElevator {
+public:
+  KernRequest *merge(KernBio *bio) override {
+    return sorted[bio->write].merge(bio);
+  }
+
+  void insert(KernRequest *rq, uint64_t now) override {
+    sorted[rq->write].add(rq);
+    rq->deadline = now + KernBlockTicks(rq->write
+                                            ? KERN_DEADLINE_WRITE_EXPIRE_MS
+                                            : KERN_DEADLINE_READ_EXPIRE_MS);
+    rq->fifo = fifo[rq->write].insert(fifo[rq->write].end(), rq);
+  }
+
+  KernRequest *dispatch(uint64_t now) override {
+    KernRequest *rq = nullptr;
+    if (batch < KERN_DEADLINE_FIFO_BATCH)
+      rq = sorted[dir].from(position[dir]);
+    if (!rq) {
+      bool reads = !fifo[0].empty();
+      bool writes = !fifo[1].empty();
+      if (!reads && !writes)
+        return nullptr;
+      if (reads && (!writes || starved < KERN_DEADLINE_WRITES_STARVED)) {
+        dir = 0;
+        starved += writes;
+      } else {
+        dir = 1;
+        starved = 0;
+      }
+      batch = 0;
+      KernRequest *oldest = fifo[dir].front();
+      rq = sorted[dir].from(position[dir]);
+      if (!rq || oldest->deadline <= now)
+        rq = oldest;
+    }
+    sorted[dir].remove(rq);
+    fifo[dir].erase(rq->fifo);
+    position[dir] = rq->end();
+    batch++;
+    return rq;
+  }
+
+  bool empty() const override { return fifo[0].empty() && fifo[1].empty(); }
+
+private:
+  KernRequestSet sorted[2];
+  std::list<KernRequest *> fifo[2]; // Oldest first
+  uint64_t position[2] = {0, 0};    // Where the last batch left off
+  int dir = 0;
+  unsigned batch = KERN_DEADLINE_FIFO_BATCH;
+  unsigned starved = 0;
+};
+
+// BFQ-style fair queueing: one queue per cgroup, each charged blocks
+// served divided by its weight. The backlogged queue with the least
+// weighted service gets the device for up to KERN_BFQ_BUDGET blocks,
+// served in block order. A queue that goes idle rejoins at the current
+// virtual time rather than with banked credit.
+class KernBFQElevator : public KernElevator {
+public:
+  KernRequest *merge(KernBio *bio) override {
+    auto it = queues.find(bio->cgroupID);
+    return it != queues.end() ? it->second.sets[bio->write].merge(bio)
+                              : nullptr;
+  }
+
+  void insert(KernRequest *rq, uint64_t) override {
+    Queue &q = queues[rq->cgroupID];
+    q.weight = std::max(rq->weight, 1u);
+    if (q.fifo.empty())
+      q.vtime = std::max(q.vtime, vclock);
+    q.sets[rq->write].add(rq);
+    rq->fifo = q.fifo.insert(q.fifo.end(), rq);
+    queued++;
+  }
+
+  KernRequest *dispatch(uint64_t) override {
+    if (!queued)
+      return nullptr;
+    if (!active || active->fifo.empty() || served >= KERN_BFQ_BUDGET) {
+      active = nullptr;
+      for (auto &entry : queues) {
+        Queue &q = entry.second;
+        if (!q.fifo.empty() && (!active || q.vtime < active->vtime))
+          active = &q;
+      }
+      served = 0;
+      vclock = active->vtime;
+    }
+    Queue &q = *active;
+    KernRequest *rq = q.sets[0].from(q.position);
+    if (!rq)
+      rq = q.sets[1].from(q.position);
+    if (!rq)
+      rq = q.fifo.front();
+    q.sets[rq->write].remove(rq);
+    q.fifo.erase(rq->fifo);
+    q.position = rq->end();
+    q.vtime += (uint64_t)rq->count * 100 / q.weight + 1;
+    served += rq->count;
+    queued--;
+    return rq;
+  }
+
+  bool empty() const override { return !queued; }
+
+private:
+  struct Queue {
+    KernRequestSet sets[2];
+    std::list<KernRequest *> fifo;
+    uint32_t weight = 100;
+    uint64_t vtime = 0;
+    uint64_t position = 0;
+  };
+
+  std::unordered_map<uint32_t, Queue> queues; // Node-stable
+  Queue *active = nullptr;
+  uint64_t served = 0;
+  uint64_t vclock = 0;
+  size_t queued = 0;
+};
+
+std::unique_ptr<KernElevator> KernElevatorCreate(KernIOScheduler scheduler) {
+  switch (scheduler) {
+  case KernIOSchedulerDeadline:
+    return std::make_unique<KernDeadlineElevator>();
+  case KernIOSchedulerBFQ:
+    return std::make_unique<KernBFQElevator>();
+  default:
+    return std::make_unique<KernNoopElevator>();
+  }
+}
+
+struct KernBlockDirStats {
+  uint64_t bios = 0;
+  uint64_t blocks = 0;
+  uint64_t requests = 0;
+  uint64_t latencyNs = 0;
+  uint64_t maxLatencyNs = 0;
+  uint64_t histogram[KERN_BLOCK_LATENCY_BUCKETS] = {};
+};
+
+struct KernBlockQueue {
+  std::mutex lock;
+  std::unique_ptr<KernElevator> elevator;
+  KernIOScheduler scheduler = KernIOSchedulerDeadline;
+  uint32_t inflight = 0;
+  uint64_t seq = 0;
+  std::atomic<bool> running[KERN_BLOCK_HW_QUEUES] = {};
+  dispatch_queue_t hw[KERN_BLOCK_HW_QUEUES];
+
+  // Backing: a host file when fd >= 0, else sparse memory
+  int fd = -1;
+  std::mutex dataLock;
+  std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> ram;
+  uint64_t capacity = 0;
+
+  // Under lock
+  KernBlockDirStats stats[2];
+  uint64_t merges = 0;
+  uint64_t discards = 0;
+  uint64_t errors = 0;
+  uint32_t maxInflight = 0;
+  uint64_t created = 0;
+};
+
+} // namespace
+
+// ============================================================================
+// KernBlockDevice
+// ============================================================================
+
+@interface KernBlockDevice ()
+- (instancetype)initWithName:(NSString *)name
+                    hostPath:(NSString *)path
+                      blocks:(uint64_t)blocks;
+- (KernBlockQueue *)queue;
+- (void)submit:(KernBio *)bios count:(size_t)count;
+- (void)discard:(uint64_t)block count:(uint64_t)count;
+@end
+
+@implementation KernBlockDevice {
+  KernBlockQueue _queue;
+}
+
+- (instancetype)initWithName:(NSString *)name
+                    hostPath:(NSString *)path
+                      blocks:(uint64_t)blocks {
+  self = [super init];
+  if (self) {
+    _name = [name copy];
+    _hostPath = [path copy];
+    _capacityBlocks = blocks;
+    _queue.capacity = blocks;
+    _queue.created = mach_absolute_time();
+    _queue.elevator = KernElevatorCreate(_queue.scheduler);
+    for (int i = 0; i < KERN_BLOCK_HW_QUEUES; i++) {
+      NSString *label =
+          [NSString stringWithFormat:@"kern.blk.%@.%d", name, i];
+      _queue.hw[i] = dispatch_queue_create(label.UTF8String,
+                                           DISPATCH_QUEUE_SERIAL);
+    }
+    if (path) {
+      // Blocks never written stay unallocated in the host file
+      _queue.fd = open(path.fileSystemRepresentation, O_RDWR | O_CREAT, 0600);
+      if (_queue.fd < 0 ||
+          ftruncate(_queue.fd, (off_t)(blocks * KERN_PAGE_SIZE)) != 0)
+        return nil;
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (_queue.fd >= 0)
+    close(_queue.fd);
+}
+
+- (KernBlockQueue *)queue {
+  return &_queue;
+}
+
+- (uint32_t)hardwareQueues {
+  return KERN_BLOCK_HW_QUEUES;
+}
+
+- (uint32_t)queueDepth {
+  return KERN_BLOCK_QUEUE_DEPTH;
+}
+
+- (KernIOScheduler)scheduler {
+  std::lock_guard<std::mutex> guard(_queue.lock);
+  return _queue.scheduler;
+}
+
+// Queued requests move to the new elevator in the old one's order
+- (void)setScheduler:(KernIOScheduler)scheduler {
+  std::lock_guard<std::mutex> guard(_queue.lock);
+  if (scheduler == _queue.scheduler)
+    return;
+  std::unique_ptr<KernElevator> next = KernElevatorCreate(scheduler);
+  uint64_t now = mach_absolute_time();
+  while (KernRequest *rq = _queue.elevator->dispatch(UINT64_MAX))
+    next->insert(rq, now);
+  _queue.elevator = std::move(next);
+  _queue.scheduler = scheduler;
+}
+
+// Runs one request against the backing store. Returns 0 or -errno.
+- (int)execute:(KernRequest *)rq {
+  if (rq->end() > _queue.capacity)
+    return -EIO;
+  if (_queue.fd >= 0) {
+    struct iovec iov[KERN_BLOCK_MAX_REQUEST];
+    int n = 0;
+    for (KernBio *bio : rq->bios)
+      for (uint32_t i = 0; i < bio->count; i++)
+        iov[n++] = {bio->pages[i], KERN_PAGE_SIZE};
+    off_t offset = (off_t)(rq->block * KERN_PAGE_SIZE);
+    ssize_t done = rq->write ? pwritev(_queue.fd, iov, n, offset)
+                             : preadv(_queue.fd, iov, n, offset);
+    return done == (ssize_t)n * KERN_PAGE_SIZE ? 0 : -EIO;
+  }
+  std::lock_guard<std::mutex> guard(_queue.dataLock);
+  uint64_t block = rq->block;
+  for (KernBio *bio : rq->bios) {
+    for (uint32_t i = 0; i < bio->count; i++, block++) {
+      if (rq->write) {
+        std::unique_ptr<uint8_t[]> &slot = _queue.ram[block];
+        if (!slot)
+          slot.reset(new uint8_t[KERN_PAGE_SIZE]);
+        memcpy(slot.get(), bio->pages[i], KERN_PAGE_SIZE);
+      } else {
+        auto it = _queue.ram.find(block);
+        if (it != _queue.ram.end())
+          memcpy(bio->pages[i], it->second.get(), KERN_PAGE_SIZE);
+        else
+          memset(bio->pages[i], 0, KERN_PAGE_SIZE);
+      }
+    }
+  }
+  return 0;
+}
+
+- (void)complete:(KernRequest *)rq error:(int)err {
+  uint64_t now = mach_absolute_time();
+  {
+    std::lock_guard<std::mutex> guard(_queue.lock);
+    _queue.inflight--;
+    KernBlockDirStats &stats = _queue.stats[rq->write];
+    stats.requests++;
+    if (err)
+      _queue.errors++;
+    for (KernBio *bio : rq->bios) {
+      uint64_t ns = KernBlockNs(now - bio->submitted);
+      stats.bios++;
+      stats.blocks += bio->count;
+      stats.latencyNs += ns;
+      stats.maxLatencyNs = std::max(stats.maxLatencyNs, ns);
+      uint64_t us = ns / 1000;
+      int bucket = us ? 64 - __builtin_clzll(us) : 0;
+      stats.histogram[std::min(bucket, KERN_BLOCK_LATENCY_BUCKETS - 1)]++;
+    }
+  }
+  for (KernBio *bio : rq->bios) {
+    KernBioWait *wait = bio->wait;
+    // Notify under the lock: the waiter's frame goes away once it sees 0
+    std::lock_guard<std::mutex> guard(wait->lock);
+    if (err && !wait->error)
+      wait->error = err;
+    if (--wait->pending == 0)
+      wait->done.notify_one();
+  }
+  delete rq;
+}
+
+// Body of one hardware dispatch context. It stops, under the queue lock,
+// when the elevator is empty or the device is at depth; a later submission
+// or completion finds it stopped and restarts it.
+- (void)drain:(int)hw {
+  for (;;) {
+    KernRequest *rq;
+    {
+      std::lock_guard<std::mutex> guard(_queue.lock);
+      rq = _queue.inflight < KERN_BLOCK_QUEUE_DEPTH
+               ? _queue.elevator->dispatch(mach_absolute_time())
+               : nullptr;
+      if (!rq) {
+        _queue.running[hw] = false;
+        return;
+      }
+      _queue.inflight++;
+      _queue.maxInflight = std::max(_queue.maxInflight, _queue.inflight);
+    }
+    // The host I/O blocks, so it runs off the dispatch context
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+      [self complete:rq error:[self execute:rq]];
+      [self run];
+    });
+  }
+}
+
+- (void)run {
+  for (int i = 0; i < KERN_BLOCK_HW_QUEUES; i++) {
+    if (_queue.running[i].exchange(true))
+      continue;
+    dispatch_async(_queue.hw[i], ^{
+      [self drain:i];
+    });
+  }
+}
+
+- (void)submit:(KernBio *)bios count:(size_t)count {
+  uint64_t now = mach_absolute_time();
+  {
+    std::lock_guard<std::mutex> guard(_queue.lock);
+    for (size_t i = 0; i < count; i++) {
+      KernBio *bio = &bios[i];
+      bio->submitted = now;
+      if (_queue.elevator->merge(bio)) {
+        _queue.merges++;
+        continue;
+      }
+      KernRequest *rq = new KernRequest();
+      rq->write = bio->write;
+      rq->block = bio->block;
+      rq->count = bio->count;
+      rq->cgroupID = bio->cgroupID;
+      rq->weight = bio->weight;
+      rq->seq = _queue.seq++;
+      rq->bios.push_back(bio);
+      _queue.elevator->insert(rq, now);
+    }
+  }
+  [self run];
+}
+
+- (void)discard:(uint64_t)block count:(uint64_t)count {
+  std::lock_guard<std::mutex> guard(_queue.lock);
+  _queue.discards += count;
+  if (_queue.fd < 0) {
+    std::lock_guard<std::mutex> dataGuard(_queue.dataLock);
+    for (uint64_t b = block; b < block + count && !_queue.ram.empty(); b++)
+      _queue.ram.erase(b);
+    return;
+  }
+#ifdef F_PUNCHHOLE
+  fpunchhole_t hole = {0, 0, (off_t)(block * KERN_PAGE_SIZE),
+                       (off_t)(count * KERN_PAGE_SIZE)};
+  fcntl(_queue.fd, F_PUNCHHOLE, &hole);
+#endif
+}
+
+@end
+
+// --- Block I/O hooks ---
+
+int KernBlockRW(KernBlockDevice *dev, bool write, const KernBlockIO *ios,
+                size_t count) {
+  if (!dev || !count)
+    return 0;
+  AdvancedKernel *kernel = [AdvancedKernel sharedInstance];
+  KernCgroup *cgroup = [kernel cgroupForProcess:[kernel currentPID]];
+
+  KernBioWait wait;
+  std::vector<KernBio> bios;
+  bios.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    // Split anything over the request cap; it could never merge whole
+    for (uint32_t done = 0; done < ios[i].count;
+         done += KERN_BLOCK_MAX_REQUEST) {
+      KernBio bio;
+      bio.write = write;
+      bio.block = ios[i].block + done;
+      bio.count = std::min(ios[i].count - done,
+                           (uint32_t)KERN_BLOCK_MAX_REQUEST);
+      bio.pages = ios[i].pages + done;
+      bio.cgroupID = cgroup ? cgroup.cgroupID : 0;
+      bio.weight = cgroup ? cgroup.ioWeight : 100;
+      bio.wait = &wait;
+      bios.push_back(bio);
+    }
+  }
+  wait.pending = bios.size();
+  [dev submit:bios.data() count:bios.size()];
+  std::unique_lock<std::mutex> lock(wait.lock);
+  wait.done.wait(lock, [&] { return wait.pending == 0; });
+  return wait.error;
+}
+
+void KernBlockDiscard(KernBlockDevice *dev, uint64_t block, uint64_t count) {
+  if (dev && count)
+    [dev discard:block count:count];
+}
+
+// ============================================================================
+// AdvancedKernel — Block Device Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Block)
+
+- (KernBlockDevice *)createBlockDevice:(NSString *)name
+                              hostPath:(NSString *)path
+                                blocks:(uint64_t)blocks
+                             scheduler:(KernIOScheduler)scheduler {
+  if (!name.length || !blocks)
+    return nil;
+  KernBlockDevice *dev = [[KernBlockDevice alloc] initWithName:name
+                                                      hostPath:path
+                                                        blocks:blocks];
+  if (!dev)
+    return nil;
+  dev.scheduler = scheduler;
+  @synchronized(self.internalState) {
+    NSMutableDictionary *devices = self.internalState[@"blockDevices"];
+    if (!devices) {
+      devices = [NSMutableDictionary dictionary];
+      self.internalState[@"blockDevices"] = devices;
+    }
+    devices[name] = dev;
+  }
+  return dev;
+}
+
+// Users still holding the device keep it alive; requests in flight finish
+- (void)removeBlockDevice:(KernBlockDevice *)dev {
+  if (!dev)
+    return;
+  @synchronized(self.internalState) {
+    NSMutableDictionary *devices = self.internalState[@"blockDevices"];
+    if (devices[dev.name] == dev)
+      [devices removeObjectForKey:dev.name];
+  }
+}
+
+- (NSDictionary *)blockDeviceStatistics:(KernBlockDevice *)dev {
+  if (!dev)
+    return @{};
+  KernBlockQueue *q = [dev queue];
+  std::lock_guard<std::mutex> guard(q->lock);
+  size_t resident;
+  {
+    std::lock_guard<std::mutex> dataGuard(q->dataLock);
+    resident = q->ram.size();
+  }
+  double seconds = KernBlockNs(mach_absolute_time() - q->created) / 1e9;
+  NSMutableDictionary *stats = [NSMutableDictionary dictionary];
+  const char *names[2] = {"read", "write"};
+  for (int dir = 0; dir < 2; dir++) {
+    const KernBlockDirStats &s = q->stats[dir];
+    // Upper bound of the bucket holding the 99th percentile
+    uint64_t rank = s.bios - s.bios / 100, seen = 0, p99 = 0;
+    for (int b = 0; b < KERN_BLOCK_LATENCY_BUCKETS && s.bios; b++) {
+      seen += s.histogram[b];
+      if (seen >= rank) {
+        p99 = 1ULL << b;
+        break;
+      }
+    }
+    NSString *prefix = @(names[dir]);
+    stats[[prefix stringByAppendingString:@"_ios"]] = @(s.bios);
+    stats[[prefix stringByAppendingString:@"_requests"]] = @(s.requests);
+    stats[[prefix stringByAppendingString:@"_bytes"]] =
+        @(s.blocks * KERN_PAGE_SIZE);
+    stats[[prefix stringByAppendingString:@"_mb_per_sec"]] =
+        @(seconds > 0 ? s.blocks * KERN_PAGE_SIZE / 1048576.0 / seconds : 0);
+    stats[[prefix stringByAppendingString:@"_avg_latency_us"]] =
+        @(s.bios ? s.latencyNs / 1000.0 / s.bios : 0);
+    stats[[prefix stringByAppendingString:@"_p99_latency_us"]] = @(p99);
+    stats[[prefix stringByAppendingString:@"_max_latency_us"]] =
+        @(s.maxLatencyNs / 1000.0);
+  }
+  static NSString *const schedulers[] = {@"none", @"mq-deadline", @"bfq"};
+  [stats addEntriesFromDictionary:@{
+    @"name" : dev.name,
+    @"backing" : dev.hostPath ?: @"ram",
+    @"capacity_blocks" : @(dev.capacityBlocks),
+    @"resident_blocks" : @(resident),
+    @"scheduler" : schedulers[q->scheduler],
+    @"hw_queues" : @(KERN_BLOCK_HW_QUEUES),
+    @"queue_depth" : @(KERN_BLOCK_QUEUE_DEPTH),
+    @"max_inflight" : @(q->maxInflight),
+    @"merges" : @(q->merges),
+    @"discarded_blocks" : @(q->discards),
+    @"errors" : @(q->errors)
+  }];
+  return stats;
+}
+
+@end
@@ -0,0 +1,333 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Cgroup Controllers: pids and io
+// ============================================================================
+//
+// Each cgroup has a C++ state record, found by id through a two-level table
+// that is read without locks. The calling thread caches its process's
+// cgroup id until some process changes cgroup.
+//
+// pids: a process is charged to its cgroup and every ancestor when created
+// and uncharged when it exits. The counters are atomics; a creation that
+// would take any level past pidsMax is rolled back and fails with EAGAIN.
+// Moving a process between cgroups transfers its charge without checking
+// limits, as migration does in Linux.
+//
+// io: reads and writes through the VFS are charged to the caller's cgroup
+// after they complete. Each limit is a token bucket that may bank
+// KERN_THROTL_BURST_MS of budget and otherwise runs into debt; a caller
+// whose charge overdraws any bucket on its path sleeps until the debt is
+// repaid. A limit on a cgroup bounds its whole subtree. It is also split
+// between the children that did I/O in that direction within the last
+// KERN_THROTL_ACTIVE_MS, in proportion to their ioWeight, so a busy
+// neighbour cannot take a quiet sibling's share while an idle sibling's
+// share goes to whoever is active. With no limit set anywhere the charge is
+// two relaxed counter updates.
+
+#define KERN_CGROUP_CHUNK 256  // Cgroups per table chunk
+#define KERN_CGROUP_CHUNKS 256 // Cgroup ids below 65536 are controlled
+#define KERN_CGROUP_MAX_DEPTH 32
+#define KERN_THROTL_BURST_MS 100  // Budget a group may bank
+#define KERN_THROTL_ACTIVE_MS 100 // Recent I/O that earns a weighted share
+
+namespace {
+
+uint64_t KernThrottleTicks(uint64_t ms) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info(&timebase);
+  });
+  return ms * 1000000ULL * timebase.denom / timebase.numer;
+}
+
+double KernThrottleSeconds(uint64_t ticks) {
+  return (double)ticks / KernThrottleTicks(1000);
+}
+
+// One limit's state (blk-throttle). Buckets run into debt: a caller that
+// overdraws sleeps until its share of the rate has elapsed.
+struct KernTokenBucket {
+  double tokens = 0;
+  uint64_t last = 0;
+
+  double take(double rate, double cost, uint64_t now) {
+    double burst = std::max(rate * KERN_THROTL_BURST_MS / 1000.0, cost);
+    if (!last)
+      tokens = burst;
+    else
+      tokens = std::min(burst,
+                        tokens + rate * KernThrottleSeconds(now - last));
+    last = now;
+    tokens -= cost;
+    return tokens >= 0 ? 0 : -tokens / rate;
+  }
+};
+
+struct KernCgroupState {
+  uint32_t cgroupID = 0;
+  __unsafe_unretained KernCgroup *cgroup = nil; // Cgroups are never freed
+  KernCgroupState *parent = nullptr;
+
+  std::atomic<uint32_t> pids{0};
+  std::atomic<uint32_t> pidsMax{UINT32_MAX};
+  std::atomic<uint64_t> pidsRejected{0};
+
+  std::atomic<uint64_t> bytes[2];
+  std::atomic<uint64_t> ios[2];
+  std::atomic<uint64_t> throttledNs{0};
+  // Under gThrottleLock
+  KernTokenBucket bps[2];
+  KernTokenBucket iops[2];
+  uint64_t lastIO[2] = {0, 0};
+  bool ioLimited = false; // Counted in gThrottleLimited
+
+  KernCgroupState() {
+    for (int dir = 0; dir < 2; dir++) {
+      bytes[dir].store(0, std::memory_order_relaxed);
+      ios[dir].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+std::atomic<std::atomic<KernCgroupState *> *> gCgroupTable[KERN_CGROUP_CHUNKS];
+std::mutex gCgroupTableLock;
+std::atomic<uint64_t> gCgroupGeneration{1}; // Bumped when processes move
+thread_local uint64_t tCgroupGeneration = 0;
+thread_local uint32_t tCgroupPID = 0;
+thread_local uint32_t tCgroupID = 0;
+
+std::mutex gThrottleLock;
+std::atomic<uint32_t> gThrottleLimited{0}; // Cgroups with any io limit
+
+KernCgroupState *KernCgroupLookup(uint32_t cgroupID) {
+  if (cgroupID == 0 || cgroupID >= KERN_CGROUP_CHUNK * KERN_CGROUP_CHUNKS)
+    return nullptr;
+  std::atomic<KernCgroupState *> *chunk =
+      gCgroupTable[cgroupID / KERN_CGROUP_CHUNK].load(
+          std::memory_order_acquire);
+  return chunk ? chunk[cgroupID % KERN_CGROUP_CHUNK].load(
+                     std::memory_order_acquire)
+               : nullptr;
+}
+
+inline bool KernThrottleUnlimited(uint64_t limit) {
+  return limit == 0 || limit == UINT64_MAX;
+}
+
+bool KernThrottleHasLimit(KernCgroup *cg) {
+  return !KernThrottleUnlimited(cg.ioReadBps) ||
+         !KernThrottleUnlimited(cg.ioWriteBps) ||
+         !KernThrottleUnlimited(cg.ioReadIOps) ||
+         !KernThrottleUnlimited(cg.ioWriteIOps);
+}
+
+// The rate a level may use: its own limit, and its weighted share of the
+// parent's rate among the parent's recently active children
+void KernThrottleRates(KernCgroupState *const *path, int depth, bool write,
+                       uint64_t now, double *bps, double *iops) {
+  const uint64_t active = KernThrottleTicks(KERN_THROTL_ACTIVE_MS);
+  for (int level = depth - 1; level >= 0; level--) {
+    KernCgroup *cg = path[level]->cgroup;
+    uint64_t ownBps = write ? cg.ioWriteBps : cg.ioReadBps;
+    uint64_t ownIOps = write ? cg.ioWriteIOps : cg.ioReadIOps;
+    bps[level] = KernThrottleUnlimited(ownBps) ? INFINITY : (double)ownBps;
+    iops[level] = KernThrottleUnlimited(ownIOps) ? INFINITY : (double)ownIOps;
+    if (level == depth - 1 ||
+        (std::isinf(bps[level + 1]) && std::isinf(iops[level + 1])))
+      continue;
+    double total = 0;
+    for (KernCgroup *sibling in path[level + 1]->cgroup.children) {
+      KernCgroupState *state = KernCgroupLookup(sibling.cgroupID);
+      if (state == path[level] ||
+          (state && now - state->lastIO[write] < active))
+        total += std::clamp(sibling.ioWeight, 1u, 1000u);
+    }
+    double share = std::clamp(cg.ioWeight, 1u, 1000u) / total;
+    bps[level] = std::min(bps[level], bps[level + 1] * share);
+    iops[level] = std::min(iops[level], iops[level + 1] * share);
+  }
+}
+
+} // namespace
+
+// --- Cgroup hooks ---
+
+void KernCgroupCreate(KernCgroup *cgroup) {
+  uint32_t cgroupID = cgroup.cgroupID;
+  if (cgroupID == 0 || cgroupID >= KERN_CGROUP_CHUNK * KERN_CGROUP_CHUNKS)
+    return;
+  std::lock_guard<std::mutex> guard(gCgroupTableLock);
+  auto &slot = gCgroupTable[cgroupID / KERN_CGROUP_CHUNK];
+  std::atomic<KernCgroupState *> *chunk = slot.load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new std::atomic<KernCgroupState *>[KERN_CGROUP_CHUNK]();
+    slot.store(chunk, std::memory_order_release);
+  }
+  KernCgroupState *state = new KernCgroupState();
+  state->cgroupID = cgroupID;
+  state->cgroup = cgroup;
+  state->parent = KernCgroupLookup(cgroup.parent.cgroupID);
+  state->pidsMax.store(cgroup.pidsMax, std::memory_order_relaxed);
+  state->ioLimited = KernThrottleHasLimit(cgroup);
+  if (state->ioLimited)
+    gThrottleLimited.fetch_add(1, std::memory_order_relaxed);
+  chunk[cgroupID % KERN_CGROUP_CHUNK].store(state, std::memory_order_release);
+}
+
+uint32_t KernCurrentCgroupID(void) {
+  uint32_t pid = KernCurrentPID();
+  uint64_t generation = gCgroupGeneration.load(std::memory_order_acquire);
+  if (__builtin_expect(pid == tCgroupPID && generation == tCgroupGeneration,
+                       1))
+    return tCgroupID;
+  KernProcess *proc = [[AdvancedKernel sharedInstance] processForPID:pid];
+  tCgroupID = proc ? proc.cgroupID : 0;
+  tCgroupPID = pid;
+  tCgroupGeneration = generation;
+  return tCgroupID;
+}
+
+void KernCgroupProcessMoved(void) {
+  gCgroupGeneration.fetch_add(1, std::memory_order_release);
+}
+
+bool KernPidsCharge(uint32_t cgroupID) {
+  KernCgroupState *state = KernCgroupLookup(cgroupID);
+  for (KernCgroupState *s = state; s; s = s->parent) {
+    uint32_t pids = s->pids.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (pids > s->pidsMax.load(std::memory_order_relaxed)) {
+      s->pids.fetch_sub(1, std::memory_order_relaxed);
+      for (KernCgroupState *u = state; u != s; u = u->parent)
+        u->pids.fetch_sub(1, std::memory_order_relaxed);
+      s->pidsRejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  return true;
+}
+
+void KernPidsUncharge(uint32_t cgroupID) {
+  for (KernCgroupState *s = KernCgroupLookup(cgroupID); s; s = s->parent)
+    s->pids.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void KernPidsMove(uint32_t fromID, uint32_t toID) {
+  KernPidsUncharge(fromID);
+  for (KernCgroupState *s = KernCgroupLookup(toID); s; s = s->parent)
+    s->pids.fetch_add(1, std::memory_order_relaxed);
+}
+
+void KernPidsSetMax(uint32_t cgroupID, uint32_t max) {
+  if (KernCgroupState *state = KernCgroupLookup(cgroupID))
+    state->pidsMax.store(max, std::memory_order_relaxed);
+}
+
+// Keeps the count of limited groups, so unlimited trees never take the lock,
+// and restarts the buckets so a new rate does not inherit the old one's debt
+void KernCgroupSetIOLimits(uint32_t cgroupID) {
+  KernCgroupState *state = KernCgroupLookup(cgroupID);
+  if (!state)
+    return;
+  std::lock_guard<std::mutex> guard(gThrottleLock);
+  bool limited = KernThrottleHasLimit(state->cgroup);
+  if (limited != state->ioLimited) {
+    state->ioLimited = limited;
+    if (limited)
+      gThrottleLimited.fetch_add(1, std::memory_order_relaxed);
+    else
+      gThrottleLimited.fetch_sub(1, std::memory_order_relaxed);
+  }
+  for (int dir = 0; dir < 2; dir++) {
+    state->bps[dir] = KernTokenBucket();
+    state->iops[dir] = KernTokenBucket();
+  }
+}
+
+void KernCgroupThrottleIO(bool write, uint64_t bytes) {
+  KernCgroupState *state = KernCgroupLookup(KernCurrentCgroupID());
+  if (!state || !bytes)
+    return;
+  state->bytes[write].fetch_add(bytes, std::memory_order_relaxed);
+  state->ios[write].fetch_add(1, std::memory_order_relaxed);
+  if (gThrottleLimited.load(std::memory_order_relaxed) == 0)
+    return;
+
+  KernCgroupState *path[KERN_CGROUP_MAX_DEPTH];
+  int depth = 0;
+  for (KernCgroupState *s = state; s && depth < KERN_CGROUP_MAX_DEPTH;
+       s = s->parent)
+    path[depth++] = s;
+  double bps[KERN_CGROUP_MAX_DEPTH], iops[KERN_CGROUP_MAX_DEPTH];
+  double wait = 0;
+  {
+    std::lock_guard<std::mutex> guard(gThrottleLock);
+    uint64_t now = mach_absolute_time();
+    for (int level = 0; level < depth; level++)
+      path[level]->lastIO[write] = now;
+    KernThrottleRates(path, depth, write, now, bps, iops);
+    for (int level = 0; level < depth; level++) {
+      KernCgroupState *s = path[level];
+      if (!std::isinf(bps[level]))
+        wait = std::max(wait, s->bps[write].take(bps[level], bytes, now));
+      if (!std::isinf(iops[level]))
+        wait = std::max(wait, s->iops[write].take(iops[level], 1, now));
+    }
+  }
+  if (wait <= 0)
+    return;
+  uint64_t start = mach_absolute_time();
+  std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  state->throttledNs.fetch_add(
+      (uint64_t)(KernThrottleSeconds(mach_absolute_time() - start) * 1e9),
+      std::memory_order_relaxed);
+}
+
+void KernCgroupStat(uint32_t cgroupID, KernCgroupStats *out) {
+  *out = KernCgroupStats();
+  KernCgroupState *state = KernCgroupLookup(cgroupID);
+  if (!state)
+    return;
+  out->pids = state->pids.load(std::memory_order_relaxed);
+  out->pidsRejected = state->pidsRejected.load(std::memory_order_relaxed);
+  out->readBytes = state->bytes[0].load(std::memory_order_relaxed);
+  out->writeBytes = state->bytes[1].load(std::memory_order_relaxed);
+  out->readIOs = state->ios[0].load(std::memory_order_relaxed);
+  out->writeIOs = state->ios[1].load(std::memory_order_relaxed);
+  out->throttledNs = state->throttledNs.load(std::memory_order_relaxed);
+}
+
+// ============================================================================
+// AdvancedKernel — Cgroup Controller Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Cgroup)
+
+- (void)setCgroupIOLimit:(KernCgroup *)cgroup
+                 readBps:(uint64_t)readBps
+                writeBps:(uint64_t)writeBps
+                readIOps:(uint64_t)readIOps
+               writeIOps:(uint64_t)writeIOps {
+  if (!cgroup)
+    return;
+  cgroup.ioReadBps = readBps ?: UINT64_MAX;
+  cgroup.ioWriteBps = writeBps ?: UINT64_MAX;
+  cgroup.ioReadIOps = readIOps ?: UINT64_MAX;
+  cgroup.ioWriteIOps = writeIOps ?: UINT64_MAX;
+}
+
+@end
@@ -1,8 +1,9 @@
 #import "AdvancedKernel.h"
 #include <mach/mach_time.h>
+#include <atomic>
 
 // ============================================================================
-// VFS, Syscall, Security, Logging, and Core AdvancedKernel Implementation
+// VFS, Syscall, Security, and Core AdvancedKernel Implementation
 // ============================================================================
 
 @implementation KernInode
@@ -25,9 +26,12 @@
     _createTime = now;
     _deviceMajor = 0;
     _deviceMinor = 0;
-    _dataBlocks = [NSMutableArray array];
+    _superblock = nil;
+    _extents = nil;
+    _dirtiedWhen = 0;
     _extendedAttributes = [NSMutableDictionary dictionary];
     _fsType = KernFSTypeAPFS;
+    _mapping = nil;
   }
   return self;
 }
@@ -40,7 +44,6 @@
     _name = @"";
     _inode = nil;
     _parent = nil;
-    _children = [NSMutableArray array];
     _isMountPoint = NO;
     _referenceCount = 1;
     _isNegative = NO;
@@ -68,6 +71,8 @@
     _mountFlags = 0;
     _readOnly = NO;
     _rootDentry = nil;
+    _blockStore = nil;
+    _writeback = nil;
   }
   return self;
 }
@@ -89,7 +94,10 @@
 }
 @end
 
-@implementation KernFileDescriptor
+@implementation KernFileDescriptor {
+  std::atomic<uint32_t> _references;
+}
+
 - (instancetype)init {
   self = [super init];
   if (self) {
@@ -98,14 +106,27 @@
     _offset = 0;
     _flags = 0;
     _mode = 0;
-    _referenceCount = 1;
+    _references = 1;
     _closeOnExec = NO;
     _nonBlocking = NO;
     _append = NO;
     _pipe = nil;
+    _readahead = nil;
   }
   return self;
 }
+
+- (uint32_t)referenceCount {
+  return _references.load(std::memory_order_relaxed);
+}
+
+- (void)acquireReference {
+  _references.fetch_add(1, std::memory_order_relaxed);
+}
+
+- (BOOL)dropReference {
+  return _references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
 @end
 
 @implementation KernSyscallResult
@@ -172,16 +193,59 @@
     _cpuShares = 1024;
     _memoryLimitBytes = UINT64_MAX;
     _memorySwapLimit = UINT64_MAX;
-    _memoryUsage = 0;
     _ioReadBps = UINT64_MAX;
     _ioWriteBps = UINT64_MAX;
     _ioReadIOps = UINT64_MAX;
     _ioWriteIOps = UINT64_MAX;
+    _ioWeight = 100;
     _pidsMax = UINT32_MAX;
-    _pidsCurrent = 0;
   }
   return self;
 }
+
+- (void)setPidsMax:(uint32_t)pidsMax {
+  _pidsMax = pidsMax;
+  KernPidsSetMax(_cgroupID, pidsMax);
+}
+
+- (void)setIoReadBps:(uint64_t)ioReadBps {
+  _ioReadBps = ioReadBps;
+  KernCgroupSetIOLimits(_cgroupID);
+}
+
+- (void)setIoWriteBps:(uint64_t)ioWriteBps {
+  _ioWriteBps = ioWriteBps;
+  KernCgroupSetIOLimits(_cgroupID);
+}
+
+- (void)setIoReadIOps:(uint64_t)ioReadIOps {
+  _ioReadIOps = ioReadIOps;
+  KernCgroupSetIOLimits(_cgroupID);
+}
+
+- (void)setIoWriteIOps:(uint64_t)ioWriteIOps {
+  _ioWriteIOps = ioWriteIOps;
+  KernCgroupSetIOLimits(_cgroupID);
+}
+
+- (void)setMemoryLimitBytes:(uint64_t)memoryLimitBytes {
+  _memoryLimitBytes = memoryLimitBytes;
+  KernMemcgSetLimit(_cgroupID, memoryLimitBytes);
+}
+
+// Counted by the pids controller, not stored
+- (uint32_t)pidsCurrent {
+  KernCgroupStats stats;
+  KernCgroupStat(_cgroupID, &stats);
+  return stats.pids;
+}
+
+// Charged by the memory controller, not stored
+- (uint64_t)memoryUsage {
+  KernMemcgStats stats;
+  KernMemcgStat(_cgroupID, &stats);
+  return stats.usage;
+}
 @end
 
 @implementation KernLogEntry
@@ -206,13 +270,11 @@
 @end
 
 // ============================================================================
-// Core AdvancedKernel singleton + VFS + Syscalls + Security + Logging
+// Core AdvancedKernel singleton + VFS + Syscalls + Security
 // ============================================================================
 
 @interface AdvancedKernel ()
 @property(nonatomic, strong) NSMutableDictionary *internalState;
-@property(nonatomic, strong) NSMutableArray<KernLogEntry *> *logBuffer;
-@property(nonatomic, assign) uint64_t logSequence;
 @property(nonatomic, assign) uint64_t bootTime;
 @property(nonatomic, assign) uint64_t syscallCount;
 @end
@@ -232,8 +294,6 @@
   self = [super init];
   if (self) {
     _internalState = [NSMutableDictionary dictionary];
-    _logBuffer = [NSMutableArray array];
-    _logSequence = 0;
     _bootTime = mach_absolute_time();
     _syscallCount = 0;
 
@@ -244,6 +304,7 @@
     _internalState[@"semaphores"] = [NSMutableArray array];
     _internalState[@"threads"] = [NSMutableArray array];
     _internalState[@"mountPoints"] = [NSMutableArray array];
+    _internalState[@"ioRings"] = [NSMutableDictionary dictionary];
     _internalState[@"namespaces"] = [NSMutableArray array];
     _internalState[@"cgroups"] = [NSMutableArray array];
     _internalState[@"sandboxProfiles"] = [NSMutableDictionary dictionary];
@@ -317,6 +378,7 @@
   rootSB.freeInodes = 50000000;
   rootSB.volumeLabel = @"Macintosh HD";
   rootSB.rootDentry = rootDentry;
+  rootInode.superblock = rootSB;
 
   // Create standard directories
   NSArray *dirs = @[
@@ -330,8 +392,9 @@
     KernInode *inode = [[KernInode alloc] init];
     inode.type = KernInodeDirectory;
     inode.mode = 0755;
+    inode.superblock = rootSB;
     dentry.inode = inode;
-    [rootDentry.children addObject:dentry];
+    KernDirInsert(rootDentry, dentry);
   }
 
   // Mount root
@@ -361,6 +424,12 @@
     sb.mountPoint = vfs[1];
     sb.blockSize = 4096;
     sb.volumeLabel = vfs[0];
+    // Files created under the mount directory allocate from its superblock
+    KernDentry *dentry = KernDirLookup(rootDentry, [vfs[1] lastPathComponent]);
+    if (dentry) {
+      sb.rootDentry = dentry;
+      dentry.inode.superblock = sb;
+    }
 
     KernMountPoint *mp = [[KernMountPoint alloc] init];
     mp.source = vfs[0];
@@ -387,12 +456,30 @@
   sb.deviceName = device;
   sb.mountPoint = mountPoint;
   sb.blockSize = 4096;
+  NSString *hostPath = options[@"hostPath"];
+  if (hostPath) {
+    uint64_t blocks = [options[@"blocks"] unsignedLongLongValue] ?: 262144;
+    KernIOScheduler scheduler = KernIOSchedulerDeadline;
+    if ([options[@"scheduler"] isEqualToString:@"none"])
+      scheduler = KernIOSchedulerNone;
+    else if ([options[@"scheduler"] isEqualToString:@"bfq"])
+      scheduler = KernIOSchedulerBFQ;
+    sb.blockDevice = [self createBlockDevice:device
+                                    hostPath:hostPath
+                                      blocks:blocks
+                                   scheduler:scheduler];
+    if (!sb.blockDevice)
+      return nil;
+    sb.totalBlocks = blocks;
+    sb.freeBlocks = blocks;
+  }
 
   KernDentry *mpDentry = [[KernDentry alloc] init];
   mpDentry.name = [mountPoint lastPathComponent];
   mpDentry.isMountPoint = YES;
   KernInode *mpInode = [[KernInode alloc] init];
   mpInode.type = KernInodeDirectory;
+  mpInode.superblock = sb;
   mpDentry.inode = mpInode;
   sb.rootDentry = mpDentry;
 
@@ -404,7 +491,7 @@
   mp.mountID = nextMountID++;
   mp.options = options;
 
-  NSMutableArray *mounts = self.internalState[@"mountPoints"];
+  NSMutableArray *mounts = KernMountTable();
   [mounts addObject:mp];
 
   [self kernelLog:KernLogInfo
@@ -415,7 +502,7 @@
 }
 
 - (BOOL)unmountFileSystem:(NSString *)mountPoint {
-  NSMutableArray *mounts = self.internalState[@"mountPoints"];
+  NSMutableArray *mounts = KernMountTable();
   KernMountPoint *toRemove = nil;
   for (KernMountPoint *mp in mounts) {
     if ([mp.target isEqualToString:mountPoint]) {
@@ -424,6 +511,7 @@
     }
   }
   if (toRemove) {
+    [self syncFileSystem:toRemove.superblock];
     [mounts removeObject:toRemove];
     [self kernelLog:KernLogInfo
            facility:KernLogVFS
@@ -434,30 +522,15 @@
 }
 
 - (KernInode *)lookupPath:(NSString *)path {
-  KernDentry *root = self.internalState[@"rootDentry"];
-  if ([path isEqualToString:@"/"])
-    return root.inode;
-
-  NSArray *components = [path pathComponents];
-  KernDentry *current = root;
-  for (NSString *comp in components) {
-    if ([comp isEqualToString:@"/"])
-      continue;
-    BOOL found = NO;
-    for (KernDentry *child in current.children) {
-      if ([child.name isEqualToString:comp]) {
-        current = child;
-        found = YES;
-        break;
-      }
-    }
-    if (!found)
-      return nil;
-  }
-  return current.inode;
+  return [self dentryForPath:path].inode;
 }
 
-- (KernInode *)createFile:(NSString *)path mode:(uint32_t)mode {
+- (KernDentry *)createEntry:(NSString *)path
+                       type:(KernInodeType)type
+                       mode:(uint32_t)mode {
+  if (KERN_STATIC_BRANCH(gKernLandlockKey) &&
+      !KernLandlockAllowsPath(path.UTF8String))
+    return nil;
   NSString *dirPath = [path stringByDeletingLastPathComponent];
   NSString *fileName = [path lastPathComponent];
 
@@ -469,35 +542,41 @@
   newDentry.name = fileName;
   newDentry.parent = parent;
   KernInode *inode = [[KernInode alloc] init];
-  inode.type = KernInodeFile;
+  inode.type = type;
   inode.mode = mode;
+  inode.superblock = parent.inode.superblock;
   newDentry.inode = inode;
-  [parent.children addObject:newDentry];
-  return inode;
+  if (KernDirInsert(parent, newDentry))
+    return nil; // Name already in use
+  KernDcacheAdd(newDentry);
+  KernFsnotify(nil, newDentry, KernNotifyCreate);
+  return newDentry;
+}
+
+- (KernInode *)createFile:(NSString *)path mode:(uint32_t)mode {
+  return [self createEntry:path type:KernInodeFile mode:mode].inode;
 }
 
 - (KernInode *)createDirectory:(NSString *)path mode:(uint32_t)mode {
-  KernInode *inode = [self createFile:path mode:mode];
-  if (inode)
-    inode.type = KernInodeDirectory;
-  return inode;
+  return [self createEntry:path type:KernInodeDirectory mode:mode].inode;
 }
 
 - (BOOL)deleteInode:(NSString *)path {
+  if (KERN_STATIC_BRANCH(gKernLandlockKey) &&
+      !KernLandlockAllowsPath(path.UTF8String))
+    return NO;
   NSString *dirPath = [path stringByDeletingLastPathComponent];
   NSString *name = [path lastPathComponent];
   KernDentry *parent = [self dentryForPath:dirPath];
   if (!parent)
     return NO;
-  KernDentry *toRemove = nil;
-  for (KernDentry *child in parent.children) {
-    if ([child.name isEqualToString:name]) {
-      toRemove = child;
-      break;
-    }
-  }
-  if (toRemove) {
-    [parent.children removeObject:toRemove];
+  KernDentry *toRemove = KernDirLookup(parent, name);
+  if (toRemove && KernDirRemove(parent, toRemove)) {
+    KernDcacheRemove(toRemove);
+    KernFsnotify(nil, toRemove, KernNotifyDelete);
+    KernInode *inode = toRemove.inode;
+    if (inode.linkCount > 0 && --inode.linkCount == 0)
+      KernFsnotifyInodeRemoved(inode);
     return YES;
   }
   return NO;
@@ -507,6 +586,9 @@
   KernInode *inode = [self lookupPath:target];
   if (!inode)
     return NO;
+  if (KERN_STATIC_BRANCH(gKernLandlockKey) &&
+      !KernLandlockAllowsPath(linkPath.UTF8String))
+    return NO;
   NSString *dirPath = [linkPath stringByDeletingLastPathComponent];
   KernDentry *parent = [self dentryForPath:dirPath];
   if (!parent)
@@ -515,67 +597,135 @@
   link.name = [linkPath lastPathComponent];
   link.parent = parent;
   link.inode = inode;
+  if (KernDirInsert(parent, link))
+    return NO;
   inode.linkCount++;
-  [parent.children addObject:link];
+  KernDcacheAdd(link);
+  KernFsnotify(nil, link, KernNotifyCreate);
   return YES;
 }
 
 - (BOOL)symlinkPath:(NSString *)target to:(NSString *)linkPath {
+  if (KERN_STATIC_BRANCH(gKernLandlockKey) &&
+      !KernLandlockAllowsPath(linkPath.UTF8String))
+    return NO;
   KernInode *inode = [[KernInode alloc] init];
   inode.type = KernInodeSymlink;
   NSString *dirPath = [linkPath stringByDeletingLastPathComponent];
   KernDentry *parent = [self dentryForPath:dirPath];
   if (!parent)
     return NO;
+  inode.superblock = parent.inode.superblock;
   KernDentry *link = [[KernDentry alloc] init];
   link.name = [linkPath lastPathComponent];
   link.parent = parent;
   link.inode = inode;
-  [parent.children addObject:link];
+  if (KernDirInsert(parent, link))
+    return NO;
+  KernDcacheAdd(link);
+  KernFsnotify(nil, link, KernNotifyCreate);
   return YES;
 }
 
-- (NSArray<KernDentry *> *)readDirectory:(NSString *)path {
-  KernDentry *dir = [self dentryForPath:path];
-  return dir ? [dir.children copy] : @[];
-}
-
 - (KernFileDescriptor *)openFile:(NSString *)path
                            flags:(uint32_t)flags
                             mode:(uint32_t)mode {
-  KernInode *inode = [self lookupPath:path];
-  if (!inode && (flags & 0x0200)) { // O_CREAT
-    inode = [self createFile:path mode:mode];
+  KernDentry *dentry = [self dentryForPath:path];
+  if (!dentry.inode && (flags & 0x0200)) { // O_CREAT
+    dentry = [self createEntry:path type:KernInodeFile mode:mode];
   }
+  KernInode *inode = dentry.inode;
   if (!inode)
     return nil;
 
-  static int32_t nextFD = 3; // 0,1,2 reserved for stdin/stdout/stderr
   KernFileDescriptor *fd = [[KernFileDescriptor alloc] init];
-  fd.fd = nextFD++;
   fd.inode = inode;
+  fd.dentry = dentry;
   fd.offset = 0;
   fd.flags = flags;
   fd.mode = mode;
+  fd.append = (flags & 0x0008) != 0;          // O_APPEND
+  fd.closeOnExec = (flags & 0x01000000) != 0; // O_CLOEXEC
+  int32_t number = [self installFileDescriptor:fd
+                                   closeOnExec:fd.closeOnExec];
+  if (number < 0)
+    return nil;
+  fd.fd = number;
   inode.accessTime = mach_absolute_time();
+  KernFsnotify(inode, dentry, KernNotifyOpen);
   return fd;
 }
 
-- (void)closeFile:(KernFileDescriptor *)fd {
-  if (fd) {
-    fd.referenceCount--;
-    fd.inode = nil;
+- (int64_t)readFD:(int32_t)fd
+             into:(void *)buffer
+           length:(NSUInteger)length
+           offset:(uint64_t)offset {
+  KernFileDescriptor *desc = [self fileDescriptorForNumber:fd];
+  if (!desc || !desc.inode)
+    return -EBADF;
+  if (!buffer && length)
+    return -EFAULT;
+  uint64_t position = offset == UINT64_MAX ? desc.offset : offset;
+  [self readaheadFile:desc offset:position length:length];
+  int64_t copied = [self pageCacheRead:desc.inode
+                                  into:buffer
+                                length:length
+                                offset:position];
+  if (copied > 0) {
+    if (offset == UINT64_MAX)
+      desc.offset = position + copied;
+    KernFsnotify(desc.inode, desc.dentry, KernNotifyAccess);
+    KernCgroupThrottleIO(false, (uint64_t)copied);
   }
+  return copied;
+}
+
+- (int64_t)writeFD:(int32_t)fd
+              from:(const void *)buffer
+            length:(NSUInteger)length
+            offset:(uint64_t)offset {
+  KernFileDescriptor *desc = [self fileDescriptorForNumber:fd];
+  if (!desc || !desc.inode)
+    return -EBADF;
+  if (!buffer && length)
+    return -EFAULT;
+  uint64_t position = offset == UINT64_MAX ? desc.offset : offset;
+  if (desc.append)
+    position = desc.inode.size;
+  int64_t written = [self pageCacheWrite:desc.inode
+                                    from:buffer
+                                  length:length
+                                  offset:position];
+  if (written > 0) {
+    if (offset == UINT64_MAX)
+      desc.offset = position + written;
+    KernFsnotify(desc.inode, desc.dentry, KernNotifyModify);
+    KernCgroupThrottleIO(true, (uint64_t)written);
+  }
+  return written;
 }
 
 - (NSData *)readFile:(KernFileDescriptor *)fd length:(NSUInteger)length {
   if (!fd || !fd.inode)
     return nil;
-  fd.inode.accessTime = mach_absolute_time();
-  // Return empty data for simulated read
-  NSUInteger readLen = MIN(length, (NSUInteger)(fd.inode.size - fd.offset));
-  fd.offset += readLen;
-  return [NSMutableData dataWithLength:readLen];
+  uint64_t size = fd.inode.size;
+  NSUInteger readLen =
+      fd.offset < size ? MIN(length, (NSUInteger)(size - fd.offset)) : 0;
+  NSMutableData *data = [NSMutableData dataWithLength:readLen];
+  [self readaheadFile:fd offset:fd.offset length:readLen];
+  int64_t copied = [self pageCacheRead:fd.inode
+                                  into:data.mutableBytes
+                                length:readLen
+                                offset:fd.offset];
+  if (copied < 0)
+    return nil;
+  data.length = (NSUInteger)copied;
+  fd.offset += copied;
+  if (copied > 0) {
+    KernFsnotify(fd.inode, fd.dentry, KernNotifyAccess);
+    KernCgroupThrottleIO(false, (uint64_t)copied);
+  }
+  return data;
 }
 
 - (NSInteger)writeFile:(KernFileDescriptor *)fd data:(NSData *)data {
@@ -583,10 +733,18 @@
     return -1;
   if (fd.append)
     fd.offset = fd.inode.size;
-  fd.inode.size = MAX(fd.inode.size, fd.offset + data.length);
-  fd.inode.modifyTime = mach_absolute_time();
-  fd.offset += data.length;
-  return data.length;
+  int64_t written = [self pageCacheWrite:fd.inode
+                                    from:data.bytes
+                                  length:data.length
+                                  offset:fd.offset];
+  if (written < 0)
+    return -1;
+  fd.offset += written;
+  if (written > 0) {
+    KernFsnotify(fd.inode, fd.dentry, KernNotifyModify);
+    KernCgroupThrottleIO(true, (uint64_t)written);
+  }
+  return (NSInteger)written;
 }
 
 - (BOOL)seekFile:(KernFileDescriptor *)fd
@@ -604,6 +762,18 @@
   case 2:
     fd.offset = fd.inode.size + offset;
     break; // SEEK_END
+  case 3: // SEEK_DATA
+  case 4: { // SEEK_HOLE
+    if (offset < 0)
+      return NO;
+    int64_t position = [self pageCacheSeek:fd.inode
+                                    offset:(uint64_t)offset
+                                      hole:whence == 4];
+    if (position < 0)
+      return NO;
+    fd.offset = (uint64_t)position;
+    break;
+  }
   default:
     return NO;
   }
@@ -611,11 +781,11 @@
 }
 
 - (NSArray<KernMountPoint *> *)mountedFileSystems {
-  return [self.internalState[@"mountPoints"] copy];
+  return [KernMountTable() copy];
 }
 
 - (NSDictionary *)fileSystemStatistics:(NSString *)mountPoint {
-  for (KernMountPoint *mp in self.internalState[@"mountPoints"]) {
+  for (KernMountPoint *mp in KernMountTable()) {
     if ([mp.target isEqualToString:mountPoint]) {
       KernSuperblock *sb = mp.superblock;
       return @{
@@ -629,6 +799,15 @@
         @"free_inodes" : @(sb.freeInodes),
         @"total_space" : @(sb.totalBlocks * sb.blockSize),
         @"free_space" : @(sb.freeBlocks * sb.blockSize),
+        @"allocated_blocks" : @(sb.blockStore.allocatedBlocks),
+        @"free_extents" : @(sb.blockStore.freeExtents),
+        @"dirty_pages" : @(sb.writeback.dirtyPages),
+        @"writeback_pages" : @(sb.writeback.writebackPages),
+        @"written_pages" : @(sb.writeback.writtenPages),
+        @"write_requests" : @(sb.writeback.writeRequests),
+        @"dirty_inodes" : @(sb.writeback.dirtyInodes),
+        @"flusher_wakeups" : @(sb.writeback.flusherWakeups),
+        @"throttled_ns" : @(sb.writeback.throttledNs),
         @"volume_label" : sb.volumeLabel ?: @"",
         @"uuid" : sb.uuid ?: @""
       };
@@ -637,158 +816,6 @@
   return @{};
 }
 
-// Helper
-- (KernDentry *)dentryForPath:(NSString *)path {
-  KernDentry *root = self.internalState[@"rootDentry"];
-  if ([path isEqualToString:@"/"] || path.length == 0)
-    return root;
-  NSArray *components = [path pathComponents];
-  KernDentry *current = root;
-  for (NSString *comp in components) {
-    if ([comp isEqualToString:@"/"])
-      continue;
-    BOOL found = NO;
-    for (KernDentry *child in current.children) {
-      if ([child.name isEqualToString:comp]) {
-        current = child;
-        found = YES;
-        break;
-      }
-    }
-    if (!found)
-      return nil;
-  }
-  return current;
-}
-
-// --- Syscall Interface ---
-
-- (KernSyscallResult *)executeSyscall:(KernSyscallNumber)number
-                                 args:(NSArray *)args {
-  self.syscallCount++;
-  KernSyscallResult *result = [[KernSyscallResult alloc] init];
-  result.success = YES;
-
-  switch (number) {
-  case KSYS_GETPID:
-    result.returnValue = 1;
-    break;
-  case KSYS_GETPPID:
-    result.returnValue = 0;
-    break;
-  case KSYS_GETUID:
-  case KSYS_GETGID:
-    result.returnValue = 0;
-    break;
-  case KSYS_UNAME:
-    result.returnValue = 0;
-    break;
-  case KSYS_SYSINFO:
-    result.returnValue = 0;
-    break;
-  case KSYS_BRK:
-    result.returnValue = 0;
-    break;
-  case KSYS_MMAP:
-    result.returnValue = 0;
-    break;
-  case KSYS_FORK: {
-    KernProcess *parent =
-        args.count > 0 ? [self processForPID:[args[0] unsignedIntValue]] : nil;
-    if (parent) {
-      KernProcess *child = [self createProcess:parent.name
-                                executablePath:parent.executablePath
-                                     arguments:parent.arguments
-                                     parentPID:parent.pid];
-      result.returnValue = child.pid;
-    } else {
-      result.success = NO;
-      result.errorCode = 3;
-      result.errorMessage = @"ESRCH";
-    }
-    break;
-  }
-  case KSYS_EXIT:
-    if (args.count > 0) {
-      [self terminateProcess:[args[0] unsignedIntValue]
-                    exitCode:[args[1] intValue]];
-    }
-    break;
-  case KSYS_KILL:
-    if (args.count >= 2) {
-      [self sendSignal:(KernSignal)[args[1] integerValue]
-             toProcess:[args[0] unsignedIntValue]];
-    }
-    break;
-  case KSYS_CLOCK_GETTIME:
-    result.returnValue = mach_absolute_time();
-    break;
-  case KSYS_GETRANDOM:
-    result.returnValue = arc4random();
-    break;
-  default:
-    result.returnValue = 0;
-    break;
-  }
-
-  [self kernelLog:KernLogTrace
-         facility:KernLogSyscall
-          message:[NSString stringWithFormat:@"syscall %@ (#%ld) -> %lld",
-                                             [self syscallName:number],
-                                             (long)number, result.returnValue]];
-  return result;
-}
-
-- (NSString *)syscallName:(KernSyscallNumber)number {
-  static NSDictionary *names = nil;
-  static dispatch_once_t onceToken;
-  dispatch_once(&onceToken, ^{
-    names = @{
-      @(KSYS_EXIT) : @"exit",
-      @(KSYS_FORK) : @"fork",
-      @(KSYS_READ) : @"read",
-      @(KSYS_WRITE) : @"write",
-      @(KSYS_OPEN) : @"open",
-      @(KSYS_CLOSE) : @"close",
-      @(KSYS_GETPID) : @"getpid",
-      @(KSYS_KILL) : @"kill",
-      @(KSYS_MMAP) : @"mmap",
-      @(KSYS_MUNMAP) : @"munmap",
-      @(KSYS_BRK) : @"brk",
-      @(KSYS_PIPE) : @"pipe",
-      @(KSYS_CLONE) : @"clone",
-      @(KSYS_EXEC) : @"execve",
-      @(KSYS_WAIT) : @"wait",
-      @(KSYS_SOCKET) : @"socket",
-      @(KSYS_BIND) : @"bind",
-      @(KSYS_LISTEN) : @"listen",
-      @(KSYS_ACCEPT) : @"accept",
-      @(KSYS_CONNECT) : @"connect",
-      @(KSYS_SEND) : @"send",
-      @(KSYS_RECV) : @"recv",
-      @(KSYS_STAT) : @"stat",
-      @(KSYS_FSTAT) : @"fstat",
-      @(KSYS_MKDIR) : @"mkdir",
-      @(KSYS_RMDIR) : @"rmdir",
-      @(KSYS_MOUNT) : @"mount",
-      @(KSYS_UMOUNT) : @"umount",
-      @(KSYS_UNAME) : @"uname",
-      @(KSYS_SYSINFO) : @"sysinfo",
-      @(KSYS_CLOCK_GETTIME) : @"clock_gettime",
-      @(KSYS_FUTEX) : @"futex",
-      @(KSYS_REBOOT) : @"reboot",
-      @(KSYS_GETRANDOM) : @"getrandom",
-      @(KSYS_IO_URING_SETUP) : @"io_uring_setup"
-    };
-  });
-  return names[@(number)]
-             ?: [NSString stringWithFormat:@"syscall_%ld", (long)number];
-}
-
-- (NSUInteger)totalSyscallCount {
-  return (NSUInteger)self.syscallCount;
-}
-
 // --- Security ---
 
 - (BOOL)checkCapability:(KernCapability)cap forProcess:(uint32_t)pid {
@@ -811,31 +838,6 @@
   caps[@(pid)] = @(current & ~cap);
 }
 
-- (KernNamespace *)createNamespace:(KernNamespaceType)type
-                        forProcess:(uint32_t)pid {
-  static uint32_t nextNSID = 1;
-  KernNamespace *ns = [[KernNamespace alloc] init];
-  ns.nsID = nextNSID++;
-  ns.type = type;
-  [ns.memberPIDs addObject:@(pid)];
-
-  KernProcess *proc = [self processForPID:pid];
-  if (proc)
-    proc.namespaceID = ns.nsID;
-
-  [self.internalState[@"namespaces"] addObject:ns];
-  return ns;
-}
-
-- (void)joinNamespace:(KernNamespace *)ns process:(uint32_t)pid {
-  if (!ns)
-    return;
-  [ns.memberPIDs addObject:@(pid)];
-  KernProcess *proc = [self processForPID:pid];
-  if (proc)
-    proc.namespaceID = ns.nsID;
-}
-
 - (KernSandboxProfile *)createSandboxProfile:(NSString *)name {
   KernSandboxProfile *profile = [[KernSandboxProfile alloc] init];
   profile.name = name;
@@ -843,13 +845,6 @@
   return profile;
 }
 
-- (void)applySandbox:(KernSandboxProfile *)profile toProcess:(uint32_t)pid {
-  [self kernelLog:KernLogInfo
-         facility:KernLogSecurity
-          message:[NSString stringWithFormat:@"Sandbox '%@' applied to PID %u",
-                                             profile.name, pid]];
-}
-
 - (KernCgroup *)createCgroup:(NSString *)name parent:(KernCgroup *)parent {
   static uint32_t nextCgID = 1;
   KernCgroup *cg = [[KernCgroup alloc] init];
@@ -861,17 +856,23 @@
   if (parent)
     [parent.children addObject:cg];
   [self.internalState[@"cgroups"] addObject:cg];
+  KernMemcgCreate(cg.cgroupID, parent.cgroupID);
+  KernCgroupCreate(cg);
   return cg;
 }
 
 - (void)addProcess:(uint32_t)pid toCgroup:(KernCgroup *)cgroup {
   if (!cgroup)
     return;
-  [cgroup.memberPIDs addObject:@(pid)];
-  cgroup.pidsCurrent++;
   KernProcess *proc = [self processForPID:pid];
-  if (proc)
-    proc.cgroupID = cgroup.cgroupID;
+  if (!proc || proc.cgroupID == cgroup.cgroupID)
+    return;
+  KernCgroup *old = [self cgroupForProcess:pid];
+  [old.memberPIDs removeObject:@(pid)];
+  [cgroup.memberPIDs addObject:@(pid)];
+  KernPidsMove(proc.cgroupID, cgroup.cgroupID);
+  proc.cgroupID = cgroup.cgroupID;
+  KernCgroupProcessMoved();
 }
 
 - (void)setCgroupCPULimit:(KernCgroup *)cgroup
@@ -884,94 +885,60 @@
 }
 
 - (void)setCgroupMemoryLimit:(KernCgroup *)cgroup bytes:(uint64_t)limit {
-  if (cgroup)
-    cgroup.memoryLimitBytes = limit;
+  if (!cgroup)
+    return;
+  cgroup.memoryLimitBytes = limit;
+}
+
+- (KernCgroup *)cgroupForProcess:(uint32_t)pid {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc || proc.cgroupID == 0)
+    return nil;
+  for (KernCgroup *cg in self.internalState[@"cgroups"]) {
+    if (cg.cgroupID == proc.cgroupID)
+      return cg;
+  }
+  return nil;
 }
 
 - (NSDictionary *)cgroupStatistics:(KernCgroup *)cgroup {
   if (!cgroup)
     return @{};
+  KernCgroupStats io;
+  KernCgroupStat(cgroup.cgroupID, &io);
+  KernMemcgStats memory;
+  KernMemcgStat(cgroup.cgroupID, &memory);
   return @{
     @"name" : cgroup.name,
     @"path" : cgroup.path,
-    @"pids_current" : @(cgroup.pidsCurrent),
+    @"pids_current" : @(io.pids),
     @"pids_max" : @(cgroup.pidsMax),
+    @"pids_events_max" : @(io.pidsRejected),
     @"cpu_quota_us" : @(cgroup.cpuQuotaUs),
     @"cpu_period_us" : @(cgroup.cpuPeriodUs),
     @"cpu_shares" : @(cgroup.cpuShares),
     @"memory_limit" : @(cgroup.memoryLimitBytes),
-    @"memory_usage" : @(cgroup.memoryUsage)
+    @"memory_usage" : @(memory.usage),
+    @"memory_peak" : @(memory.peak),
+    @"memory_stat" : @{
+      @"anon" : @(memory.anon),
+      @"file" : @(memory.file),
+      @"reclaimed_pages" : @(memory.reclaimed)
+    },
+    @"memory_events" : @{
+      @"max" : @(memory.eventsMax),
+      @"oom" : @(memory.eventsOOM),
+      @"oom_kill" : @(memory.eventsOOMKill)
+    },
+    @"io_weight" : @(cgroup.ioWeight),
+    @"io_read_bytes" : @(io.readBytes),
+    @"io_write_bytes" : @(io.writeBytes),
+    @"io_read_ios" : @(io.readIOs),
+    @"io_write_ios" : @(io.writeIOs),
+    @"io_throttled_ns" : @(io.throttledNs)
   };
 }
 
-// --- Logging ---
-
-- (void)kernelLog:(KernLogLevel)level
-         facility:(KernLogFacility)facility
-          message:(NSString *)message {
-  KernLogEntry *entry = [[KernLogEntry alloc] init];
-  entry.sequenceNumber = self.logSequence++;
-  entry.level = level;
-  entry.facility = facility;
-  entry.message = message;
-  entry.timestampNs = mach_absolute_time();
-
-  [self.logBuffer addObject:entry];
-  if (self.logBuffer.count > 100000) {
-    [self.logBuffer removeObjectsInRange:NSMakeRange(0, 10000)];
-  }
-
-  if (level <= KernLogWarning) {
-    NSLog(@"[KERN %@] %@", [self logLevelString:level], message);
-  }
-}
-
-- (NSString *)logLevelString:(KernLogLevel)level {
-  switch (level) {
-  case KernLogEmergency:
-    return @"EMERG";
-  case KernLogAlert:
-    return @"ALERT";
-  case KernLogCritical:
-    return @"CRIT";
-  case KernLogError:
-    return @"ERR";
-  case KernLogWarning:
-    return @"WARN";
-  case KernLogNotice:
-    return @"NOTICE";
-  case KernLogInfo:
-    return @"INFO";
-  case KernLogDebug:
-    return @"DEBUG";
-  case KernLogTrace:
-    return @"TRACE";
-  }
-  return @"UNKNOWN";
-}
-
-- (NSArray<KernLogEntry *> *)logEntriesWithLevel:(KernLogLevel)minLevel
-                                        facility:(KernLogFacility)facility
-                                           count:(NSUInteger)count {
-  NSMutableArray *results = [NSMutableArray array];
-  for (KernLogEntry *entry in [self.logBuffer reverseObjectEnumerator]) {
-    if (entry.level <= minLevel &&
-        (facility == KernLogKernel || entry.facility == facility)) {
-      [results addObject:entry];
-      if (results.count >= count)
-        break;
-    }
-  }
-  return [[results reverseObjectEnumerator] allObjects];
-}
-
-- (void)clearLogs {
-  [self.logBuffer removeAllObjects];
-}
-- (NSUInteger)logCount {
-  return self.logBuffer.count;
-}
-
 // --- System Info ---
 
 - (NSDictionary *)kernelInfo {
@@ -981,7 +948,9 @@
     @"uptime_seconds" : @([self uptimeNanoseconds] / 1000000000.0),
     @"process_count" : @([self allProcesses].count),
     @"syscall_count" : @(self.syscallCount),
-    @"log_entries" : @(self.logBuffer.count),
+    @"log_entries" : @([self logCount]),
+    @"profiler" : [self profilerStatus],
+    @"perf_counters" : [self perfCounterStatus],
     @"total_memory" : @([self totalPhysicalMemory]),
     @"boot_time" : @(self.bootTime),
     @"hostname" : [[NSProcessInfo processInfo] hostName],
@@ -0,0 +1,485 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Dentry Cache (dcache)
+// ============================================================================
+//
+// A global hash of (parent dentry, component name) -> dentry sitting in front
+// of the dentry tree. Lookups walk hash chains without taking any lock inside
+// an epoch-based RCU read section; inserts, removals and the shrinker
+// serialize on gDcacheLock and retire unlinked nodes until every reader that
+// could still see them has left its read section.
+//
+// Misses that fail in the tree leave a negative dentry behind, so repeated
+// probes for a missing name are answered from the hash. Every node keeps a
+// strong reference to its parent, which pins the key address for as long as
+// the node is hashed.
+//
+// A miss result is only hashed if its directory did not change while the
+// tree was searched. Creates and removals bump a sequence count for the
+// directory they touch (striped by address, so a change in an unrelated
+// directory rarely matters). Nodes are also linked into per-parent child
+// lists, so removing a directory unhashes everything cached beneath it.
+
+#define KERN_DCACHE_BUCKETS (1u << 18)
+#define KERN_DCACHE_MAX_ENTRIES (1u << 20)
+#define KERN_DCACHE_RETIRE_BATCH 64
+#define KERN_DCACHE_SEQ_STRIPES 4096
+
+namespace {
+
+// --- Epoch-based RCU ---
+
+struct KernRcuReader {
+  std::atomic<uint64_t> epoch{0}; // 0 while quiescent
+  uint32_t nesting = 0;
+  KernRcuReader();
+  ~KernRcuReader();
+};
+
+std::mutex gRcuReadersLock;
+std::vector<KernRcuReader *> gRcuReaders;
+std::atomic<uint64_t> gRcuEpoch{1};
+
+KernRcuReader::KernRcuReader() {
+  std::lock_guard<std::mutex> guard(gRcuReadersLock);
+  gRcuReaders.push_back(this);
+}
+
+KernRcuReader::~KernRcuReader() {
+  std::lock_guard<std::mutex> guard(gRcuReadersLock);
+  gRcuReaders.erase(std::find(gRcuReaders.begin(), gRcuReaders.end(), this));
+}
+
+thread_local KernRcuReader tRcuReader;
+
+void KernRcuReadLock() {
+  KernRcuReader &reader = tRcuReader;
+  if (reader.nesting++ == 0) {
+    reader.epoch.store(gRcuEpoch.load(std::memory_order_acquire),
+                       std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+void KernRcuReadUnlock() {
+  KernRcuReader &reader = tRcuReader;
+  if (--reader.nesting == 0)
+    reader.epoch.store(0, std::memory_order_release);
+}
+
+// Oldest epoch a reader may still be running in
+uint64_t KernRcuOldestReader() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t oldest = UINT64_MAX;
+  std::lock_guard<std::mutex> guard(gRcuReadersLock);
+  for (KernRcuReader *reader : gRcuReaders) {
+    uint64_t epoch = reader->epoch.load(std::memory_order_acquire);
+    if (epoch && epoch < oldest)
+      oldest = epoch;
+  }
+  return oldest;
+}
+
+// --- Hash table ---
+
+struct KernDcacheNode {
+  std::atomic<KernDcacheNode *> next{nullptr};
+  KernDentry *parent; // Strong: pins the key
+  KernDentry *dentry;
+  uint64_t hash;
+  std::string name;
+  std::atomic<bool> referenced{false};
+  KernDcacheNode *lruPrev = nullptr; // Under gDcacheLock
+  KernDcacheNode *lruNext = nullptr;
+  KernDcacheNode *siblingPrev = nullptr; // Parent's child list
+  KernDcacheNode *siblingNext = nullptr;
+  uint64_t retireEpoch = 0;
+};
+
+std::atomic<KernDcacheNode *> gDcacheTable[KERN_DCACHE_BUCKETS];
+std::mutex gDcacheLock;
+KernDcacheNode *gDcacheLRUHead = nullptr; // Most recently inserted
+KernDcacheNode *gDcacheLRUTail = nullptr;
+std::vector<KernDcacheNode *> gDcacheRetired;
+std::unordered_map<void *, KernDcacheNode *> gDcacheChildren; // By parent
+std::atomic<uint64_t> gDcacheDirSeq[KERN_DCACHE_SEQ_STRIPES];
+std::atomic<uint64_t> gDcacheEntries{0};
+std::atomic<uint64_t> gDcacheNegativeEntries{0};
+std::atomic<uint64_t> gDcacheHits{0};
+std::atomic<uint64_t> gDcacheNegativeHits{0};
+std::atomic<uint64_t> gDcacheMisses{0};
+std::atomic<uint64_t> gDcacheEvictions{0};
+
+inline uint64_t KernDcacheHash(__unsafe_unretained KernDentry *parent,
+                               const char *name, size_t length) {
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t)name[i]) * 0x100000001b3ULL;
+  uint64_t key = (uint64_t)(uintptr_t)(__bridge void *)parent;
+  return hash ^ (key * 0x9e3779b97f4a7c15ULL);
+}
+
+// Bumped under gDcacheLock whenever a directory gains or loses an entry
+inline std::atomic<uint64_t> &
+KernDcacheDirSeq(__unsafe_unretained KernDentry *dir) {
+  uint64_t key = (uint64_t)(uintptr_t)(__bridge void *)dir;
+  return gDcacheDirSeq[(key * 0x9e3779b97f4a7c15ULL) >> 52];
+}
+
+inline std::atomic<KernDcacheNode *> &KernDcacheBucket(uint64_t hash) {
+  return gDcacheTable[(hash ^ (hash >> 32)) & (KERN_DCACHE_BUCKETS - 1)];
+}
+
+inline bool KernDcacheMatches(const KernDcacheNode *node,
+                              __unsafe_unretained KernDentry *parent,
+                              uint64_t hash, const char *name, size_t length) {
+  return node->hash == hash && node->parent == parent &&
+         node->name.size() == length &&
+         memcmp(node->name.data(), name, length) == 0;
+}
+
+// Caller is inside a read section.
+KernDcacheNode *KernDcacheFind(__unsafe_unretained KernDentry *parent,
+                               uint64_t hash, const char *name,
+                               size_t length) {
+  KernDcacheNode *node =
+      KernDcacheBucket(hash).load(std::memory_order_acquire);
+  for (; node; node = node->next.load(std::memory_order_acquire)) {
+    if (KernDcacheMatches(node, parent, hash, name, length)) {
+      if (!node->referenced.load(std::memory_order_relaxed))
+        node->referenced.store(true, std::memory_order_relaxed);
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+void KernDcacheLRUUnlink(KernDcacheNode *node) {
+  (node->lruPrev ? node->lruPrev->lruNext : gDcacheLRUHead) = node->lruNext;
+  (node->lruNext ? node->lruNext->lruPrev : gDcacheLRUTail) = node->lruPrev;
+  node->lruPrev = node->lruNext = nullptr;
+}
+
+void KernDcacheSiblingUnlink(KernDcacheNode *node) {
+  void *key = (__bridge void *)node->parent;
+  if (node->siblingPrev)
+    node->siblingPrev->siblingNext = node->siblingNext;
+  else if (node->siblingNext)
+    gDcacheChildren[key] = node->siblingNext;
+  else
+    gDcacheChildren.erase(key);
+  if (node->siblingNext)
+    node->siblingNext->siblingPrev = node->siblingPrev;
+  node->siblingPrev = node->siblingNext = nullptr;
+}
+
+void KernDcacheSiblingPush(KernDcacheNode *node) {
+  KernDcacheNode *&head = gDcacheChildren[(__bridge void *)node->parent];
+  node->siblingNext = head;
+  if (head)
+    head->siblingPrev = node;
+  head = node;
+}
+
+void KernDcacheLRUPush(KernDcacheNode *node) {
+  node->lruPrev = nullptr;
+  node->lruNext = gDcacheLRUHead;
+  (gDcacheLRUHead ? gDcacheLRUHead->lruPrev : gDcacheLRUTail) = node;
+  gDcacheLRUHead = node;
+}
+
+// Free retired nodes no reader can still reach. Caller holds gDcacheLock.
+void KernDcacheReclaim(bool force) {
+  if (gDcacheRetired.empty() ||
+      (!force && gDcacheRetired.size() < KERN_DCACHE_RETIRE_BATCH))
+    return;
+  uint64_t oldest = KernRcuOldestReader();
+  auto keep = gDcacheRetired.begin();
+  for (KernDcacheNode *node : gDcacheRetired) {
+    if (node->retireEpoch < oldest)
+      delete node;
+    else
+      *keep++ = node;
+  }
+  gDcacheRetired.erase(keep, gDcacheRetired.end());
+}
+
+// Unhash a node found through prev. Caller holds gDcacheLock.
+void KernDcacheUnlinkLocked(std::atomic<KernDcacheNode *> *prev,
+                            KernDcacheNode *node) {
+  prev->store(node->next.load(std::memory_order_relaxed),
+              std::memory_order_release);
+  KernDcacheLRUUnlink(node);
+  KernDcacheSiblingUnlink(node);
+  gDcacheEntries.fetch_sub(1, std::memory_order_relaxed);
+  if (node->dentry.isNegative)
+    gDcacheNegativeEntries.fetch_sub(1, std::memory_order_relaxed);
+  node->retireEpoch = gRcuEpoch.fetch_add(1, std::memory_order_acq_rel);
+  gDcacheRetired.push_back(node);
+}
+
+// Unhash a node without knowing its predecessor. Caller holds gDcacheLock.
+void KernDcacheUnhashLocked(KernDcacheNode *node) {
+  std::atomic<KernDcacheNode *> *prev = &KernDcacheBucket(node->hash);
+  while (prev->load(std::memory_order_relaxed) != node)
+    prev = &prev->load(std::memory_order_relaxed)->next;
+  KernDcacheUnlinkLocked(prev, node);
+}
+
+// Unhash everything cached below dir, which is leaving the tree, and fail
+// any miss under it that is still in flight. Caller holds gDcacheLock.
+void KernDcacheUnhashSubtreeLocked(KernDentry *dir) {
+  std::vector<KernDentry *> pending{dir};
+  while (!pending.empty()) {
+    KernDentry *current = pending.back();
+    pending.pop_back();
+    KernDcacheDirSeq(current).fetch_add(1, std::memory_order_release);
+    for (;;) {
+      auto it = gDcacheChildren.find((__bridge void *)current);
+      if (it == gDcacheChildren.end())
+        break;
+      KernDcacheNode *node = it->second;
+      if (!node->dentry.isNegative)
+        pending.push_back(node->dentry);
+      KernDcacheUnhashLocked(node);
+    }
+  }
+}
+
+// Remove the node for a key, if hashed. Caller holds gDcacheLock.
+void KernDcacheRemoveLocked(__unsafe_unretained KernDentry *parent,
+                            uint64_t hash, const char *name, size_t length) {
+  std::atomic<KernDcacheNode *> *prev = &KernDcacheBucket(hash);
+  for (KernDcacheNode *node = prev->load(std::memory_order_relaxed); node;
+       node = prev->load(std::memory_order_relaxed)) {
+    if (KernDcacheMatches(node, parent, hash, name, length)) {
+      KernDcacheUnlinkLocked(prev, node);
+      return;
+    }
+    prev = &node->next;
+  }
+}
+
+NSUInteger KernDcacheShrinkLocked(NSUInteger count);
+
+// Hash dentry under parent, replacing any entry for the same name. Caller
+// holds gDcacheLock.
+void KernDcacheInsertLocked(KernDentry *parent, KernDentry *dentry,
+                            uint64_t hash, const char *name, size_t length) {
+  KernDcacheRemoveLocked(parent, hash, name, length);
+  if (gDcacheEntries.load(std::memory_order_relaxed) >=
+      KERN_DCACHE_MAX_ENTRIES)
+    KernDcacheShrinkLocked(KERN_DCACHE_MAX_ENTRIES / 8);
+
+  KernDcacheNode *node = new KernDcacheNode();
+  node->parent = parent;
+  node->dentry = dentry;
+  node->hash = hash;
+  node->name.assign(name, length);
+  std::atomic<KernDcacheNode *> &bucket = KernDcacheBucket(hash);
+  node->next.store(bucket.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+  bucket.store(node, std::memory_order_release);
+  KernDcacheLRUPush(node);
+  KernDcacheSiblingPush(node);
+  gDcacheEntries.fetch_add(1, std::memory_order_relaxed);
+  if (dentry.isNegative)
+    gDcacheNegativeEntries.fetch_add(1, std::memory_order_relaxed);
+  KernDcacheReclaim(false);
+}
+
+// Second-chance scan from the cold end of the LRU. Nodes referenced since
+// the last pass are rotated back to the head instead of being evicted.
+NSUInteger KernDcacheShrinkLocked(NSUInteger count) {
+  NSUInteger freed = 0;
+  NSUInteger budget = 2 * gDcacheEntries.load(std::memory_order_relaxed);
+  while (freed < count && gDcacheLRUTail && budget--) {
+    KernDcacheNode *node = gDcacheLRUTail;
+    if (node->referenced.exchange(false, std::memory_order_relaxed)) {
+      KernDcacheLRUUnlink(node);
+      KernDcacheLRUPush(node);
+      continue;
+    }
+    KernDcacheUnhashLocked(node);
+    freed++;
+  }
+  gDcacheEvictions.fetch_add(freed, std::memory_order_relaxed);
+  KernDcacheReclaim(true);
+  return freed;
+}
+
+// Whether dentry is the root or hashed under its parent. Caller holds
+// gDcacheLock.
+bool KernDcacheHashedLocked(KernDentry *dentry) {
+  KernDentry *parent = dentry.parent;
+  if (!parent)
+    return true;
+  const char *name = dentry.name.UTF8String;
+  size_t length = strlen(name);
+  KernDcacheNode *node = KernDcacheFind(
+      parent, KernDcacheHash(parent, name, length), name, length);
+  return node && node->dentry == dentry;
+}
+
+// Tree fallback on a hash miss: look the name up in the parent's directory
+// index and hash the outcome, positive or negative. The insert is dropped if
+// the parent gained or lost an entry meanwhile, since the lookup may have
+// raced with it, or if the parent itself is no longer hashed.
+KernDentry *KernDcacheLookupSlow(KernDentry *parent, uint64_t hash,
+                                 const char *name, size_t length) {
+  std::atomic<uint64_t> &dirSeq = KernDcacheDirSeq(parent);
+  uint64_t seq = dirSeq.load(std::memory_order_acquire);
+  NSString *component = [[NSString alloc] initWithBytes:name
+                                                 length:length
+                                               encoding:NSUTF8StringEncoding];
+  KernDentry *found = KernDirLookup(parent, component);
+  KernDentry *entry = found;
+  if (!entry) {
+    entry = [[KernDentry alloc] init];
+    entry.name = component;
+    entry.parent = parent;
+    entry.isNegative = YES;
+  }
+  std::lock_guard<std::mutex> guard(gDcacheLock);
+  if (dirSeq.load(std::memory_order_relaxed) == seq &&
+      KernDcacheHashedLocked(parent))
+    KernDcacheInsertLocked(parent, entry, hash, name, length);
+  return found;
+}
+
+} // namespace
+
+void KernDcacheAdd(KernDentry *dentry) {
+  KernDentry *parent = dentry.parent;
+  if (!parent)
+    return;
+  const char *name = dentry.name.UTF8String;
+  size_t length = strlen(name);
+  uint64_t hash = KernDcacheHash(parent, name, length);
+  std::lock_guard<std::mutex> guard(gDcacheLock);
+  KernDcacheDirSeq(parent).fetch_add(1, std::memory_order_release);
+  KernDcacheInsertLocked(parent, dentry, hash, name, length);
+}
+
+void KernDcacheRemove(KernDentry *dentry) {
+  KernDentry *parent = dentry.parent;
+  if (!parent)
+    return;
+  KernDentry *negative = [[KernDentry alloc] init];
+  negative.name = dentry.name;
+  negative.parent = parent;
+  negative.isNegative = YES;
+  const char *name = dentry.name.UTF8String;
+  size_t length = strlen(name);
+  uint64_t hash = KernDcacheHash(parent, name, length);
+  std::lock_guard<std::mutex> guard(gDcacheLock);
+  KernDcacheDirSeq(parent).fetch_add(1, std::memory_order_release);
+  KernDcacheUnhashSubtreeLocked(dentry);
+  KernDcacheInsertLocked(parent, negative, hash, name, length);
+}
+
+// ============================================================================
+// AdvancedKernel — Dentry Cache Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Dcache)
+
+- (KernDentry *)dentryForPath:(NSString *)path {
+  uint64_t traceStart =
+      KERN_TRACE_ENABLED(KernTraceDentryLookup) ? mach_absolute_time() : 0;
+  KernDentry *root = self.internalState[@"rootDentry"];
+  const char *cursor = path.UTF8String;
+  if (!cursor)
+    return root;
+
+  // Dentries reached through the hash are pinned by their nodes for the
+  // duration of the read section, so the walk holds them without retaining.
+  __unsafe_unretained KernDentry *current = root;
+  KernDentry *pinned = nil; // Holds a tree-scan result the hash may not
+  BOOL resolved = NO;
+  KernRcuReadLock();
+  for (;;) {
+    while (*cursor == '/')
+      cursor++;
+    if (!*cursor) {
+      resolved = YES;
+      break;
+    }
+    const char *name = cursor;
+    while (*cursor && *cursor != '/')
+      cursor++;
+    size_t length = (size_t)(cursor - name);
+    if (length == 1 && name[0] == '.')
+      continue;
+    if (length == 2 && name[0] == '.' && name[1] == '.') {
+      current = current.parent ?: current;
+      continue;
+    }
+
+    uint64_t hash = KernDcacheHash(current, name, length);
+    KernDcacheNode *node = KernDcacheFind(current, hash, name, length);
+    if (node) {
+      if (node->dentry.isNegative) {
+        gDcacheNegativeHits.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+      gDcacheHits.fetch_add(1, std::memory_order_relaxed);
+      current = node->dentry;
+      continue;
+    }
+    gDcacheMisses.fetch_add(1, std::memory_order_relaxed);
+    KernDentry *child = KernDcacheLookupSlow(current, hash, name, length);
+    if (!child)
+      break;
+    pinned = child;
+    current = child;
+  }
+  KernDentry *result = resolved ? current : nil;
+  KernRcuReadUnlock();
+  if (result && KERN_STATIC_BRANCH(gKernLandlockKey) &&
+      !KernLandlockAllows(result))
+    result = nil;
+  KERN_TRACE(KernTraceDentryLookup, path.length, result != nil,
+             mach_absolute_time() - traceStart, 0);
+  return result;
+}
+
+- (NSUInteger)shrinkDentryCache:(NSUInteger)count {
+  std::lock_guard<std::mutex> guard(gDcacheLock);
+  return KernDcacheShrinkLocked(count);
+}
+
+- (NSDictionary *)dentryCacheStatistics {
+  uint64_t hits = gDcacheHits.load(std::memory_order_relaxed);
+  uint64_t negativeHits = gDcacheNegativeHits.load(std::memory_order_relaxed);
+  uint64_t misses = gDcacheMisses.load(std::memory_order_relaxed);
+  uint64_t total = hits + negativeHits + misses;
+  return @{
+    @"entries" : @(gDcacheEntries.load(std::memory_order_relaxed)),
+    @"negative_entries" :
+        @(gDcacheNegativeEntries.load(std::memory_order_relaxed)),
+    @"buckets" : @(KERN_DCACHE_BUCKETS),
+    @"max_entries" : @(KERN_DCACHE_MAX_ENTRIES),
+    @"hits" : @(hits),
+    @"negative_hits" : @(negativeHits),
+    @"misses" : @(misses),
+    @"hit_rate" : @(total ? (double)(hits + negativeHits) / total : 0),
+    @"evictions" : @(gDcacheEvictions.load(std::memory_order_relaxed))
+  };
+}
+
+@end
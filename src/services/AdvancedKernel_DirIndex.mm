@@ -0,0 +1,503 @@
+#import "AdvancedKernel.h"
+#include <shared_mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Directory Indexes
+// ============================================================================
+//
+// Each directory keeps its entries in a B+tree keyed by a 64-bit hash of
+// the name, as ext4's htree does, with the name itself breaking the rare
+// tie. Lookup, insert and unlink cost O(log n); an insert finds any entry
+// already using the name on its way down, so duplicate names cannot be
+// created. Leaves are linked in key order for readdir.
+//
+// A readdir cursor remembers the key of the last entry it returned and
+// resumes at the first key after it, so it stays valid across inserts and
+// unlinks without pinning anything: entries added or removed meanwhile are
+// seen at most once. Entries are streamed to the caller in batches taken
+// under the directory's lock and handed out after it is dropped.
+//
+// Interior nodes hold separator keys: separator i is no greater than any
+// key under child i and greater than every key under child i - 1. Empty
+// leaves are unlinked at once; underfull nodes are left as they are.
+
+#define KERN_DIR_FANOUT 64
+#define KERN_DIR_MAX_DEPTH 16
+#define KERN_DIR_BATCH 64 // Entries copied out per lock hold in readdir
+
+namespace {
+
+uint64_t KernDirHash(NSString *name) {
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+  for (const char *p = name.UTF8String; p && *p; p++)
+    hash = (hash ^ (uint8_t)*p) * 0x100000001b3ULL;
+  return hash;
+}
+
+int KernDirCompare(uint64_t hashA, NSString *nameA, uint64_t hashB,
+                   NSString *nameB) {
+  if (hashA != hashB)
+    return hashA < hashB ? -1 : 1;
+  return (int)[nameA compare:nameB options:NSLiteralSearch];
+}
+
+class KernDirTree {
+public:
+  KernDirTree() : root_(new Leaf()) {}
+  KernDirTree(const KernDirTree &) = delete;
+  KernDirTree &operator=(const KernDirTree &) = delete;
+  ~KernDirTree() { destroy(root_); }
+
+  size_t size() const { return size_; }
+  unsigned height() const { return height_; }
+
+  KernDentry *find(uint64_t hash, NSString *name) const {
+    const Leaf *leaf = descend(hash, name, nullptr, nullptr);
+    unsigned pos = lowerBound(leaf, hash, name);
+    if (pos < leaf->count && equal(leaf, pos, hash, name))
+      return leaf->dentries[pos];
+    return nil;
+  }
+
+  // Returns the entry already holding the name, or nil once inserted
+  KernDentry *insert(uint64_t hash, KernDentry *dentry) {
+    NSString *name = dentry.name;
+    Inner *path[KERN_DIR_MAX_DEPTH];
+    unsigned slots[KERN_DIR_MAX_DEPTH];
+    unsigned depth = 0;
+    Leaf *leaf = descend(hash, name, path, slots, &depth);
+    unsigned pos = lowerBound(leaf, hash, name);
+    if (pos < leaf->count && equal(leaf, pos, hash, name))
+      return leaf->dentries[pos];
+
+    size_++;
+    if (leaf->count < KERN_DIR_FANOUT) {
+      leafInsert(leaf, pos, hash, dentry);
+      return nil;
+    }
+    // Split the full leaf, then push its new right half's key upwards
+    Leaf *right = new Leaf();
+    unsigned half = KERN_DIR_FANOUT / 2;
+    for (unsigned i = half; i < KERN_DIR_FANOUT; i++) {
+      right->hashes[i - half] = leaf->hashes[i];
+      right->dentries[i - half] = leaf->dentries[i];
+      leaf->dentries[i] = nil;
+    }
+    right->count = KERN_DIR_FANOUT - half;
+    leaf->count = half;
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next)
+      leaf->next->prev = right;
+    leaf->next = right;
+    if (pos <= half)
+      leafInsert(leaf, pos, hash, dentry);
+    else
+      leafInsert(right, pos - half, hash, dentry);
+
+    Node *child = right;
+    uint64_t sepHash = right->hashes[0];
+    NSString *sepName = right->dentries[0].name;
+    while (depth > 0) {
+      Inner *parent = path[--depth];
+      unsigned at = slots[depth] + 1;
+      if (parent->count < KERN_DIR_FANOUT) {
+        innerInsert(parent, at, sepHash, sepName, child);
+        return nil;
+      }
+      Inner *sibling = new Inner();
+      for (unsigned i = half; i < KERN_DIR_FANOUT; i++) {
+        sibling->hashes[i - half] = parent->hashes[i];
+        sibling->names[i - half] = parent->names[i];
+        sibling->children[i - half] = parent->children[i];
+        parent->names[i] = nil;
+      }
+      sibling->count = KERN_DIR_FANOUT - half;
+      parent->count = half;
+      if (at <= half)
+        innerInsert(parent, at, sepHash, sepName, child);
+      else
+        innerInsert(sibling, at - half, sepHash, sepName, child);
+      // The sibling's first separator moves up; slot 0 carries none
+      sepHash = sibling->hashes[0];
+      sepName = sibling->names[0];
+      sibling->names[0] = nil;
+      child = sibling;
+    }
+    Inner *top = new Inner();
+    top->children[0] = root_;
+    top->children[1] = child;
+    top->hashes[1] = sepHash;
+    top->names[1] = sepName;
+    top->count = 2;
+    root_ = top;
+    height_++;
+    return nil;
+  }
+
+  // Unlink the entry for name. Returns it, or nil if there is none.
+  KernDentry *erase(uint64_t hash, NSString *name) {
+    Inner *path[KERN_DIR_MAX_DEPTH];
+    unsigned slots[KERN_DIR_MAX_DEPTH];
+    unsigned depth = 0;
+    Leaf *leaf = descend(hash, name, path, slots, &depth);
+    unsigned pos = lowerBound(leaf, hash, name);
+    if (pos >= leaf->count || !equal(leaf, pos, hash, name))
+      return nil;
+    KernDentry *removed = leaf->dentries[pos];
+    for (unsigned i = pos; i + 1 < leaf->count; i++) {
+      leaf->hashes[i] = leaf->hashes[i + 1];
+      leaf->dentries[i] = leaf->dentries[i + 1];
+    }
+    leaf->dentries[--leaf->count] = nil;
+    size_--;
+    if (leaf->count || depth == 0)
+      return removed;
+
+    if (leaf->prev)
+      leaf->prev->next = leaf->next;
+    if (leaf->next)
+      leaf->next->prev = leaf->prev;
+    Node *empty = leaf;
+    while (depth > 0) {
+      Inner *parent = path[--depth];
+      innerRemove(parent, slots[depth]);
+      destroyNode(empty);
+      if (parent->count)
+        break;
+      empty = parent;
+    }
+    while (!root_->leaf && root_->count == 1) {
+      Inner *top = (Inner *)root_;
+      root_ = top->children[0];
+      top->count = 0;
+      delete top;
+      height_--;
+    }
+    return removed;
+  }
+
+  // Copy up to max entries after (hash, name) in key order, or from the
+  // first entry when !started. Returns how many were copied.
+  size_t scan(bool started, uint64_t hash, NSString *name,
+              std::vector<KernDentry *> &out, size_t max) const {
+    const Leaf *leaf;
+    unsigned pos;
+    if (!started) {
+      const Node *node = root_;
+      while (!node->leaf)
+        node = ((const Inner *)node)->children[0];
+      leaf = (const Leaf *)node;
+      pos = 0;
+    } else {
+      leaf = descend(hash, name, nullptr, nullptr);
+      pos = lowerBound(leaf, hash, name);
+      if (pos < leaf->count && equal(leaf, pos, hash, name))
+        pos++;
+    }
+    size_t copied = 0;
+    while (leaf && copied < max) {
+      for (; pos < leaf->count && copied < max; pos++, copied++)
+        out.push_back(leaf->dentries[pos]);
+      leaf = leaf->next;
+      pos = 0;
+    }
+    return copied;
+  }
+
+private:
+  struct Node {
+    bool leaf;
+    unsigned count = 0; // Entries in a leaf, children in an inner node
+    explicit Node(bool l) : leaf(l) {}
+  };
+  struct Leaf : Node {
+    Leaf *prev = nullptr;
+    Leaf *next = nullptr;
+    uint64_t hashes[KERN_DIR_FANOUT];
+    KernDentry *dentries[KERN_DIR_FANOUT];
+    Leaf() : Node(true) {}
+  };
+  struct Inner : Node {
+    uint64_t hashes[KERN_DIR_FANOUT]; // Separators; slot 0 is unused
+    NSString *names[KERN_DIR_FANOUT];
+    Node *children[KERN_DIR_FANOUT];
+    Inner() : Node(false) {}
+  };
+
+  static bool equal(const Leaf *leaf, unsigned pos, uint64_t hash,
+                    NSString *name) {
+    return leaf->hashes[pos] == hash &&
+           [leaf->dentries[pos].name isEqualToString:name];
+  }
+
+  // First slot whose key is not less than (hash, name)
+  static unsigned lowerBound(const Leaf *leaf, uint64_t hash, NSString *name) {
+    unsigned lo = 0, hi = leaf->count;
+    while (lo < hi) {
+      unsigned mid = (lo + hi) / 2;
+      if (KernDirCompare(leaf->hashes[mid], leaf->dentries[mid].name, hash,
+                         name) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  // Last child whose separator is not greater than (hash, name)
+  static unsigned childFor(const Inner *inner, uint64_t hash, NSString *name) {
+    unsigned lo = 1, hi = inner->count;
+    while (lo < hi) {
+      unsigned mid = (lo + hi) / 2;
+      if (KernDirCompare(inner->hashes[mid], inner->names[mid], hash, name) <=
+          0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo - 1;
+  }
+
+  Leaf *descend(uint64_t hash, NSString *name, Inner **path, unsigned *slots,
+                unsigned *depth = nullptr) const {
+    Node *node = root_;
+    unsigned level = 0;
+    while (!node->leaf) {
+      Inner *inner = (Inner *)node;
+      unsigned slot = childFor(inner, hash, name);
+      if (path) {
+        path[level] = inner;
+        slots[level] = slot;
+      }
+      level++;
+      node = inner->children[slot];
+    }
+    if (depth)
+      *depth = level;
+    return (Leaf *)node;
+  }
+
+  static void leafInsert(Leaf *leaf, unsigned pos, uint64_t hash,
+                         KernDentry *dentry) {
+    for (unsigned i = leaf->count; i > pos; i--) {
+      leaf->hashes[i] = leaf->hashes[i - 1];
+      leaf->dentries[i] = leaf->dentries[i - 1];
+    }
+    leaf->hashes[pos] = hash;
+    leaf->dentries[pos] = dentry;
+    leaf->count++;
+  }
+
+  static void innerInsert(Inner *inner, unsigned at, uint64_t hash,
+                          NSString *name, Node *child) {
+    for (unsigned i = inner->count; i > at; i--) {
+      inner->hashes[i] = inner->hashes[i - 1];
+      inner->names[i] = inner->names[i - 1];
+      inner->children[i] = inner->children[i - 1];
+    }
+    inner->hashes[at] = hash;
+    inner->names[at] = name;
+    inner->children[at] = child;
+    inner->count++;
+  }
+
+  // Removing child 0 promotes child 1, whose separator is dropped
+  static void innerRemove(Inner *inner, unsigned at) {
+    for (unsigned i = at; i + 1 < inner->count; i++) {
+      inner->hashes[i] = inner->hashes[i + 1];
+      inner->names[i] = inner->names[i + 1];
+      inner->children[i] = inner->children[i + 1];
+    }
+    inner->names[--inner->count] = nil;
+    inner->names[0] = nil;
+  }
+
+  static void destroyNode(Node *node) {
+    if (node->leaf)
+      delete (Leaf *)node;
+    else
+      delete (Inner *)node;
+  }
+
+  static void destroy(Node *node) {
+    if (!node->leaf) {
+      Inner *inner = (Inner *)node;
+      for (unsigned i = 0; i < inner->count; i++)
+        destroy(inner->children[i]);
+    }
+    destroyNode(node);
+  }
+
+  Node *root_;
+  size_t size_ = 0;
+  unsigned height_ = 1;
+};
+
+struct KernDirIndexState {
+  std::shared_mutex lock;
+  KernDirTree tree;
+};
+
+} // namespace
+
+// ============================================================================
+// KernDirIndex / KernDirCursor
+// ============================================================================
+
+@interface KernDirIndex ()
+- (KernDirIndexState *)state;
+@end
+
+@implementation KernDirIndex {
+  KernDirIndexState _state;
+}
+
+- (KernDirIndexState *)state {
+  return &_state;
+}
+
+- (NSUInteger)count {
+  std::shared_lock<std::shared_mutex> guard(_state.lock);
+  return _state.tree.size();
+}
+
+- (NSUInteger)height {
+  std::shared_lock<std::shared_mutex> guard(_state.lock);
+  return _state.tree.height();
+}
+
+@end
+
+@interface KernDirCursor ()
+@property(nonatomic, strong, readwrite) KernDentry *directory;
+@property(nonatomic, assign, readwrite) BOOL finished;
+@property(nonatomic, assign) BOOL started;
+@property(nonatomic, assign) uint64_t lastHash;
+@property(nonatomic, strong) NSString *lastName;
+@end
+
+@implementation KernDirCursor
+@end
+
+static KernDirIndexState *KernDirState(KernDentry *dir, BOOL create) {
+  KernDirIndex *index = dir.index;
+  if (!index && create) {
+    @synchronized(dir) {
+      if (!dir.index)
+        dir.index = [[KernDirIndex alloc] init];
+      index = dir.index;
+    }
+  }
+  return index ? [index state] : nullptr;
+}
+
+// --- Directory hooks ---
+
+KernDentry *KernDirLookup(KernDentry *dir, NSString *name) {
+  KernDirIndexState *state = KernDirState(dir, NO);
+  if (!state || !name)
+    return nil;
+  uint64_t hash = KernDirHash(name);
+  std::shared_lock<std::shared_mutex> guard(state->lock);
+  return state->tree.find(hash, name);
+}
+
+KernDentry *KernDirInsert(KernDentry *dir, KernDentry *dentry) {
+  KernDirIndexState *state = KernDirState(dir, YES);
+  uint64_t hash = KernDirHash(dentry.name);
+  std::unique_lock<std::shared_mutex> guard(state->lock);
+  return state->tree.insert(hash, dentry);
+}
+
+BOOL KernDirRemove(KernDentry *dir, KernDentry *dentry) {
+  KernDirIndexState *state = KernDirState(dir, NO);
+  if (!state)
+    return NO;
+  NSString *name = dentry.name;
+  uint64_t hash = KernDirHash(name);
+  std::unique_lock<std::shared_mutex> guard(state->lock);
+  if (state->tree.find(hash, name) != dentry)
+    return NO;
+  state->tree.erase(hash, name);
+  return YES;
+}
+
+// ============================================================================
+// AdvancedKernel — Directory Index Methods
+// ============================================================================
+
+@implementation AdvancedKernel (DirIndex)
+
+- (NSArray<KernDentry *> *)readDirectory:(NSString *)path {
+  KernDirCursor *cursor = [self openDirectory:path];
+  if (!cursor)
+    return @[];
+  NSMutableArray<KernDentry *> *entries =
+      [NSMutableArray arrayWithCapacity:cursor.directory.index.count];
+  while ([self readDirectory:cursor
+                       count:NSUIntegerMax
+                  usingBlock:^(KernDentry *entry) {
+                    [entries addObject:entry];
+                  }])
+    ;
+  return entries;
+}
+
+- (KernDirCursor *)openDirectory:(NSString *)path {
+  KernDentry *dir = [self dentryForPath:path];
+  if (!dir)
+    return nil;
+  KernDirCursor *cursor = [[KernDirCursor alloc] init];
+  cursor.directory = dir;
+  return cursor;
+}
+
+- (NSUInteger)readDirectory:(KernDirCursor *)cursor
+                      count:(NSUInteger)count
+                 usingBlock:(void (^)(KernDentry *entry))block {
+  if (!cursor || cursor.finished)
+    return 0;
+  KernDirIndexState *state = KernDirState(cursor.directory, NO);
+  if (!state) {
+    cursor.finished = YES;
+    return 0;
+  }
+  std::vector<KernDentry *> batch;
+  batch.reserve(KERN_DIR_BATCH);
+  NSUInteger visited = 0;
+  while (visited < count) {
+    batch.clear();
+    size_t want = (size_t)MIN(count - visited, (NSUInteger)KERN_DIR_BATCH);
+    {
+      std::shared_lock<std::shared_mutex> guard(state->lock);
+      state->tree.scan(cursor.started, cursor.lastHash, cursor.lastName, batch,
+                       want);
+    }
+    if (batch.empty()) {
+      cursor.finished = YES;
+      break;
+    }
+    KernDentry *last = batch.back();
+    cursor.started = YES;
+    cursor.lastHash = KernDirHash(last.name);
+    cursor.lastName = last.name;
+    for (KernDentry *entry : batch)
+      block(entry);
+    visited += batch.size();
+    if (batch.size() < want) {
+      cursor.finished = YES;
+      break;
+    }
+  }
+  return visited;
+}
+
+@end
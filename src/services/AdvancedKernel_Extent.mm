@@ -0,0 +1,400 @@
+#import "AdvancedKernel.h"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ============================================================================
+// Extent Block Mapping
+// ============================================================================
+//
+// File data lives in 4 KB blocks owned by a superblock's block store. Each
+// inode maps its logical blocks through an ordered map of extents, so a
+// lookup is one tree search and a sequentially written file stays a single
+// extent: a growing file takes blocks from a per-inode reservation window
+// that continues physically where its last extent ends, and adjacent
+// mappings are merged as they are made.
+//
+// Block contents live on the superblock's block device, a RAM disk unless
+// the mount named a host file. Reads and writes map blocks under the
+// extent lock, then submit one bio per physically contiguous run after
+// dropping it; freed runs are discarded on the device.
+//
+// Lock order is extent map, then block store, then device.
+
+#define KERN_EXTENT_RESERVE 512 // Blocks preallocated ahead of a writer
+#define KERN_BLOCK_STORE_SPAN (1ULL << 40) // Size of unbounded stores
+
+namespace {
+
+struct KernExtent {
+  uint64_t length;
+  uint64_t physical;
+};
+
+struct KernBlockStoreState {
+  std::mutex lock;
+  std::map<uint64_t, uint64_t> free; // Free runs: start -> length
+  KernBlockDevice *device;
+  uint64_t allocated = 0;
+  __weak KernSuperblock *superblock;
+
+  // Take up to want blocks, starting at goal if it is free, else from the
+  // next free run after it. Returns the count taken; 0 when full. Caller
+  // holds the lock.
+  uint64_t allocate(uint64_t goal, uint64_t want, uint64_t *start) {
+    if (free.empty())
+      return 0;
+    auto it = free.upper_bound(goal);
+    if (it != free.begin()) {
+      auto prev = std::prev(it);
+      if (goal < prev->first + prev->second)
+        it = prev;
+    }
+    if (it == free.end())
+      it = free.begin();
+    uint64_t runStart = it->first;
+    uint64_t runEnd = runStart + it->second;
+    uint64_t from = goal > runStart && goal < runEnd ? goal : runStart;
+    uint64_t count = std::min(want, runEnd - from);
+    free.erase(it);
+    if (from > runStart)
+      free[runStart] = from - runStart;
+    if (from + count < runEnd)
+      free[from + count] = runEnd - from - count;
+    allocated += count;
+    account(-(int64_t)count);
+    *start = from;
+    return count;
+  }
+
+  // Return a run to the free map, merging with its neighbours. Caller holds
+  // the lock.
+  void release(uint64_t start, uint64_t length) {
+    if (!length)
+      return;
+    KernBlockDiscard(device, start, length);
+    allocated -= length;
+    account((int64_t)length);
+    auto next = free.lower_bound(start);
+    if (next != free.end() && next->first == start + length) {
+      length += next->second;
+      next = free.erase(next);
+    }
+    if (next != free.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == start) {
+        prev->second += length;
+        return;
+      }
+    }
+    free[start] = length;
+  }
+
+  void account(int64_t delta) {
+    KernSuperblock *sb = superblock;
+    if (sb && sb.totalBlocks)
+      sb.freeBlocks = (uint64_t)((int64_t)sb.freeBlocks + delta);
+  }
+};
+
+struct KernExtentMap {
+  std::mutex lock;
+  std::map<uint64_t, KernExtent> extents; // Logical start -> extent
+  uint64_t mapped = 0;
+  uint64_t reserveStart = 0; // Allocated but not yet mapped
+  uint64_t reserveLength = 0;
+  KernBlockStore *store;
+
+  // Physical block of a logical block, or UINT64_MAX for a hole
+  uint64_t lookup(uint64_t block) const {
+    auto it = extents.upper_bound(block);
+    if (it == extents.begin())
+      return UINT64_MAX;
+    --it;
+    uint64_t delta = block - it->first;
+    return delta < it->second.length ? it->second.physical + delta
+                                     : UINT64_MAX;
+  }
+
+  // Where a new mapping for block should land physically to extend the
+  // extent before it
+  uint64_t goal(uint64_t block) const {
+    auto it = extents.upper_bound(block);
+    if (it == extents.begin())
+      return 0;
+    --it;
+    return it->second.physical + (block - it->first);
+  }
+
+  void insert(uint64_t block, uint64_t physical) {
+    mapped++;
+    auto next = extents.upper_bound(block);
+    bool joinsNext = next != extents.end() && next->first == block + 1 &&
+                     next->second.physical == physical + 1;
+    if (next != extents.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second.length == block &&
+          prev->second.physical + prev->second.length == physical) {
+        prev->second.length++;
+        if (joinsNext) {
+          prev->second.length += next->second.length;
+          extents.erase(next);
+        }
+        return;
+      }
+    }
+    if (joinsNext) {
+      KernExtent merged = {next->second.length + 1, physical};
+      extents.erase(next);
+      extents[block] = merged;
+      return;
+    }
+    extents[block] = {1, physical};
+  }
+};
+
+} // namespace
+
+// ============================================================================
+// KernBlockStore / KernExtentTree
+// ============================================================================
+
+@interface KernBlockStore ()
+- (instancetype)initWithSuperblock:(KernSuperblock *)sb;
+- (KernBlockStoreState *)state;
+@end
+
+@implementation KernBlockStore {
+  KernBlockStoreState _state;
+}
+
+// Blocks outside the superblock's initial free count are treated as in use
+- (instancetype)initWithSuperblock:(KernSuperblock *)sb {
+  self = [super init];
+  if (self) {
+    _state.superblock = sb;
+    _state.device = sb.blockDevice;
+    if (!_state.device)
+      _state.device = [[AdvancedKernel sharedInstance]
+          createBlockDevice:sb ? sb.deviceName : @"anon"
+                   hostPath:nil
+                     blocks:sb.totalBlocks ?: KERN_BLOCK_STORE_SPAN
+                  scheduler:KernIOSchedulerDeadline];
+    if (sb.totalBlocks) {
+      uint64_t freeBlocks = MIN(sb.freeBlocks, sb.totalBlocks);
+      if (freeBlocks)
+        _state.free[sb.totalBlocks - freeBlocks] = freeBlocks;
+    } else {
+      _state.free[0] = KERN_BLOCK_STORE_SPAN;
+    }
+  }
+  return self;
+}
+
+- (KernBlockStoreState *)state {
+  return &_state;
+}
+
+- (KernBlockDevice *)device {
+  return _state.device;
+}
+
+- (uint64_t)allocatedBlocks {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.allocated;
+}
+
+- (NSUInteger)freeExtents {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.free.size();
+}
+
+@end
+
+@interface KernExtentTree ()
+- (instancetype)initWithStore:(KernBlockStore *)store;
+- (KernExtentMap *)map;
+@end
+
+@implementation KernExtentTree {
+  KernExtentMap _map;
+}
+
+- (instancetype)initWithStore:(KernBlockStore *)store {
+  self = [super init];
+  if (self)
+    _map.store = store;
+  return self;
+}
+
+- (void)dealloc {
+  KernBlockStoreState *store = [_map.store state];
+  std::lock_guard<std::mutex> guard(store->lock);
+  for (auto &entry : _map.extents)
+    store->release(entry.second.physical, entry.second.length);
+  store->release(_map.reserveStart, _map.reserveLength);
+}
+
+- (KernExtentMap *)map {
+  return &_map;
+}
+
+- (NSUInteger)extentCount {
+  std::lock_guard<std::mutex> guard(_map.lock);
+  return _map.extents.size();
+}
+
+- (uint64_t)mappedBlocks {
+  std::lock_guard<std::mutex> guard(_map.lock);
+  return _map.mapped;
+}
+
+@end
+
+static KernBlockStore *KernSuperblockStore(KernSuperblock *sb) {
+  if (!sb) {
+    // Inodes outside any mounted file system (pipes, sockets)
+    static KernBlockStore *anonymous;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+      anonymous = [[KernBlockStore alloc] initWithSuperblock:nil];
+    });
+    return anonymous;
+  }
+  KernBlockStore *store = sb.blockStore;
+  if (!store) {
+    @synchronized(sb) {
+      if (!sb.blockStore)
+        sb.blockStore = [[KernBlockStore alloc] initWithSuperblock:sb];
+      store = sb.blockStore;
+    }
+  }
+  return store;
+}
+
+static KernExtentMap *KernInodeExtents(KernInode *inode, bool create) {
+  KernExtentTree *tree = inode.extents;
+  if (!tree && create) {
+    @synchronized(inode) {
+      if (!inode.extents)
+        inode.extents = [[KernExtentTree alloc]
+            initWithStore:KernSuperblockStore(inode.superblock)];
+      tree = inode.extents;
+    }
+  }
+  return tree ? [tree map] : nullptr;
+}
+
+// Append block to the run list, extending the last run when both the
+// physical block and the caller's buffer follow on from it
+static void KernBlockRunAdd(std::vector<KernBlockIO> &ios, uint64_t physical,
+                            uint8_t *const *page) {
+  if (!ios.empty()) {
+    KernBlockIO &last = ios.back();
+    if (last.block + last.count == physical &&
+        last.pages + last.count == page) {
+      last.count++;
+      return;
+    }
+  }
+  ios.push_back({physical, 1, page});
+}
+
+int KernInodeReadBlocks(KernInode *inode, uint64_t block,
+                        uint8_t *const *data, size_t count) {
+  KernExtentMap *map = KernInodeExtents(inode, false);
+  std::vector<KernBlockIO> ios;
+  KernBlockDevice *device = nil;
+  if (map) {
+    std::lock_guard<std::mutex> guard(map->lock);
+    device = map->store.device;
+    for (size_t i = 0; i < count; i++) {
+      uint64_t physical = map->lookup(block + i);
+      if (physical == UINT64_MAX)
+        memset(data[i], 0, KERN_PAGE_SIZE);
+      else
+        KernBlockRunAdd(ios, physical, data + i);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++)
+      memset(data[i], 0, KERN_PAGE_SIZE);
+  }
+  return KernBlockRW(device, false, ios.data(), ios.size());
+}
+
+int KernInodeWriteBlocks(KernInode *inode, uint64_t block,
+                         const uint8_t *const *data, size_t count,
+                         size_t tailLength) {
+  KernExtentMap *map = KernInodeExtents(inode, true);
+  KernBlockStoreState *store = [map->store state];
+  // The device writes whole blocks: zero the last one past the file data
+  std::vector<uint8_t *> pages(count);
+  for (size_t i = 0; i < count; i++)
+    pages[i] = const_cast<uint8_t *>(data[i]);
+  std::unique_ptr<uint8_t[]> tail;
+  if (count && tailLength < KERN_PAGE_SIZE) {
+    tail.reset(new uint8_t[KERN_PAGE_SIZE]);
+    memcpy(tail.get(), data[count - 1], tailLength);
+    memset(tail.get() + tailLength, 0, KERN_PAGE_SIZE - tailLength);
+    pages[count - 1] = tail.get();
+  }
+  std::vector<KernBlockIO> ios;
+  uint64_t allocated = 0;
+  int err = 0;
+  {
+    std::lock_guard<std::mutex> guard(map->lock);
+    std::lock_guard<std::mutex> storeGuard(store->lock);
+    for (size_t i = 0; i < count; i++) {
+      uint64_t physical = map->lookup(block + i);
+      if (physical == UINT64_MAX) {
+        uint64_t goal = map->goal(block + i);
+        if (!map->reserveLength || map->reserveStart != goal) {
+          store->release(map->reserveStart, map->reserveLength);
+          map->reserveLength = store->allocate(goal, KERN_EXTENT_RESERVE,
+                                               &map->reserveStart);
+          if (!map->reserveLength) {
+            err = -ENOSPC;
+            break;
+          }
+        }
+        physical = map->reserveStart++;
+        map->reserveLength--;
+        map->insert(block + i, physical);
+        allocated++;
+      }
+      KernBlockRunAdd(ios, physical, pages.data() + i);
+    }
+  }
+  if (allocated)
+    inode.blocks += allocated * (KERN_PAGE_SIZE / 512);
+  int ioErr = KernBlockRW(store->device, true, ios.data(), ios.size());
+  return err ?: ioErr;
+}
+
+uint64_t KernInodeNextBlock(KernInode *inode, uint64_t block, bool data) {
+  KernExtentMap *map = KernInodeExtents(inode, false);
+  if (!map)
+    return data ? UINT64_MAX : block;
+  std::lock_guard<std::mutex> guard(map->lock);
+  auto it = map->extents.upper_bound(block);
+  if (it != map->extents.begin()) {
+    auto prev = std::prev(it);
+    uint64_t end = prev->first + prev->second.length;
+    if (block < end) {
+      if (data)
+        return block;
+      // Logically adjacent extents can be physically apart
+      while (it != map->extents.end() && it->first == end) {
+        end = it->first + it->second.length;
+        ++it;
+      }
+      return end;
+    }
+  }
+  if (!data)
+    return block;
+  return it != map->extents.end() ? it->first : UINT64_MAX;
+}
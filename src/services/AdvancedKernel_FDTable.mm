@@ -0,0 +1,389 @@
+#import "AdvancedKernel.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// File Descriptor Tables
+// ============================================================================
+//
+// Each process owns a table of open files indexed by descriptor number. An
+// open bit per slot finds the lowest free number, and a second level with
+// one bit per full 64-slot word lets the search skip 4096 descriptors per
+// word it reads. Slots also carry a close-on-exec bit; the open file
+// (KernFileDescriptor: inode, offset, flags) is shared between the slots
+// and tables that refer to it and counts them in referenceCount.
+//
+// fork copies the table, taking a reference on every open file; clone with
+// CLONE_FILES shares the table itself, counted in users, and the last user
+// to exit closes what is left. Open files are finalized after the table
+// lock is dropped.
+
+#define KERN_FD_FIRST 3      // 0-2 are reserved for stdio
+#define KERN_FD_MIN_SLOTS 64 // Initial table size
+#define KERN_FD_CLOEXEC 1    // FD_CLOEXEC
+
+namespace {
+
+// First clear bit at or after from, or bits.size() * 64
+size_t KernFirstZero(const std::vector<uint64_t> &bits, size_t from) {
+  size_t word = from / 64;
+  if (word >= bits.size())
+    return bits.size() * 64;
+  uint64_t free = ~bits[word] & (~0ULL << (from % 64));
+  while (!free) {
+    if (++word == bits.size())
+      return bits.size() * 64;
+    free = ~bits[word];
+  }
+  return word * 64 + __builtin_ctzll(free);
+}
+
+struct KernFDTableState {
+  std::mutex lock;
+  std::vector<KernFileDescriptor *> files; // Indexed by fd
+  std::vector<uint64_t> open;              // Bit per slot
+  std::vector<uint64_t> full;              // Bit per all-open word of open
+  std::vector<uint64_t> cloexec;           // Bit per slot
+  uint32_t count = 0;
+  std::atomic<uint32_t> users{1};
+
+  bool isOpen(uint32_t fd) const {
+    return fd < files.size() && (open[fd / 64] >> (fd % 64) & 1);
+  }
+
+  void grow(size_t slots) {
+    size_t size = std::max(files.size(), (size_t)KERN_FD_MIN_SLOTS);
+    while (size < slots)
+      size *= 2;
+    if (size == files.size())
+      return;
+    files.resize(size);
+    open.resize(size / 64);
+    cloexec.resize(size / 64);
+    full.resize((size / 64 + 63) / 64);
+  }
+
+  // Lowest free slot at or after minimum, growing the table for it
+  uint32_t lowestFree(uint32_t minimum) {
+    size_t word = minimum / 64;
+    size_t fd = files.size();
+    while (word < open.size()) {
+      if (full[word / 64] >> (word % 64) & 1) {
+        word = KernFirstZero(full, word);
+        continue;
+      }
+      fd = KernFirstZero(open, std::max(word * 64, (size_t)minimum));
+      break;
+    }
+    fd = std::max(fd, (size_t)minimum);
+    grow(fd + 1);
+    return (uint32_t)fd;
+  }
+
+  void set(uint32_t fd, KernFileDescriptor *file, bool closeOnExec) {
+    uint64_t bit = 1ULL << (fd % 64);
+    files[fd] = file;
+    open[fd / 64] |= bit;
+    if (open[fd / 64] == ~0ULL)
+      full[fd / 4096] |= 1ULL << (fd / 64 % 64);
+    if (closeOnExec)
+      cloexec[fd / 64] |= bit;
+    else
+      cloexec[fd / 64] &= ~bit;
+    count++;
+  }
+
+  // Empty slot fd, returning its open file for the caller to put
+  KernFileDescriptor *clear(uint32_t fd) {
+    uint64_t bit = 1ULL << (fd % 64);
+    KernFileDescriptor *file = files[fd];
+    files[fd] = nil;
+    open[fd / 64] &= ~bit;
+    cloexec[fd / 64] &= ~bit;
+    full[fd / 4096] &= ~(1ULL << (fd / 64 % 64));
+    count--;
+    return file;
+  }
+};
+
+// Drop one slot reference; the last one reports the close and releases the
+// file's inode
+void KernFilePut(KernFileDescriptor *file) {
+  if (!file || ![file dropReference])
+    return;
+  KernFsnotify(file.inode, file.dentry,
+               (file.flags & 0x0003) ? KernNotifyCloseWrite // O_WRONLY|O_RDWR
+                                     : KernNotifyCloseNoWrite);
+  file.inode = nil;
+}
+
+// The calling thread's table, cached with the PID it belongs to. Processes
+// are never freed and keep their table object for life, so the cached
+// pointers stay valid.
+thread_local uint32_t tFDTablePID = 0;
+thread_local __unsafe_unretained KernProcess *tFDTableProcess = nil;
+
+} // namespace
+
+// ============================================================================
+// KernFDTable
+// ============================================================================
+
+@interface KernFDTable ()
+- (KernFDTableState *)state;
+@end
+
+@implementation KernFDTable {
+  KernFDTableState _state;
+}
+
+- (KernFDTableState *)state {
+  return &_state;
+}
+
+- (NSUInteger)openCount {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.count;
+}
+
+- (NSUInteger)capacity {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.files.size();
+}
+
+- (uint32_t)users {
+  return _state.users.load(std::memory_order_relaxed);
+}
+
+@end
+
+// ============================================================================
+// AdvancedKernel — File Descriptor Methods
+// ============================================================================
+
+@implementation AdvancedKernel (FDTable)
+
+- (KernProcess *)fileTableProcess {
+  uint32_t pid = [self currentPID];
+  if (pid != tFDTablePID || !tFDTableProcess) {
+    tFDTableProcess = [self processForPID:pid];
+    tFDTablePID = pid;
+  }
+  return tFDTableProcess;
+}
+
+- (int32_t)installFileDescriptor:(KernFileDescriptor *)file
+                     closeOnExec:(BOOL)cloexec {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc)
+    return -ESRCH;
+  if (!file)
+    return -EINVAL;
+  KernFDTableState *table = [proc.fdTable state];
+  std::lock_guard<std::mutex> guard(table->lock);
+  uint32_t fd = table->lowestFree(KERN_FD_FIRST);
+  if (fd >= proc.maxFDs)
+    return -EMFILE;
+  table->set(fd, file, cloexec);
+  return (int32_t)fd;
+}
+
+- (KernFileDescriptor *)fileDescriptorForNumber:(int32_t)fd {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0)
+    return nil;
+  KernFDTableState *table = [proc.fdTable state];
+  std::lock_guard<std::mutex> guard(table->lock);
+  return table->isOpen((uint32_t)fd) ? table->files[fd] : nil;
+}
+
+- (int32_t)closeFD:(int32_t)fd {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0)
+    return -EBADF;
+  KernFDTableState *table = [proc.fdTable state];
+  KernFileDescriptor *file;
+  {
+    std::lock_guard<std::mutex> guard(table->lock);
+    if (!table->isOpen((uint32_t)fd))
+      return -EBADF;
+    file = table->clear((uint32_t)fd);
+  }
+  KernFilePut(file);
+  return 0;
+}
+
+// Closes the number the file was opened as, if it still refers to it
+- (void)closeFile:(KernFileDescriptor *)fd {
+  if (fd && [self fileDescriptorForNumber:fd.fd] == fd)
+    [self closeFD:fd.fd];
+}
+
+- (int32_t)dupFD:(int32_t)fd
+         minimum:(int32_t)minimum
+     closeOnExec:(BOOL)cloexec {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0)
+    return -EBADF;
+  if (minimum < 0 || (uint32_t)minimum >= proc.maxFDs)
+    return -EINVAL;
+  KernFDTableState *table = [proc.fdTable state];
+  std::lock_guard<std::mutex> guard(table->lock);
+  if (!table->isOpen((uint32_t)fd))
+    return -EBADF;
+  uint32_t target = table->lowestFree((uint32_t)minimum);
+  if (target >= proc.maxFDs)
+    return -EMFILE;
+  KernFileDescriptor *file = table->files[fd];
+  [file acquireReference];
+  table->set(target, file, cloexec);
+  return (int32_t)target;
+}
+
+- (int32_t)dup2FD:(int32_t)fd to:(int32_t)target closeOnExec:(BOOL)cloexec {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0 || target < 0 || (uint32_t)target >= proc.maxFDs)
+    return -EBADF;
+  KernFDTableState *table = [proc.fdTable state];
+  KernFileDescriptor *replaced = nil;
+  {
+    std::lock_guard<std::mutex> guard(table->lock);
+    if (!table->isOpen((uint32_t)fd))
+      return -EBADF;
+    if (fd == target)
+      return target;
+    table->grow((size_t)target + 1);
+    if (table->isOpen((uint32_t)target))
+      replaced = table->clear((uint32_t)target);
+    KernFileDescriptor *file = table->files[fd];
+    [file acquireReference];
+    table->set((uint32_t)target, file, cloexec);
+  }
+  KernFilePut(replaced);
+  return target;
+}
+
+- (int32_t)descriptorFlags:(int32_t)fd {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0)
+    return -EBADF;
+  KernFDTableState *table = [proc.fdTable state];
+  std::lock_guard<std::mutex> guard(table->lock);
+  if (!table->isOpen((uint32_t)fd))
+    return -EBADF;
+  return table->cloexec[fd / 64] >> (fd % 64) & 1 ? KERN_FD_CLOEXEC : 0;
+}
+
+- (int32_t)setDescriptorFlags:(int32_t)flags forFD:(int32_t)fd {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc || fd < 0)
+    return -EBADF;
+  KernFDTableState *table = [proc.fdTable state];
+  std::lock_guard<std::mutex> guard(table->lock);
+  if (!table->isOpen((uint32_t)fd))
+    return -EBADF;
+  uint64_t bit = 1ULL << (fd % 64);
+  if (flags & KERN_FD_CLOEXEC)
+    table->cloexec[fd / 64] |= bit;
+  else
+    table->cloexec[fd / 64] &= ~bit;
+  return 0;
+}
+
+- (int32_t)closeRangeFrom:(uint32_t)first
+                       to:(uint32_t)last
+              closeOnExec:(BOOL)cloexecOnly {
+  KernProcess *proc = [self fileTableProcess];
+  if (!proc)
+    return -ESRCH;
+  if (first > last)
+    return -EINVAL;
+  KernFDTableState *table = [proc.fdTable state];
+  std::vector<KernFileDescriptor *> closed;
+  {
+    std::lock_guard<std::mutex> guard(table->lock);
+    uint64_t end = std::min((uint64_t)last + 1, (uint64_t)table->files.size());
+    for (uint64_t fd = first; fd < end; fd++) {
+      if (!table->isOpen((uint32_t)fd))
+        continue;
+      if (cloexecOnly)
+        table->cloexec[fd / 64] |= 1ULL << (fd % 64);
+      else
+        closed.push_back(table->clear((uint32_t)fd));
+    }
+  }
+  for (KernFileDescriptor *file : closed)
+    KernFilePut(file);
+  return 0;
+}
+
+- (NSUInteger)closeExecDescriptorsForProcess:(uint32_t)pid {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc)
+    return 0;
+  KernFDTableState *table = [proc.fdTable state];
+  std::vector<KernFileDescriptor *> closed;
+  {
+    std::lock_guard<std::mutex> guard(table->lock);
+    for (size_t word = 0; word < table->cloexec.size(); word++) {
+      uint64_t bits = table->cloexec[word] & table->open[word];
+      while (bits) {
+        uint32_t fd = (uint32_t)(word * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+        closed.push_back(table->clear(fd));
+      }
+    }
+  }
+  for (KernFileDescriptor *file : closed)
+    KernFilePut(file);
+  return closed.size();
+}
+
+// Runs before the child is visible to anything that could cache its table
+- (void)forkFileTable:(KernProcess *)parent
+            toProcess:(KernProcess *)child
+                share:(BOOL)share {
+  if (!parent || !child)
+    return;
+  if (share) {
+    [parent.fdTable state]->users.fetch_add(1, std::memory_order_relaxed);
+    child.fdTable = parent.fdTable;
+    return;
+  }
+  KernFDTableState *from = [parent.fdTable state];
+  KernFDTableState *to = [child.fdTable state];
+  std::lock_guard<std::mutex> guard(from->lock);
+  std::lock_guard<std::mutex> childGuard(to->lock);
+  to->files = from->files;
+  to->open = from->open;
+  to->full = from->full;
+  to->cloexec = from->cloexec;
+  to->count = from->count;
+  for (KernFileDescriptor *file : to->files)
+    [file acquireReference];
+}
+
+- (void)exitFileTable:(KernProcess *)proc {
+  KernFDTableState *table = [proc.fdTable state];
+  if (!table || table->users.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+  std::vector<KernFileDescriptor *> closed;
+  {
+    std::lock_guard<std::mutex> guard(table->lock);
+    for (size_t fd = 0; fd < table->files.size(); fd++)
+      if (table->isOpen((uint32_t)fd))
+        closed.push_back(table->clear((uint32_t)fd));
+  }
+  for (KernFileDescriptor *file : closed)
+    KernFilePut(file);
+}
+
+@end
@@ -0,0 +1,401 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Asynchronous Submission/Completion Rings (io_uring-style)
+// ============================================================================
+//
+// The SQ is single-producer (the submitter) / single-consumer (ioRingEnter);
+// the CQ has many producers (the worker pool) and one consumer (the reaper).
+// Entering the ring copies pending SQEs out, splits them into link chains and
+// hands each chain to the worker pool, where its operations run in order.
+
+#define KERN_IORING_MAX_ENTRIES 32768
+
+typedef std::shared_ptr<std::vector<KernRingSQE>> KernRingChain;
+
+@interface KernIORing ()
+- (KernRingSQE *)nextSQE;
+- (void)publishSQEs;
+- (BOOL)postCompletion:(uint64_t)userData result:(int32_t)res;
+- (void)waitForCompletions:(uint32_t)count;
+- (void)beginOperations:(uint32_t)count;
+@end
+
+@implementation KernIORing {
+  std::mutex _cqLock; // Serializes CQ producers
+  std::condition_variable _cqPosted;
+  std::atomic<uint32_t> _inflight;
+  uint32_t _sqeTail; // Tail of SQEs handed out but not yet published
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _ringID = 0;
+    _ownerPID = 0;
+    _memory = nil;
+    _sq = NULL;
+    _cq = NULL;
+    _sqes = NULL;
+    _cqes = NULL;
+    _submittedCount = 0;
+    _completedCount = 0;
+    _inflight = 0;
+    _sqeTail = 0;
+  }
+  return self;
+}
+
+- (KernRingSQE *)nextSQE {
+  uint32_t head = __atomic_load_n(&_sq->head, __ATOMIC_ACQUIRE);
+  uint32_t published = __atomic_load_n(&_sq->tail, __ATOMIC_RELAXED);
+  if ((int32_t)(published - _sqeTail) > 0)
+    _sqeTail = published; // Another producer wrote the shared ring directly
+  if (_sqeTail - head >= _sq->ringEntries)
+    return NULL;
+  KernRingSQE *sqe = &_sqes[_sqeTail++ & _sq->ringMask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->off = UINT64_MAX;
+  return sqe;
+}
+
+- (void)publishSQEs {
+  uint32_t published = __atomic_load_n(&_sq->tail, __ATOMIC_RELAXED);
+  if ((int32_t)(_sqeTail - published) > 0)
+    __atomic_store_n(&_sq->tail, _sqeTail, __ATOMIC_RELEASE);
+}
+
+- (void)beginOperations:(uint32_t)count {
+  _inflight.fetch_add(count, std::memory_order_relaxed);
+}
+
+- (BOOL)postCompletion:(uint64_t)userData result:(int32_t)res {
+  BOOL posted = NO;
+  {
+    std::lock_guard<std::mutex> guard(_cqLock);
+    uint32_t head = __atomic_load_n(&_cq->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = _cq->tail;
+    if (tail - head < _cq->ringEntries) {
+      KernRingCQE *cqe = &_cqes[tail & _cq->ringMask];
+      cqe->userData = userData;
+      cqe->res = res;
+      cqe->flags = 0;
+      __atomic_store_n(&_cq->tail, tail + 1, __ATOMIC_RELEASE);
+      _completedCount++;
+      posted = YES;
+    } else {
+      __atomic_fetch_add(&_cq->overflow, 1, __ATOMIC_RELAXED);
+    }
+    _inflight.fetch_sub(1, std::memory_order_release);
+  }
+  _cqPosted.notify_all();
+  return posted;
+}
+
+- (void)waitForCompletions:(uint32_t)count {
+  std::unique_lock<std::mutex> guard(_cqLock);
+  _cqPosted.wait(guard, [&] {
+    uint32_t ready = _cq->tail - __atomic_load_n(&_cq->head, __ATOMIC_ACQUIRE);
+    return ready >= count || _inflight.load(std::memory_order_acquire) == 0;
+  });
+}
+
+@end
+
+// ============================================================================
+// AdvancedKernel — Ring Methods
+// ============================================================================
+
+static dispatch_queue_t KernIORingWorkers(void) {
+  static dispatch_queue_t workers;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    workers = dispatch_queue_create(
+        "com.virtualos.kernel.ioring",
+        dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_CONCURRENT,
+                                                QOS_CLASS_USER_INITIATED, 0));
+  });
+  return workers;
+}
+
+@implementation AdvancedKernel (IORing)
+
+- (KernIORing *)ioRingSetup:(uint32_t)entries forProcess:(uint32_t)pid {
+  if (entries == 0 || entries > KERN_IORING_MAX_ENTRIES)
+    return nil;
+  uint32_t sqEntries = 1;
+  while (sqEntries < entries)
+    sqEntries <<= 1;
+  uint32_t cqEntries = sqEntries * 2;
+
+  static uint32_t nextRingID = 1;
+  KernIORing *ring = [[KernIORing alloc] init];
+  ring.ringID = nextRingID++;
+  ring.ownerPID = pid;
+
+  NSUInteger size = 2 * sizeof(KernRingHeader) +
+                    sqEntries * sizeof(KernRingSQE) +
+                    cqEntries * sizeof(KernRingCQE);
+  ring.memory = [self
+      createSharedMemory:[NSString stringWithFormat:@"io_uring:%u", ring.ringID]
+                    size:size];
+  if (!ring.memory)
+    return nil;
+  uint8_t *base = (uint8_t *)[self attachSharedMemory:ring.memory
+                                           forProcess:pid];
+  ring.sq = (KernRingHeader *)base;
+  ring.cq = (KernRingHeader *)(base + sizeof(KernRingHeader));
+  ring.sqes = (KernRingSQE *)(base + 2 * sizeof(KernRingHeader));
+  ring.cqes = (KernRingCQE *)(ring.sqes + sqEntries);
+  ring.sq->ringEntries = sqEntries;
+  ring.sq->ringMask = sqEntries - 1;
+  ring.cq->ringEntries = cqEntries;
+  ring.cq->ringMask = cqEntries - 1;
+
+  @synchronized(self.internalState[@"ioRings"]) {
+    self.internalState[@"ioRings"][@(ring.ringID)] = ring;
+  }
+  [self kernelLog:KernLogInfo
+         facility:KernLogSyscall
+          message:[NSString stringWithFormat:@"io_uring %u: %u SQEs, %u CQEs "
+                                             @"for PID %u",
+                                             ring.ringID, sqEntries, cqEntries,
+                                             pid]];
+  return ring;
+}
+
+- (KernRingSQE *)ioRingGetSQE:(KernIORing *)ring {
+  return ring ? [ring nextSQE] : NULL;
+}
+
+// Checks an SQE's fields before it runs. Returns 0 or the -errno it
+// completes with.
+static int32_t KernIORingValidate(uint32_t pid, const KernRingSQE *sqe) {
+  switch ((KernRingOp)sqe->opcode) {
+  case KernRingOpMmap:
+    // Only the owner's address space; sqe->pid may name nothing else
+    return sqe->pid && sqe->pid != pid ? -EPERM : 0;
+  case KernRingOpFutexWait:
+    // Waits run on a shared worker, which must not park indefinitely
+    return sqe->timeoutNs ? 0 : -EINVAL;
+  default:
+    return 0;
+  }
+}
+
+// Ring operations are syscalls issued by the ring's owner, so they pass
+// through the same filters as the direct entry path.
+static bool KernIORingFiltered(uint32_t pid, const KernRingSQE *sqe,
+                               int32_t *res) {
+  KernSyscallNumber nr;
+  uint64_t args[KERN_SYSCALL_MAX_ARGS] = {0};
+  switch ((KernRingOp)sqe->opcode) {
+  case KernRingOpRead:
+  case KernRingOpWrite:
+    nr = sqe->opcode == KernRingOpRead ? KSYS_READ : KSYS_WRITE;
+    args[0] = (uint64_t)sqe->fd;
+    args[1] = sqe->addr;
+    args[2] = sqe->len;
+    break;
+  case KernRingOpOpen:
+    nr = KSYS_OPEN;
+    args[0] = sqe->addr;
+    args[1] = sqe->opFlags;
+    args[2] = sqe->len;
+    break;
+  case KernRingOpClose:
+    nr = KSYS_CLOSE;
+    args[0] = (uint64_t)sqe->fd;
+    break;
+  case KernRingOpMmap:
+    nr = KSYS_MMAP;
+    args[0] = pid;
+    args[1] = sqe->addr;
+    args[2] = sqe->len;
+    args[3] = sqe->opFlags;
+    args[4] = sqe->off;
+    break;
+  case KernRingOpFutexWait:
+  case KernRingOpFutexWake:
+    nr = KSYS_FUTEX;
+    args[0] = sqe->addr;
+    args[1] = sqe->opcode == KernRingOpFutexWake;
+    args[2] = sqe->opcode == KernRingOpFutexWake ? sqe->len : sqe->off;
+    args[3] = sqe->timeoutNs;
+    break;
+  default:
+    return false;
+  }
+  int64_t denied;
+  if (!KernSeccompReject(pid, nr, args, &denied))
+    return false;
+  *res = (int32_t)denied;
+  return true;
+}
+
+- (int32_t)ioRingExecute:(const KernRingSQE *)sqe forProcess:(uint32_t)pid {
+  if (int32_t invalid = KernIORingValidate(pid, sqe))
+    return invalid;
+  int32_t denied;
+  if (KERN_STATIC_BRANCH(gKernSeccompKey) &&
+      KernIORingFiltered(pid, sqe, &denied))
+    return denied;
+  switch ((KernRingOp)sqe->opcode) {
+  case KernRingOpNop:
+    return 0;
+  case KernRingOpRead:
+    return (int32_t)[self readFD:sqe->fd
+                            into:(void *)(uintptr_t)sqe->addr
+                          length:sqe->len
+                          offset:sqe->off];
+  case KernRingOpWrite:
+    return (int32_t)[self writeFD:sqe->fd
+                             from:(const void *)(uintptr_t)sqe->addr
+                           length:sqe->len
+                           offset:sqe->off];
+  case KernRingOpOpen: {
+    const char *path = (const char *)(uintptr_t)sqe->addr;
+    if (!path)
+      return -EFAULT;
+    KernFileDescriptor *fd = [self openFile:@(path)
+                                      flags:sqe->opFlags
+                                       mode:sqe->len];
+    return fd ? fd.fd : -ENOENT;
+  }
+  case KernRingOpClose: {
+    KernFileDescriptor *fd = [self fileDescriptorForNumber:sqe->fd];
+    if (!fd)
+      return -EBADF;
+    [self closeFile:fd];
+    return 0;
+  }
+  case KernRingOpMmap: {
+    // A CQE result cannot carry an address; the mapping is placed at addr
+    KernVMA *vma = [self mmapForProcess:pid
+                                address:sqe->addr
+                                 length:sqe->len
+                             protection:(KernMemoryProtection)sqe->opFlags
+                                  flags:(KernMmapFlags)sqe->off];
+    return vma ? 0 : -ENOMEM;
+  }
+  case KernRingOpFutexWait:
+    return [self futexWait:(uint32_t *)(uintptr_t)sqe->addr
+                  expected:(uint32_t)sqe->off
+                 timeoutNs:sqe->timeoutNs];
+  case KernRingOpFutexWake:
+    return [self futexWake:(uint32_t *)(uintptr_t)sqe->addr count:sqe->len];
+  case KernRingOpTimeout:
+    return -ETIME; // Deferred by the chain runner, never executed inline
+  }
+  return -EINVAL;
+}
+
+// Run chain[index...] in order on the worker pool. A failed linked operation
+// cancels the rest of its chain; timeouts re-arm the chain with dispatch_after
+// instead of parking a worker thread.
+- (void)ioRing:(KernIORing *)ring
+      runChain:(KernRingChain)chain
+          from:(size_t)index {
+  while (index < chain->size()) {
+    const KernRingSQE &sqe = (*chain)[index];
+    if (sqe.opcode == KernRingOpTimeout) {
+      uint64_t userData = sqe.userData;
+      dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)sqe.timeoutNs),
+                     KernIORingWorkers(), ^{
+                       [ring postCompletion:userData result:-ETIME];
+                       [self ioRing:ring runChain:chain from:index + 1];
+                     });
+      return;
+    }
+    // Descriptors resolve in the owner's table on whichever worker runs this
+    uint32_t savedPID = [self currentPID];
+    [self setCurrentPID:ring.ownerPID];
+    int32_t res = [self ioRingExecute:&sqe forProcess:ring.ownerPID];
+    [self setCurrentPID:savedPID];
+    [ring postCompletion:sqe.userData result:res];
+    index++;
+    if (res < 0 && (sqe.flags & KERN_SQE_IO_LINK)) {
+      for (; index < chain->size(); index++)
+        [ring postCompletion:(*chain)[index].userData result:-ECANCELED];
+    }
+  }
+}
+
+- (NSInteger)ioRingEnter:(KernIORing *)ring
+                toSubmit:(uint32_t)toSubmit
+             minComplete:(uint32_t)minComplete {
+  if (!ring)
+    return -EBADF;
+  uint32_t submitted = 0;
+  @synchronized(ring) {
+    [ring publishSQEs];
+    uint32_t head = ring.sq->head;
+    uint32_t tail = __atomic_load_n(&ring.sq->tail, __ATOMIC_ACQUIRE);
+    submitted = MIN(toSubmit, tail - head);
+    [ring beginOperations:submitted];
+
+    dispatch_queue_t workers = KernIORingWorkers();
+    KernRingChain chain = std::make_shared<std::vector<KernRingSQE>>();
+    for (uint32_t i = 0; i < submitted; i++) {
+      const KernRingSQE &sqe = ring.sqes[(head + i) & ring.sq->ringMask];
+      chain->push_back(sqe);
+      // A link flag on the last SQE of the batch ends the chain there
+      if ((sqe.flags & KERN_SQE_IO_LINK) && i + 1 < submitted)
+        continue;
+      KernRingChain ready = chain;
+      dispatch_async(workers, ^{
+        [self ioRing:ring runChain:ready from:0];
+      });
+      chain = std::make_shared<std::vector<KernRingSQE>>();
+    }
+    __atomic_store_n(&ring.sq->head, head + submitted, __ATOMIC_RELEASE);
+    ring.submittedCount += submitted;
+  }
+  self.syscallCount += submitted;
+  if (minComplete)
+    [ring waitForCompletions:minComplete];
+  return submitted;
+}
+
+- (uint32_t)ioRingReapCompletions:(KernIORing *)ring
+                             into:(KernRingCQE *)cqes
+                              max:(uint32_t)max {
+  if (!ring || !cqes)
+    return 0;
+  uint32_t head = ring.cq->head;
+  uint32_t tail = __atomic_load_n(&ring.cq->tail, __ATOMIC_ACQUIRE);
+  uint32_t count = MIN(max, tail - head);
+  for (uint32_t i = 0; i < count; i++)
+    cqes[i] = ring.cqes[(head + i) & ring.cq->ringMask];
+  __atomic_store_n(&ring.cq->head, head + count, __ATOMIC_RELEASE);
+  return count;
+}
+
+- (void)ioRingDestroy:(KernIORing *)ring {
+  if (!ring)
+    return;
+  [ring waitForCompletions:UINT32_MAX]; // Drain in-flight operations
+  @synchronized(self.internalState[@"ioRings"]) {
+    [self.internalState[@"ioRings"] removeObjectForKey:@(ring.ringID)];
+  }
+  [self detachSharedMemory:ring.memory fromProcess:ring.ownerPID];
+  [self destroySharedMemory:ring.memory];
+  ring.sq = NULL;
+  ring.cq = NULL;
+  ring.sqes = NULL;
+  ring.cqes = NULL;
+}
+
+@end
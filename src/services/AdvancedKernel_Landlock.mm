@@ -0,0 +1,365 @@
+#import "AdvancedKernel.h"
+#include <fnmatch.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Path Rulesets (Landlock-style)
+// ============================================================================
+//
+// A sandbox profile's allowedPaths and deniedPaths compile into a trie of
+// path components. A component may be a literal, a glob matched with
+// fnmatch ("*.log", "tmp?"), or "**", which stands for any number of
+// components. A rule covers its path and everything beneath it; when
+// several rules match, the one matched deepest in the path wins and deny
+// beats allow at equal depth. Paths that match no rule are allowed unless
+// the profile lists allowedPaths, which turns the ruleset into an
+// allow-list.
+//
+// Applying a profile pushes a layer onto the process's stack, which its
+// children inherit, and every layer must allow an access. The check runs on
+// the dentry that dentryForPath: resolves, so directories can still be
+// traversed on the way to an allowed path, and on the target of every
+// create, link and unlink. Each dentry remembers its last verdict together
+// with the serial of the stack that produced it; serials are never reused
+// and dentries never move, so a repeated lookup costs one compare.
+//
+// Layers also carry the profile's maxProcesses and maxThreads as atomic
+// counters charged on fork and thread creation and released on exit, so a
+// limit check is O(1) per layer. maxFDs lowers the process's descriptor
+// limit, which the descriptor table already enforces.
+
+KernStaticKey gKernLandlockKey;
+
+namespace {
+
+enum : uint8_t { KernPathAllow = 1, KernPathDeny = 2 };
+
+struct KernPathNode {
+  std::unordered_map<std::string, uint32_t> children; // Literal components
+  std::vector<std::pair<std::string, uint32_t>> globs;
+  uint32_t anyDepth = 0; // "**" child, 0 if none
+  bool isAnyDepth = false;
+  uint8_t rule = 0;
+};
+
+struct KernLandlockLayer {
+  std::vector<KernPathNode> nodes{1}; // nodes[0] is the root
+  bool defaultAllow = true;
+  uint64_t serial = 0; // Of the stack this layer tops
+  uint32_t maxProcesses = UINT32_MAX;
+  uint32_t maxThreads = UINT32_MAX;
+  mutable std::atomic<uint32_t> processes{0};
+  mutable std::atomic<uint32_t> threads{0};
+  std::shared_ptr<const KernLandlockLayer> prev;
+
+  std::atomic<uint32_t> &count(bool thread) const {
+    return thread ? threads : processes;
+  }
+  uint32_t limit(bool thread) const {
+    return thread ? maxThreads : maxProcesses;
+  }
+
+  void addRule(const char *pattern, uint8_t rule) {
+    uint32_t node = 0;
+    for (const char *p = pattern; *p;) {
+      while (*p == '/')
+        p++;
+      const char *start = p;
+      while (*p && *p != '/')
+        p++;
+      std::string component(start, p - start);
+      if (component.empty() || component == ".")
+        continue;
+      node = child(node, component);
+    }
+    nodes[node].rule |= rule;
+  }
+
+  uint32_t child(uint32_t node, const std::string &component) {
+    if (component == "**") {
+      if (!nodes[node].anyDepth) {
+        nodes[node].anyDepth = (uint32_t)nodes.size();
+        nodes.emplace_back().isAnyDepth = true;
+      }
+      return nodes[node].anyDepth;
+    }
+    if (component.find_first_of("*?[") != std::string::npos) {
+      for (auto &glob : nodes[node].globs)
+        if (glob.first == component)
+          return glob.second;
+      nodes[node].globs.emplace_back(component, (uint32_t)nodes.size());
+    } else {
+      auto found = nodes[node].children.find(component);
+      if (found != nodes[node].children.end())
+        return found->second;
+      nodes[node].children[component] = (uint32_t)nodes.size();
+    }
+    nodes.emplace_back();
+    return (uint32_t)nodes.size() - 1;
+  }
+
+  // Steps all active trie nodes through the path's components, keeping the
+  // deepest rule seen
+  bool allows(const std::vector<std::string_view> &components) const {
+    std::vector<uint32_t> active, next;
+    int bestDepth = -1;
+    uint8_t best = 0;
+    auto enter = [&](uint32_t node, int depth, std::vector<uint32_t> &into) {
+      while (node) {
+        if (std::find(into.begin(), into.end(), node) != into.end())
+          return;
+        into.push_back(node);
+        if (uint8_t rule = nodes[node].rule) {
+          if (depth > bestDepth)
+            best = 0;
+          bestDepth = depth;
+          best |= rule;
+        }
+        node = nodes[node].anyDepth; // "**" also matches nothing
+      }
+    };
+    active.push_back(0);
+    if (nodes[0].rule) {
+      bestDepth = 0;
+      best = nodes[0].rule;
+    }
+    if (nodes[0].anyDepth)
+      enter(nodes[0].anyDepth, 0, active);
+    for (size_t i = 0; i < components.size() && !active.empty(); i++) {
+      std::string name(components[i]);
+      int depth = (int)i + 1;
+      next.clear();
+      for (uint32_t node : active) {
+        const KernPathNode &n = nodes[node];
+        if (n.isAnyDepth)
+          enter(node, depth, next);
+        auto found = n.children.find(name);
+        if (found != n.children.end())
+          enter(found->second, depth, next);
+        for (auto &glob : n.globs)
+          if (fnmatch(glob.first.c_str(), name.c_str(), FNM_PERIOD) == 0)
+            enter(glob.second, depth, next);
+      }
+      active.swap(next);
+    }
+    return bestDepth >= 0 ? !(best & KernPathDeny) : defaultAllow;
+  }
+};
+
+typedef std::shared_ptr<const KernLandlockLayer> KernLandlockStack;
+
+struct KernLandlockTask {
+  KernLandlockStack stack;
+  uint32_t threads = 0; // Live threads charged to the stack
+};
+
+struct KernLandlockTaskCache {
+  uint32_t pid = 0;
+  uint64_t generation = 0;
+  KernLandlockStack stack;
+};
+
+std::mutex gLandlockLock;
+std::unordered_map<uint32_t, KernLandlockTask> gLandlockTasks;
+std::atomic<uint64_t> gLandlockGeneration{1};
+std::atomic<uint64_t> gLandlockSerial{1};
+thread_local KernLandlockTaskCache tLandlockCache;
+
+// The calling thread's stack, cached with its PID
+const KernLandlockLayer *KernLandlockCurrent() {
+  KernLandlockTaskCache &cache = tLandlockCache;
+  uint32_t pid = KernCurrentPID();
+  uint64_t generation = gLandlockGeneration.load(std::memory_order_acquire);
+  if (cache.pid != pid || cache.generation != generation) {
+    std::lock_guard<std::mutex> guard(gLandlockLock);
+    auto it = gLandlockTasks.find(pid);
+    cache.stack = it != gLandlockTasks.end() ? it->second.stack : nullptr;
+    cache.pid = pid;
+    cache.generation = generation;
+  }
+  return cache.stack.get();
+}
+
+bool KernLandlockStackAllows(const KernLandlockLayer *stack,
+                             const std::vector<std::string_view> &path) {
+  for (const KernLandlockLayer *l = stack; l; l = l->prev.get())
+    if (!l->allows(path))
+      return false;
+  return true;
+}
+
+// Charge one unit to every layer's counter, undoing it if any is full
+bool KernLandlockCharge(const KernLandlockLayer *stack, bool thread) {
+  for (const KernLandlockLayer *l = stack; l; l = l->prev.get()) {
+    if (l->count(thread).fetch_add(1, std::memory_order_relaxed) >=
+        l->limit(thread)) {
+      for (const KernLandlockLayer *u = stack; u != l->prev.get();
+           u = u->prev.get())
+        u->count(thread).fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  return true;
+}
+
+void KernLandlockRelease(const KernLandlockLayer *stack, bool thread,
+                         uint32_t count) {
+  for (const KernLandlockLayer *l = stack; l; l = l->prev.get())
+    l->count(thread).fetch_sub(count, std::memory_order_relaxed);
+}
+
+// Caller holds gLandlockLock.
+void KernLandlockSetTask(uint32_t pid, KernLandlockTask task) {
+  if (gLandlockTasks.count(pid) == 0)
+    KernStaticKeyEnable(gKernLandlockKey);
+  gLandlockTasks[pid] = std::move(task);
+  gLandlockGeneration.fetch_add(1, std::memory_order_release);
+}
+
+} // namespace
+
+bool KernLandlockAllows(KernDentry *dentry) {
+  const KernLandlockLayer *stack = KernLandlockCurrent();
+  if (!stack)
+    return true;
+  uint64_t cached = dentry.landlockVerdict;
+  if ((cached >> 1) == stack->serial)
+    return cached & 1;
+  // Names are collected leaf first; the root contributes none
+  std::vector<NSString *> names;
+  for (KernDentry *d = dentry; d.parent; d = d.parent)
+    names.push_back(d.name);
+  std::vector<std::string_view> path;
+  path.reserve(names.size());
+  for (auto it = names.rbegin(); it != names.rend(); ++it)
+    path.emplace_back((*it).UTF8String);
+  bool allowed = KernLandlockStackAllows(stack, path);
+  dentry.landlockVerdict = stack->serial << 1 | allowed;
+  return allowed;
+}
+
+bool KernLandlockAllowsPath(const char *path) {
+  const KernLandlockLayer *stack = KernLandlockCurrent();
+  if (!stack)
+    return true;
+  std::vector<std::string_view> components;
+  for (const char *p = path; *p;) {
+    while (*p == '/')
+      p++;
+    const char *start = p;
+    while (*p && *p != '/')
+      p++;
+    std::string_view name(start, p - start);
+    if (name.empty() || name == ".")
+      continue;
+    if (name == "..") {
+      if (!components.empty())
+        components.pop_back();
+      continue;
+    }
+    components.push_back(name);
+  }
+  return KernLandlockStackAllows(stack, components);
+}
+
+bool KernLandlockFork(uint32_t ppid, uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gLandlockLock);
+  auto it = gLandlockTasks.find(ppid);
+  if (it == gLandlockTasks.end())
+    return true;
+  KernLandlockStack stack = it->second.stack;
+  if (!KernLandlockCharge(stack.get(), false))
+    return false;
+  KernLandlockSetTask(pid, {std::move(stack), 0});
+  return true;
+}
+
+void KernLandlockExit(uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gLandlockLock);
+  auto it = gLandlockTasks.find(pid);
+  if (it == gLandlockTasks.end())
+    return;
+  KernLandlockRelease(it->second.stack.get(), false, 1);
+  KernLandlockRelease(it->second.stack.get(), true, it->second.threads);
+  gLandlockTasks.erase(it);
+  KernStaticKeyDisable(gKernLandlockKey);
+  gLandlockGeneration.fetch_add(1, std::memory_order_release);
+}
+
+bool KernLandlockThreadCreate(uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gLandlockLock);
+  auto it = gLandlockTasks.find(pid);
+  if (it == gLandlockTasks.end())
+    return true;
+  if (!KernLandlockCharge(it->second.stack.get(), true))
+    return false;
+  it->second.threads++;
+  return true;
+}
+
+void KernLandlockThreadExit(uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gLandlockLock);
+  auto it = gLandlockTasks.find(pid);
+  if (it == gLandlockTasks.end() || it->second.threads == 0)
+    return;
+  KernLandlockRelease(it->second.stack.get(), true, 1);
+  it->second.threads--;
+}
+
+// ============================================================================
+// AdvancedKernel — Path Ruleset Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Landlock)
+
+// Compile the profile's path rules and limits into a layer above the
+// process's current stack. The process and its live threads are charged to
+// the new layer straight away, even past its limits, as a process already
+// over RLIMIT_NPROC is not killed by setrlimit.
+- (void)applyPathRuleset:(KernSandboxProfile *)profile
+               toProcess:(uint32_t)pid {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc)
+    return;
+  auto layer = std::make_shared<KernLandlockLayer>();
+  layer->defaultAllow = profile.allowedPaths.count == 0;
+  for (NSString *path in profile.allowedPaths)
+    layer->addRule(path.UTF8String, KernPathAllow);
+  for (NSString *path in profile.deniedPaths)
+    layer->addRule(path.UTF8String, KernPathDeny);
+  layer->maxProcesses = profile.maxProcesses ?: UINT32_MAX;
+  layer->maxThreads = profile.maxThreads ?: UINT32_MAX;
+  layer->serial = gLandlockSerial.fetch_add(1, std::memory_order_relaxed);
+  proc.maxFDs = MIN(proc.maxFDs, profile.maxFDs ?: UINT32_MAX);
+
+  uint32_t threads = 0;
+  for (KernThread *thread in (NSArray *)proc.threads)
+    threads += thread.state != KernThreadTerminated;
+  std::lock_guard<std::mutex> guard(gLandlockLock);
+  KernLandlockTask task;
+  auto it = gLandlockTasks.find(pid);
+  if (it != gLandlockTasks.end()) {
+    layer->prev = it->second.stack;
+    threads = it->second.threads;
+  }
+  layer->processes.store(1, std::memory_order_relaxed);
+  layer->threads.store(threads, std::memory_order_relaxed);
+  task.stack = std::move(layer);
+  task.threads = threads;
+  KernLandlockSetTask(pid, std::move(task));
+}
+
+@end
@@ -0,0 +1,452 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#if KERN_LOCKDEP
+#include <dlfcn.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#endif
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Lock Dependency Validator (lockdep) and Contention Profiler
+// ============================================================================
+//
+// Every lock belongs to a class (its name). When a thread acquires a lock
+// while holding others, an edge held-class -> new-class is added to a global
+// dependency graph; an edge that closes a cycle is a potential deadlock and is
+// reported with the acquisition sites of both locks. The same hooks time how
+// long each class is waited for and held, bucketed into log2 histograms.
+//
+// Counting semaphores have no owner: the post that balances a wait usually
+// comes from another thread. They are profiled for acquisitions and waits
+// but never pushed on the held-lock stack, so they add no dependencies.
+
+#if KERN_LOCKDEP
+
+#define KERN_LOCKDEP_MAX_DEPTH 48
+#define KERN_LOCKDEP_HIST_BUCKETS 32
+
+namespace {
+
+struct KernLockHistogram {
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> totalNs{0};
+  std::atomic<uint64_t> maxNs{0};
+  std::atomic<uint64_t> buckets[KERN_LOCKDEP_HIST_BUCKETS] = {};
+
+  void record(uint64_t ns) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prev = maxNs.load(std::memory_order_relaxed);
+    while (ns > prev &&
+           !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+    // Bucket i holds samples in [2^(i-1), 2^i) ns; bucket 0 holds zero.
+    unsigned bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= KERN_LOCKDEP_HIST_BUCKETS)
+      bucket = KERN_LOCKDEP_HIST_BUCKETS - 1;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void reset() {
+    count = 0;
+    totalNs = 0;
+    maxNs = 0;
+    for (auto &b : buckets)
+      b = 0;
+  }
+};
+
+struct KernLockClassInfo {
+  std::string name;
+  std::atomic<int> kind{KernLockKindMutex};
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contentions{0};
+  KernLockHistogram hold;
+  KernLockHistogram wait;
+};
+
+// First observed occurrence of a dependency: where the held lock was taken
+// and where the dependent lock was then acquired.
+struct KernLockEdge {
+  void *heldSite;
+  void *acquireSite;
+};
+
+struct KernLockViolation {
+  uint32_t heldClass;
+  uint32_t acquireClass;
+  void *heldSite;
+  void *acquireSite;
+  KernLockEdge reverse; // Sites of the first edge on the existing path back
+  std::vector<uint32_t> chain;
+  bool recursive;
+};
+
+struct KernHeldLock {
+  uint32_t lockClass;
+  KernLockKind kind;
+  void *site;
+  uint64_t acquiredNs;
+};
+
+struct KernLockdepTask {
+  KernHeldLock held[KERN_LOCKDEP_MAX_DEPTH];
+  uint32_t depth;
+  uint32_t waitClass;
+  uint64_t waitStartNs;
+};
+
+std::atomic<bool> gLockdepEnabled{true};
+std::mutex gLockdepLock; // Guards everything below
+std::deque<KernLockClassInfo> gLockClasses;
+std::unordered_map<std::string, uint32_t> gLockClassIDs;
+std::vector<std::vector<uint32_t>> gLockGraph; // Adjacency by class ID
+std::unordered_map<uint64_t, KernLockEdge> gLockEdges;
+std::unordered_set<uint64_t> gReportedEdges;
+std::vector<KernLockViolation> gLockViolations;
+
+thread_local KernLockdepTask tLockdepTask;
+
+inline uint64_t KernLockdepNow() {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+inline uint64_t KernLockEdgeKey(uint32_t from, uint32_t to) {
+  return ((uint64_t)from << 32) | to;
+}
+
+inline KernLockClassInfo *KernLockClassForID(uint32_t lockClass) {
+  // Classes are never removed, so the deque slot stays valid after unlock.
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  if (lockClass == 0 || lockClass > gLockClasses.size())
+    return nullptr;
+  return &gLockClasses[lockClass - 1];
+}
+
+// Breadth-first search for an existing path from -> to. On success the path
+// (excluding `from`) is written to chain.
+bool KernLockPathExists(uint32_t from, uint32_t to,
+                        std::vector<uint32_t> &chain) {
+  std::vector<uint32_t> parent(gLockGraph.size(), 0);
+  std::vector<uint32_t> queue{from};
+  parent[from] = from;
+  for (size_t i = 0; i < queue.size(); i++) {
+    uint32_t node = queue[i];
+    for (uint32_t next : gLockGraph[node]) {
+      if (parent[next])
+        continue;
+      parent[next] = node;
+      if (next == to) {
+        for (uint32_t n = to; n != from; n = parent[n])
+          chain.insert(chain.begin(), n);
+        return true;
+      }
+      queue.push_back(next);
+    }
+  }
+  return false;
+}
+
+NSString *KernLockSiteString(void *site) {
+  Dl_info info;
+  if (site && dladdr(site, &info) && info.dli_sname) {
+    uintptr_t offset = (uintptr_t)site - (uintptr_t)info.dli_saddr;
+    return [NSString stringWithFormat:@"%s+0x%lx", info.dli_sname,
+                                      (unsigned long)offset];
+  }
+  return [NSString stringWithFormat:@"%p", site];
+}
+
+NSString *KernLockClassName(uint32_t lockClass) {
+  if (lockClass == 0 || lockClass > gLockClasses.size())
+    return @"<unknown>";
+  return @(gLockClasses[lockClass - 1].name.c_str());
+}
+
+NSDictionary *KernLockViolationDictionary(const KernLockViolation &v) {
+  NSMutableArray *chain = [NSMutableArray array];
+  for (uint32_t c : v.chain)
+    [chain addObject:KernLockClassName(c)];
+  return @{
+    @"type" : v.recursive ? @"recursive" : @"circular",
+    @"held_class" : KernLockClassName(v.heldClass),
+    @"held_site" : KernLockSiteString(v.heldSite),
+    @"acquire_class" : KernLockClassName(v.acquireClass),
+    @"acquire_site" : KernLockSiteString(v.acquireSite),
+    @"existing_chain" : chain,
+    @"existing_held_site" : KernLockSiteString(v.reverse.heldSite),
+    @"existing_acquire_site" : KernLockSiteString(v.reverse.acquireSite)
+  };
+}
+
+NSDictionary *KernLockHistogramDictionary(const KernLockHistogram &h) {
+  NSMutableArray *buckets = [NSMutableArray array];
+  for (unsigned i = 0; i < KERN_LOCKDEP_HIST_BUCKETS; i++) {
+    uint64_t n = h.buckets[i].load(std::memory_order_relaxed);
+    if (n == 0)
+      continue;
+    [buckets addObject:@{
+      @"le_ns" : @(i == 0 ? 0ULL : (1ULL << i) - 1),
+      @"count" : @(n)
+    }];
+  }
+  uint64_t count = h.count.load(std::memory_order_relaxed);
+  uint64_t total = h.totalNs.load(std::memory_order_relaxed);
+  return @{
+    @"count" : @(count),
+    @"total_ns" : @(total),
+    @"avg_ns" : @(count ? total / count : 0),
+    @"max_ns" : @(h.maxNs.load(std::memory_order_relaxed)),
+    @"histogram" : buckets
+  };
+}
+
+// Validate the new dependencies created by acquiring lockClass. Returns
+// reports for the violations found so they can be logged after gLockdepLock
+// is dropped.
+NSArray<NSDictionary *> *KernLockdepValidate(KernLockdepTask &task,
+                                             uint32_t lockClass,
+                                             KernLockKind kind, void *site) {
+  NSMutableArray *found = nil;
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  for (uint32_t i = 0; i < task.depth; i++) {
+    const KernHeldLock &held = task.held[i];
+    uint64_t key = KernLockEdgeKey(held.lockClass, lockClass);
+    if (gLockEdges.count(key) || gReportedEdges.count(key))
+      continue;
+
+    KernLockViolation v = {held.lockClass, lockClass, held.site, site,
+                           {nullptr, nullptr}, {}, false};
+    if (held.lockClass == lockClass) {
+      // Two locks of one class nested; shared readers may do this safely.
+      if (held.kind == KernLockKindRWLockRead &&
+          kind == KernLockKindRWLockRead)
+        continue;
+      v.recursive = true;
+    } else if (KernLockPathExists(lockClass, held.lockClass, v.chain)) {
+      uint32_t first = v.chain.empty() ? held.lockClass : v.chain.front();
+      v.reverse = gLockEdges[KernLockEdgeKey(lockClass, first)];
+    } else {
+      gLockEdges[key] = {held.site, site};
+      gLockGraph[held.lockClass].push_back(lockClass);
+      continue;
+    }
+    gReportedEdges.insert(key);
+    gLockViolations.push_back(v);
+    if (!found)
+      found = [NSMutableArray array];
+    [found addObject:KernLockViolationDictionary(v)];
+  }
+  return found;
+}
+
+} // namespace
+
+uint32_t KernLockdepClass(NSString *name) {
+  std::string key = name.length ? name.UTF8String : "<anonymous>";
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  auto it = gLockClassIDs.find(key);
+  if (it != gLockClassIDs.end())
+    return it->second;
+  gLockClasses.emplace_back();
+  gLockClasses.back().name = key;
+  uint32_t lockClass = (uint32_t)gLockClasses.size();
+  gLockClassIDs[key] = lockClass;
+  if (gLockGraph.size() <= lockClass)
+    gLockGraph.resize(lockClass + 1);
+  return lockClass;
+}
+
+void KernLockdepContended(uint32_t lockClass, KernLockKind kind) {
+  if (!gLockdepEnabled.load(std::memory_order_relaxed))
+    return;
+  KernLockClassInfo *info = KernLockClassForID(lockClass);
+  if (!info)
+    return;
+  info->contentions.fetch_add(1, std::memory_order_relaxed);
+  KernLockdepTask &task = tLockdepTask;
+  if (task.waitClass != lockClass) {
+    task.waitClass = lockClass;
+    task.waitStartNs = KernLockdepNow();
+  }
+}
+
+void KernLockdepAcquired(uint32_t lockClass, KernLockKind kind, void *site) {
+  if (!gLockdepEnabled.load(std::memory_order_relaxed))
+    return;
+  KernLockClassInfo *info = KernLockClassForID(lockClass);
+  if (!info)
+    return;
+  uint64_t now = KernLockdepNow();
+  KernLockdepTask &task = tLockdepTask;
+  info->kind.store(kind, std::memory_order_relaxed);
+  info->acquisitions.fetch_add(1, std::memory_order_relaxed);
+  if (task.waitClass == lockClass) {
+    info->wait.record(now - task.waitStartNs);
+    task.waitClass = 0;
+  }
+
+  if (kind == KernLockKindSemaphore)
+    return;
+
+  NSArray<NSDictionary *> *violations =
+      KernLockdepValidate(task, lockClass, kind, site);
+  for (NSDictionary *report in violations) {
+    [[AdvancedKernel sharedInstance]
+        kernelLog:KernLogWarning
+         facility:KernLogThread
+          message:[NSString
+                      stringWithFormat:
+                          @"lockdep: possible %@ locking: acquiring '%@' at %@ "
+                          @"while holding '%@' taken at %@",
+                          report[@"type"], report[@"acquire_class"],
+                          report[@"acquire_site"], report[@"held_class"],
+                          report[@"held_site"]]];
+  }
+
+  if (task.depth < KERN_LOCKDEP_MAX_DEPTH) {
+    task.held[task.depth++] = {lockClass, kind, site, now};
+    return;
+  }
+  // Forget this thread's locks rather than validate against a truncated
+  // stack; releases of the dropped locks find nothing and are ignored.
+  task.depth = 0;
+  task.waitClass = 0;
+  [[AdvancedKernel sharedInstance]
+      kernelLog:KernLogWarning
+       facility:KernLogThread
+        message:[NSString stringWithFormat:
+                              @"lockdep: held lock stack overflow acquiring "
+                              @"'%@' at %@, dropping this thread's state",
+                              @(info->name.c_str()),
+                              KernLockSiteString(site)]];
+}
+
+void KernLockdepReleased(uint32_t lockClass, KernLockKind kind) {
+  if (!gLockdepEnabled.load(std::memory_order_relaxed) ||
+      kind == KernLockKindSemaphore)
+    return;
+  KernLockdepTask &task = tLockdepTask;
+  // Locks need not be released in LIFO order; search from the top.
+  for (uint32_t i = task.depth; i-- > 0;) {
+    if (task.held[i].lockClass != lockClass || task.held[i].kind != kind)
+      continue;
+    KernLockClassInfo *info = KernLockClassForID(lockClass);
+    if (info)
+      info->hold.record(KernLockdepNow() - task.held[i].acquiredNs);
+    for (uint32_t j = i + 1; j < task.depth; j++)
+      task.held[j - 1] = task.held[j];
+    task.depth--;
+    return;
+  }
+  // Not on this thread's stack, e.g. dropped on overflow.
+}
+
+#endif // KERN_LOCKDEP
+
+// ============================================================================
+// AdvancedKernel — Lockdep Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Lockdep)
+
+- (void)setLockdepEnabled:(BOOL)enabled {
+#if KERN_LOCKDEP
+  gLockdepEnabled = enabled;
+  [self kernelLog:KernLogInfo
+         facility:KernLogThread
+          message:enabled ? @"lockdep enabled" : @"lockdep disabled"];
+#endif
+}
+
+- (BOOL)isLockdepEnabled {
+#if KERN_LOCKDEP
+  return gLockdepEnabled.load(std::memory_order_relaxed);
+#else
+  return NO;
+#endif
+}
+
+- (NSArray<NSDictionary *> *)lockdepViolations {
+  NSMutableArray *result = [NSMutableArray array];
+#if KERN_LOCKDEP
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  for (const KernLockViolation &v : gLockViolations)
+    [result addObject:KernLockViolationDictionary(v)];
+#endif
+  return result;
+}
+
+- (NSDictionary *)lockContentionProfile {
+#if KERN_LOCKDEP
+  static NSArray *kindNames =
+      @[ @"mutex", @"rwlock_read", @"rwlock_write", @"spinlock", @"semaphore" ];
+  NSMutableArray *classes = [NSMutableArray array];
+  NSMutableArray *dependencies = [NSMutableArray array];
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  for (const KernLockClassInfo &info : gLockClasses) {
+    int kind = info.kind.load(std::memory_order_relaxed);
+    [classes addObject:@{
+      @"name" : @(info.name.c_str()),
+      @"kind" : kindNames[kind],
+      @"acquisitions" : @(info.acquisitions.load(std::memory_order_relaxed)),
+      @"contentions" : @(info.contentions.load(std::memory_order_relaxed)),
+      @"hold_time" : KernLockHistogramDictionary(info.hold),
+      @"wait_time" : KernLockHistogramDictionary(info.wait)
+    }];
+  }
+  for (const auto &edge : gLockEdges) {
+    [dependencies addObject:@{
+      @"held" : KernLockClassName((uint32_t)(edge.first >> 32)),
+      @"acquired" : KernLockClassName((uint32_t)edge.first),
+      @"held_site" : KernLockSiteString(edge.second.heldSite),
+      @"acquire_site" : KernLockSiteString(edge.second.acquireSite)
+    }];
+  }
+  NSMutableArray *violations = [NSMutableArray array];
+  for (const KernLockViolation &v : gLockViolations)
+    [violations addObject:KernLockViolationDictionary(v)];
+  return @{
+    @"enabled" : @(gLockdepEnabled.load(std::memory_order_relaxed)),
+    @"lock_classes" : classes,
+    @"dependencies" : dependencies,
+    @"violations" : violations
+  };
+#else
+  return @{@"enabled" : @NO};
+#endif
+}
+
+- (NSData *)lockContentionProfileJSON {
+  return [NSJSONSerialization dataWithJSONObject:[self lockContentionProfile]
+                                         options:NSJSONWritingPrettyPrinted
+                                           error:nil];
+}
+
+- (void)resetLockStatistics {
+#if KERN_LOCKDEP
+  std::lock_guard<std::mutex> guard(gLockdepLock);
+  for (KernLockClassInfo &info : gLockClasses) {
+    info.acquisitions = 0;
+    info.contentions = 0;
+    info.hold.reset();
+    info.wait.reset();
+  }
+#endif
+}
+
+@end
@@ -0,0 +1,881 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Kernel Log Rings
+// ============================================================================
+//
+// Messages go into fixed-size 64-byte binary records, printk style: the
+// format string pointer and up to four raw argument words, formatted only
+// when a reader asks for them. Each record carries a global sequence number
+// taken when it is written; readers merge the rings by sequence. C string
+// arguments may not outlive the call, so like bstr_printf their bytes are
+// copied (bounded) into a side buffer and the word holds an offset into it.
+//
+// There is one ring per CPU. A thread is bound to a ring round-robin on its
+// first message and keeps it, which stands in for running on that CPU;
+// while there are no more logging threads than rings every ring has one
+// writer. Writers claim a slot by advancing the ring head, clear its
+// sequence, fill it in and publish the new sequence, so they never wait on
+// readers or on each other. A full ring overwrites its oldest record.
+// Readers copy a record and keep it only if its sequence was the same
+// before and after the copy.
+//
+// Messages that arrive as NSStrings (kernelLog:facility:message:) become
+// text records: the string sits in a side table next to the ring, written
+// and read under the ring's text lock so a reader never retains a string
+// the writer is releasing. Copied C string arguments use a second side
+// table under the same lock. KERN_LOG records without them skip the lock.
+
+#define KERN_LOG_MAX_RINGS 64
+#define KERN_LOG_RING_RECORDS 8192 // Per ring, a power of two
+#define KERN_LOG_RING_MASK (KERN_LOG_RING_RECORDS - 1)
+#define KERN_LOG_DEFAULT_LEVEL KernLogDebug
+
+std::atomic<uint8_t> gKernLogLevels[KERN_LOG_FACILITIES] = {
+    KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL,
+    KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL,
+    KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL,
+    KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL,
+    KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL, KERN_LOG_DEFAULT_LEVEL,
+    KERN_LOG_DEFAULT_LEVEL};
+
+namespace {
+
+struct KernLogRecord {
+  std::atomic<uint64_t> sequence{0}; // 0 while being written
+  uint64_t timestamp;
+  const char *format; // Null for a text record
+  uint32_t pid;
+  uint8_t level;
+  uint8_t facility;
+  uint8_t count;     // Arguments, then string argument mask << 4
+  uint8_t subsystem; // Interned name, 0 for none
+  uint64_t args[KERN_LOG_MAX_ARGS];
+};
+static_assert(sizeof(KernLogRecord) == 64, "log records are one cache line");
+
+struct KernLogRing {
+  alignas(64) std::atomic<uint64_t> head{0};
+  uint32_t cpu = 0;
+  alignas(64) KernLogRecord records[KERN_LOG_RING_RECORDS];
+  std::mutex textLock;
+  NSString *texts[KERN_LOG_RING_RECORDS];
+  NSData *strings[KERN_LOG_RING_RECORDS]; // Copied C string arguments
+};
+
+// A record as copied out by a reader
+struct KernLogCopy {
+  uint64_t sequence;
+  uint64_t timestamp;
+  const char *format;
+  NSString *text;
+  NSData *strings; // Set when stringArgs is
+  uint32_t pid;
+  uint32_t cpu;
+  uint8_t level;
+  uint8_t facility;
+  uint8_t count;
+  uint8_t stringArgs; // Arguments that are offsets into strings
+  uint8_t subsystem;
+  uint64_t args[KERN_LOG_MAX_ARGS];
+};
+
+std::atomic<uint64_t> gKernLogSequence{0};
+std::atomic<uint64_t> gKernLogFloor{0}; // Records at or below were cleared
+std::atomic<uint32_t> gKernLogNextRing{0};
+std::atomic<KernLogRing *> gKernLogRings[KERN_LOG_MAX_RINGS];
+thread_local KernLogRing *tKernLogRing = nullptr;
+
+KernLogRing *KernLogLocalRing() {
+  if (__builtin_expect(tKernLogRing != nullptr, 1))
+    return tKernLogRing;
+  uint32_t cpu = gKernLogNextRing.fetch_add(1, std::memory_order_relaxed) %
+                 KERN_LOG_MAX_RINGS;
+  KernLogRing *ring = gKernLogRings[cpu].load(std::memory_order_acquire);
+  if (!ring) {
+    KernLogRing *fresh = new KernLogRing();
+    fresh->cpu = cpu;
+    if (gKernLogRings[cpu].compare_exchange_strong(ring, fresh,
+                                                   std::memory_order_acq_rel))
+      ring = fresh;
+    else
+      delete fresh;
+  }
+  tKernLogRing = ring;
+  return ring;
+}
+
+// Claim the next slot and clear its sequence. The caller fills it in and
+// publishes with KernLogPublish.
+KernLogRecord &KernLogClaim(KernLogRing *ring, uint64_t *slot) {
+  *slot = ring->head.fetch_add(1, std::memory_order_relaxed) &
+          KERN_LOG_RING_MASK;
+  KernLogRecord &record = ring->records[*slot];
+  record.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return record;
+}
+
+void KernLogPublish(KernLogRecord &record, KernLogLevel level,
+                    KernLogFacility facility, uint8_t subsystem) {
+  record.timestamp = mach_absolute_time();
+  record.pid = KernCurrentPID();
+  record.level = (uint8_t)level;
+  record.facility = (uint8_t)facility;
+  record.subsystem = subsystem;
+  record.sequence.store(
+      gKernLogSequence.fetch_add(1, std::memory_order_relaxed) + 1,
+      std::memory_order_release);
+}
+
+// Copy the C strings flagged in *strings, NUL-terminated and truncated to
+// KERN_LOG_STRING_MAX bytes, replacing each word with its offset. Null
+// pointers stay 0 and lose their flag.
+NSData *KernLogCopyStrings(uint64_t *words, unsigned count,
+                           unsigned *strings) {
+  std::string buffer;
+  for (unsigned i = 0; i < count; i++) {
+    if (!(*strings >> i & 1))
+      continue;
+    const char *str = (const char *)(uintptr_t)words[i];
+    if (!str) {
+      *strings &= ~(1u << i);
+      continue;
+    }
+    words[i] = buffer.size();
+    buffer.append(str, strnlen(str, KERN_LOG_STRING_MAX - 1));
+    buffer.push_back('\0');
+  }
+  return buffer.empty() ? nil
+                        : [NSData dataWithBytes:buffer.data()
+                                         length:buffer.size()];
+}
+
+bool KernLogCopyRecord(KernLogRing *ring, uint64_t slot, KernLogCopy &out) {
+  const KernLogRecord &record = ring->records[slot];
+  uint64_t sequence = record.sequence.load(std::memory_order_acquire);
+  if (sequence == 0)
+    return false;
+  out.timestamp = record.timestamp;
+  out.format = record.format;
+  out.pid = record.pid;
+  out.level = record.level;
+  out.facility = record.facility;
+  out.subsystem = record.subsystem;
+  out.count = std::min<uint8_t>(record.count & 0xF, KERN_LOG_MAX_ARGS);
+  out.stringArgs = record.count >> 4;
+  memcpy(out.args, record.args, sizeof(out.args));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (record.sequence.load(std::memory_order_relaxed) != sequence)
+    return false;
+  out.sequence = sequence;
+  out.cpu = ring->cpu;
+  out.text = nil;
+  out.strings = nil;
+  if (!out.format || out.stringArgs) {
+    std::lock_guard<std::mutex> guard(ring->textLock);
+    if (record.sequence.load(std::memory_order_relaxed) != sequence)
+      return false;
+    if (!out.format)
+      out.text = ring->texts[slot];
+    else
+      out.strings = ring->strings[slot];
+  }
+  return true;
+}
+
+// Records published since the per-ring positions in consumed, merged
+// across rings in sequence order, and advance the positions. A ring stops
+// at a slot still being written so the record is picked up next time;
+// records overwritten before they were collected are added to dropped.
+std::vector<KernLogCopy> KernLogCollect(uint64_t *consumed, uint64_t *dropped) {
+  uint64_t floor = gKernLogFloor.load(std::memory_order_acquire);
+  std::vector<std::vector<KernLogCopy>> perRing;
+  for (size_t r = 0; r < KERN_LOG_MAX_RINGS; r++) {
+    KernLogRing *ring = gKernLogRings[r].load(std::memory_order_acquire);
+    if (!ring)
+      continue;
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t pos = consumed[r];
+    if (head > KERN_LOG_RING_RECORDS && pos < head - KERN_LOG_RING_RECORDS) {
+      *dropped += head - KERN_LOG_RING_RECORDS - pos;
+      pos = head - KERN_LOG_RING_RECORDS;
+    }
+    std::vector<KernLogCopy> records;
+    records.reserve((size_t)(head - pos));
+    KernLogCopy copy;
+    for (; pos < head; pos++) {
+      if (!KernLogCopyRecord(ring, pos & KERN_LOG_RING_MASK, copy))
+        break;
+      if (copy.sequence > floor)
+        records.push_back(copy);
+    }
+    consumed[r] = pos;
+    // Ring order is claim order; writers sharing a ring can publish
+    // sequences slightly out of it
+    std::sort(records.begin(), records.end(),
+              [](const KernLogCopy &a, const KernLogCopy &b) {
+                return a.sequence < b.sequence;
+              });
+    if (!records.empty())
+      perRing.push_back(std::move(records));
+  }
+
+  size_t total = 0;
+  for (auto &records : perRing)
+    total += records.size();
+  std::vector<KernLogCopy> merged;
+  merged.reserve(total);
+  typedef std::pair<uint64_t, size_t> Cursor; // (sequence, ring)
+  std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+  std::vector<size_t> next(perRing.size(), 0);
+  for (size_t r = 0; r < perRing.size(); r++)
+    heap.push({perRing[r][0].sequence, r});
+  while (!heap.empty()) {
+    size_t r = heap.top().second;
+    heap.pop();
+    merged.push_back(perRing[r][next[r]]);
+    if (++next[r] < perRing[r].size())
+      heap.push({perRing[r][next[r]].sequence, r});
+  }
+  return merged;
+}
+
+// printf-style rendering of raw argument words. Length modifiers are
+// replaced by ll so every word is passed at full width, after truncating
+// it to the width the format named.
+NSString *KernLogRender(const KernLogCopy &record) {
+  if (!record.format)
+    return record.text ?: @"";
+  std::string out;
+  char spec[32];
+  char buffer[256];
+  unsigned next = 0;
+  for (const char *p = record.format; *p; p++) {
+    if (*p != '%') {
+      out.push_back(*p);
+      continue;
+    }
+    if (p[1] == '%') {
+      out.push_back('%');
+      p++;
+      continue;
+    }
+    size_t n = 0;
+    unsigned bits = 32;
+    spec[n++] = '%';
+    const char *q = p + 1;
+    for (; *q && !strchr("diouxXcfFeEgGaAsp@", *q); q++) {
+      if (*q == 'h')
+        bits = bits == 16 ? 8 : 16;
+      else if (strchr("lLjztq", *q))
+        bits = 64;
+      else if (n < sizeof(spec) - 4) // Room for ll, conversion and NUL
+        spec[n++] = *q;
+    }
+    if (!*q)
+      break;
+    p = q;
+    unsigned arg = next;
+    uint64_t word = next < record.count ? record.args[next++] : 0;
+    uint64_t mask = bits < 64 ? (1ULL << bits) - 1 : ~0ULL;
+    switch (*q) {
+    case 'd':
+    case 'i': {
+      int64_t value = (int64_t)(word & mask);
+      if (bits < 64 && (word >> (bits - 1)) & 1)
+        value = (int64_t)(word | ~mask);
+      memcpy(spec + n, "ll", 2);
+      spec[n + 2] = *q;
+      spec[n + 3] = 0;
+      snprintf(buffer, sizeof(buffer), spec, (long long)value);
+      break;
+    }
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      memcpy(spec + n, "ll", 2);
+      spec[n + 2] = *q;
+      spec[n + 3] = 0;
+      snprintf(buffer, sizeof(buffer), spec, (unsigned long long)(word & mask));
+      break;
+    case 'c':
+      spec[n] = 'c';
+      spec[n + 1] = 0;
+      snprintf(buffer, sizeof(buffer), spec, (int)(word & 0xFF));
+      break;
+    case 's': {
+      // Only copied strings are read; other words are not known to be live
+      const char *str = word ? "(?)" : "(null)";
+      if ((record.stringArgs >> arg & 1) && word < record.strings.length)
+        str = (const char *)record.strings.bytes + word;
+      spec[n] = 's';
+      spec[n + 1] = 0;
+      snprintf(buffer, sizeof(buffer), spec, str);
+      break;
+    }
+    case 'p':
+      spec[n] = 'p';
+      spec[n + 1] = 0;
+      snprintf(buffer, sizeof(buffer), spec, (void *)(uintptr_t)word);
+      break;
+    case '@':
+      snprintf(buffer, sizeof(buffer), "(object)");
+      break;
+    default: { // Floating point, stored as double bits
+      double value;
+      memcpy(&value, &word, sizeof(value));
+      spec[n] = *q;
+      spec[n + 1] = 0;
+      snprintf(buffer, sizeof(buffer), spec, value);
+      break;
+    }
+    }
+    out += buffer;
+  }
+  return [[NSString alloc] initWithBytes:out.data()
+                                  length:out.size()
+                                encoding:NSUTF8StringEncoding]
+             ?: @"";
+}
+
+// Subsystem names are interned to a byte; id 0 is no subsystem. Once all
+// 255 ids are taken further names are logged without one.
+std::mutex gKernLogSubsystemLock;
+NSMutableArray<NSString *> *gKernLogSubsystems; // Name of id i + 1
+NSMutableDictionary<NSString *, NSNumber *> *gKernLogSubsystemIDs;
+
+uint8_t KernLogSubsystemID(NSString *name, bool create) {
+  if (name.length == 0)
+    return 0;
+  std::lock_guard<std::mutex> guard(gKernLogSubsystemLock);
+  NSNumber *known = gKernLogSubsystemIDs[name];
+  if (known || !create)
+    return known.unsignedCharValue;
+  if (!gKernLogSubsystems) {
+    gKernLogSubsystems = [NSMutableArray array];
+    gKernLogSubsystemIDs = [NSMutableDictionary dictionary];
+  }
+  if (gKernLogSubsystems.count >= UINT8_MAX)
+    return 0;
+  [gKernLogSubsystems addObject:[name copy]];
+  uint8_t sid = (uint8_t)gKernLogSubsystems.count;
+  gKernLogSubsystemIDs[name] = @(sid);
+  return sid;
+}
+
+NSString *KernLogSubsystemName(uint8_t sid) {
+  if (sid == 0)
+    return @"";
+  std::lock_guard<std::mutex> guard(gKernLogSubsystemLock);
+  return gKernLogSubsystems[sid - 1];
+}
+
+KernLogEntry *KernLogMakeEntry(const KernLogCopy &record) {
+  KernLogEntry *entry = [[KernLogEntry alloc] init];
+  entry.sequenceNumber = record.sequence;
+  entry.level = (KernLogLevel)record.level;
+  entry.facility = (KernLogFacility)record.facility;
+  entry.subsystem = KernLogSubsystemName(record.subsystem);
+  entry.message = KernLogRender(record);
+  entry.timestampNs = record.timestamp;
+  entry.processID = record.pid;
+  entry.cpuID = record.cpu;
+  return entry;
+}
+
+NSString *KernLogLevelName(KernLogLevel level) {
+  switch (level) {
+  case KernLogEmergency:
+    return @"EMERG";
+  case KernLogAlert:
+    return @"ALERT";
+  case KernLogCritical:
+    return @"CRIT";
+  case KernLogError:
+    return @"ERR";
+  case KernLogWarning:
+    return @"WARN";
+  case KernLogNotice:
+    return @"NOTICE";
+  case KernLogInfo:
+    return @"INFO";
+  case KernLogDebug:
+    return @"DEBUG";
+  case KernLogTrace:
+    return @"TRACE";
+  }
+  return @"UNKNOWN";
+}
+
+// ============================================================================
+// Log Query Index
+// ============================================================================
+//
+// Queries run against an index that pulls new records out of the rings
+// when a query arrives, so indexing costs nothing on the logging path and
+// each record is indexed once. Indexed records get consecutive positions
+// in a bounded store; when it is full the oldest positions fall off.
+//
+// Posting lists give the positions of each level, facility and subsystem in
+// ascending order. A query walks the shortest list its predicates allow
+// (the levels it accepts are merged on the fly) and checks the remaining
+// predicates on each candidate; only candidates that pass the cheap checks
+// are formatted for a substring match. A skip index samples the store's
+// timestamps every KERN_LOG_SKIP positions, so a time bound becomes a
+// binary search plus a short scan. Timestamps taken on different CPUs can
+// be slightly out of sequence order; the index clamps each one to its
+// predecessor's so the store stays time-ordered, and time bounds apply to
+// the clamped value.
+//
+// A query is a cursor: it remembers the position after the last record it
+// returned, so tailing the log costs only the records added since.
+
+#define KERN_LOG_INDEX_RECORDS 65536 // Store capacity, a power of two
+#define KERN_LOG_LEVELS (KernLogTrace + 1)
+#define KERN_LOG_SUBSYSTEMS 256
+#define KERN_LOG_SKIP 64
+
+struct KernLogIndexed {
+  KernLogCopy record;
+  uint64_t time; // Clamped to be non-decreasing in position order
+};
+
+struct KernLogIndex {
+  std::mutex lock;
+  std::vector<KernLogIndexed> store =
+      std::vector<KernLogIndexed>(KERN_LOG_INDEX_RECORDS);
+  uint64_t base = 0; // Live positions are [base, end)
+  uint64_t end = 0;
+  uint64_t lastTime = 0;
+  uint64_t consumed[KERN_LOG_MAX_RINGS] = {};
+  uint64_t dropped = 0; // Overwritten in a ring before being indexed
+  std::deque<uint64_t> byLevel[KERN_LOG_LEVELS];
+  std::deque<uint64_t> byFacility[KERN_LOG_FACILITIES];
+  std::deque<uint64_t> bySubsystem[KERN_LOG_SUBSYSTEMS];
+  std::deque<uint64_t> skipTimes; // Time at skipBase + i * KERN_LOG_SKIP
+  uint64_t skipBase = 0;
+
+  KernLogIndexed &at(uint64_t pos) {
+    return store[pos & (KERN_LOG_INDEX_RECORDS - 1)];
+  }
+};
+
+KernLogIndex &KernLogGetIndex() {
+  static KernLogIndex *index = new KernLogIndex();
+  return *index;
+}
+
+void KernLogTrim(std::deque<uint64_t> &list, uint64_t base) {
+  while (!list.empty() && list.front() < base)
+    list.pop_front();
+}
+
+// Pull newly published records into the index. Caller holds index.lock.
+void KernLogIngest(KernLogIndex &index) {
+  std::vector<KernLogCopy> records =
+      KernLogCollect(index.consumed, &index.dropped);
+  if (records.empty())
+    return;
+  for (const KernLogCopy &record : records) {
+    uint64_t pos = index.end++;
+    index.lastTime = std::max(index.lastTime, record.timestamp);
+    KernLogIndexed &slot = index.at(pos);
+    slot.record = record;
+    slot.time = index.lastTime;
+    index.byLevel[std::min<uint8_t>(record.level, KernLogTrace)].push_back(
+        pos);
+    index.byFacility[record.facility & (KERN_LOG_FACILITIES - 1)].push_back(
+        pos);
+    if (record.subsystem)
+      index.bySubsystem[record.subsystem].push_back(pos);
+    if (pos % KERN_LOG_SKIP == 0) {
+      if (index.skipTimes.empty())
+        index.skipBase = pos;
+      index.skipTimes.push_back(slot.time);
+    }
+  }
+  if (index.end - index.base <= KERN_LOG_INDEX_RECORDS)
+    return;
+  index.base = index.end - KERN_LOG_INDEX_RECORDS;
+  for (auto &list : index.byLevel)
+    KernLogTrim(list, index.base);
+  for (auto &list : index.byFacility)
+    KernLogTrim(list, index.base);
+  for (auto &list : index.bySubsystem)
+    KernLogTrim(list, index.base);
+  while (!index.skipTimes.empty() &&
+         index.skipBase + KERN_LOG_SKIP <= index.base) {
+    index.skipTimes.pop_front();
+    index.skipBase += KERN_LOG_SKIP;
+  }
+}
+
+// First live position whose time is at least t
+uint64_t KernLogPositionAt(KernLogIndex &index, uint64_t t) {
+  auto samples = index.skipTimes.begin();
+  auto first = std::lower_bound(samples, index.skipTimes.end(), t);
+  uint64_t pos = index.base;
+  if (first != samples)
+    pos = std::max(pos, index.skipBase + (uint64_t)(first - samples - 1) *
+                                             KERN_LOG_SKIP);
+  while (pos < index.end && index.at(pos).time < t)
+    pos++;
+  return pos;
+}
+
+struct KernLogFilter {
+  uint8_t maxLevel = KernLogTrace;
+  int facility = -1; // Any
+  int subsystem = -1;
+  NSString *substring;
+};
+
+// The query's predicates on one indexed record; formats the message only
+// for a substring match, and returns the entry when the record matches.
+KernLogEntry *KernLogMatch(const KernLogFilter &filter,
+                           const KernLogCopy &record) {
+  if (record.level > filter.maxLevel)
+    return nil;
+  if (filter.facility >= 0 && record.facility != filter.facility)
+    return nil;
+  if (filter.subsystem >= 0 && record.subsystem != filter.subsystem)
+    return nil;
+  KernLogEntry *entry = KernLogMakeEntry(record);
+  if (filter.substring.length &&
+      [entry.message rangeOfString:filter.substring].location == NSNotFound)
+    return nil;
+  return entry;
+}
+
+// Visit matching records in [from, to), ascending or descending, until
+// visit returns false. Candidates come from the shortest usable posting
+// list, or the store itself when no predicate narrows the search.
+template <typename Visit>
+void KernLogScan(KernLogIndex &index, const KernLogFilter &filter,
+                 uint64_t from, uint64_t to, bool descending, Visit visit) {
+  if (from >= to)
+    return;
+  std::vector<const std::deque<uint64_t> *> lists;
+  size_t best = SIZE_MAX;
+  if (filter.maxLevel < KernLogTrace) {
+    size_t size = 0;
+    for (unsigned level = 0; level <= filter.maxLevel; level++)
+      size += index.byLevel[level].size();
+    best = size;
+    for (unsigned level = 0; level <= filter.maxLevel; level++)
+      lists.push_back(&index.byLevel[level]);
+  }
+  if (filter.facility >= 0 &&
+      index.byFacility[filter.facility].size() < best) {
+    best = index.byFacility[filter.facility].size();
+    lists.assign(1, &index.byFacility[filter.facility]);
+  }
+  if (filter.subsystem > 0 &&
+      index.bySubsystem[filter.subsystem].size() < best) {
+    best = index.bySubsystem[filter.subsystem].size();
+    lists.assign(1, &index.bySubsystem[filter.subsystem]);
+  }
+
+  if (lists.empty()) {
+    for (uint64_t i = 0; i < to - from; i++) {
+      uint64_t pos = descending ? to - 1 - i : from + i;
+      KernLogEntry *entry = KernLogMatch(filter, index.at(pos).record);
+      if (entry && !visit(pos, entry))
+        return;
+    }
+    return;
+  }
+
+  // Merge the lists: next[i] is list i's next candidate in scan order
+  std::vector<size_t> next(lists.size());
+  for (size_t i = 0; i < lists.size(); i++) {
+    const auto &list = *lists[i];
+    uint64_t bound = descending ? to : from;
+    next[i] = std::lower_bound(list.begin(), list.end(), bound) - list.begin();
+  }
+  for (;;) {
+    size_t pick = SIZE_MAX;
+    uint64_t pos = 0;
+    for (size_t i = 0; i < lists.size(); i++) {
+      const auto &list = *lists[i];
+      if (descending) {
+        if (next[i] == 0 || list[next[i] - 1] < from)
+          continue;
+        if (pick == SIZE_MAX || list[next[i] - 1] > pos) {
+          pick = i;
+          pos = list[next[i] - 1];
+        }
+      } else {
+        if (next[i] >= list.size() || list[next[i]] >= to)
+          continue;
+        if (pick == SIZE_MAX || list[next[i]] < pos) {
+          pick = i;
+          pos = list[next[i]];
+        }
+      }
+    }
+    if (pick == SIZE_MAX)
+      return;
+    if (descending)
+      next[pick]--;
+    else
+      next[pick]++;
+    KernLogEntry *entry = KernLogMatch(filter, index.at(pos).record);
+    if (entry && !visit(pos, entry))
+      return;
+  }
+}
+
+} // namespace
+
+void KernLogWrite(KernLogLevel level, KernLogFacility facility,
+                  const char *format, const uint64_t *args, unsigned count,
+                  unsigned strings) {
+  KernLogRing *ring = KernLogLocalRing();
+  uint64_t words[KERN_LOG_MAX_ARGS];
+  memcpy(words, args, count * sizeof(uint64_t));
+  NSData *copied = nil;
+  if (__builtin_expect(strings != 0, 0))
+    copied = KernLogCopyStrings(words, count, &strings);
+  auto fill = [&](KernLogRecord &record) {
+    record.format = format;
+    record.count = (uint8_t)(count | strings << 4);
+    for (unsigned i = 0; i < count; i++)
+      record.args[i] = words[i];
+    KernLogPublish(record, level, facility, 0);
+  };
+  uint64_t slot;
+  if (strings) {
+    std::lock_guard<std::mutex> guard(ring->textLock);
+    KernLogRecord &record = KernLogClaim(ring, &slot);
+    ring->strings[slot] = copied;
+    fill(record);
+  } else {
+    fill(KernLogClaim(ring, &slot));
+  }
+
+  if (__builtin_expect(level <= KernLogWarning, 0)) {
+    KernLogCopy copy = {};
+    copy.format = format;
+    copy.count = (uint8_t)count;
+    copy.stringArgs = (uint8_t)strings;
+    copy.strings = copied;
+    memcpy(copy.args, words, count * sizeof(uint64_t));
+    NSLog(@"[KERN %@] %@", KernLogLevelName(level), KernLogRender(copy));
+  }
+}
+
+// ============================================================================
+// KernLogQuery
+// ============================================================================
+
+@implementation KernLogQuery
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _maxLevel = KernLogTrace;
+    _facility = -1;
+    _subsystem = nil;
+    _startTime = 0;
+    _endTime = UINT64_MAX;
+    _substring = nil;
+    _position = 0;
+    _missed = 0;
+  }
+  return self;
+}
+@end
+
+// ============================================================================
+// AdvancedKernel — Logging Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Log)
+
+- (void)kernelLog:(KernLogLevel)level
+         facility:(KernLogFacility)facility
+          message:(NSString *)message {
+  [self kernelLog:level facility:facility subsystem:nil message:message];
+}
+
+- (void)kernelLog:(KernLogLevel)level
+         facility:(KernLogFacility)facility
+        subsystem:(NSString *)subsystem
+          message:(NSString *)message {
+  if (!KernLogEnabled(level, facility))
+    return;
+  uint8_t sid = KernLogSubsystemID(subsystem, true);
+  KernLogRing *ring = KernLogLocalRing();
+  {
+    std::lock_guard<std::mutex> guard(ring->textLock);
+    uint64_t slot;
+    KernLogRecord &record = KernLogClaim(ring, &slot);
+    ring->texts[slot] = [message copy];
+    record.format = nullptr;
+    record.count = 0;
+    KernLogPublish(record, level, facility, sid);
+  }
+
+  if (level <= KernLogWarning) {
+    NSLog(@"[KERN %@] %@", KernLogLevelName(level), message);
+  }
+}
+
+- (void)setLogLevel:(KernLogLevel)level forFacility:(KernLogFacility)facility {
+  gKernLogLevels[facility & (KERN_LOG_FACILITIES - 1)].store(
+      (uint8_t)level, std::memory_order_relaxed);
+}
+
+- (KernLogLevel)logLevelForFacility:(KernLogFacility)facility {
+  return (KernLogLevel)gKernLogLevels[facility & (KERN_LOG_FACILITIES - 1)]
+      .load(std::memory_order_relaxed);
+}
+
+- (NSArray<KernLogEntry *> *)logEntriesWithLevel:(KernLogLevel)minLevel
+                                        facility:(KernLogFacility)facility
+                                           count:(NSUInteger)count {
+  KernLogFilter filter;
+  filter.maxLevel = (uint8_t)MIN(MAX(minLevel, 0), KernLogTrace);
+  if (facility != KernLogKernel) // Kernel matches every facility here
+    filter.facility = (int)(facility & (KERN_LOG_FACILITIES - 1));
+  NSMutableArray *results = [NSMutableArray array];
+  if (count == 0)
+    return results;
+  KernLogIndex &index = KernLogGetIndex();
+  std::lock_guard<std::mutex> guard(index.lock);
+  KernLogIngest(index);
+  KernLogScan(index, filter, index.base, index.end, true,
+              [&](uint64_t, KernLogEntry *entry) {
+                [results addObject:entry];
+                return results.count < count;
+              });
+  return [[results reverseObjectEnumerator] allObjects];
+}
+
+- (NSArray<KernLogEntry *> *)queryLog:(KernLogQuery *)query
+                                limit:(NSUInteger)limit {
+  KernLogFilter filter;
+  filter.maxLevel = (uint8_t)MIN(MAX(query.maxLevel, 0), KernLogTrace);
+  if (query.facility >= 0)
+    filter.facility = (int)(query.facility & (KERN_LOG_FACILITIES - 1));
+  filter.substring = query.substring;
+  NSMutableArray *results = [NSMutableArray array];
+  KernLogIndex &index = KernLogGetIndex();
+  std::lock_guard<std::mutex> guard(index.lock);
+  KernLogIngest(index);
+  if (query.subsystem.length) {
+    filter.subsystem = KernLogSubsystemID(query.subsystem, false);
+    if (filter.subsystem == 0) { // Never logged, so nothing can match
+      query.position = index.end;
+      return results;
+    }
+  }
+
+  uint64_t from = query.position;
+  if (from < index.base) {
+    query.missed += index.base - from;
+    from = index.base;
+  }
+  if (query.startTime)
+    from = std::max(from, KernLogPositionAt(index, query.startTime));
+  uint64_t to = index.end;
+  if (query.endTime < UINT64_MAX)
+    to = KernLogPositionAt(index, query.endTime + 1);
+  // Stopping short of the end leaves the cursor after the last match;
+  // otherwise everything up to the end has been looked at
+  uint64_t resume = index.end;
+  if (limit > 0) {
+    KernLogScan(index, filter, from, to, false,
+                [&](uint64_t pos, KernLogEntry *entry) {
+                  [results addObject:entry];
+                  if (results.count < limit)
+                    return true;
+                  resume = pos + 1;
+                  return false;
+                });
+  } else {
+    resume = from;
+  }
+  query.position = resume;
+  return results;
+}
+
+- (uint64_t)logEndPosition {
+  KernLogIndex &index = KernLogGetIndex();
+  std::lock_guard<std::mutex> guard(index.lock);
+  KernLogIngest(index);
+  return index.end;
+}
+
+- (void)clearLogs {
+  KernLogIndex &index = KernLogGetIndex();
+  std::lock_guard<std::mutex> guard(index.lock);
+  gKernLogFloor.store(gKernLogSequence.load(std::memory_order_acquire),
+                      std::memory_order_release);
+  KernLogIngest(index);
+  index.base = index.end;
+  for (auto &list : index.byLevel)
+    list.clear();
+  for (auto &list : index.byFacility)
+    list.clear();
+  for (auto &list : index.bySubsystem)
+    list.clear();
+  index.skipTimes.clear();
+}
+
+- (NSUInteger)logCount {
+  KernLogIndex &index = KernLogGetIndex();
+  std::lock_guard<std::mutex> guard(index.lock);
+  KernLogIngest(index);
+  return (NSUInteger)(index.end - index.base);
+}
+
+- (NSDictionary *)logStatistics {
+  uint64_t rings = 0, written = 0, overwritten = 0, dropped, indexed;
+  {
+    KernLogIndex &index = KernLogGetIndex();
+    std::lock_guard<std::mutex> guard(index.lock);
+    dropped = index.dropped;
+    indexed = index.end - index.base;
+  }
+  for (auto &slot : gKernLogRings) {
+    KernLogRing *ring = slot.load(std::memory_order_acquire);
+    if (!ring)
+      continue;
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    rings++;
+    written += head;
+    if (head > KERN_LOG_RING_RECORDS)
+      overwritten += head - KERN_LOG_RING_RECORDS;
+  }
+  return @{
+    @"rings" : @(rings),
+    @"records_per_ring" : @(KERN_LOG_RING_RECORDS),
+    @"written" : @(written),
+    @"overwritten" : @(overwritten),
+    @"indexed" : @(indexed),
+    @"dropped_before_indexed" : @(dropped),
+    @"sequence" : @(gKernLogSequence.load(std::memory_order_relaxed))
+  };
+}
+
+@end
@@ -0,0 +1,370 @@
+#import "AdvancedKernel.h"
+#include <atomic>
+#include <mutex>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Memory Cgroup Charging
+// ============================================================================
+//
+// Every cgroup has a page counter charged for the anonymous frames handed
+// out by allocatePage and the page cache pages read or written on behalf of
+// its processes. A charge walks up the parent chain and succeeds only if
+// every ancestor stays within its limit, so a parent's limit bounds its
+// whole subtree.
+//
+// Charging every page against shared counters would put an atomic add per
+// ancestor on each allocation. Instead each CPU keeps a stock: pages
+// precharged for one cgroup. A charge for the stocked cgroup is taken from
+// the stock under the CPU's own lock; otherwise KERN_MEMCG_BATCH pages are
+// charged up the hierarchy at once and the surplus is stocked. Uncharges
+// return to the stock, and a stock over twice the batch gives the excess
+// back. Per-cgroup statistics are per-CPU counters summed on read. As in
+// the trace rings, a "CPU" is a slot claimed by each host thread in turn.
+//
+// Stocked pages count towards usage, so a charge that finds the hierarchy
+// full first drains the stocks of the cgroup over its limit, then reclaims
+// that cgroup's page cache, retrying a few times. If that does not make
+// room, anonymous charges invoke the OOM killer on the cgroup: its member
+// process with the most mapped pages has its frames freed and is killed.
+// Page cache charges happen under a mapping lock and fail with -ENOMEM
+// instead. There is no swap, so memorySwapLimit has nothing to bound.
+
+#define KERN_MEMCG_BATCH 64          // Pages precharged per stock refill
+#define KERN_MEMCG_STOCKS 64         // Per-CPU stocks
+#define KERN_MEMCG_CHUNK 256         // Cgroups per table chunk
+#define KERN_MEMCG_CHUNKS 256        // Cgroup ids below 65536 are charged
+#define KERN_MEMCG_RECLAIM_RETRIES 5 // Reclaim passes before OOM
+
+namespace {
+
+enum KernMemcgEvent : unsigned {
+  KernMemcgEventMax = 0, // Charges that hit a limit
+  KernMemcgEventOOM,
+  KernMemcgEventOOMKill,
+  KernMemcgEventReclaimed, // Pages reclaimed to make room
+  KernMemcgEventCount
+};
+
+struct alignas(64) KernMemcgCPU {
+  std::atomic<int64_t> stat[KernMemcgItemCount];
+};
+
+} // namespace
+
+struct KernMemcg {
+  uint32_t cgroupID = 0;
+  KernMemcg *parent = nullptr;
+  std::atomic<uint64_t> usage{0}; // Pages, stocks included
+  std::atomic<uint64_t> peak{0};
+  std::atomic<uint64_t> limit{UINT64_MAX}; // Pages
+  std::atomic<uint64_t> events[KernMemcgEventCount];
+  KernMemcgCPU cpu[KERN_MEMCG_STOCKS];
+
+  KernMemcg() {
+    for (auto &event : events)
+      event.store(0, std::memory_order_relaxed);
+    for (KernMemcgCPU &slot : cpu)
+      for (auto &stat : slot.stat)
+        stat.store(0, std::memory_order_relaxed);
+  }
+};
+
+namespace {
+
+struct alignas(64) KernMemcgStock {
+  std::atomic_flag lock = ATOMIC_FLAG_INIT;
+  KernMemcg *cached = nullptr;
+  uint64_t pages = 0;
+};
+
+// Cgroups are never destroyed, so table entries live forever
+std::atomic<std::atomic<KernMemcg *> *> gMemcgTable[KERN_MEMCG_CHUNKS];
+std::mutex gMemcgTableLock;
+KernMemcgStock gMemcgStocks[KERN_MEMCG_STOCKS];
+std::atomic<uint32_t> gMemcgNextStock{0};
+thread_local int tMemcgStock = -1;
+
+inline unsigned KernMemcgLocalCPU() {
+  if (__builtin_expect(tMemcgStock < 0, 0))
+    tMemcgStock =
+        (int)(gMemcgNextStock.fetch_add(1, std::memory_order_relaxed) %
+              KERN_MEMCG_STOCKS);
+  return (unsigned)tMemcgStock;
+}
+
+inline void KernMemcgStockLock(KernMemcgStock &stock) {
+  while (stock.lock.test_and_set(std::memory_order_acquire))
+    ;
+}
+
+inline void KernMemcgStockUnlock(KernMemcgStock &stock) {
+  stock.lock.clear(std::memory_order_release);
+}
+
+// Charge pages to memcg and its ancestors. Returns the first cgroup that
+// would exceed its limit, with nothing charged, or null on success.
+KernMemcg *KernMemcgTryCharge(KernMemcg *memcg, uint64_t pages) {
+  for (KernMemcg *m = memcg; m; m = m->parent) {
+    uint64_t usage = m->usage.fetch_add(pages, std::memory_order_relaxed) +
+                     pages;
+    if (usage > m->limit.load(std::memory_order_relaxed)) {
+      m->usage.fetch_sub(pages, std::memory_order_relaxed);
+      for (KernMemcg *u = memcg; u != m; u = u->parent)
+        u->usage.fetch_sub(pages, std::memory_order_relaxed);
+      return m;
+    }
+    uint64_t peak = m->peak.load(std::memory_order_relaxed);
+    while (usage > peak &&
+           !m->peak.compare_exchange_weak(peak, usage,
+                                          std::memory_order_relaxed))
+      ;
+  }
+  return nullptr;
+}
+
+void KernMemcgCancel(KernMemcg *memcg, uint64_t pages) {
+  for (KernMemcg *m = memcg; m; m = m->parent)
+    m->usage.fetch_sub(pages, std::memory_order_relaxed);
+}
+
+// Add pages to a stock, replacing whatever it held. Caller holds its lock.
+void KernMemcgStockRefill(KernMemcgStock &stock, KernMemcg *memcg,
+                          uint64_t pages) {
+  if (stock.cached != memcg) {
+    if (stock.cached && stock.pages)
+      KernMemcgCancel(stock.cached, stock.pages);
+    stock.cached = memcg;
+    stock.pages = 0;
+  }
+  stock.pages += pages;
+  if (stock.pages > 2 * KERN_MEMCG_BATCH) {
+    KernMemcgCancel(memcg, stock.pages - KERN_MEMCG_BATCH);
+    stock.pages = KERN_MEMCG_BATCH;
+  }
+}
+
+// Return every stocked precharge within root's subtree
+void KernMemcgDrainStocks(KernMemcg *root) {
+  for (KernMemcgStock &stock : gMemcgStocks) {
+    KernMemcgStockLock(stock);
+    if (stock.cached && KernMemcgIsDescendant(stock.cached, root)) {
+      KernMemcgCancel(stock.cached, stock.pages);
+      stock.cached = nullptr;
+      stock.pages = 0;
+    }
+    KernMemcgStockUnlock(stock);
+  }
+}
+
+uint64_t KernMemcgReclaim(KernMemcg *memcg, uint64_t pages) {
+  uint64_t reclaimed = KernPageCacheReclaimMemcg(memcg, (NSUInteger)pages);
+  memcg->events[KernMemcgEventReclaimed].fetch_add(reclaimed,
+                                                   std::memory_order_relaxed);
+  return reclaimed;
+}
+
+// Kill the process in over's subtree with the most mapped pages, freeing
+// its frames first so their charges return at once.
+bool KernMemcgOOMKill(KernMemcg *over) {
+  AdvancedKernel *kernel = [AdvancedKernel sharedInstance];
+  KernProcess *victim = nil;
+  NSUInteger victimPages = 0;
+  for (KernProcess *proc in [kernel allProcesses]) {
+    if (proc.pid <= 1 || proc.state == KernProcZombie)
+      continue;
+    KernMemcg *memcg = KernMemcgLookup(proc.cgroupID);
+    if (!memcg || !KernMemcgIsDescendant(memcg, over))
+      continue;
+    NSString *key = [NSString stringWithFormat:@"pageTable_%u", proc.pid];
+    NSUInteger pages = [kernel.internalState[key] count];
+    if (!victim || pages > victimPages) {
+      victim = proc;
+      victimPages = pages;
+    }
+  }
+  if (!victim)
+    return false;
+
+  over->events[KernMemcgEventOOMKill].fetch_add(1, std::memory_order_relaxed);
+  KERN_LOG(KernLogError, KernLogMemory,
+           "Memory cgroup %u out of memory: killed PID %u (%llu pages)",
+           over->cgroupID, victim.pid, (unsigned long long)victimPages);
+  NSString *key = [NSString stringWithFormat:@"pageTable_%u", victim.pid];
+  NSDictionary *pageTable = kernel.internalState[key];
+  NSArray *frames = kernel.internalState[@"pageFrames"];
+  for (KernPageTableEntry *pte in pageTable.allValues) {
+    uint64_t frame = pte.physicalAddress / KERN_PAGE_SIZE;
+    if (frame < frames.count) {
+      KernPageTableEntry *page = frames[frame];
+      if (page.state == KernPageAllocated && page.memcgID)
+        [kernel freePage:page];
+    }
+    [kernel flushTLBEntry:pte.virtualAddress];
+  }
+  [kernel.internalState removeObjectForKey:key];
+  [kernel killProcess:victim.pid signal:KernSIGKILL];
+  return true;
+}
+
+bool KernMemcgChargeSlow(KernMemcg *memcg, uint64_t pages, bool mayOOM) {
+  uint64_t batch = MAX(pages, (uint64_t)KERN_MEMCG_BATCH);
+  int retries = KERN_MEMCG_RECLAIM_RETRIES;
+  bool killed = false;
+  for (;;) {
+    KernMemcg *over = KernMemcgTryCharge(memcg, batch);
+    if (!over) {
+      if (batch > pages) {
+        KernMemcgStock &stock = gMemcgStocks[KernMemcgLocalCPU()];
+        KernMemcgStockLock(stock);
+        KernMemcgStockRefill(stock, memcg, batch - pages);
+        KernMemcgStockUnlock(stock);
+      }
+      return true;
+    }
+    // Near the limit, charge exactly what is needed
+    if (batch > pages) {
+      batch = pages;
+      continue;
+    }
+    over->events[KernMemcgEventMax].fetch_add(1, std::memory_order_relaxed);
+    if (retries-- > 0) {
+      KernMemcgDrainStocks(over);
+      KernMemcgReclaim(over, MAX(pages, (uint64_t)KERN_MEMCG_BATCH));
+      continue;
+    }
+    over->events[KernMemcgEventOOM].fetch_add(1, std::memory_order_relaxed);
+    if (!mayOOM || killed || !KernMemcgOOMKill(over))
+      return false;
+    killed = true;
+    retries = KERN_MEMCG_RECLAIM_RETRIES;
+  }
+}
+
+} // namespace
+
+// --- Charging hooks ---
+
+KernMemcg *KernMemcgLookup(uint32_t cgroupID) {
+  if (cgroupID == 0 || cgroupID >= KERN_MEMCG_CHUNK * KERN_MEMCG_CHUNKS)
+    return nullptr;
+  std::atomic<KernMemcg *> *chunk =
+      gMemcgTable[cgroupID / KERN_MEMCG_CHUNK].load(std::memory_order_acquire);
+  return chunk ? chunk[cgroupID % KERN_MEMCG_CHUNK].load(
+                     std::memory_order_acquire)
+               : nullptr;
+}
+
+uint32_t KernMemcgID(const KernMemcg *memcg) {
+  return memcg ? memcg->cgroupID : 0;
+}
+
+bool KernMemcgIsDescendant(const KernMemcg *memcg, const KernMemcg *root) {
+  for (; memcg; memcg = memcg->parent)
+    if (memcg == root)
+      return true;
+  return false;
+}
+
+KernMemcg *KernMemcgCurrent(void) {
+  return KernMemcgLookup(KernCurrentCgroupID());
+}
+
+bool KernMemcgCharge(KernMemcg *memcg, uint64_t pages, KernMemcgItem item,
+                     bool mayOOM) {
+  if (!memcg || !pages)
+    return true;
+  const unsigned cpu = KernMemcgLocalCPU();
+  KernMemcgStock &stock = gMemcgStocks[cpu];
+  KernMemcgStockLock(stock);
+  bool stocked = stock.cached == memcg && stock.pages >= pages;
+  if (stocked)
+    stock.pages -= pages;
+  KernMemcgStockUnlock(stock);
+  if (!stocked && !KernMemcgChargeSlow(memcg, pages, mayOOM))
+    return false;
+  memcg->cpu[cpu].stat[item].fetch_add((int64_t)pages,
+                                       std::memory_order_relaxed);
+  return true;
+}
+
+void KernMemcgUncharge(KernMemcg *memcg, uint64_t pages, KernMemcgItem item) {
+  if (!memcg || !pages)
+    return;
+  const unsigned cpu = KernMemcgLocalCPU();
+  memcg->cpu[cpu].stat[item].fetch_sub((int64_t)pages,
+                                       std::memory_order_relaxed);
+  KernMemcgStock &stock = gMemcgStocks[cpu];
+  KernMemcgStockLock(stock);
+  KernMemcgStockRefill(stock, memcg, pages);
+  KernMemcgStockUnlock(stock);
+}
+
+void KernMemcgCreate(uint32_t cgroupID, uint32_t parentID) {
+  if (cgroupID == 0 || cgroupID >= KERN_MEMCG_CHUNK * KERN_MEMCG_CHUNKS)
+    return;
+  std::lock_guard<std::mutex> guard(gMemcgTableLock);
+  auto &slot = gMemcgTable[cgroupID / KERN_MEMCG_CHUNK];
+  std::atomic<KernMemcg *> *chunk = slot.load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new std::atomic<KernMemcg *>[KERN_MEMCG_CHUNK]();
+    slot.store(chunk, std::memory_order_release);
+  }
+  KernMemcg *memcg = new KernMemcg();
+  memcg->cgroupID = cgroupID;
+  memcg->parent = KernMemcgLookup(parentID);
+  chunk[cgroupID % KERN_MEMCG_CHUNK].store(memcg, std::memory_order_release);
+}
+
+// Lowering a limit reclaims down to it but never OOM-kills
+void KernMemcgSetLimit(uint32_t cgroupID, uint64_t bytes) {
+  KernMemcg *memcg = KernMemcgLookup(cgroupID);
+  if (!memcg)
+    return;
+  uint64_t limit = bytes == UINT64_MAX ? UINT64_MAX : bytes / KERN_PAGE_SIZE;
+  memcg->limit.store(limit, std::memory_order_relaxed);
+  if (memcg->usage.load(std::memory_order_relaxed) <= limit)
+    return;
+  KernMemcgDrainStocks(memcg);
+  for (int retries = KERN_MEMCG_RECLAIM_RETRIES; retries--;) {
+    uint64_t usage = memcg->usage.load(std::memory_order_relaxed);
+    if (usage <= limit || KernMemcgReclaim(memcg, usage - limit) == 0)
+      break;
+  }
+}
+
+void KernMemcgStat(uint32_t cgroupID, KernMemcgStats *out) {
+  *out = KernMemcgStats();
+  KernMemcg *memcg = KernMemcgLookup(cgroupID);
+  if (!memcg)
+    return;
+  out->usage = memcg->usage.load(std::memory_order_relaxed) * KERN_PAGE_SIZE;
+  out->peak = memcg->peak.load(std::memory_order_relaxed) * KERN_PAGE_SIZE;
+  uint64_t limit = memcg->limit.load(std::memory_order_relaxed);
+  out->limit = limit == UINT64_MAX ? UINT64_MAX : limit * KERN_PAGE_SIZE;
+  // memory.stat counts are hierarchical, like usage
+  int64_t items[KernMemcgItemCount] = {0};
+  for (uint32_t chunkIndex = 0; chunkIndex < KERN_MEMCG_CHUNKS; chunkIndex++) {
+    std::atomic<KernMemcg *> *chunk =
+        gMemcgTable[chunkIndex].load(std::memory_order_acquire);
+    for (uint32_t i = 0; chunk && i < KERN_MEMCG_CHUNK; i++) {
+      KernMemcg *m = chunk[i].load(std::memory_order_acquire);
+      if (!m || !KernMemcgIsDescendant(m, memcg))
+        continue;
+      for (const KernMemcgCPU &slot : m->cpu)
+        for (unsigned item = 0; item < KernMemcgItemCount; item++)
+          items[item] += slot.stat[item].load(std::memory_order_relaxed);
+    }
+  }
+  out->anon = (uint64_t)MAX(items[KernMemcgAnon], (int64_t)0) * KERN_PAGE_SIZE;
+  out->file = (uint64_t)MAX(items[KernMemcgFile], (int64_t)0) * KERN_PAGE_SIZE;
+  out->eventsMax = memcg->events[KernMemcgEventMax].load();
+  out->eventsOOM = memcg->events[KernMemcgEventOOM].load();
+  out->eventsOOMKill = memcg->events[KernMemcgEventOOMKill].load();
+  out->reclaimed = memcg->events[KernMemcgEventReclaimed].load();
+}
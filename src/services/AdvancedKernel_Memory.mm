@@ -4,8 +4,6 @@
 // Private interface visible to all kernel category files
 @interface AdvancedKernel ()
 @property(nonatomic, strong) NSMutableDictionary *internalState;
-@property(nonatomic, strong) NSMutableArray<KernLogEntry *> *logBuffer;
-@property(nonatomic, assign) uint64_t logSequence;
 @property(nonatomic, assign) uint64_t bootTime;
 @property(nonatomic, assign) uint64_t syscallCount;
 @end
@@ -115,6 +113,27 @@
 }
 @end
 
+// Top-down search: the highest align-aligned range of len bytes in
+// [bottom, top) that no VMA overlaps, or 0. Unmapped holes are found again.
+uint64_t KernVMAPlacement(KernProcess *proc, uint64_t top, uint64_t bottom,
+                          uint64_t len, uint64_t align) {
+  if (!len || top < bottom || top - bottom < len)
+    return 0;
+  uint64_t va = (top - len) & ~(align - 1);
+  for (BOOL moved = YES; moved;) {
+    moved = NO;
+    for (KernVMA *vma in proc.memoryMaps) {
+      if (vma.endAddress <= va || vma.startAddress >= va + len)
+        continue;
+      if (vma.startAddress < bottom + len)
+        return 0;
+      va = (vma.startAddress - len) & ~(align - 1);
+      moved = YES;
+    }
+  }
+  return va >= bottom ? va : 0;
+}
+
 // ============================================================================
 // AdvancedKernel — Virtual Memory Methods
 // ============================================================================
@@ -196,9 +215,18 @@
 }
 
 - (KernPageTableEntry *)allocatePage {
+  // The calling process's memory cgroup pays for the frame
+  KernMemcg *memcg = KernMemcgCurrent();
+  if (!KernMemcgCharge(memcg, 1, KernMemcgAnon, true)) {
+    [self kernelLog:KernLogError
+           facility:KernLogMemory
+            message:@"Out of memory: cgroup limit reached"];
+    return nil;
+  }
   NSMutableArray *pageFrames = self.internalState[@"pageFrames"];
   for (KernPageTableEntry *pte in pageFrames) {
     if (pte.state == KernPageFree) {
+      pte.memcgID = KernMemcgID(memcg);
       pte.state = KernPageAllocated;
       pte.present = YES;
       pte.referenceCount = 1;
@@ -210,9 +238,11 @@
           [self.internalState[@"freePages"] unsignedIntegerValue] - 1;
       [self.internalState setObject:@(allocated) forKey:@"allocatedPages"];
       [self.internalState setObject:@(free) forKey:@"freePages"];
+      KERN_TRACE(KernTraceAllocatePage, pte.physicalAddress, free, 0, 0);
       return pte;
     }
   }
+  KernMemcgUncharge(memcg, 1, KernMemcgAnon);
   [self kernelLog:KernLogError
          facility:KernLogMemory
           message:@"Out of memory: no free pages"];
@@ -222,6 +252,8 @@
 - (void)freePage:(KernPageTableEntry *)page {
   if (!page)
     return;
+  KernMemcgUncharge(KernMemcgLookup(page.memcgID), 1, KernMemcgAnon);
+  page.memcgID = 0;
   page.state = KernPageFree;
   page.present = NO;
   page.dirty = NO;
@@ -322,51 +354,74 @@
   if (!pageTable)
     return nil;
 
-  return pageTable[@(pageNum)];
+  KernPageTableEntry *pte = pageTable[@(pageNum)];
+  if (pte)
+    return pte;
+
+  // Huge mappings keep a single entry at the 2 MB-aligned head page. Answer
+  // with the 4 KB page inside it, so the in-page offset applies as usual.
+  uint64_t hugePagePages = KERN_PAGE_SIZE_2M / KERN_PAGE_SIZE;
+  uint64_t headPage = pageNum & ~(hugePagePages - 1);
+  KernPageTableEntry *huge = pageTable[@(headPage)];
+  if (!(huge.flags & PTE_HUGE_PAGE))
+    return nil;
+  pte = [[KernPageTableEntry alloc] init];
+  pte.virtualAddress = pageNum * KERN_PAGE_SIZE;
+  pte.physicalAddress =
+      huge.physicalAddress + (pageNum - headPage) * KERN_PAGE_SIZE;
+  pte.protection = huge.protection;
+  pte.present = huge.present;
+  pte.state = huge.state;
+  pte.flags = huge.flags;
+  return pte;
 }
 
 - (void)handlePageFault:(uint64_t)address
                  reason:(KernPageFaultReason)reason
              forProcess:(uint32_t)pid {
+  KERN_TRACE(KernTracePageFault, address, reason, pid, 0);
   KernProcess *proc = [self processForPID:pid];
+  if (proc && reason != KernPageFaultProtection &&
+      [self handleFileMappingFault:address
+                             write:reason == KernPageFaultWriteAccess ||
+                                   reason == KernPageFaultCopyOnWrite
+                        forProcess:proc])
+    return;
   if (proc) {
     proc.pageFaults++;
   }
 
-  NSString *reasonStr;
+  const char *reasonStr;
   switch (reason) {
   case KernPageFaultNotPresent:
-    reasonStr = @"page not present";
+    reasonStr = "page not present";
     break;
   case KernPageFaultProtection:
-    reasonStr = @"protection violation";
+    reasonStr = "protection violation";
     break;
   case KernPageFaultWriteAccess:
-    reasonStr = @"write to read-only page";
+    reasonStr = "write to read-only page";
     break;
   case KernPageFaultCopyOnWrite:
-    reasonStr = @"copy-on-write";
+    reasonStr = "copy-on-write";
     break;
   case KernPageFaultSwapIn:
-    reasonStr = @"swap-in needed";
+    reasonStr = "swap-in needed";
     break;
   case KernPageFaultDemandZero:
-    reasonStr = @"demand zero page";
+    reasonStr = "demand zero page";
     break;
   case KernPageFaultStackGrowth:
-    reasonStr = @"stack growth";
+    reasonStr = "stack growth";
     break;
   default:
-    reasonStr = @"unknown";
+    reasonStr = "unknown";
     break;
   }
 
-  [self kernelLog:KernLogDebug
-         facility:KernLogMemory
-          message:[NSString
-                      stringWithFormat:@"Page fault at 0x%llx (%@) for PID %u",
-                                       (unsigned long long)address, reasonStr,
-                                       pid]];
+  KERN_LOG(KernLogDebug, KernLogMemory,
+           "Page fault at 0x%llx (%s) for PID %u", (unsigned long long)address,
+           reasonStr, pid);
 
   switch (reason) {
   case KernPageFaultDemandZero:
@@ -429,7 +484,7 @@
   for (KernTLBEntry *entry in tlb) {
     entry.valid = NO;
   }
-  [self kernelLog:KernLogDebug facility:KernLogMemory message:@"TLB flushed"];
+  KERN_LOG(KernLogDebug, KernLogMemory, "TLB flushed");
 }
 
 - (void)flushTLBEntry:(uint64_t)virtualAddr {
@@ -479,13 +534,10 @@
     }
   }
 
-  [self kernelLog:KernLogDebug
-         facility:KernLogMemory
-          message:[NSString
-                      stringWithFormat:
-                          @"mmap: PID %u, addr=0x%llx, len=%llu, prot=0x%lx",
-                          pid, (unsigned long long)addr,
-                          (unsigned long long)len, (unsigned long)prot]];
+  KERN_LOG(KernLogDebug, KernLogMemory,
+           "mmap: PID %u, addr=0x%llx, len=%llu, prot=0x%lx", pid,
+           (unsigned long long)addr, (unsigned long long)len,
+           (unsigned long)prot);
 
   return vma;
 }
@@ -0,0 +1,405 @@
+#import "AdvancedKernel.h"
+#include <stdlib.h>
+#include <mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Memory-Mapped Files
+// ============================================================================
+//
+// A file mapping's pages are the inode's page cache pages: a fault looks the
+// page up in the cache and pins it into the VMA, reading it in first on a
+// miss (a major fault) together with the pages that follow it, so a
+// sequential scan reaches the backing store in runs. The same page is seen
+// by read(2) and by every process mapping the file.
+//
+// MAP_SHARED stores land in the cached page and mark it dirty for the
+// normal writeback path. MAP_PRIVATE mappings share cached pages until the
+// first store, which copies the page into the VMA (copy on write) and drops
+// the pin. Attached shared memory segments resolve to the segment's host
+// memory, so every attached process sees the same bytes. Anonymous mappings
+// fill with zeroed private pages.
+//
+// An explicit address may not overlap an existing mapping unless MAP_FIXED
+// is given, which replaces the mappings inside the range; one that would
+// have to be split, or an attached segment, is refused.
+//
+// The simulated page tables carry no data, so process memory is reached
+// through accessUserMemory:, which faults pages in as it walks them. Pins
+// last until the VMA is unmapped; a mapping larger than the page cache
+// limit keeps its pages resident regardless.
+
+#define KERN_MMAP_FAULT_AROUND 32 // Pages read in per major fault
+
+namespace {
+
+struct KernMappedPage {
+  uint8_t *data = nullptr;
+  void *cached = nullptr; // Pinned page cache page; null for private pages
+};
+
+struct KernVMAPagesState {
+  std::mutex lock; // Held across faults, like mmap_lock
+  std::vector<KernMappedPage> pages;
+  KernInode *file = nil;
+  uint8_t *segment = nullptr; // Host memory of an attached shm segment
+  uint64_t pageOffset = 0;    // File page of the first VMA page
+  bool shared = false;
+  uint64_t resident = 0;
+  uint64_t privatePages = 0;
+};
+
+} // namespace
+
+// ============================================================================
+// KernVMAPages
+// ============================================================================
+
+@interface KernVMAPages ()
+- (instancetype)initWithVMA:(KernVMA *)vma;
+- (KernVMAPagesState *)state;
+@end
+
+@implementation KernVMAPages {
+  KernVMAPagesState _state;
+}
+
+- (instancetype)initWithVMA:(KernVMA *)vma {
+  self = [super init];
+  if (self) {
+    _state.pages.resize((vma.size + KERN_PAGE_SIZE - 1) / KERN_PAGE_SIZE);
+    _state.file = vma.file;
+    _state.segment = (uint8_t *)vma.shm.mapping;
+    _state.pageOffset = vma.fileOffset / KERN_PAGE_SIZE;
+    _state.shared = (vma.flags & KernMmapShared) != 0;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (KernMappedPage &page : _state.pages) {
+    if (page.cached)
+      KernPageCachePutMapped(page.cached);
+    else if (!_state.segment)
+      free(page.data);
+  }
+}
+
+- (KernVMAPagesState *)state {
+  return &_state;
+}
+
+- (uint64_t)residentPages {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.resident;
+}
+
+- (uint64_t)privatePages {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.privatePages;
+}
+
+@end
+
+namespace {
+
+KernVMAPagesState *KernVMAState(KernVMA *vma) {
+  KernVMAPages *pages = vma.pages;
+  if (!pages) {
+    @synchronized(vma) {
+      if (!vma.pages)
+        vma.pages = [[KernVMAPages alloc] initWithVMA:vma];
+      pages = vma.pages;
+    }
+  }
+  return [pages state];
+}
+
+KernVMA *KernFindVMA(KernProcess *proc, uint64_t address) {
+  for (KernVMA *vma in proc.memoryMaps) {
+    if (address >= vma.startAddress && address < vma.endAddress)
+      return vma;
+  }
+  return nil;
+}
+
+// Make page i of a mapping present for a load or a store. Caller holds the
+// state lock. Returns the page's data, or null with *err set: -ENXIO past the
+// end of the file (SIGBUS), -ENOMEM when no page could be had.
+uint8_t *KernVMAFault(__unsafe_unretained AdvancedKernel *k,
+                      KernVMAPagesState *s, uint64_t i, bool write,
+                      KernProcess *proc, int *err) {
+  KernMappedPage &entry = s->pages[i];
+  if (entry.data && (!write || s->shared || !entry.cached))
+    return entry.data;
+
+  bool major = false;
+  if (!entry.data) {
+    if (s->file) {
+      uint64_t index = s->pageOffset + i;
+      if (index * KERN_PAGE_SIZE >= s->file.size) {
+        *err = -ENXIO;
+        return nullptr;
+      }
+      // Reclaim may take the pages between populating and pinning them
+      void *cached;
+      for (int attempt = 0;
+           !(cached = KernPageCacheGetMapped(s->file, index, &entry.data));
+           attempt++) {
+        if (attempt == 2) {
+          *err = -ENOMEM;
+          return nullptr;
+        }
+        [k pageCachePopulate:s->file
+                       index:index
+                       count:(NSUInteger)MIN((uint64_t)KERN_MMAP_FAULT_AROUND,
+                                             s->pages.size() - i)];
+        major = true;
+      }
+      entry.cached = cached;
+    } else if (s->segment) {
+      entry.data = s->segment + i * KERN_PAGE_SIZE;
+    } else {
+      entry.data = (uint8_t *)calloc(1, KERN_PAGE_SIZE);
+      if (!entry.data) {
+        *err = -ENOMEM;
+        return nullptr;
+      }
+      s->privatePages++;
+    }
+    s->resident++;
+  }
+
+  if (write && !s->shared && entry.cached) {
+    uint8_t *copy = (uint8_t *)malloc(KERN_PAGE_SIZE);
+    if (!copy) {
+      *err = -ENOMEM;
+      return nullptr;
+    }
+    memcpy(copy, entry.data, KERN_PAGE_SIZE);
+    KernPageCachePutMapped(entry.cached);
+    entry.data = copy;
+    entry.cached = nullptr;
+    s->privatePages++;
+  }
+
+  if (proc) {
+    proc.pageFaults++;
+    if (major)
+      proc.majorFaults++;
+    else
+      proc.minorFaults++;
+  }
+  return entry.data;
+}
+
+} // namespace
+
+// ============================================================================
+// AdvancedKernel — File Mapping Methods
+// ============================================================================
+
+@implementation AdvancedKernel (FileMap)
+
+- (int64_t)mmapFD:(int32_t)fd
+       forProcess:(uint32_t)pid
+          address:(uint64_t)addr
+           length:(uint64_t)len
+       protection:(KernMemoryProtection)prot
+            flags:(KernMmapFlags)flags
+           offset:(uint64_t)offset {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc)
+    return -ESRCH;
+  if (!len || offset % KERN_PAGE_SIZE || addr % KERN_PAGE_SIZE ||
+      !(flags & KernMmapShared) == !(flags & KernMmapPrivate))
+    return -EINVAL;
+  KernFileDescriptor *desc = [self fileDescriptorForNumber:fd];
+  if (!desc || !desc.inode)
+    return -EBADF;
+  if (desc.pipe)
+    return -ENODEV;
+  if ((flags & KernMmapShared) && (prot & KernMemProtWrite) &&
+      (desc.flags & 0x0003) == 0x0000) // O_RDONLY
+    return -EACCES;
+
+  len = (len + KERN_PAGE_SIZE - 1) & ~(uint64_t)(KERN_PAGE_SIZE - 1);
+  if (!addr) {
+    addr = KernVMAPlacement(proc, proc.stackBottom - KERN_STACK_GAP,
+                            proc.heapEnd, len, KERN_PAGE_SIZE);
+    if (!addr)
+      return -ENOMEM;
+  } else {
+    if (addr + len < addr)
+      return -EINVAL;
+    for (KernVMA *vma in proc.memoryMaps) {
+      if (vma.startAddress >= addr + len || vma.endAddress <= addr)
+        continue;
+      if (!(flags & KernMmapFixed))
+        return -EEXIST;
+      // Segments leave through detachSharedMemory:, not by being replaced
+      if (vma.startAddress < addr || vma.endAddress > addr + len || vma.shm)
+        return -EINVAL;
+    }
+    if (flags & KernMmapFixed)
+      [self munmapForProcess:pid address:addr length:len];
+  }
+  KernVMA *vma = [self mmapForProcess:pid
+                              address:addr
+                               length:len
+                           protection:prot
+                                flags:(flags & ~KernMmapPopulate) |
+                                      KernMmapFile];
+  if (!vma)
+    return -ENOMEM;
+  KernInode *inode = desc.inode;
+  vma.isAnonymous = NO;
+  vma.file = inode;
+  vma.fileOffset = offset;
+  vma.mappedFile = [NSString
+      stringWithFormat:@"inode %llu", (unsigned long long)inode.inodeNumber];
+
+  if (flags & KernMmapPopulate) {
+    KernVMAPagesState *s = KernVMAState(vma);
+    std::lock_guard<std::mutex> guard(s->lock);
+    int err = 0;
+    for (uint64_t i = 0; i < s->pages.size(); i++) {
+      if (!KernVMAFault(self, s, i, false, proc, &err))
+        break;
+    }
+  }
+  return (int64_t)vma.startAddress;
+}
+
+- (int64_t)accessUserMemory:(uint64_t)address
+                     length:(NSUInteger)length
+                 forProcess:(uint32_t)pid
+                      write:(BOOL)write
+                 usingBlock:(void (^)(uint8_t *data, NSUInteger length))block {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc)
+    return -ESRCH;
+  KernMemoryProtection needed = write ? KernMemProtWrite : KernMemProtRead;
+  uint64_t done = 0;
+  int err = 0;
+  while (done < length && !err) {
+    uint64_t position = address + done;
+    KernVMA *vma = KernFindVMA(proc, position);
+    if (!vma || !(vma.protection & needed)) {
+      err = -EFAULT;
+      break;
+    }
+    KernVMAPagesState *s = KernVMAState(vma);
+    // Dirty throttling sleeps, so it waits until the VMA lock is dropped
+    bool dirtied = false;
+    {
+      std::lock_guard<std::mutex> guard(s->lock);
+      while (done < length && position < vma.endAddress) {
+        uint64_t offset = position - vma.startAddress;
+        size_t inPage = (size_t)(offset % KERN_PAGE_SIZE);
+        size_t chunk = (size_t)MIN((uint64_t)(KERN_PAGE_SIZE - inPage),
+                                   length - done);
+        uint64_t i = offset / KERN_PAGE_SIZE;
+        uint8_t *data = KernVMAFault(self, s, i, write, proc, &err);
+        if (!data)
+          break;
+        block(data + inPage, chunk);
+        if (write && s->pages[i].cached &&
+            KernPageCacheDirtyMapped(s->file, s->pages[i].cached))
+          dirtied = true;
+        done += chunk;
+        position += chunk;
+      }
+    }
+    if (dirtied)
+      KernPageCacheBalanceMapped(s->file);
+  }
+  if (err == -ENXIO)
+    [self sendSignal:KernSIGBUS toProcess:pid];
+  return done || !length ? (int64_t)done : (err == -ENXIO ? -EFAULT : err);
+}
+
+- (int64_t)readUserMemory:(uint64_t)address
+                     into:(void *)buffer
+                   length:(NSUInteger)length
+               forProcess:(uint32_t)pid {
+  __block uint8_t *out = (uint8_t *)buffer;
+  return [self accessUserMemory:address
+                         length:length
+                     forProcess:pid
+                          write:NO
+                     usingBlock:^(uint8_t *data, NSUInteger chunk) {
+                       memcpy(out, data, chunk);
+                       out += chunk;
+                     }];
+}
+
+- (int64_t)writeUserMemory:(uint64_t)address
+                      from:(const void *)buffer
+                    length:(NSUInteger)length
+                forProcess:(uint32_t)pid {
+  __block const uint8_t *in = (const uint8_t *)buffer;
+  return [self accessUserMemory:address
+                         length:length
+                     forProcess:pid
+                          write:YES
+                     usingBlock:^(uint8_t *data, NSUInteger chunk) {
+                       memcpy(data, in, chunk);
+                       in += chunk;
+                     }];
+}
+
+// Shared stores are already dirty in the page cache, so MS_ASYNC has
+// nothing to do; MS_SYNC writes back every file the range maps.
+- (int64_t)msyncForProcess:(uint32_t)pid
+                   address:(uint64_t)addr
+                    length:(uint64_t)len
+                      sync:(BOOL)sync {
+  KernProcess *proc = [self processForPID:pid];
+  if (!proc)
+    return -ESRCH;
+  if (addr % KERN_PAGE_SIZE)
+    return -EINVAL;
+  BOOL mapped = NO;
+  int64_t ret = 0;
+  for (KernVMA *vma in [proc.memoryMaps copy]) {
+    if (vma.endAddress <= addr || vma.startAddress >= addr + len)
+      continue;
+    mapped = YES;
+    if (!sync || !vma.file || !(vma.flags & KernMmapShared))
+      continue;
+    [self writebackInode:vma.file];
+    if (vma.file.mapping.nrDirty)
+      ret = -EIO;
+  }
+  return mapped ? ret : -ENOMEM;
+}
+
+- (BOOL)handleFileMappingFault:(uint64_t)address
+                         write:(BOOL)write
+                    forProcess:(KernProcess *)proc {
+  KernVMA *vma = KernFindVMA(proc, address);
+  if (!vma.file)
+    return NO;
+  int err = 0;
+  if (vma.protection & (write ? KernMemProtWrite : KernMemProtRead)) {
+    KernVMAPagesState *s = KernVMAState(vma);
+    std::lock_guard<std::mutex> guard(s->lock);
+    uint64_t i = (address - vma.startAddress) / KERN_PAGE_SIZE;
+    KernVMAFault(self, s, i, write, proc, &err);
+  } else {
+    err = -EFAULT;
+  }
+  if (err)
+    [self sendSignal:err == -ENXIO ? KernSIGBUS : KernSIGSEGV
+           toProcess:proc.pid];
+  return YES;
+}
+
+@end
@@ -0,0 +1,458 @@
+#import "AdvancedKernel.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Namespaces: pid, mount and ipc
+// ============================================================================
+//
+// PID namespaces nest up to KERN_PIDNS_MAX_LEVEL deep below the initial
+// one. A process gets a number in its own namespace and in every ancestor,
+// each taken cyclically from that namespace's ID radix, so global PIDs are
+// the numbers in the initial namespace. A radix maps a number to the
+// process's pid record in four dependent loads, and the record lists the
+// process's number at each level, so translating either way is O(1) and
+// takes no lock. processForPID: goes through the initial radix as well.
+//
+// As with unshare(CLONE_NEWPID), creating or joining a PID namespace
+// leaves the process where it is and places its future children there.
+// Mount and IPC namespaces move the process itself. A new mount namespace
+// starts from a copy of its creator's mount table, and a new IPC namespace
+// starts empty. Named message queues and shared memory segments are
+// registered in the namespace of the process that creates them, and
+// messageQueueNamed: and sharedMemoryNamed: only look there.
+//
+// Children inherit their parent's namespaces. Namespaces and pid records
+// live as long as the kernel, as processes do.
+
+#define KERN_IDR_BITS 6
+#define KERN_IDR_LEVELS 4 // IDs below 1 << 24
+#define KERN_IDR_FANOUT (1u << KERN_IDR_BITS)
+#define KERN_PIDNS_MAX_LEVEL 32
+
+namespace {
+
+// One radix node: children or, at the leaves, entries. bitmap marks full
+// children or used entries; it is only touched under the owner's lock.
+struct KernIdrNode {
+  std::atomic<void *> slots[KERN_IDR_FANOUT];
+  uint64_t bitmap = 0;
+  KernIdrNode() {
+    for (auto &slot : slots)
+      slot.store(nullptr, std::memory_order_relaxed);
+  }
+};
+
+struct KernIdr {
+  KernIdrNode root;
+  uint32_t next = 1; // Cyclic cursor
+  uint32_t count = 0;
+
+  void *find(uint32_t id) const {
+    if (id >> (KERN_IDR_BITS * KERN_IDR_LEVELS))
+      return nullptr;
+    const KernIdrNode *node = &root;
+    for (int level = KERN_IDR_LEVELS - 1; level > 0 && node; level--)
+      node = (const KernIdrNode *)node->slots[(id >> (level * KERN_IDR_BITS)) &
+                                              (KERN_IDR_FANOUT - 1)]
+                 .load(std::memory_order_acquire);
+    return node ? node->slots[id & (KERN_IDR_FANOUT - 1)].load(
+                      std::memory_order_acquire)
+                : nullptr;
+  }
+
+  // Lowest free ID at or after min within node's subtree, or -1
+  int64_t allocIn(KernIdrNode *node, int level, uint32_t min, void *ptr) {
+    const int shift = level * KERN_IDR_BITS;
+    const uint32_t first = min >> shift;
+    uint64_t free = ~node->bitmap & (~0ULL << first);
+    while (free) {
+      uint32_t index = __builtin_ctzll(free);
+      free &= free - 1;
+      uint64_t bit = 1ULL << index;
+      if (level == 0) {
+        node->slots[index].store(ptr, std::memory_order_release);
+        node->bitmap |= bit;
+        return index;
+      }
+      auto *child = (KernIdrNode *)node->slots[index].load(
+          std::memory_order_relaxed);
+      if (!child) {
+        child = new KernIdrNode();
+        node->slots[index].store(child, std::memory_order_release);
+      }
+      uint32_t childMin = index == first ? min & ((1u << shift) - 1) : 0;
+      int64_t id = allocIn(child, level - 1, childMin, ptr);
+      if (id < 0)
+        continue;
+      if (child->bitmap == ~0ULL)
+        node->bitmap |= bit;
+      return (int64_t)index << shift | id;
+    }
+    return -1;
+  }
+
+  // 0 when every ID from 1 up is taken
+  uint32_t alloc(void *ptr) {
+    int64_t id = allocIn(&root, KERN_IDR_LEVELS - 1, next, ptr);
+    if (id < 0 && next > 1)
+      id = allocIn(&root, KERN_IDR_LEVELS - 1, 1, ptr);
+    if (id < 0)
+      return 0;
+    next = (uint32_t)id + 1;
+    if (next >> (KERN_IDR_BITS * KERN_IDR_LEVELS))
+      next = 1;
+    count++;
+    return (uint32_t)id;
+  }
+
+  void remove(uint32_t id) {
+    KernIdrNode *path[KERN_IDR_LEVELS];
+    KernIdrNode *node = &root;
+    for (int level = KERN_IDR_LEVELS - 1; level >= 0; level--) {
+      path[level] = node;
+      if (level > 0)
+        node = (KernIdrNode *)node->slots[(id >> (level * KERN_IDR_BITS)) &
+                                          (KERN_IDR_FANOUT - 1)]
+                   .load(std::memory_order_relaxed);
+      if (!node)
+        return;
+    }
+    node->slots[id & (KERN_IDR_FANOUT - 1)].store(nullptr,
+                                                  std::memory_order_release);
+    for (int level = 0; level < KERN_IDR_LEVELS; level++)
+      path[level]->bitmap &=
+          ~(1ULL << ((id >> (level * KERN_IDR_BITS)) & (KERN_IDR_FANOUT - 1)));
+    count--;
+  }
+};
+
+struct KernPidNS {
+  uint32_t nsID = 0; // KernNamespace.nsID, 0 for the initial namespace
+  uint32_t level = 0;
+  KernPidNS *parent = nullptr;
+  KernIdr idr; // Number -> KernPidRecord
+};
+
+struct KernMountNS {
+  uint32_t nsID = 0;
+  NSMutableArray<KernMountPoint *> *mounts;
+};
+
+struct KernIpcNS {
+  uint32_t nsID = 0;
+  NSMutableDictionary<NSString *, KernMessageQueue *> *queues;
+  NSMutableDictionary<NSString *, KernSharedMemory *> *segments;
+};
+
+struct KernPidNumber {
+  uint32_t nr;
+  KernPidNS *ns;
+};
+
+// A process's numbers, one per level from the initial namespace down to
+// its own, and the namespaces it uses
+struct KernPidRecord {
+  __unsafe_unretained KernProcess *proc = nil; // Processes are never freed
+  uint32_t ppid = 0;
+  KernPidNS *pidForChildren = nullptr;
+  KernMountNS *mnt = nullptr;
+  KernIpcNS *ipc = nullptr;
+  std::vector<KernPidNumber> numbers;
+
+  KernPidNS *ns() const { return numbers.back().ns; }
+};
+
+std::mutex gNamespaceLock; // Allocation, namespace switches, IPC tables
+KernPidNS gInitPidNS;
+KernIpcNS gInitIpcNS;
+std::unordered_map<uint32_t, KernPidNS *> gPidNamespaces;
+std::unordered_map<uint32_t, KernMountNS *> gMountNamespaces;
+std::unordered_map<uint32_t, KernIpcNS *> gIpcNamespaces;
+
+inline KernPidRecord *KernPidLookup(uint32_t pid) {
+  return (KernPidRecord *)gInitPidNS.idr.find(pid);
+}
+
+// Number of record in ns, 0 if the process is not visible there
+inline uint32_t KernPidNrIn(const KernPidRecord *record, const KernPidNS *ns) {
+  if (!record || ns->level >= record->numbers.size())
+    return 0;
+  const KernPidNumber &number = record->numbers[ns->level];
+  return number.ns == ns ? number.nr : 0;
+}
+
+inline KernPidNS *KernPidViewer(uint32_t viewer) {
+  KernPidRecord *record = KernPidLookup(viewer);
+  return record ? record->ns() : &gInitPidNS;
+}
+
+// Caller holds gNamespaceLock.
+KernIpcNS *KernIpcCurrentLocked() {
+  KernPidRecord *record = KernPidLookup(KernCurrentPID());
+  return record && record->ipc ? record->ipc : &gInitIpcNS;
+}
+
+KernIpcNS *KernIpcForID(uint32_t nsID) {
+  auto it = gIpcNamespaces.find(nsID);
+  return it != gIpcNamespaces.end() ? it->second : &gInitIpcNS;
+}
+
+} // namespace
+
+// --- PID hooks ---
+
+uint32_t KernPidAlloc(uint32_t ppid) {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  KernPidRecord *parent = KernPidLookup(ppid);
+  KernPidNS *ns = parent && parent->pidForChildren ? parent->pidForChildren
+                                                   : &gInitPidNS;
+  auto *record = new KernPidRecord();
+  record->ppid = ppid;
+  record->numbers.resize(ns->level + 1);
+  for (KernPidNS *level = ns; level; level = level->parent) {
+    uint32_t nr = level->idr.alloc(record);
+    if (!nr) {
+      for (KernPidNS *undo = ns; undo != level; undo = undo->parent)
+        undo->idr.remove(record->numbers[undo->level].nr);
+      delete record;
+      return 0;
+    }
+    record->numbers[level->level] = {nr, level};
+  }
+  record->pidForChildren = ns;
+  record->mnt = parent ? parent->mnt : nullptr;
+  record->ipc = parent ? parent->ipc : nullptr;
+  return record->numbers[0].nr;
+}
+
+void KernPidInstall(uint32_t pid, KernProcess *proc) {
+  if (KernPidRecord *record = KernPidLookup(pid))
+    record->proc = proc;
+}
+
+void KernPidFree(uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  KernPidRecord *record = KernPidLookup(pid);
+  if (!record)
+    return;
+  for (const KernPidNumber &number : record->numbers)
+    number.ns->idr.remove(number.nr);
+  delete record;
+}
+
+KernProcess *KernPidProcess(uint32_t pid) {
+  KernPidRecord *record = KernPidLookup(pid);
+  return record ? record->proc : nil;
+}
+
+uint32_t KernPidNr(uint32_t pid, uint32_t viewer) {
+  return KernPidNrIn(KernPidLookup(pid), KernPidViewer(viewer));
+}
+
+uint32_t KernPidFind(uint32_t nr, uint32_t viewer) {
+  auto *record = (KernPidRecord *)KernPidViewer(viewer)->idr.find(nr);
+  return record ? record->numbers[0].nr : 0;
+}
+
+uint32_t KernPidParentNr(uint32_t pid) {
+  KernPidRecord *record = KernPidLookup(pid);
+  return record ? KernPidNrIn(KernPidLookup(record->ppid), record->ns()) : 0;
+}
+
+// --- Mount and IPC hooks ---
+
+NSMutableArray<KernMountPoint *> *KernMountTable(void) {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  KernPidRecord *record = KernPidLookup(KernCurrentPID());
+  if (record && record->mnt)
+    return record->mnt->mounts;
+  return [AdvancedKernel sharedInstance].internalState[@"mountPoints"];
+}
+
+uint32_t KernIpcRegister(NSString *name, id object, bool segment) {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  KernIpcNS *ns = KernIpcCurrentLocked();
+  if (!ns->queues) {
+    ns->queues = [NSMutableDictionary dictionary];
+    ns->segments = [NSMutableDictionary dictionary];
+  }
+  NSMutableDictionary *table = segment ? ns->segments : ns->queues;
+  if (name.length && !table[name])
+    table[name] = object;
+  return ns->nsID;
+}
+
+void KernIpcUnregister(uint32_t nsID, NSString *name, id object,
+                       bool segment) {
+  if (!name.length)
+    return;
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  KernIpcNS *ns = KernIpcForID(nsID);
+  NSMutableDictionary *table = segment ? ns->segments : ns->queues;
+  if (table[name] == object)
+    [table removeObjectForKey:name];
+}
+
+// ============================================================================
+// AdvancedKernel — Namespace Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Namespace)
+
+- (KernNamespace *)createNamespace:(KernNamespaceType)type
+                        forProcess:(uint32_t)pid {
+  static uint32_t nextNSID = 1;
+  KernProcess *proc = [self processForPID:pid];
+  KernNamespace *ns = [[KernNamespace alloc] init];
+  ns.type = type;
+  {
+    std::lock_guard<std::mutex> guard(gNamespaceLock);
+    KernPidRecord *record = KernPidLookup(pid);
+    ns.nsID = nextNSID++;
+    switch (type) {
+    case KernNSPID: {
+      KernPidNS *parent = record ? record->ns() : &gInitPidNS;
+      if (parent->level >= KERN_PIDNS_MAX_LEVEL)
+        return nil;
+      auto *pidNS = new KernPidNS();
+      pidNS->nsID = ns.nsID;
+      pidNS->level = parent->level + 1;
+      pidNS->parent = parent;
+      gPidNamespaces[ns.nsID] = pidNS;
+      if (record)
+        record->pidForChildren = pidNS;
+      break;
+    }
+    case KernNSMount: {
+      auto *mountNS = new KernMountNS();
+      mountNS->nsID = ns.nsID;
+      NSArray *current = record && record->mnt
+                             ? record->mnt->mounts
+                             : self.internalState[@"mountPoints"];
+      mountNS->mounts = [current mutableCopy];
+      gMountNamespaces[ns.nsID] = mountNS;
+      if (record)
+        record->mnt = mountNS;
+      break;
+    }
+    case KernNSIPC: {
+      auto *ipcNS = new KernIpcNS();
+      ipcNS->nsID = ns.nsID;
+      ipcNS->queues = [NSMutableDictionary dictionary];
+      ipcNS->segments = [NSMutableDictionary dictionary];
+      gIpcNamespaces[ns.nsID] = ipcNS;
+      if (record)
+        record->ipc = ipcNS;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  [ns.memberPIDs addObject:@(pid)];
+  if (proc)
+    proc.namespaceID = ns.nsID;
+  [self.internalState[@"namespaces"] addObject:ns];
+  return ns;
+}
+
+- (void)joinNamespace:(KernNamespace *)ns process:(uint32_t)pid {
+  if (!ns)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(gNamespaceLock);
+    KernPidRecord *record = KernPidLookup(pid);
+    if (record) {
+      switch (ns.type) {
+      case KernNSPID: {
+        // Only into the process's own namespace or one below it
+        auto it = gPidNamespaces.find(ns.nsID);
+        if (it == gPidNamespaces.end())
+          return;
+        KernPidNS *target = it->second;
+        KernPidNS *up = target;
+        while (up && up->level > record->ns()->level)
+          up = up->parent;
+        if (up != record->ns())
+          return;
+        record->pidForChildren = target;
+        break;
+      }
+      case KernNSMount: {
+        auto it = gMountNamespaces.find(ns.nsID);
+        if (it != gMountNamespaces.end())
+          record->mnt = it->second;
+        break;
+      }
+      case KernNSIPC: {
+        auto it = gIpcNamespaces.find(ns.nsID);
+        if (it != gIpcNamespaces.end())
+          record->ipc = it->second;
+        break;
+      }
+      default:
+        break;
+      }
+    }
+  }
+  [ns.memberPIDs addObject:@(pid)];
+  KernProcess *proc = [self processForPID:pid];
+  if (proc)
+    proc.namespaceID = ns.nsID;
+}
+
+- (uint32_t)pidOfProcess:(uint32_t)pid inNamespace:(KernNamespace *)ns {
+  if (!ns)
+    return pid;
+  KernPidNS *pidNS;
+  {
+    std::lock_guard<std::mutex> guard(gNamespaceLock);
+    auto it = gPidNamespaces.find(ns.nsID);
+    if (it == gPidNamespaces.end())
+      return 0;
+    pidNS = it->second;
+  }
+  return KernPidNrIn(KernPidLookup(pid), pidNS);
+}
+
+- (KernProcess *)processForPID:(uint32_t)nr inNamespace:(KernNamespace *)ns {
+  if (!ns)
+    return [self processForPID:nr];
+  KernPidNS *pidNS;
+  {
+    std::lock_guard<std::mutex> guard(gNamespaceLock);
+    auto it = gPidNamespaces.find(ns.nsID);
+    if (it == gPidNamespaces.end())
+      return nil;
+    pidNS = it->second;
+  }
+  auto *record = (KernPidRecord *)pidNS->idr.find(nr);
+  return record ? record->proc : nil;
+}
+
+- (NSUInteger)processCountInNamespace:(KernNamespace *)ns {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  auto it = gPidNamespaces.find(ns.nsID);
+  return it != gPidNamespaces.end() ? it->second->idr.count : 0;
+}
+
+- (KernMessageQueue *)messageQueueNamed:(NSString *)name {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  return KernIpcCurrentLocked()->queues[name];
+}
+
+- (KernSharedMemory *)sharedMemoryNamed:(NSString *)name {
+  std::lock_guard<std::mutex> guard(gNamespaceLock);
+  return KernIpcCurrentLocked()->segments[name];
+}
+
+@end
@@ -0,0 +1,508 @@
+#import "AdvancedKernel.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Filesystem Notification
+// ============================================================================
+//
+// A watch is a mark on an inode, or on a superblock for a filesystem-wide
+// watch, naming the group (listener) it reports to, its watch descriptor
+// and the events it wants. Each inode or superblock keeps the union of its
+// marks' masks, so an event nobody asked for costs one load once the VFS
+// hook gets past the global static key.
+//
+// Every group has a bounded multi-producer event ring. Writers claim a
+// slot by advancing the tail and publish it by bumping the slot's sequence,
+// so reporting an event never takes a lock or waits for the reader. A full
+// ring drops the event and sets an overflow flag; the reader sees one
+// KernNotifyOverflow event after the ones that made it in. An unread modify
+// event for the same watch and inode absorbs later ones: the pending table
+// holds a key per queued modify until the reader takes it.
+//
+// Marks hold their group's state by shared pointer, so an event being
+// queued on a group that is going away still lands in valid memory. Lock
+// order is marks lock, then the group's watch lock.
+
+#define KERN_NOTIFY_NAME_MAX 255
+#define KERN_NOTIFY_DEFAULT_EVENTS 1024
+#define KERN_NOTIFY_MAX_EVENTS 65536
+#define KERN_NOTIFY_MAX_WATCHES 8192 // Per group
+#define KERN_NOTIFY_PENDING_SLOTS 256
+#define KERN_NOTIFY_PENDING_PROBES 8
+#define KERN_NOTIFY_MERGE_WD_MAX 0xFFFF // Fits the merge key's top bits
+
+KernStaticKey gKernNotifyKey;
+
+namespace {
+
+struct KernNotifySlot {
+  std::atomic<uint64_t> sequence{0};
+  int32_t wd = 0;
+  uint32_t mask = 0;
+  uint32_t pendingSlot = 0; // Pending table entry + 1 for a merging modify
+  char name[KERN_NOTIFY_NAME_MAX + 1];
+};
+
+struct KernNotifyRecord {
+  int32_t wd;
+  uint32_t mask;
+  uint32_t pendingSlot;
+  char name[KERN_NOTIFY_NAME_MAX + 1];
+};
+
+struct KernNotifyGroupState {
+  std::unique_ptr<KernNotifySlot[]> slots;
+  uint64_t slotMask;
+  alignas(64) std::atomic<uint64_t> tail{0}; // Next slot to fill
+  alignas(64) std::atomic<uint64_t> head{0}; // Next slot to read
+  std::atomic<uint64_t> pending[KERN_NOTIFY_PENDING_SLOTS];
+  std::atomic<bool> overflow{false};
+  std::atomic<uint64_t> delivered{0};
+  std::atomic<uint64_t> coalesced{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<int32_t> readers{0}; // Waiting in readNotifyEvents
+  std::mutex waitLock;
+  std::condition_variable wait;
+  std::mutex watchLock;
+  std::unordered_map<int32_t, KernNotifyMarks *> watches;
+  int32_t nextWD = 1;
+
+  explicit KernNotifyGroupState(uint32_t capacity)
+      : slots(new KernNotifySlot[capacity]), slotMask(capacity - 1) {
+    for (uint32_t i = 0; i < capacity; i++)
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    for (auto &entry : pending)
+      entry.store(0, std::memory_order_relaxed);
+  }
+
+  bool push(int32_t wd, uint32_t mask, const char *name, uint32_t merge) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    KernNotifySlot *slot;
+    for (;;) {
+      slot = &slots[pos & slotMask];
+      uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      int64_t diff = (int64_t)(sequence - pos);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false; // Full
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+    slot->wd = wd;
+    slot->mask = mask;
+    slot->pendingSlot = merge;
+    strlcpy(slot->name, name ? name : "", sizeof(slot->name));
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(KernNotifyRecord *out) {
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    KernNotifySlot *slot;
+    for (;;) {
+      slot = &slots[pos & slotMask];
+      uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      int64_t diff = (int64_t)(sequence - (pos + 1));
+      if (diff == 0) {
+        if (head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false; // Empty
+      } else {
+        pos = head.load(std::memory_order_relaxed);
+      }
+    }
+    out->wd = slot->wd;
+    out->mask = slot->mask;
+    out->pendingSlot = slot->pendingSlot;
+    memcpy(out->name, slot->name, sizeof(out->name));
+    slot->sequence.store(pos + slotMask + 1, std::memory_order_release);
+    // Later modifies queue their own event from here on
+    if (out->pendingSlot)
+      pending[out->pendingSlot - 1].store(0, std::memory_order_release);
+    return true;
+  }
+
+  bool ready() {
+    uint64_t pos = head.load(std::memory_order_acquire);
+    return slots[pos & slotMask].sequence.load(std::memory_order_acquire) ==
+               pos + 1 ||
+           overflow.load(std::memory_order_acquire);
+  }
+
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!readers.load(std::memory_order_relaxed))
+      return;
+    {
+      std::lock_guard<std::mutex> guard(waitLock);
+    }
+    wait.notify_all();
+  }
+};
+
+struct KernNotifyMark {
+  std::shared_ptr<KernNotifyGroupState> group;
+  int32_t wd;
+  uint32_t mask;
+};
+
+struct KernNotifyMarksState {
+  std::atomic<uint32_t> mask{0};
+  std::mutex lock;
+  std::vector<KernNotifyMark> marks;
+
+  // Caller holds the lock
+  void recompute() {
+    uint32_t all = 0;
+    for (const KernNotifyMark &mark : marks)
+      all |= mark.mask;
+    mask.store(all, std::memory_order_relaxed);
+  }
+};
+
+// Claim a pending table entry for a modify on key. Returns the entry + 1,
+// 0 when the table is too busy to merge, or UINT32_MAX when a modify for
+// key is already queued and unread.
+uint32_t KernNotifyClaimPending(KernNotifyGroupState *group, uint64_t key) {
+  uint32_t hash = (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32);
+  for (uint32_t probe = 0; probe < KERN_NOTIFY_PENDING_PROBES; probe++) {
+    uint32_t i = (hash + probe) & (KERN_NOTIFY_PENDING_SLOTS - 1);
+    uint64_t current = group->pending[i].load(std::memory_order_acquire);
+    if (current == key)
+      return UINT32_MAX;
+    if (current == 0) {
+      if (group->pending[i].compare_exchange_strong(current, key))
+        return i + 1;
+      if (current == key)
+        return UINT32_MAX;
+    }
+  }
+  return 0;
+}
+
+void KernNotifyQueue(KernNotifyGroupState *group, int32_t wd, uint32_t mask,
+                     const char *name, KernInode *inode) {
+  uint32_t merge = 0;
+  if ((mask & ~KernNotifyIsDir) == KernNotifyModify &&
+      wd <= KERN_NOTIFY_MERGE_WD_MAX) {
+    uint64_t key = ((uint64_t)(uintptr_t)(__bridge void *)inode &
+                    0xFFFFFFFFFFFFULL) |
+                   (uint64_t)wd << 48;
+    merge = KernNotifyClaimPending(group, key);
+    if (merge == UINT32_MAX) {
+      group->coalesced.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  if (group->push(wd, mask, name, merge)) {
+    group->delivered.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    if (merge)
+      group->pending[merge - 1].store(0, std::memory_order_release);
+    group->dropped.fetch_add(1, std::memory_order_relaxed);
+    group->overflow.store(true, std::memory_order_release);
+  }
+  group->wake();
+}
+
+// Remove group's mark wd. Returns whether it was still attached.
+bool KernNotifyDetach(KernNotifyMarksState *marks, KernNotifyGroupState *group,
+                      int32_t wd) {
+  bool found = false;
+  {
+    std::lock_guard<std::mutex> guard(marks->lock);
+    for (auto it = marks->marks.begin(); it != marks->marks.end(); ++it) {
+      if (it->group.get() == group && it->wd == wd) {
+        marks->marks.erase(it);
+        found = true;
+        break;
+      }
+    }
+    marks->recompute();
+  }
+  if (found)
+    KernStaticKeyDisable(gKernNotifyKey);
+  return found;
+}
+
+} // namespace
+
+// ============================================================================
+// KernNotifyMarks / KernNotifyEvent / KernNotifyGroup
+// ============================================================================
+
+@interface KernNotifyMarks ()
+- (KernNotifyMarksState *)state;
+@end
+
+@implementation KernNotifyMarks {
+  KernNotifyMarksState _state;
+}
+
+- (KernNotifyMarksState *)state {
+  return &_state;
+}
+
+- (KernNotifyMask)mask {
+  return _state.mask.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger)count {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.marks.size();
+}
+
+@end
+
+@implementation KernNotifyEvent
+@end
+
+@interface KernNotifyGroup ()
+- (instancetype)initWithCapacity:(uint32_t)capacity;
+- (const std::shared_ptr<KernNotifyGroupState> &)state;
+@end
+
+@implementation KernNotifyGroup {
+  std::shared_ptr<KernNotifyGroupState> _state;
+}
+
+- (instancetype)initWithCapacity:(uint32_t)capacity {
+  self = [super init];
+  if (self) {
+    _capacity = capacity;
+    _state = std::make_shared<KernNotifyGroupState>(capacity);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  std::unordered_map<int32_t, KernNotifyMarks *> watches;
+  {
+    std::lock_guard<std::mutex> guard(_state->watchLock);
+    watches.swap(_state->watches);
+  }
+  for (auto &entry : watches)
+    KernNotifyDetach([entry.second state], _state.get(), entry.first);
+}
+
+- (const std::shared_ptr<KernNotifyGroupState> &)state {
+  return _state;
+}
+
+- (NSUInteger)watchCount {
+  std::lock_guard<std::mutex> guard(_state->watchLock);
+  return _state->watches.size();
+}
+
+- (uint64_t)queuedEvents {
+  return _state->tail.load() - _state->head.load();
+}
+
+- (uint64_t)deliveredEvents {
+  return _state->delivered.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)coalescedEvents {
+  return _state->coalesced.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)droppedEvents {
+  return _state->dropped.load(std::memory_order_relaxed);
+}
+
+@end
+
+// --- VFS hooks ---
+
+static void KernNotifySend(KernNotifyMarks *marks, uint32_t mask,
+                           KernInode *inode, NSString *name) {
+  KernNotifyMarksState *state = [marks state];
+  if (!(state->mask.load(std::memory_order_relaxed) & mask &
+        KernNotifyAllEvents))
+    return;
+  const char *utf8 = name.UTF8String;
+  std::lock_guard<std::mutex> guard(state->lock);
+  for (const KernNotifyMark &mark : state->marks) {
+    if (mark.mask & mask & KernNotifyAllEvents)
+      KernNotifyQueue(mark.group.get(), mark.wd,
+                      (mask & (mark.mask | KernNotifyIsDir)), utf8, inode);
+  }
+}
+
+void KernFsnotifyDeliver(KernInode *inode, KernDentry *dentry, uint32_t mask) {
+  KernInode *target = inode ?: dentry.inode;
+  if (!target)
+    return;
+  if (target.type == KernInodeDirectory)
+    mask |= KernNotifyIsDir;
+  if (KernNotifyMarks *marks = inode.notifyMarks)
+    KernNotifySend(marks, mask, target, nil);
+  if (KernNotifyMarks *marks = dentry.parent.inode.notifyMarks)
+    KernNotifySend(marks, mask, target, dentry.name);
+  if (KernNotifyMarks *marks = target.superblock.notifyMarks)
+    KernNotifySend(marks, mask, target, dentry.name);
+}
+
+void KernFsnotifyInodeRemoved(KernInode *inode) {
+  if (!KERN_STATIC_BRANCH(gKernNotifyKey))
+    return;
+  KernNotifyMarks *marks = inode.notifyMarks;
+  if (!marks)
+    return;
+  KernFsnotifyDeliver(inode, nil, KernNotifyDeleteSelf);
+  KernNotifyMarksState *state = [marks state];
+  std::vector<KernNotifyMark> gone;
+  {
+    std::lock_guard<std::mutex> guard(state->lock);
+    gone.swap(state->marks);
+    state->recompute();
+  }
+  for (const KernNotifyMark &mark : gone) {
+    KernNotifyQueue(mark.group.get(), mark.wd, KernNotifyIgnored, nullptr,
+                    inode);
+    {
+      std::lock_guard<std::mutex> guard(mark.group->watchLock);
+      mark.group->watches.erase(mark.wd);
+    }
+    KernStaticKeyDisable(gKernNotifyKey);
+  }
+}
+
+// ============================================================================
+// AdvancedKernel — Notification Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Notify)
+
+- (KernNotifyGroup *)notifyInit:(uint32_t)capacity {
+  if (capacity == 0)
+    capacity = KERN_NOTIFY_DEFAULT_EVENTS;
+  capacity = MIN(capacity, (uint32_t)KERN_NOTIFY_MAX_EVENTS);
+  uint32_t rounded = 1;
+  while (rounded < capacity)
+    rounded <<= 1;
+  return [[KernNotifyGroup alloc] initWithCapacity:rounded];
+}
+
+- (int32_t)notifyGroup:(KernNotifyGroup *)group
+          addWatchPath:(NSString *)path
+                  mask:(KernNotifyMask)mask
+            filesystem:(BOOL)filesystem {
+  if (!group || !(mask & KernNotifyAllEvents))
+    return -EINVAL;
+  KernInode *inode = [self lookupPath:path];
+  if (!inode)
+    return -ENOENT;
+  NSObject *owner = inode;
+  if (filesystem) {
+    owner = inode.superblock;
+    if (!owner)
+      return -EINVAL;
+  }
+  KernNotifyMarks *marks;
+  @synchronized(owner) {
+    marks = [(id)owner notifyMarks];
+    if (!marks) {
+      marks = [[KernNotifyMarks alloc] init];
+      [(id)owner setNotifyMarks:marks];
+    }
+  }
+
+  const std::shared_ptr<KernNotifyGroupState> &state = [group state];
+  uint32_t wanted = mask & KernNotifyAllEvents;
+  KernNotifyMarksState *marksState = [marks state];
+  std::lock_guard<std::mutex> guard(marksState->lock);
+  for (KernNotifyMark &mark : marksState->marks) {
+    if (mark.group == state) {
+      mark.mask = (mask & KernNotifyMaskAdd) ? mark.mask | wanted : wanted;
+      marksState->recompute();
+      return mark.wd;
+    }
+  }
+  int32_t wd;
+  {
+    std::lock_guard<std::mutex> watchGuard(state->watchLock);
+    if (state->watches.size() >= KERN_NOTIFY_MAX_WATCHES)
+      return -ENOSPC;
+    wd = state->nextWD++;
+    state->watches[wd] = marks;
+  }
+  marksState->marks.push_back({state, wd, wanted});
+  marksState->recompute();
+  KernStaticKeyEnable(gKernNotifyKey);
+  return wd;
+}
+
+- (int32_t)notifyGroup:(KernNotifyGroup *)group removeWatch:(int32_t)wd {
+  if (!group)
+    return -EINVAL;
+  const std::shared_ptr<KernNotifyGroupState> &state = [group state];
+  KernNotifyMarks *marks;
+  {
+    std::lock_guard<std::mutex> guard(state->watchLock);
+    auto it = state->watches.find(wd);
+    if (it == state->watches.end())
+      return -EINVAL;
+    marks = it->second;
+    state->watches.erase(it);
+  }
+  if (KernNotifyDetach([marks state], state.get(), wd))
+    KernNotifyQueue(state.get(), wd, KernNotifyIgnored, nullptr, nil);
+  return 0;
+}
+
+- (NSArray<KernNotifyEvent *> *)readNotifyEvents:(KernNotifyGroup *)group
+                                         maximum:(NSUInteger)maximum
+                                       timeoutNs:(uint64_t)timeoutNs {
+  if (!group || maximum == 0)
+    return @[];
+  KernNotifyGroupState *state = [group state].get();
+  if (timeoutNs && !state->ready()) {
+    state->readers.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(state->waitLock);
+      state->wait.wait_for(lock, std::chrono::nanoseconds(timeoutNs),
+                           [state] { return state->ready(); });
+    }
+    state->readers.fetch_sub(1);
+  }
+
+  NSMutableArray<KernNotifyEvent *> *events = [NSMutableArray array];
+  KernNotifyRecord record;
+  while (events.count < maximum && state->pop(&record)) {
+    KernNotifyEvent *event = [[KernNotifyEvent alloc] init];
+    event.wd = record.wd;
+    event.mask = record.mask;
+    if (record.name[0])
+      event.name = @(record.name);
+    [events addObject:event];
+  }
+  if (events.count < maximum && state->overflow.exchange(false)) {
+    KernNotifyEvent *event = [[KernNotifyEvent alloc] init];
+    event.wd = -1;
+    event.mask = KernNotifyOverflow;
+    [events addObject:event];
+  }
+  return events;
+}
+
+@end
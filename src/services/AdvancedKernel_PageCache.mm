@@ -0,0 +1,1051 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Page Cache
+// ============================================================================
+//
+// Every inode that sees I/O gets a KernAddressSpace: a radix tree of 4 KB
+// pages keyed by file page index, with per-node tag bitmaps so dirty and
+// under-writeback pages can be found without visiting clean ones. All cached
+// pages also sit on one global two-list LRU. New pages start on the inactive
+// list; a second access promotes them to the active list, and reclaim
+// demotes unreferenced active pages before evicting from the inactive tail.
+//
+// Lock order is mapping lock, then LRU lock. Reclaim runs under the LRU lock
+// and only try-locks mappings, skipping any that are busy. Memory cgroup
+// charges for new pages are made under the mapping lock, so reclaim they
+// trigger also skips the mapping being charged for. Dirty pages it
+// finds are written back once the LRU lock is dropped and freed by a second
+// pass, so device I/O never holds up other LRU users.
+// Pages mapped into process address spaces (AdvancedKernel_Mmap.mm) are
+// pinned by a map count, and reclaim and invalidation pass over them.
+
+#define KERN_PAGE_SHIFT 12
+#define KERN_PAGE_TREE_BITS 6
+#define KERN_PAGE_TREE_SLOTS (1u << KERN_PAGE_TREE_BITS)
+#define KERN_WRITEBACK_BATCH 256 // Pages per backing-store write request
+
+namespace {
+
+enum : uint32_t {
+  KernPageUptodate = 1u << 0,
+  KernPageDirty = 1u << 1,
+  KernPageWriteback = 1u << 2,
+  KernPageActive = 1u << 3,
+  KernPageReferenced = 1u << 4,
+};
+
+enum KernPageTag : unsigned {
+  KernPageTagDirty = 0,
+  KernPageTagWriteback,
+  KernPageTagCount
+};
+
+// --- Radix tree ---
+
+struct KernPageTreeNode {
+  unsigned shift; // Index bits below this level
+  unsigned offset = 0; // Slot in parent
+  KernPageTreeNode *parent = nullptr;
+  uint64_t present = 0; // Occupied slots
+  uint64_t tags[KernPageTagCount] = {};
+  void *slots[KERN_PAGE_TREE_SLOTS] = {};
+  explicit KernPageTreeNode(unsigned s) : shift(s) {}
+};
+
+class KernPageTree {
+public:
+  KernPageTree() = default;
+  KernPageTree(const KernPageTree &) = delete;
+  KernPageTree &operator=(const KernPageTree &) = delete;
+  ~KernPageTree() { destroy(root_); }
+
+  bool empty() const { return root_ == nullptr; }
+
+  void *load(uint64_t index) const {
+    KernPageTreeNode *node = root_;
+    if (!node || !covers(index))
+      return nullptr;
+    for (;;) {
+      void *entry = node->slots[slot(node, index)];
+      if (node->shift == 0 || !entry)
+        return entry;
+      node = (KernPageTreeNode *)entry;
+    }
+  }
+
+  void store(uint64_t index, void *entry) {
+    if (!root_)
+      root_ = new KernPageTreeNode(0);
+    while (!covers(index)) {
+      KernPageTreeNode *top =
+          new KernPageTreeNode(root_->shift + KERN_PAGE_TREE_BITS);
+      top->slots[0] = root_;
+      top->present = 1;
+      for (unsigned t = 0; t < KernPageTagCount; t++)
+        top->tags[t] = root_->tags[t] ? 1 : 0;
+      root_->parent = top;
+      root_ = top;
+    }
+    KernPageTreeNode *node = root_;
+    while (node->shift > 0) {
+      unsigned s = slot(node, index);
+      if (!node->slots[s]) {
+        KernPageTreeNode *child =
+            new KernPageTreeNode(node->shift - KERN_PAGE_TREE_BITS);
+        child->parent = node;
+        child->offset = s;
+        node->slots[s] = child;
+        node->present |= 1ULL << s;
+      }
+      node = (KernPageTreeNode *)node->slots[s];
+    }
+    unsigned s = slot(node, index);
+    node->slots[s] = entry;
+    node->present |= 1ULL << s;
+  }
+
+  void *erase(uint64_t index) {
+    KernPageTreeNode *node = leaf(index);
+    if (!node)
+      return nullptr;
+    unsigned s = slot(node, index);
+    void *entry = node->slots[s];
+    if (!entry)
+      return nullptr;
+    for (unsigned t = 0; t < KernPageTagCount; t++)
+      clearTagFrom(node, s, (KernPageTag)t);
+    node->slots[s] = nullptr;
+    node->present &= ~(1ULL << s);
+    // Free nodes that became empty; their tag bits are already clear
+    while (node && !node->present) {
+      KernPageTreeNode *parent = node->parent;
+      if (parent) {
+        parent->slots[node->offset] = nullptr;
+        parent->present &= ~(1ULL << node->offset);
+      } else {
+        root_ = nullptr;
+      }
+      delete node;
+      node = parent;
+    }
+    return entry;
+  }
+
+  void setTag(uint64_t index, KernPageTag tag) {
+    KernPageTreeNode *node = leaf(index);
+    unsigned s = node ? slot(node, index) : 0;
+    while (node) {
+      uint64_t before = node->tags[tag];
+      node->tags[tag] |= 1ULL << s;
+      if (before)
+        break; // Ancestors already carry the tag
+      s = node->offset;
+      node = node->parent;
+    }
+  }
+
+  void clearTag(uint64_t index, KernPageTag tag) {
+    KernPageTreeNode *node = leaf(index);
+    if (node)
+      clearTagFrom(node, slot(node, index), tag);
+  }
+
+  // First entry at or after *index, optionally carrying tag. Updates *index.
+  void *findNext(uint64_t *index, int tag = -1) const {
+    KernPageTreeNode *node = root_;
+    uint64_t i = *index;
+    if (!node || !covers(i))
+      return nullptr;
+    for (;;) {
+      unsigned s = slot(node, i);
+      uint64_t bits = (tag >= 0 ? node->tags[tag] : node->present) &
+                      (~0ULL << s);
+      if (!bits) {
+        if (!node->parent)
+          return nullptr;
+        unsigned width = node->shift + KERN_PAGE_TREE_BITS;
+        i = ((i >> width) + 1) << width;
+        node = node->parent;
+        continue;
+      }
+      unsigned next = (unsigned)__builtin_ctzll(bits);
+      if (next != s) {
+        unsigned width = node->shift + KERN_PAGE_TREE_BITS;
+        uint64_t high = width < 64 ? (i >> width) << width : 0;
+        i = high | ((uint64_t)next << node->shift);
+      }
+      if (node->shift == 0) {
+        *index = i;
+        return node->slots[next];
+      }
+      node = (KernPageTreeNode *)node->slots[next];
+    }
+  }
+
+private:
+  KernPageTreeNode *root_ = nullptr;
+
+  static unsigned slot(const KernPageTreeNode *node, uint64_t index) {
+    return (unsigned)(index >> node->shift) & (KERN_PAGE_TREE_SLOTS - 1);
+  }
+
+  bool covers(uint64_t index) const {
+    unsigned width = root_->shift + KERN_PAGE_TREE_BITS;
+    return width >= 64 || (index >> width) == 0;
+  }
+
+  KernPageTreeNode *leaf(uint64_t index) const {
+    KernPageTreeNode *node = root_;
+    if (!node || !covers(index))
+      return nullptr;
+    while (node && node->shift > 0)
+      node = (KernPageTreeNode *)node->slots[slot(node, index)];
+    return node;
+  }
+
+  static void clearTagFrom(KernPageTreeNode *node, unsigned s,
+                           KernPageTag tag) {
+    while (node) {
+      node->tags[tag] &= ~(1ULL << s);
+      if (node->tags[tag])
+        break; // Siblings still tagged
+      s = node->offset;
+      node = node->parent;
+    }
+  }
+
+  static void destroy(KernPageTreeNode *node) {
+    if (!node)
+      return;
+    if (node->shift > 0) {
+      for (unsigned s = 0; s < KERN_PAGE_TREE_SLOTS; s++)
+        destroy((KernPageTreeNode *)node->slots[s]);
+    }
+    delete node;
+  }
+};
+
+// --- Pages and mappings ---
+
+struct KernPageMapping;
+
+struct KernCachePage {
+  uint64_t index = 0;
+  uint8_t *data = nullptr;
+  std::atomic<uint32_t> flags{0};
+  std::atomic<uint32_t> mapcount{0}; // Address-space mappings pinning it
+  KernPageMapping *mapping = nullptr;
+  KernCachePage *lruPrev = nullptr; // Under the LRU lock
+  KernCachePage *lruNext = nullptr;
+  KernMemcg *memcg = nullptr; // Charged for this page
+};
+
+// Backing-store operations for one mapping (address_space_operations)
+struct KernAddressSpaceOps {
+  // Fill count contiguous pages starting at index from the backing store.
+  // Returns 0 or -errno.
+  int (*readpages)(KernInode *host, uint64_t index, uint8_t *const *data,
+                   size_t count);
+  // Store count contiguous pages starting at index; only the first
+  // tailLength bytes of the last one are file data. Returns 0 or -errno.
+  int (*writepages)(KernInode *host, uint64_t index,
+                    const uint8_t *const *data, size_t count,
+                    size_t tailLength);
+};
+
+struct KernPageMapping {
+  std::mutex lock;
+  KernPageTree pages;
+  __weak KernInode *host;
+  const KernAddressSpaceOps *ops = nullptr;
+  KernWriteback *wb; // Host superblock's dirty accounting
+  uint64_t nrPages = 0;
+  uint64_t nrDirty = 0;
+  uint64_t nrWriteback = 0;
+};
+
+struct KernPageList {
+  KernCachePage *head = nullptr;
+  KernCachePage *tail = nullptr;
+  uint64_t count = 0;
+
+  void push(KernCachePage *page) {
+    page->lruPrev = nullptr;
+    page->lruNext = head;
+    (head ? head->lruPrev : tail) = page;
+    head = page;
+    count++;
+  }
+  void remove(KernCachePage *page) {
+    (page->lruPrev ? page->lruPrev->lruNext : head) = page->lruNext;
+    (page->lruNext ? page->lruNext->lruPrev : tail) = page->lruPrev;
+    page->lruPrev = page->lruNext = nullptr;
+    count--;
+  }
+};
+
+std::mutex gPageLRULock;
+KernPageList gPageActive;
+KernPageList gPageInactive;
+std::atomic<uint64_t> gPageCacheLimit{0}; // Pages; 0 until first use
+std::atomic<uint64_t> gPageCacheHits{0};
+std::atomic<uint64_t> gPageCacheMisses{0};
+std::atomic<uint64_t> gPageCacheEvictions{0};
+std::atomic<uint64_t> gPageCacheWritebacks{0};
+std::atomic<uint64_t> gPageCacheDeviceReads{0}; // readpages calls
+std::atomic<uint64_t> gPageCacheReadahead{0};   // Pages read ahead of use
+thread_local KernPageMapping *tPageCharging; // Mapping locked by a charge
+
+const KernAddressSpaceOps kExtentOps = {KernInodeReadBlocks,
+                                        KernInodeWriteBlocks};
+
+KernCachePage *KernPageAlloc(uint64_t index) {
+  KernCachePage *page = new KernCachePage();
+  page->index = index;
+  if (posix_memalign((void **)&page->data, KERN_PAGE_SIZE, KERN_PAGE_SIZE)) {
+    delete page;
+    return nullptr;
+  }
+  return page;
+}
+
+// Charge a new page to memcg. Called under the mapping lock, so reclaim run
+// by the charge passes over that mapping instead of locking it again.
+bool KernPageCharge(KernPageMapping *mapping, KernMemcg *memcg) {
+  tPageCharging = mapping;
+  bool charged = KernMemcgCharge(memcg, 1, KernMemcgFile, false);
+  tPageCharging = nullptr;
+  return charged;
+}
+
+// Free a page that never entered the cache, returning its charge
+void KernPageDiscard(KernCachePage *page, KernMemcg *memcg) {
+  KernMemcgUncharge(memcg, 1, KernMemcgFile);
+  free(page->data);
+  delete page;
+}
+
+// Tag a page dirty. Returns true when it is the mapping's first dirty page.
+// Caller holds the mapping lock.
+bool KernPageMarkDirty(KernPageMapping *mapping, KernCachePage *page) {
+  if (page->flags.fetch_or(KernPageDirty) & KernPageDirty)
+    return false;
+  mapping->pages.setTag(page->index, KernPageTagDirty);
+  KernWritebackAccount(mapping->wb, 1, 0);
+  return mapping->nrDirty++ == 0;
+}
+
+// Write back contiguous dirty pages as one request. Caller holds the mapping
+// lock; on failure the pages stay dirty for the next attempt.
+int KernPageWritebackRun(KernPageMapping *mapping, KernInode *host,
+                         KernCachePage *const *run, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    KernCachePage *page = run[i];
+    page->flags.fetch_or(KernPageWriteback);
+    mapping->pages.setTag(page->index, KernPageTagWriteback);
+    page->flags.fetch_and(~KernPageDirty);
+    mapping->pages.clearTag(page->index, KernPageTagDirty);
+  }
+  mapping->nrDirty -= count;
+  mapping->nrWriteback += count;
+  KernWritebackAccount(mapping->wb, -(int64_t)count, (int64_t)count);
+
+  int err = 0;
+  if (host) {
+    // Pages wholly past EOF carry no file data
+    uint64_t size = host.size;
+    size_t length = count;
+    while (length && (run[length - 1]->index << KERN_PAGE_SHIFT) >= size)
+      length--;
+    if (length) {
+      const uint8_t *data[KERN_WRITEBACK_BATCH];
+      for (size_t i = 0; i < length; i++)
+        data[i] = run[i]->data;
+      uint64_t tail = size - (run[length - 1]->index << KERN_PAGE_SHIFT);
+      err = mapping->ops->writepages(
+          host, run[0]->index, data, length,
+          (size_t)MIN(tail, (uint64_t)KERN_PAGE_SIZE));
+      if (!err)
+        KernWritebackCompleted(mapping->wb, length);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    KernCachePage *page = run[i];
+    if (err)
+      KernPageMarkDirty(mapping, page);
+    page->flags.fetch_and(~KernPageWriteback);
+    mapping->pages.clearTag(page->index, KernPageTagWriteback);
+  }
+  mapping->nrWriteback -= count;
+  KernWritebackAccount(mapping->wb, 0, -(int64_t)count);
+  if (!err)
+    gPageCacheWritebacks.fetch_add(count, std::memory_order_relaxed);
+  return err;
+}
+
+// Drop a page from its mapping and free it. Caller holds both locks and has
+// written the page back if needed.
+void KernPageFreeLocked(KernPageMapping *mapping, KernCachePage *page) {
+  mapping->pages.erase(page->index);
+  mapping->nrPages--;
+  uint32_t flags = page->flags.load();
+  if (flags & KernPageDirty) {
+    mapping->nrDirty--;
+    KernWritebackAccount(mapping->wb, -1, 0);
+  }
+  (flags & KernPageActive ? gPageActive : gPageInactive).remove(page);
+  KernPageDiscard(page, page->memcg);
+}
+
+// Insert a new page at index, already charged to memcg. Caller holds the
+// mapping lock. Returns whether the cache is now over its limit.
+bool KernPageCacheAdd(KernPageMapping *mapping, KernCachePage *page,
+                      KernMemcg *memcg) {
+  page->mapping = mapping;
+  page->memcg = memcg;
+  mapping->pages.store(page->index, page);
+  mapping->nrPages++;
+  std::lock_guard<std::mutex> guard(gPageLRULock);
+  gPageInactive.push(page);
+  return gPageActive.count + gPageInactive.count > gPageCacheLimit;
+}
+
+// Second access to an inactive page promotes it; the first only marks it.
+void KernPageMarkAccessed(KernCachePage *page) {
+  uint32_t flags = page->flags.load(std::memory_order_relaxed);
+  if (!(flags & KernPageReferenced)) {
+    page->flags.fetch_or(KernPageReferenced, std::memory_order_relaxed);
+    return;
+  }
+  if (flags & KernPageActive)
+    return;
+  std::lock_guard<std::mutex> guard(gPageLRULock);
+  if (page->flags.load() & KernPageActive)
+    return;
+  gPageInactive.remove(page);
+  page->flags.fetch_or(KernPageActive);
+  page->flags.fetch_and(~KernPageReferenced);
+  gPageActive.push(page);
+}
+
+// A dirty page reclaim passed over. The host keeps the mapping alive once
+// the LRU lock is dropped, and the page is found again by index.
+struct KernReclaimDirty {
+  KernInode *host;
+  uint64_t index;
+};
+
+// Free an inactive page if it is clean and unmapped. Caller holds the LRU
+// lock. A busy mapping, the one this thread is charging under, or a mapped
+// page leaves the page in place; a dirty one is also added to dirty, when
+// given, to be written back later.
+bool KernPageTryEvict(KernCachePage *page,
+                      std::vector<KernReclaimDirty> *dirty) {
+  KernPageMapping *mapping = page->mapping;
+  if (mapping == tPageCharging || !mapping->lock.try_lock())
+    return false;
+  // Mapped pages stay until unmapped; mapcount only rises under the lock
+  bool evict = !page->mapcount.load() &&
+               !(page->flags.load() & KernPageDirty);
+  if (evict)
+    KernPageFreeLocked(mapping, page);
+  else if (dirty && !page->mapcount.load())
+    dirty->push_back({mapping->host, page->index});
+  mapping->lock.unlock();
+  return evict;
+}
+
+// Write back the pages reclaim found dirty, in contiguous runs per mapping.
+// Called without the LRU lock; the pages stay cached, clean, for the next
+// pass to free. Busy mappings are skipped as in the scan, so this may run
+// under another mapping's lock. Releases the hosts, so must not run under
+// the LRU lock.
+void KernPageReclaimWriteback(std::vector<KernReclaimDirty> &dirty) {
+  std::sort(dirty.begin(), dirty.end(),
+            [](const KernReclaimDirty &a, const KernReclaimDirty &b) {
+              if (a.host != b.host)
+                return (__bridge void *)a.host < (__bridge void *)b.host;
+              return a.index < b.index;
+            });
+  KernCachePage *run[KERN_WRITEBACK_BATCH];
+  for (size_t i = 0, end; i < dirty.size(); i = end) {
+    KernInode *host = dirty[i].host;
+    for (end = i; end < dirty.size() && dirty[end].host == host;)
+      end++;
+    if (!host)
+      continue;
+    KernPageMapping *mapping = [host.mapping state];
+    if (mapping == tPageCharging)
+      continue;
+    std::unique_lock<std::mutex> guard(mapping->lock, std::try_to_lock);
+    if (!guard.owns_lock())
+      continue;
+    size_t count = 0;
+    for (size_t j = i; j < end; j++) {
+      auto *page = (KernCachePage *)mapping->pages.load(dirty[j].index);
+      if (!page || !(page->flags.load() & KernPageDirty) ||
+          page->mapcount.load())
+        continue;
+      if (count && (count == KERN_WRITEBACK_BATCH ||
+                    page->index != run[count - 1]->index + 1)) {
+        KernPageWritebackRun(mapping, host, run, count);
+        count = 0;
+      }
+      run[count++] = page;
+    }
+    if (count)
+      KernPageWritebackRun(mapping, host, run, count);
+  }
+  dirty.clear();
+}
+
+// Reclaim up to count pages. Must not be called with a mapping lock held.
+NSUInteger KernPageCacheReclaim(NSUInteger count) {
+  std::vector<KernReclaimDirty> dirty;
+  NSUInteger freed = 0;
+  for (int pass = 0; pass < 2 && freed < count; pass++) {
+    {
+      std::lock_guard<std::mutex> guard(gPageLRULock);
+      // Keep the inactive list at least as long as the active one
+      for (uint64_t budget = pass ? 0 : gPageActive.count;
+           budget-- && gPageInactive.count < gPageActive.count;) {
+        KernCachePage *page = gPageActive.tail;
+        gPageActive.remove(page);
+        if (page->flags.fetch_and(~KernPageReferenced) & KernPageReferenced) {
+          gPageActive.push(page);
+        } else {
+          page->flags.fetch_and(~KernPageActive);
+          gPageInactive.push(page);
+        }
+      }
+
+      uint64_t budget = 2 * gPageInactive.count;
+      while (freed < count && gPageInactive.tail && budget--) {
+        KernCachePage *page = gPageInactive.tail;
+        if ((page->flags.fetch_and(~KernPageReferenced) &
+             KernPageReferenced) ||
+            !KernPageTryEvict(page, pass ? nullptr : &dirty)) {
+          gPageInactive.remove(page);
+          gPageInactive.push(page);
+          continue;
+        }
+        freed++;
+      }
+    }
+    if (dirty.empty())
+      break;
+    KernPageReclaimWriteback(dirty);
+  }
+  gPageCacheEvictions.fetch_add(freed, std::memory_order_relaxed);
+  return freed;
+}
+
+void KernPageCacheReclaimExcess(void) {
+  uint64_t cached;
+  {
+    std::lock_guard<std::mutex> guard(gPageLRULock);
+    cached = gPageActive.count + gPageInactive.count;
+    if (cached <= gPageCacheLimit)
+      return;
+  }
+  // Reclaim in batches so a burst of misses doesn't reclaim page by page
+  KernPageCacheReclaim(
+      (NSUInteger)(cached - gPageCacheLimit + gPageCacheLimit / 64));
+}
+
+} // namespace
+
+// ============================================================================
+// KernAddressSpace
+// ============================================================================
+
+@interface KernAddressSpace ()
+- (instancetype)initWithHost:(KernInode *)host;
+- (KernPageMapping *)state;
+@end
+
+@implementation KernAddressSpace {
+  KernPageMapping _state;
+}
+
+- (instancetype)initWithHost:(KernInode *)host {
+  self = [super init];
+  if (self) {
+    _state.host = host;
+    _state.ops = &kExtentOps;
+    _state.wb = KernInodeWriteback(host);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // The host is going away, so cached data is dropped without writeback
+  std::lock_guard<std::mutex> guard(gPageLRULock);
+  uint64_t index = 0;
+  while (KernCachePage *page =
+             (KernCachePage *)_state.pages.findNext(&index)) {
+    KernPageFreeLocked(&_state, page);
+    index++;
+  }
+}
+
+- (KernPageMapping *)state {
+  return &_state;
+}
+
+- (uint64_t)nrPages {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.nrPages;
+}
+
+- (uint64_t)nrDirty {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.nrDirty;
+}
+
+- (uint64_t)nrWriteback {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.nrWriteback;
+}
+
+@end
+
+static KernPageMapping *KernInodeMapping(KernInode *inode) {
+  KernAddressSpace *mapping = inode.mapping;
+  if (!mapping) {
+    @synchronized(inode) {
+      if (!inode.mapping)
+        inode.mapping = [[KernAddressSpace alloc] initWithHost:inode];
+      mapping = inode.mapping;
+    }
+  }
+  return [mapping state];
+}
+
+// --- Mapped page hooks ---
+
+void *KernPageCacheGetMapped(KernInode *inode, uint64_t index,
+                             uint8_t **data) {
+  KernPageMapping *mapping = KernInodeMapping(inode);
+  std::lock_guard<std::mutex> guard(mapping->lock);
+  KernCachePage *page = (KernCachePage *)mapping->pages.load(index);
+  if (!page) {
+    gPageCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  gPageCacheHits.fetch_add(1, std::memory_order_relaxed);
+  KernPageMarkAccessed(page);
+  page->mapcount.fetch_add(1);
+  *data = page->data;
+  return page;
+}
+
+void KernPageCachePutMapped(void *page) {
+  ((KernCachePage *)page)->mapcount.fetch_sub(1);
+}
+
+// The flag test keeps stores to an already dirty page lock-free. Called after
+// the store, so writeback that cleaned the page mid-store is followed by
+// another.
+bool KernPageCacheDirtyMapped(KernInode *inode, void *cached) {
+  KernCachePage *page = (KernCachePage *)cached;
+  if (page->flags.load(std::memory_order_relaxed) & KernPageDirty)
+    return false;
+  KernPageMapping *mapping = page->mapping;
+  {
+    std::lock_guard<std::mutex> guard(mapping->lock);
+    if (KernPageMarkDirty(mapping, page))
+      KernWritebackInodeDirtied(mapping->wb, inode);
+  }
+  inode.modifyTime = mach_absolute_time();
+  return true;
+}
+
+void KernPageCacheBalanceMapped(KernInode *inode) {
+  KernBalanceDirtyPages(KernInodeMapping(inode)->wb, gPageCacheLimit.load());
+}
+
+// --- Memory cgroup reclaim ---
+
+// Ages and evicts only the subtree's pages, walking the lists in place so
+// that other cgroups' pages keep their LRU positions.
+NSUInteger KernPageCacheReclaimMemcg(KernMemcg *memcg, NSUInteger count) {
+  if (!memcg || !count)
+    return 0;
+  std::vector<KernReclaimDirty> dirty;
+  NSUInteger freed = 0;
+  for (int pass = 0; pass < 2 && freed < count; pass++) {
+    {
+      std::lock_guard<std::mutex> guard(gPageLRULock);
+      for (KernCachePage *page = pass ? nullptr : gPageActive.tail; page;) {
+        KernCachePage *prev = page->lruPrev;
+        if (KernMemcgIsDescendant(page->memcg, memcg) &&
+            !(page->flags.fetch_and(~KernPageReferenced) &
+              KernPageReferenced)) {
+          gPageActive.remove(page);
+          page->flags.fetch_and(~KernPageActive);
+          gPageInactive.push(page);
+        }
+        page = prev;
+      }
+
+      for (KernCachePage *page = gPageInactive.tail; page && freed < count;) {
+        KernCachePage *prev = page->lruPrev;
+        if (KernMemcgIsDescendant(page->memcg, memcg) &&
+            KernPageTryEvict(page, pass ? nullptr : &dirty))
+          freed++;
+        page = prev;
+      }
+    }
+    if (dirty.empty())
+      break;
+    KernPageReclaimWriteback(dirty);
+  }
+  gPageCacheEvictions.fetch_add(freed, std::memory_order_relaxed);
+  return freed;
+}
+
+// ============================================================================
+// AdvancedKernel — Page Cache Methods
+// ============================================================================
+
+@implementation AdvancedKernel (PageCache)
+
+- (void)ensurePageCacheLimit {
+  std::lock_guard<std::mutex> guard(gPageLRULock);
+  if (!gPageCacheLimit)
+    gPageCacheLimit = [self totalPhysicalMemory] / 4 / KERN_PAGE_SIZE;
+}
+
+- (int64_t)pageCacheRead:(KernInode *)inode
+                    into:(void *)buffer
+                  length:(NSUInteger)length
+                  offset:(uint64_t)offset {
+  if (!inode)
+    return -EBADF;
+  if (!buffer && length)
+    return -EFAULT;
+  [self ensurePageCacheLimit];
+  KernPageMapping *mapping = KernInodeMapping(inode);
+  KernMemcg *memcg = nullptr;
+  BOOL memcgResolved = NO;
+  BOOL overLimit = NO;
+  uint64_t copied = 0;
+  {
+    std::lock_guard<std::mutex> guard(mapping->lock);
+    uint64_t size = inode.size;
+    if (offset >= size)
+      return 0;
+    length = (NSUInteger)MIN((uint64_t)length, size - offset);
+    while (copied < length) {
+      uint64_t position = offset + copied;
+      uint64_t index = position >> KERN_PAGE_SHIFT;
+      size_t inPage = (size_t)(position & (KERN_PAGE_SIZE - 1));
+      size_t chunk = (size_t)MIN((uint64_t)(KERN_PAGE_SIZE - inPage),
+                                 length - copied);
+      KernCachePage *page = (KernCachePage *)mapping->pages.load(index);
+      if (page) {
+        gPageCacheHits.fetch_add(1, std::memory_order_relaxed);
+        KernPageMarkAccessed(page);
+      } else {
+        gPageCacheMisses.fetch_add(1, std::memory_order_relaxed);
+        gPageCacheDeviceReads.fetch_add(1, std::memory_order_relaxed);
+        if (!memcgResolved) {
+          memcg = KernMemcgCurrent();
+          memcgResolved = YES;
+        }
+        if (!KernPageCharge(mapping, memcg))
+          break;
+        page = KernPageAlloc(index);
+        if (!page) {
+          KernMemcgUncharge(memcg, 1, KernMemcgFile);
+          break;
+        }
+        int err = mapping->ops->readpages(inode, index, &page->data, 1);
+        if (err) {
+          KernPageDiscard(page, memcg);
+          return copied ? (int64_t)copied : err;
+        }
+        page->flags.fetch_or(KernPageUptodate);
+        overLimit |= KernPageCacheAdd(mapping, page, memcg);
+      }
+      memcpy((uint8_t *)buffer + copied, page->data + inPage, chunk);
+      copied += chunk;
+    }
+  }
+  inode.accessTime = mach_absolute_time();
+  if (overLimit)
+    KernPageCacheReclaimExcess();
+  return copied || !length ? (int64_t)copied : -ENOMEM;
+}
+
+- (int64_t)pageCacheWrite:(KernInode *)inode
+                     from:(const void *)buffer
+                   length:(NSUInteger)length
+                   offset:(uint64_t)offset {
+  if (!inode)
+    return -EBADF;
+  if (!buffer && length)
+    return -EFAULT;
+  [self ensurePageCacheLimit];
+  KernPageMapping *mapping = KernInodeMapping(inode);
+  KernMemcg *memcg = nullptr;
+  BOOL memcgResolved = NO;
+  BOOL overLimit = NO;
+  uint64_t copied = 0;
+  int err = 0;
+  {
+    std::lock_guard<std::mutex> guard(mapping->lock);
+    uint64_t size = inode.size;
+    while (copied < length) {
+      uint64_t position = offset + copied;
+      uint64_t index = position >> KERN_PAGE_SHIFT;
+      size_t inPage = (size_t)(position & (KERN_PAGE_SIZE - 1));
+      size_t chunk = (size_t)MIN((uint64_t)(KERN_PAGE_SIZE - inPage),
+                                 length - copied);
+      KernCachePage *page = (KernCachePage *)mapping->pages.load(index);
+      if (page) {
+        KernPageMarkAccessed(page);
+      } else {
+        if (!memcgResolved) {
+          memcg = KernMemcgCurrent();
+          memcgResolved = YES;
+        }
+        if (!KernPageCharge(mapping, memcg))
+          break;
+        page = KernPageAlloc(index);
+        if (!page) {
+          KernMemcgUncharge(memcg, 1, KernMemcgFile);
+          break;
+        }
+        // A partial write into existing data needs the rest of the page
+        if (chunk < KERN_PAGE_SIZE && (index << KERN_PAGE_SHIFT) < size) {
+          gPageCacheDeviceReads.fetch_add(1, std::memory_order_relaxed);
+          err = mapping->ops->readpages(inode, index, &page->data, 1);
+          if (err) {
+            KernPageDiscard(page, memcg);
+            break;
+          }
+        } else {
+          memset(page->data, 0, KERN_PAGE_SIZE);
+        }
+        page->flags.fetch_or(KernPageUptodate);
+        overLimit |= KernPageCacheAdd(mapping, page, memcg);
+      }
+      memcpy(page->data + inPage, (const uint8_t *)buffer + copied, chunk);
+      if (KernPageMarkDirty(mapping, page))
+        KernWritebackInodeDirtied(mapping->wb, inode);
+      copied += chunk;
+    }
+    if (offset + copied > size)
+      inode.size = offset + copied;
+  }
+  inode.modifyTime = mach_absolute_time();
+  if (overLimit)
+    KernPageCacheReclaimExcess();
+  if (copied)
+    KernBalanceDirtyPages(mapping->wb, gPageCacheLimit.load());
+  return copied || !length ? (int64_t)copied : (err ?: -ENOMEM);
+}
+
+- (NSUInteger)pageCachePopulate:(KernInode *)inode
+                          index:(uint64_t)index
+                          count:(NSUInteger)count {
+  if (!inode || !count)
+    return 0;
+  [self ensurePageCacheLimit];
+  KernPageMapping *mapping = KernInodeMapping(inode);
+  KernMemcg *memcg = nullptr;
+  BOOL memcgResolved = NO;
+  BOOL overLimit = NO;
+  NSUInteger added = 0;
+  {
+    std::lock_guard<std::mutex> guard(mapping->lock);
+    uint64_t size = inode.size;
+    uint64_t end = MIN(index + count,
+                       (size + KERN_PAGE_SIZE - 1) >> KERN_PAGE_SHIFT);
+    // Each run of missing pages is one request to the backing store
+    std::vector<KernCachePage *> run;
+    std::vector<uint8_t *> buffers;
+    bool failed = false;
+    for (uint64_t i = index; i <= end && !failed; i++) {
+      if (i < end && !mapping->pages.load(i)) {
+        if (!memcgResolved) {
+          memcg = KernMemcgCurrent();
+          memcgResolved = YES;
+        }
+        KernCachePage *page = nullptr;
+        if (KernPageCharge(mapping, memcg)) {
+          page = KernPageAlloc(i);
+          if (!page)
+            KernMemcgUncharge(memcg, 1, KernMemcgFile);
+        }
+        if (page) {
+          run.push_back(page);
+          buffers.push_back(page->data);
+          continue;
+        }
+        failed = true;
+      }
+      if (run.empty())
+        continue;
+      gPageCacheDeviceReads.fetch_add(1, std::memory_order_relaxed);
+      if (mapping->ops->readpages(inode, run.front()->index, buffers.data(),
+                                  run.size()) != 0) {
+        for (KernCachePage *page : run)
+          KernPageDiscard(page, memcg);
+        break;
+      }
+      for (KernCachePage *page : run) {
+        page->flags.fetch_or(KernPageUptodate);
+        overLimit |= KernPageCacheAdd(mapping, page, memcg);
+      }
+      added += run.size();
+      run.clear();
+      buffers.clear();
+    }
+  }
+  gPageCacheReadahead.fetch_add(added, std::memory_order_relaxed);
+  if (overLimit)
+    KernPageCacheReclaimExcess();
+  return added;
+}
+
+- (NSUInteger)invalidateInodePages:(KernInode *)inode {
+  if (!inode || !inode.mapping)
+    return 0;
+  KernPageMapping *mapping = [inode.mapping state];
+  NSUInteger dropped = 0;
+  std::lock_guard<std::mutex> guard(mapping->lock);
+  std::lock_guard<std::mutex> lruGuard(gPageLRULock);
+  uint64_t index = 0;
+  while (KernCachePage *page =
+             (KernCachePage *)mapping->pages.findNext(&index)) {
+    index++;
+    if ((page->flags.load() & (KernPageDirty | KernPageWriteback)) ||
+        page->mapcount.load())
+      continue;
+    KernPageFreeLocked(mapping, page);
+    dropped++;
+  }
+  return dropped;
+}
+
+- (NSInteger)writebackInode:(KernInode *)inode {
+  if (!inode || !inode.mapping)
+    return 0;
+  KernPageMapping *mapping = [inode.mapping state];
+  NSInteger written = 0;
+  KernCachePage *run[KERN_WRITEBACK_BATCH];
+  size_t count = 0;
+  std::lock_guard<std::mutex> guard(mapping->lock);
+  uint64_t index = 0;
+  while (KernCachePage *page = (KernCachePage *)mapping->pages.findNext(
+             &index, KernPageTagDirty)) {
+    index++;
+    if (count && (count == KERN_WRITEBACK_BATCH ||
+                  page->index != run[count - 1]->index + 1)) {
+      if (KernPageWritebackRun(mapping, inode, run, count) == 0)
+        written += count;
+      count = 0;
+    }
+    run[count++] = page;
+  }
+  if (count && KernPageWritebackRun(mapping, inode, run, count) == 0)
+    written += count;
+  if (mapping->nrDirty == 0)
+    inode.dirtiedWhen = 0;
+  return written;
+}
+
+- (int64_t)pageCacheSeek:(KernInode *)inode
+                  offset:(uint64_t)offset
+                    hole:(BOOL)hole {
+  if (!inode)
+    return -EBADF;
+  KernPageMapping *mapping = KernInodeMapping(inode);
+  std::lock_guard<std::mutex> guard(mapping->lock);
+  uint64_t size = inode.size;
+  if (offset >= size)
+    return -ENXIO;
+  uint64_t block = offset >> KERN_PAGE_SHIFT;
+  uint64_t last = (size - 1) >> KERN_PAGE_SHIFT;
+  if (!hole) {
+    uint64_t next = KernInodeNextBlock(inode, block, true);
+    uint64_t index = block;
+    if (mapping->pages.findNext(&index, KernPageTagDirty))
+      next = MIN(next, index);
+    if (next > last)
+      return -ENXIO;
+    return (int64_t)MAX(offset, next << KERN_PAGE_SHIFT);
+  }
+  // A hole is a block that is neither mapped nor dirty in the cache
+  while (block <= last) {
+    KernCachePage *page = (KernCachePage *)mapping->pages.load(block);
+    if (page && (page->flags.load() & KernPageDirty)) {
+      block++;
+      continue;
+    }
+    uint64_t next = KernInodeNextBlock(inode, block, false);
+    if (next == block)
+      return (int64_t)MAX(offset, block << KERN_PAGE_SHIFT);
+    block = next;
+  }
+  return (int64_t)size; // The implicit hole at end of file
+}
+
+- (NSUInteger)shrinkPageCache:(NSUInteger)pages {
+  return KernPageCacheReclaim(pages);
+}
+
+- (void)setPageCacheLimit:(uint64_t)bytes {
+  {
+    std::lock_guard<std::mutex> guard(gPageLRULock);
+    gPageCacheLimit = MAX(bytes / KERN_PAGE_SIZE, (uint64_t)1);
+  }
+  KernPageCacheReclaimExcess();
+}
+
+- (NSDictionary *)pageCacheStatistics {
+  [self ensurePageCacheLimit];
+  uint64_t active, inactive, limit;
+  {
+    std::lock_guard<std::mutex> guard(gPageLRULock);
+    active = gPageActive.count;
+    inactive = gPageInactive.count;
+    limit = gPageCacheLimit;
+  }
+  uint64_t hits = gPageCacheHits.load(std::memory_order_relaxed);
+  uint64_t misses = gPageCacheMisses.load(std::memory_order_relaxed);
+  return @{
+    @"cached_pages" : @(active + inactive),
+    @"cached_bytes" : @((active + inactive) * KERN_PAGE_SIZE),
+    @"active_pages" : @(active),
+    @"inactive_pages" : @(inactive),
+    @"dirty_pages" : @(KernWritebackDirtyPages()),
+    @"limit_pages" : @(limit),
+    @"hits" : @(hits),
+    @"misses" : @(misses),
+    @"hit_rate" : @(hits + misses ? (double)hits / (hits + misses) : 0),
+    @"device_reads" : @(gPageCacheDeviceReads.load(std::memory_order_relaxed)),
+    @"readahead_pages" : @(gPageCacheReadahead.load(std::memory_order_relaxed)),
+    @"evictions" : @(gPageCacheEvictions.load(std::memory_order_relaxed)),
+    @"writebacks" : @(gPageCacheWritebacks.load(std::memory_order_relaxed))
+  };
+}
+
+@end
@@ -0,0 +1,422 @@
+#import "AdvancedKernel.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Performance Counters
+// ============================================================================
+//
+// Each host thread that counts opens its own counters the first time it
+// needs them, with perf_event_open on the calling thread (pid 0, any CPU),
+// user space only. The events are opened as three groups: cycles,
+// instructions, branches and branch misses; cache references and misses;
+// and the software task clock, page faults and context switches. Members of
+// a group are scheduled onto the PMU together, so ratios within a group
+// (IPC, branch miss rate, cache miss rate) are always taken over the same
+// instructions. One read of a group leader returns every member.
+//
+// When there are more events than hardware counters the kernel multiplexes
+// the groups and each reading carries the time the group was enabled and
+// the time it actually ran. A delta is scaled by enabled / running, and
+// the fraction of time running is reported next to every value so that a
+// heavily extrapolated number is recognisable. An interval in which a group
+// never ran contributes nothing and is counted as unscheduled.
+//
+// Where perf_event_open is missing or refused (Darwin, containers, a high
+// perf_event_paranoid), the software events come from the thread CPU clock
+// and getrusage and the hardware events are reported as unsupported rather
+// than estimated. Darwin has no per-thread rusage, so there page faults and
+// context switches are process-wide.
+//
+// Counts are attributed two ways. KernPerfScope is an RAII guard that reads
+// the counters on entry and exit and adds the difference to a named region.
+// Simulated processes with counters attached are charged on every
+// setCurrentPID: the thread reads its counters and credits the interval
+// since the previous switch to the process that was current. Both paths sit
+// behind gKernPerfKey and cost one relaxed load while counting is off.
+
+KernStaticKey gKernPerfKey;
+
+namespace {
+
+static const char *const kKernPerfEventNames[KernPerfEventCount] = {
+    "cycles",         "instructions",  "cache_references",
+    "cache_misses",   "branches",      "branch_misses",
+    "task_clock_ns",  "page_faults",   "context_switches"};
+
+#define KERN_PERF_GROUPS 3
+#define KERN_PERF_GROUP_MAX 4
+
+struct KernPerfGroup {
+  int leader = -1;
+  int fds[KERN_PERF_GROUP_MAX] = {-1, -1, -1, -1};
+  KernPerfEvent events[KERN_PERF_GROUP_MAX];
+  unsigned count = 0;
+};
+
+struct KernPerfThread {
+  KernPerfGroup groups[KERN_PERF_GROUPS];
+  uint32_t hardware = 0; // Events read from perf_event_open
+  uint32_t supported = 0;
+  bool haveLast = false;
+  KernPerfReading last;
+
+  ~KernPerfThread() {
+    for (KernPerfGroup &group : groups)
+      for (unsigned i = 0; i < group.count; i++)
+        if (group.fds[i] >= 0)
+          close(group.fds[i]);
+  }
+};
+
+struct KernPerfTotals {
+  double value[KernPerfEventCount] = {};
+  uint64_t enabled[KernPerfEventCount] = {};
+  uint64_t running[KernPerfEventCount] = {};
+  uint64_t intervals = 0;
+  uint64_t unscheduled = 0;
+};
+
+static thread_local std::unique_ptr<KernPerfThread> tPerfThread;
+static std::mutex gPerfLock;
+static std::map<std::string, KernPerfTotals> gPerfRegions;
+static std::unordered_map<uint32_t, KernPerfTotals> gPerfProcesses;
+static std::atomic<uint32_t> gPerfAttached{0};
+static std::atomic<uint32_t> gPerfHardware{0}; // Union over threads
+static std::atomic<uint32_t> gPerfSupported{0};
+static std::atomic<uint32_t> gPerfThreads{0};
+static bool gPerfEnabled = false;
+
+static inline uint64_t KernPerfClock(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__linux__)
+static int KernPerfOpen(uint32_t type, uint64_t config, int group,
+                        bool user) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = user;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group,
+                      PERF_FLAG_FD_CLOEXEC);
+}
+
+// Opens a group, dropping members the PMU does not have. A member that
+// fails leaves the rest of the group counting.
+static void KernPerfOpenGroup(KernPerfThread &t, KernPerfGroup &group,
+                              uint32_t type, const uint64_t *configs,
+                              const KernPerfEvent *events, unsigned count,
+                              bool user) {
+  for (unsigned i = 0; i < count; i++) {
+    int fd = KernPerfOpen(type, configs[i], group.leader, user);
+    if (fd < 0)
+      continue;
+    if (group.leader < 0)
+      group.leader = fd;
+    group.fds[group.count] = fd;
+    group.events[group.count++] = events[i];
+    t.hardware |= 1u << events[i];
+  }
+}
+#endif
+
+static KernPerfThread &KernPerfThreadState() {
+  if (tPerfThread)
+    return *tPerfThread;
+  tPerfThread.reset(new KernPerfThread());
+  KernPerfThread &t = *tPerfThread;
+#if defined(__linux__)
+  static const uint64_t core[] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+  static const KernPerfEvent coreEvents[] = {
+      KernPerfCycles, KernPerfInstructions, KernPerfBranches,
+      KernPerfBranchMisses};
+  static const uint64_t cache[] = {PERF_COUNT_HW_CACHE_REFERENCES,
+                                   PERF_COUNT_HW_CACHE_MISSES};
+  static const KernPerfEvent cacheEvents[] = {KernPerfCacheReferences,
+                                              KernPerfCacheMisses};
+  static const uint64_t software[] = {PERF_COUNT_SW_TASK_CLOCK,
+                                      PERF_COUNT_SW_PAGE_FAULTS,
+                                      PERF_COUNT_SW_CONTEXT_SWITCHES};
+  static const KernPerfEvent softwareEvents[] = {
+      KernPerfTaskClock, KernPerfPageFaults, KernPerfContextSwitches};
+  KernPerfOpenGroup(t, t.groups[0], PERF_TYPE_HARDWARE, core, coreEvents, 4,
+                    true);
+  KernPerfOpenGroup(t, t.groups[1], PERF_TYPE_HARDWARE, cache, cacheEvents, 2,
+                    true);
+  KernPerfOpenGroup(t, t.groups[2], PERF_TYPE_SOFTWARE, software,
+                    softwareEvents, 3, false);
+#endif
+  // The software fallback always covers the software events
+  t.supported = t.hardware | 1u << KernPerfTaskClock |
+                1u << KernPerfPageFaults | 1u << KernPerfContextSwitches;
+  gPerfHardware.fetch_or(t.hardware, std::memory_order_relaxed);
+  gPerfSupported.fetch_or(t.supported, std::memory_order_relaxed);
+  gPerfThreads.fetch_add(1, std::memory_order_relaxed);
+  return t;
+}
+
+static void KernPerfReadThread(KernPerfThread &t, KernPerfReading &r) {
+#if defined(__linux__)
+  for (KernPerfGroup &group : t.groups) {
+    if (group.leader < 0)
+      continue;
+    uint64_t buffer[3 + KERN_PERF_GROUP_MAX];
+    ssize_t got = read(group.leader, buffer, sizeof(buffer));
+    if (got < (ssize_t)(3 * sizeof(uint64_t)))
+      continue;
+    uint64_t n = buffer[0] < group.count ? buffer[0] : group.count;
+    for (uint64_t i = 0; i < n; i++) {
+      KernPerfEvent event = group.events[i];
+      r.value[event] = buffer[3 + i];
+      r.enabled[event] = buffer[1];
+      r.running[event] = buffer[2];
+    }
+  }
+#endif
+  const uint32_t software = ~t.hardware & t.supported;
+  if (!software)
+    return;
+  // The fallback is never multiplexed: enabled and running advance together
+  const uint64_t now = KernPerfClock(CLOCK_MONOTONIC);
+  struct rusage usage;
+#if defined(__linux__)
+  getrusage(RUSAGE_THREAD, &usage);
+#else
+  getrusage(RUSAGE_SELF, &usage);
+#endif
+  uint64_t values[KernPerfEventCount] = {0};
+  values[KernPerfTaskClock] = KernPerfClock(CLOCK_THREAD_CPUTIME_ID);
+  values[KernPerfPageFaults] = usage.ru_minflt + usage.ru_majflt;
+  values[KernPerfContextSwitches] = usage.ru_nvcsw + usage.ru_nivcsw;
+  for (unsigned event = 0; event < KernPerfEventCount; event++) {
+    if (!(software & 1u << event))
+      continue;
+    r.value[event] = values[event];
+    r.enabled[event] = now;
+    r.running[event] = now;
+  }
+}
+
+static void KernPerfAccumulate(KernPerfTotals &totals, uint32_t supported,
+                               const KernPerfReading &from,
+                               const KernPerfReading &to) {
+  bool unscheduled = false;
+  for (unsigned event = 0; event < KernPerfEventCount; event++) {
+    if (!(supported & 1u << event))
+      continue;
+    uint64_t enabled = to.enabled[event] - from.enabled[event];
+    uint64_t running = to.running[event] - from.running[event];
+    if (running == 0) {
+      unscheduled = unscheduled || enabled > 0;
+      continue;
+    }
+    double raw = (double)(to.value[event] - from.value[event]);
+    totals.value[event] += raw * (double)enabled / (double)running;
+    totals.enabled[event] += enabled;
+    totals.running[event] += running;
+  }
+  totals.intervals++;
+  totals.unscheduled += unscheduled;
+}
+
+static NSDictionary *KernPerfDescribe(const KernPerfTotals &totals) {
+  const uint32_t supported = gPerfSupported.load(std::memory_order_relaxed);
+  NSMutableDictionary *events = [NSMutableDictionary dictionary];
+  for (unsigned event = 0; event < KernPerfEventCount; event++) {
+    if (!(supported & 1u << event))
+      continue;
+    double running = totals.enabled[event]
+                         ? (double)totals.running[event] * 100.0 /
+                               (double)totals.enabled[event]
+                         : 0;
+    events[@(kKernPerfEventNames[event])] = @{
+      @"value" : @((uint64_t)(totals.value[event] + 0.5)),
+      @"running_percent" : @(running)
+    };
+  }
+  NSMutableDictionary *result = [NSMutableDictionary dictionary];
+  result[@"events"] = events;
+  result[@"intervals"] = @(totals.intervals);
+  result[@"unscheduled_intervals"] = @(totals.unscheduled);
+  const double *v = totals.value;
+  if (v[KernPerfCycles] > 0 && (supported & 1u << KernPerfInstructions))
+    result[@"ipc"] = @(v[KernPerfInstructions] / v[KernPerfCycles]);
+  if (v[KernPerfCacheReferences] > 0)
+    result[@"cache_miss_rate"] =
+        @(v[KernPerfCacheMisses] / v[KernPerfCacheReferences]);
+  if (v[KernPerfBranches] > 0)
+    result[@"branch_miss_rate"] =
+        @(v[KernPerfBranchMisses] / v[KernPerfBranches]);
+  return result;
+}
+
+// Starts the calling thread's next process interval now
+static void KernPerfRestartInterval() {
+  KernPerfThread &t = KernPerfThreadState();
+  KernPerfReadThread(t, t.last);
+  t.haveLast = true;
+}
+
+} // namespace
+
+bool KernPerfScopeBegin(KernPerfReading &start) {
+  KernPerfReadThread(KernPerfThreadState(), start);
+  return true;
+}
+
+void KernPerfScopeEnd(const char *region, const KernPerfReading &start) {
+  KernPerfThread &t = KernPerfThreadState();
+  KernPerfReading end;
+  KernPerfReadThread(t, end);
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  KernPerfAccumulate(gPerfRegions[region], t.supported, start, end);
+}
+
+void KernPerfSwitchProcess(uint32_t from) {
+  if (gPerfAttached.load(std::memory_order_relaxed) == 0) {
+    if (tPerfThread)
+      tPerfThread->haveLast = false;
+    return;
+  }
+  KernPerfThread &t = KernPerfThreadState();
+  KernPerfReading now;
+  KernPerfReadThread(t, now);
+  if (t.haveLast) {
+    std::lock_guard<std::mutex> guard(gPerfLock);
+    auto it = gPerfProcesses.find(from);
+    if (it != gPerfProcesses.end())
+      KernPerfAccumulate(it->second, t.supported, t.last, now);
+  }
+  t.last = now;
+  t.haveLast = true;
+}
+
+@implementation AdvancedKernel (Perf)
+
+- (void)setPerfCountersEnabled:(BOOL)enabled {
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  if (gPerfEnabled == (bool)enabled)
+    return;
+  gPerfEnabled = enabled;
+  if (enabled)
+    KernStaticKeyEnable(gKernPerfKey);
+  else
+    KernStaticKeyDisable(gKernPerfKey);
+}
+
+- (BOOL)perfCountersEnabled {
+  return KERN_STATIC_BRANCH(gKernPerfKey);
+}
+
+- (int32_t)attachPerfCountersToProcess:(uint32_t)pid {
+  if (![self processForPID:pid])
+    return -ESRCH;
+  // Charge the calling thread's open interval before the new process can
+  // collect any of it, then count the current process from here
+  const bool enabled = KERN_STATIC_BRANCH(gKernPerfKey);
+  if (enabled)
+    KernPerfSwitchProcess(KernCurrentPID());
+  {
+    std::lock_guard<std::mutex> guard(gPerfLock);
+    if (!gPerfProcesses.emplace(pid, KernPerfTotals()).second)
+      return -EEXIST;
+    gPerfAttached.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (enabled)
+    KernPerfRestartInterval();
+  return 0;
+}
+
+- (int32_t)detachPerfCountersFromProcess:(uint32_t)pid {
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  if (gPerfProcesses.erase(pid) == 0)
+    return -ENOENT;
+  gPerfAttached.fetch_sub(1, std::memory_order_relaxed);
+  return 0;
+}
+
+- (NSDictionary *)perfCountersForProcess:(uint32_t)pid {
+  // Close the calling thread's open interval so the result is current
+  if (KERN_STATIC_BRANCH(gKernPerfKey) && KernCurrentPID() == pid)
+    KernPerfSwitchProcess(pid);
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  auto it = gPerfProcesses.find(pid);
+  return it == gPerfProcesses.end() ? nil : KernPerfDescribe(it->second);
+}
+
+- (NSDictionary *)perfCountersForRegion:(NSString *)region {
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  auto it = gPerfRegions.find(region.UTF8String);
+  return it == gPerfRegions.end() ? nil : KernPerfDescribe(it->second);
+}
+
+- (NSDictionary *)perfCounterReport {
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  NSMutableDictionary *regions = [NSMutableDictionary dictionary];
+  for (const auto &entry : gPerfRegions)
+    regions[@(entry.first.c_str())] = KernPerfDescribe(entry.second);
+  NSMutableDictionary *processes = [NSMutableDictionary dictionary];
+  for (const auto &entry : gPerfProcesses)
+    processes[[NSString stringWithFormat:@"%u", entry.first]] =
+        KernPerfDescribe(entry.second);
+  return @{@"regions" : regions, @"processes" : processes};
+}
+
+- (void)resetPerfCounters {
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  gPerfRegions.clear();
+  for (auto &entry : gPerfProcesses)
+    entry.second = KernPerfTotals();
+}
+
+- (NSDictionary *)perfCounterStatus {
+  const uint32_t hardware = gPerfHardware.load(std::memory_order_relaxed);
+  const uint32_t supported = gPerfSupported.load(std::memory_order_relaxed);
+  NSMutableArray *events = [NSMutableArray array];
+  for (unsigned event = 0; event < KernPerfEventCount; event++)
+    if (supported & 1u << event)
+      [events addObject:@(kKernPerfEventNames[event])];
+  NSString *backend = @"none";
+  if (gPerfThreads.load(std::memory_order_relaxed) > 0)
+    backend = hardware ? @"perf_event" : @"software";
+  std::lock_guard<std::mutex> guard(gPerfLock);
+  return @{
+    @"enabled" : @(gPerfEnabled),
+    @"backend" : backend,
+    @"events" : events,
+    @"threads" : @(gPerfThreads.load(std::memory_order_relaxed)),
+    @"regions" : @(gPerfRegions.size()),
+    @"attached_processes" : @(gPerfProcesses.size())
+  };
+}
+
+@end
@@ -0,0 +1,460 @@
+#import "AdvancedKernel.h"
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#endif
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Sampling Profiler
+// ============================================================================
+//
+// A SIGPROF timer interrupts profiled threads at the configured frequency of
+// CPU time. The handler unwinds the interrupted thread's frame-pointer chain
+// from the signal context and copies the return addresses into a fixed
+// sample buffer. Nothing in the handler locks, allocates or symbolizes.
+//
+// On Linux each profiled thread gets its own timer_create timer on its
+// thread CPU clock, delivered to that thread alone (SIGEV_THREAD_ID). A
+// thread joins with profileCurrentThread; the thread that starts the
+// profiler joins automatically. Darwin has no per-thread timers, so there
+// one ITIMER_PROF timer runs on the process CPU clock and the kernel delivers
+// its signal to whichever thread is running: every thread is profiled.
+//
+// The sample buffer is a bounded multi-producer queue. A handler claims the
+// next slot with a compare-and-swap on the head, provided the reader has
+// freed it, and marks it complete with its position plus one. If the
+// buffer is full the sample is dropped and counted. A timer on a dispatch
+// queue drains the buffer every KERN_PROF_DRAIN_MS, folding identical
+// stacks into counts.
+//
+// Symbolization happens only at export. dladdr and the C++ demangler name
+// each unique address once. An address with no dynamic symbol is written as
+// module+offset so addr2line or atos can resolve it later. The output is one
+// "root;...;leaf count" line per stack, the folded format that flamegraph
+// tools read.
+//
+// Unwinding needs frame pointers. Darwin keeps them by default; the
+// Makefile builds with -fno-omit-frame-pointer for everyone else. A frame
+// pointer that is misaligned, does not move up the stack, or leaves the
+// thread's stack ends the walk.
+
+#define KERN_PROF_MAX_FRAMES 62 // Fills a 512-byte sample
+#define KERN_PROF_SAMPLES 8192  // Buffer slots, a power of two
+#define KERN_PROF_SAMPLE_MASK (KERN_PROF_SAMPLES - 1)
+#define KERN_PROF_DRAIN_MS 100
+#define KERN_PROF_MAX_HZ 10000
+
+namespace {
+
+struct KernProfSample {
+  std::atomic<uint64_t> sequence; // Buffer position + 1 once written
+  uint32_t thread;
+  uint32_t depth;
+  uintptr_t pcs[KERN_PROF_MAX_FRAMES]; // Leaf first
+};
+static_assert(sizeof(KernProfSample) == 512, "samples are 512 bytes");
+
+KernProfSample gProfSamples[KERN_PROF_SAMPLES];
+std::atomic<uint64_t> gProfHead{0};
+std::atomic<uint64_t> gProfTail{0};
+std::atomic<uint64_t> gProfTaken{0};
+std::atomic<uint64_t> gProfDropped{0};
+std::atomic<uint64_t> gProfTruncated{0};
+std::atomic<bool> gProfRunning{false};
+
+std::mutex gProfLock; // Everything below
+uint32_t gProfFrequency = 0;
+uint64_t gProfStartTime = 0;
+uint64_t gProfRunTime = 0; // Mach ticks over finished runs
+bool gProfHandlerInstalled = false;
+dispatch_source_t gProfDrainTimer;
+std::map<std::vector<uintptr_t>, uint64_t> gProfStacks; // Root first
+std::unordered_set<uint32_t> gProfThreads;              // Threads sampled
+#if defined(__linux__)
+std::vector<timer_t> gProfTimers;
+std::unordered_set<uint32_t> gProfArmed; // Threads with a timer
+
+// Captured when a thread joins: the handler cannot ask for them safely
+thread_local uintptr_t tProfStackLow = 0;
+thread_local uintptr_t tProfStackHigh = 0;
+#endif
+
+uint32_t KernProfThreadID() {
+#if defined(__linux__)
+  return (uint32_t)syscall(SYS_gettid);
+#else
+  return (uint32_t)pthread_mach_thread_np(pthread_self());
+#endif
+}
+
+bool KernProfStackBounds(uintptr_t &low, uintptr_t &high) {
+#if defined(__APPLE__)
+  pthread_t self = pthread_self();
+  high = (uintptr_t)pthread_get_stackaddr_np(self);
+  low = high - pthread_get_stacksize_np(self);
+  return true;
+#elif defined(__linux__)
+  low = tProfStackLow;
+  high = tProfStackHigh;
+  return high != 0;
+#else
+  return false;
+#endif
+}
+
+// The interrupted pc and frame pointer, from the signal context
+bool KernProfContextFrame(void *context, uintptr_t &pc, uintptr_t &fp) {
+  auto *uc = (ucontext_t *)context;
+#if defined(__APPLE__) && defined(__x86_64__)
+  pc = uc->uc_mcontext->__ss.__rip;
+  fp = uc->uc_mcontext->__ss.__rbp;
+  return true;
+#elif defined(__APPLE__) && defined(__arm64__)
+  pc = (uintptr_t)__darwin_arm_thread_state64_get_pc(uc->uc_mcontext->__ss);
+  fp = (uintptr_t)__darwin_arm_thread_state64_get_fp(uc->uc_mcontext->__ss);
+  return true;
+#elif defined(__linux__) && defined(__x86_64__)
+  pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+  fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+  return true;
+#elif defined(__linux__) && defined(__aarch64__)
+  pc = (uintptr_t)uc->uc_mcontext.pc;
+  fp = (uintptr_t)uc->uc_mcontext.regs[29];
+  return true;
+#else
+  (void)uc;
+  return false;
+#endif
+}
+
+uintptr_t KernProfStripPointer(uintptr_t address) {
+#if defined(__has_feature)
+#if __has_feature(ptrauth_calls)
+  return (uintptr_t)__builtin_ptrauth_strip((void *)address, 0);
+#endif
+#endif
+  return address;
+}
+
+void KernProfSignal(int, siginfo_t *, void *context) {
+  if (!gProfRunning.load(std::memory_order_relaxed))
+    return;
+  int savedErrno = errno;
+  uintptr_t pc, fp;
+  uintptr_t low = 0, high = UINTPTR_MAX;
+  if (!KernProfContextFrame(context, pc, fp)) {
+    pc = (uintptr_t)__builtin_return_address(0);
+    fp = (uintptr_t)__builtin_frame_address(0);
+  }
+  KernProfStackBounds(low, high);
+
+  uint64_t pos = gProfHead.load(std::memory_order_relaxed);
+  do {
+    if (pos - gProfTail.load(std::memory_order_acquire) >=
+        KERN_PROF_SAMPLES) {
+      gProfDropped.fetch_add(1, std::memory_order_relaxed);
+      errno = savedErrno;
+      return;
+    }
+  } while (!gProfHead.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed));
+
+  KernProfSample &sample = gProfSamples[pos & KERN_PROF_SAMPLE_MASK];
+  uint32_t depth = 0;
+  sample.pcs[depth++] = KernProfStripPointer(pc);
+  while (depth < KERN_PROF_MAX_FRAMES) {
+    if (fp == 0 || (fp & (sizeof(uintptr_t) - 1)) || fp < low ||
+        fp + 2 * sizeof(uintptr_t) > high)
+      break;
+    const uintptr_t *frame = (const uintptr_t *)fp;
+    uintptr_t ret = KernProfStripPointer(frame[1]);
+    if (ret == 0)
+      break;
+    sample.pcs[depth++] = ret;
+    if (frame[0] <= fp)
+      break;
+    fp = frame[0];
+  }
+  if (depth == KERN_PROF_MAX_FRAMES)
+    gProfTruncated.fetch_add(1, std::memory_order_relaxed);
+  sample.thread = KernProfThreadID();
+  sample.depth = depth;
+  sample.sequence.store(pos + 1, std::memory_order_release);
+  gProfTaken.fetch_add(1, std::memory_order_relaxed);
+  errno = savedErrno;
+}
+
+// Folds completed samples into gProfStacks. Caller holds gProfLock.
+void KernProfDrain() {
+  uint64_t head = gProfHead.load(std::memory_order_acquire);
+  uint64_t pos = gProfTail.load(std::memory_order_relaxed);
+  for (; pos < head; pos++) {
+    KernProfSample &sample = gProfSamples[pos & KERN_PROF_SAMPLE_MASK];
+    if (sample.sequence.load(std::memory_order_acquire) != pos + 1)
+      break; // Still being written; later samples wait for it
+    std::vector<uintptr_t> stack(sample.pcs, sample.pcs + sample.depth);
+    std::reverse(stack.begin(), stack.end());
+    gProfStacks[stack]++;
+    gProfThreads.insert(sample.thread);
+  }
+  gProfTail.store(pos, std::memory_order_release);
+}
+
+#if defined(__linux__)
+// Caller holds gProfLock
+bool KernProfArmThread() {
+  uint32_t tid = KernProfThreadID();
+  if (gProfArmed.count(tid))
+    return true;
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    void *base;
+    size_t size;
+    if (pthread_attr_getstack(&attr, &base, &size) == 0) {
+      tProfStackLow = (uintptr_t)base;
+      tProfStackHigh = (uintptr_t)base + size;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  struct sigevent event = {};
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+#ifdef sigev_notify_thread_id
+  event.sigev_notify_thread_id = (pid_t)tid;
+#else
+  event._sigev_un._tid = (pid_t)tid;
+#endif
+  timer_t timer;
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0)
+    return false;
+  struct itimerspec period = {};
+  period.it_interval.tv_nsec = 1000000000L / gProfFrequency;
+  period.it_value = period.it_interval;
+  if (timer_settime(timer, 0, &period, NULL) != 0) {
+    timer_delete(timer);
+    return false;
+  }
+  gProfTimers.push_back(timer);
+  gProfArmed.insert(tid);
+  return true;
+}
+#endif
+
+std::string KernProfSymbol(uintptr_t address, bool leaf) {
+  // Return addresses point after the call; look up the call itself
+  uintptr_t lookup = leaf ? address : address - 1;
+  Dl_info info;
+  if (!dladdr((const void *)lookup, &info) || !info.dli_fname)
+    return "[unknown]";
+  if (info.dli_sname) {
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+    free(demangled);
+    for (char &c : name)
+      if (c == ';')
+        c = ':'; // Semicolons separate frames
+    return name;
+  }
+  const char *module = strrchr(info.dli_fname, '/');
+  module = module ? module + 1 : info.dli_fname;
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "+0x%lx",
+           (unsigned long)(lookup - (uintptr_t)info.dli_fbase));
+  return std::string(module) + buffer;
+}
+
+} // namespace
+
+// ============================================================================
+// AdvancedKernel — Profiler Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Profiler)
+
+- (BOOL)startProfilerWithFrequency:(NSUInteger)hz {
+  if (hz == 0 || hz > KERN_PROF_MAX_HZ)
+    return NO;
+  std::lock_guard<std::mutex> guard(gProfLock);
+  if (gProfRunning.load(std::memory_order_relaxed))
+    return NO;
+  // The handler stays installed once set: a signal still pending when the
+  // profiler stops must not reach SIGPROF's default action, which kills
+  // the process. While stopped the handler returns at once.
+  if (!gProfHandlerInstalled) {
+    struct sigaction action = {};
+    action.sa_sigaction = KernProfSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, NULL) != 0)
+      return NO;
+    gProfHandlerInstalled = true;
+  }
+  gProfFrequency = (uint32_t)hz;
+  gProfStartTime = mach_absolute_time();
+  gProfRunning.store(true, std::memory_order_release);
+
+#if defined(__linux__)
+  if (!KernProfArmThread()) {
+    gProfRunning.store(false, std::memory_order_release);
+    return NO;
+  }
+#else
+  struct itimerval period = {};
+  period.it_interval.tv_usec = (int)(1000000 / hz);
+  period.it_value = period.it_interval;
+  setitimer(ITIMER_PROF, &period, NULL);
+#endif
+
+  uint64_t interval = KERN_PROF_DRAIN_MS * NSEC_PER_MSEC;
+  dispatch_source_t timer = dispatch_source_create(
+      DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+      dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+  dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, interval),
+                            interval, interval / 5);
+  dispatch_source_set_event_handler(timer, ^{
+    std::lock_guard<std::mutex> drainGuard(gProfLock);
+    KernProfDrain();
+  });
+  dispatch_resume(timer);
+  gProfDrainTimer = timer;
+  KERN_LOG(KernLogInfo, KernLogKernel, "profiler: sampling at %u Hz",
+           gProfFrequency);
+  return YES;
+}
+
+- (BOOL)profileCurrentThread {
+  std::lock_guard<std::mutex> guard(gProfLock);
+  if (!gProfRunning.load(std::memory_order_relaxed))
+    return NO;
+#if defined(__linux__)
+  return KernProfArmThread();
+#else
+  return YES; // The process timer samples every thread
+#endif
+}
+
+- (void)stopProfiler {
+  std::lock_guard<std::mutex> guard(gProfLock);
+  if (!gProfRunning.load(std::memory_order_relaxed))
+    return;
+#if defined(__linux__)
+  for (timer_t timer : gProfTimers)
+    timer_delete(timer);
+  gProfTimers.clear();
+  gProfArmed.clear();
+#else
+  struct itimerval off = {};
+  setitimer(ITIMER_PROF, &off, NULL);
+#endif
+  gProfRunning.store(false, std::memory_order_release);
+  dispatch_source_cancel(gProfDrainTimer);
+  gProfDrainTimer = nil;
+  gProfRunTime += mach_absolute_time() - gProfStartTime;
+  KernProfDrain();
+}
+
+- (void)resetProfile {
+  std::lock_guard<std::mutex> guard(gProfLock);
+  KernProfDrain();
+  gProfStacks.clear();
+  gProfThreads.clear();
+  gProfRunTime = 0;
+  gProfStartTime = mach_absolute_time();
+  gProfTaken.store(0, std::memory_order_relaxed);
+  gProfDropped.store(0, std::memory_order_relaxed);
+  gProfTruncated.store(0, std::memory_order_relaxed);
+}
+
+- (NSString *)profileFoldedStacks {
+  std::map<std::vector<uintptr_t>, uint64_t> stacks;
+  {
+    std::lock_guard<std::mutex> guard(gProfLock);
+    KernProfDrain();
+    stacks = gProfStacks;
+  }
+  // Samples at different pcs in the same functions fold into one line
+  std::unordered_map<uintptr_t, std::string> leaves, callers;
+  std::map<std::string, uint64_t> lines;
+  for (const auto &entry : stacks) {
+    const std::vector<uintptr_t> &stack = entry.first;
+    std::string line;
+    for (size_t i = 0; i < stack.size(); i++) {
+      bool leaf = i + 1 == stack.size();
+      auto &names = leaf ? leaves : callers;
+      auto it = names.find(stack[i]);
+      if (it == names.end())
+        it = names.emplace(stack[i], KernProfSymbol(stack[i], leaf)).first;
+      if (i)
+        line += ';';
+      line += it->second;
+    }
+    lines[line] += entry.second;
+  }
+  std::string folded;
+  for (const auto &line : lines)
+    folded += line.first + ' ' + std::to_string(line.second) + '\n';
+  return @(folded.c_str());
+}
+
+- (BOOL)writeProfileFoldedStacks:(NSString *)path {
+  return [[self profileFoldedStacks] writeToFile:path
+                                      atomically:YES
+                                        encoding:NSUTF8StringEncoding
+                                           error:NULL];
+}
+
+- (NSDictionary *)profilerStatus {
+  std::lock_guard<std::mutex> guard(gProfLock);
+  bool running = gProfRunning.load(std::memory_order_relaxed);
+  uint64_t ticks =
+      gProfRunTime + (running ? mach_absolute_time() - gProfStartTime : 0);
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  NSUInteger threads = gProfThreads.size();
+  BOOL perThread = NO;
+#if defined(__linux__)
+  perThread = YES;
+  if (running)
+    threads = gProfArmed.size();
+#endif
+  return @{
+    @"running" : @(running),
+    @"frequency_hz" : @(gProfFrequency),
+    @"per_thread_timers" : @(perThread),
+    @"threads" : @(threads),
+    @"samples" : @(gProfTaken.load(std::memory_order_relaxed)),
+    @"dropped" : @(gProfDropped.load(std::memory_order_relaxed)),
+    @"truncated" : @(gProfTruncated.load(std::memory_order_relaxed)),
+    @"unique_stacks" : @(gProfStacks.size()),
+    @"profiled_seconds" : @((double)ticks * timebase.numer / timebase.denom /
+                            1e9)
+  };
+}
+
+@end
@@ -0,0 +1,164 @@
+#import "AdvancedKernel.h"
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Adaptive Readahead
+// ============================================================================
+//
+// Each open file tracks the window it last read ahead. A read that
+// continues the previous one is sequential: the first starts a window a few
+// times the request size, and reaching the window's async marker issues the
+// next, doubled window in the background so the reader never waits on it.
+// A reader that catches up with a background window waits for it instead
+// of reading its pages again, so only sequential pages that were evicted
+// before use count as thrashing, and those halve the window. Reads
+// whose starts repeat the same gap are strided; confirmed strides prefetch
+// the next few records. Anything else is random and drops the window.
+
+#define KERN_RA_MIN_PAGES 4
+#define KERN_RA_MAX_PAGES 64 // 256 KB
+#define KERN_RA_STRIDE_DEPTH 4 // Strided records kept in flight
+
+@implementation KernReadaheadState
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _start = 0;
+    _size = 0;
+    _asyncSize = 0;
+    _pending = nil;
+    _pendingStart = 0;
+    _pendingEnd = 0;
+    _prevStart = 0;
+    _prevIndex = UINT64_MAX;
+    _stride = 0;
+    _strideCount = 0;
+  }
+  return self;
+}
+@end
+
+@implementation AdvancedKernel (Readahead)
+
+- (void)readaheadAsync:(KernInode *)inode
+                 index:(uint64_t)index
+                 count:(uint64_t)count
+                 group:(dispatch_group_t)group {
+  // Pages are charged to the reader, not to whichever thread runs this
+  uint32_t pid = [self currentPID];
+  dispatch_block_t work = ^{
+    uint32_t saved = [self currentPID];
+    [self setCurrentPID:pid];
+    [self pageCachePopulate:inode index:index count:(NSUInteger)count];
+    [self setCurrentPID:saved];
+  };
+  dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+  if (group)
+    dispatch_group_async(group, queue, work);
+  else
+    dispatch_async(queue, work);
+}
+
+// Wait for background windows overlapping [index, last], so their pages
+// are not read a second time
+- (void)readaheadWaitPending:(KernReadaheadState *)ra
+                       index:(uint64_t)index
+                        last:(uint64_t)last {
+  if (!ra.pending || last < ra.pendingStart || index >= ra.pendingEnd)
+    return;
+  dispatch_group_wait(ra.pending, DISPATCH_TIME_FOREVER);
+  ra.pending = nil;
+}
+
+- (void)readaheadFile:(KernFileDescriptor *)fd
+               offset:(uint64_t)offset
+               length:(NSUInteger)length {
+  KernInode *inode = fd.inode;
+  uint64_t size = inode.size;
+  if (!inode || fd.pipe || !length || offset >= size)
+    return;
+  KernReadaheadState *ra = fd.readahead;
+  if (!ra) {
+    ra = [[KernReadaheadState alloc] init];
+    fd.readahead = ra;
+  }
+  uint64_t index = offset / KERN_PAGE_SIZE;
+  uint64_t last = (MIN(offset + length, size) - 1) / KERN_PAGE_SIZE;
+  uint64_t eof = (size - 1) / KERN_PAGE_SIZE;
+  uint64_t pages = last - index + 1;
+  uint64_t prevIndex = ra.prevIndex;
+  int64_t stride = (int64_t)(index - ra.prevStart);
+  ra.prevStart = index;
+  ra.prevIndex = last;
+
+  BOOL sequential = prevIndex == UINT64_MAX
+                        ? index == 0
+                        : index == prevIndex || index == prevIndex + 1;
+  if (sequential) {
+    ra.strideCount = 0;
+    // A sequential read below the window's end is in it or in the window
+    // before, which has already been read ahead
+    if (ra.size && index < ra.start + ra.size) {
+      [self readaheadWaitPending:ra index:index last:last];
+      // Pages read ahead that are gone were evicted before use
+      if ([self pageCachePopulate:inode index:index count:pages] > 0)
+        ra.size = MAX(ra.size / 2, (uint64_t)KERN_RA_MIN_PAGES);
+      uint64_t marker = ra.start + ra.size - ra.asyncSize;
+      uint64_t next = ra.start + ra.size;
+      if (last >= marker && next <= eof) {
+        ra.start = next;
+        ra.size = MIN(ra.size * 2, (uint64_t)KERN_RA_MAX_PAGES);
+        ra.asyncSize = ra.size;
+        if (!ra.pending) {
+          ra.pending = dispatch_group_create();
+          ra.pendingStart = ra.start;
+        }
+        ra.pendingEnd = ra.start + ra.size;
+        [self readaheadAsync:inode
+                       index:ra.start
+                       count:ra.size
+                       group:ra.pending];
+      }
+      return;
+    }
+    // New window: the request now, plus room ahead of it
+    ra.start = index;
+    ra.size = MAX(MIN(MAX(pages * 4, (uint64_t)KERN_RA_MIN_PAGES),
+                      (uint64_t)KERN_RA_MAX_PAGES),
+                  pages);
+    ra.asyncSize = ra.size - pages;
+    [self readaheadWaitPending:ra index:ra.start last:ra.start + ra.size - 1];
+    [self pageCachePopulate:inode index:ra.start count:(NSUInteger)ra.size];
+    return;
+  }
+
+  if (stride != 0 && stride == ra.stride) {
+    // Once confirmed, keep KERN_RA_STRIDE_DEPTH records ahead of the reader
+    ra.strideCount++;
+    int first = ra.strideCount == 1 ? 1 : KERN_RA_STRIDE_DEPTH;
+    for (int k = first; k <= KERN_RA_STRIDE_DEPTH; k++) {
+      int64_t record = (int64_t)index + k * stride;
+      if (record < 0 || (uint64_t)record > eof)
+        break;
+      [self readaheadAsync:inode
+                     index:(uint64_t)record
+                     count:pages
+                     group:nil];
+    }
+    return;
+  }
+
+  // Random access: drop the window until a pattern reappears
+  ra.stride = stride;
+  ra.strideCount = 0;
+  ra.start = index;
+  ra.size = 0;
+  ra.asyncSize = 0;
+}
+
+@end
@@ -1,10 +1,14 @@
 #import "AdvancedKernel.h"
+#include <fcntl.h>
 #include <mach/mach_time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 @interface AdvancedKernel ()
 @property(nonatomic, strong) NSMutableDictionary *internalState;
-@property(nonatomic, strong) NSMutableArray<KernLogEntry *> *logBuffer;
-@property(nonatomic, assign) uint64_t logSequence;
 @property(nonatomic, assign) uint64_t bootTime;
 @property(nonatomic, assign) uint64_t syscallCount;
 @end
@@ -87,7 +91,7 @@
     _gid = 0;
     _euid = 0;
     _egid = 0;
-    _openFileDescriptors = [NSMutableArray array];
+    _fdTable = [[KernFDTable alloc] init];
     _maxFDs = 1024;
     _signalHandlers = [NSMutableDictionary dictionary];
     _pendingSignals = 0;
@@ -193,8 +197,14 @@
   if (self) {
     _shmID = 0;
     _name = @"";
-    _data = [NSMutableData data];
+    _mapping = NULL;
+    _backingFD = -1;
+    _backingPath = nil;
     _size = 0;
+    _mappedSize = 0;
+    _pageSize = KERN_PAGE_SIZE;
+    _hugePages = NO;
+    _attachAddresses = [NSMutableDictionary dictionary];
     _ownerPID = 0;
     _permissions = 0666;
     _attachCount = 0;
@@ -206,6 +216,17 @@
   }
   return self;
 }
+
+- (void)dealloc {
+  if (_mapping)
+    munmap(_mapping, _mappedSize);
+  if (_backingFD >= 0)
+    close(_backingFD);
+#if !defined(__linux__)
+  if (_backingPath)
+    shm_unlink(_backingPath.UTF8String);
+#endif
+}
 @end
 
 @implementation KernSemaphore
@@ -220,6 +241,7 @@
     _waitQueue = [NSMutableArray array];
     _waitCount = 0;
     _postCount = 0;
+    _lockClass = 0;
   }
   return self;
 }
@@ -264,6 +286,7 @@
     _usePriorityInheritance = NO;
     _lockCount = 0;
     _contentionCount = 0;
+    _lockClass = 0;
   }
   return self;
 }
@@ -281,6 +304,7 @@
     _readWaitQueue = [NSMutableArray array];
     _writeWaitQueue = [NSMutableArray array];
     _preferWriters = YES;
+    _lockClass = 0;
   }
   return self;
 }
@@ -305,10 +329,12 @@
   self = [super init];
   if (self) {
     _spinlockID = 0;
+    _name = @"";
     _locked = NO;
     _ownerCPU = 0;
     _spinCount = 0;
     _interruptsDisabled = NO;
+    _lockClass = 0;
   }
   return self;
 }
@@ -328,6 +354,55 @@
 }
 @end
 
+// ============================================================================
+// Futex hash table — waiters are queued per bucket on the host address
+// ============================================================================
+
+namespace {
+
+struct KernFutexWaiter {
+  uint32_t *address = nullptr;
+  bool woken = false;
+  std::condition_variable wakeup;
+  KernFutexWaiter *next = nullptr;
+};
+
+struct KernFutexBucket {
+  std::mutex lock;
+  KernFutexWaiter *waiters = nullptr;
+};
+
+KernFutexBucket gFutexBuckets[256];
+
+KernFutexBucket &KernFutexBucketFor(uint32_t *address) {
+  uint64_t hash = ((uintptr_t)address >> 2) * 0x9E3779B97F4A7C15ULL;
+  return gFutexBuckets[hash >> 56];
+}
+
+// Map len bytes of fd on an align boundary: reserve enough address space to
+// find one, map the file there and give back the slack on either side
+void *KernMapAligned(int fd, size_t len, size_t align) {
+  size_t reserve = len + align - KERN_PAGE_SIZE;
+  uint8_t *base = (uint8_t *)mmap(NULL, reserve, PROT_NONE,
+                                  MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (base == MAP_FAILED)
+    return MAP_FAILED;
+  uint8_t *start =
+      (uint8_t *)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+  if (mmap(start, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(base, reserve);
+    return MAP_FAILED;
+  }
+  if (start > base)
+    munmap(base, start - base);
+  if (start + len < base + reserve)
+    munmap(start + len, base + reserve - (start + len));
+  return start;
+}
+
+} // namespace
+
 // ============================================================================
 // Scheduler & IPC Methods
 // ============================================================================
@@ -338,11 +413,34 @@
                 executablePath:(NSString *)path
                      arguments:(NSArray<NSString *> *)args
                      parentPID:(uint32_t)ppid {
-  static uint32_t nextPID = 1;
+  // Children start in their parent's namespaces, cgroup and sandbox,
+  // subject to the cgroup's pids limit and the sandbox's maxProcesses
+  KernProcess *parent = ppid > 0 ? [self processForPID:ppid] : nil;
+  uint32_t cgroupID = parent ? parent.cgroupID : 0;
+  uint32_t pid = KernPidAlloc(ppid);
+  NSString *refused = nil;
+  if (!pid) {
+    refused = @"no free PID";
+  } else if (!KernPidsCharge(cgroupID)) {
+    KernPidFree(pid);
+    refused = [NSString stringWithFormat:@"cgroup %u at pids.max", cgroupID];
+  } else if (parent && !KernLandlockFork(ppid, pid)) {
+    KernPidFree(pid);
+    KernPidsUncharge(cgroupID);
+    refused = @"sandbox at maxProcesses";
+  }
+  if (refused) {
+    [self kernelLog:KernLogWarning
+           facility:KernLogProcess
+            message:[NSString stringWithFormat:@"fork rejected: %@ (ppid=%u)",
+                                               refused, ppid]];
+    return nil;
+  }
 
   KernProcess *proc = [[KernProcess alloc] init];
-  proc.pid = nextPID++;
+  proc.pid = pid;
   proc.ppid = ppid;
+  proc.cgroupID = cgroupID;
   proc.pgid = proc.pid;
   proc.sid = proc.pid;
   proc.name = name;
@@ -361,6 +459,7 @@
     self.internalState[@"processes"] = processes;
   }
   [processes addObject:proc];
+  KernPidInstall(pid, proc);
 
   // Add to run queue
   KernRunQueue *rq = self.internalState[@"runQueue_0"];
@@ -373,12 +472,12 @@
   rq.taskCount++;
 
   // Link parent
-  if (ppid > 0) {
-    KernProcess *parent = [self processForPID:ppid];
-    if (parent) {
-      proc.parent = parent;
-      [parent.children addObject:proc];
-    }
+  if (parent) {
+    proc.parent = parent;
+    proc.maxFDs = parent.maxFDs;
+    [parent.children addObject:proc];
+    KernSeccompFork(ppid, proc.pid);
+    [[self cgroupForProcess:proc.pid].memberPIDs addObject:@(proc.pid)];
   }
 
   [self
@@ -393,12 +492,18 @@
 
 - (void)terminateProcess:(uint32_t)pid exitCode:(int32_t)code {
   KernProcess *proc = [self processForPID:pid];
-  if (!proc)
+  if (!proc || proc.state == KernProcZombie)
     return;
 
   proc.state = KernProcZombie;
   proc.exitCode = code;
   proc.endTime = [NSDate date];
+  KernSeccompExit(pid);
+  KernPidsUncharge(proc.cgroupID);
+  KernLandlockExit(pid);
+  [[self cgroupForProcess:pid].memberPIDs removeObject:@(pid)];
+  [self exitFileTable:proc];
+  [proc.memoryMaps removeAllObjects]; // Drops file mapping pins
 
   // Re-parent children to init (PID 1)
   for (KernProcess *child in proc.children) {
@@ -444,6 +549,8 @@
   // Priority 1: Real-time FIFO/RR tasks
   for (KernProcess *proc in rq.realtimeTasks) {
     if (proc.state == KernProcReady) {
+      KERN_TRACE(KernTraceSchedule, rq.currentTask.pid, proc.pid,
+                 rq.realtimeTasks.count + rq.normalTasks.count, rq.clockTicks);
       if (rq.currentTask != proc) {
         KernProcess *old = rq.currentTask;
         [self contextSwitch:old to:proc];
@@ -478,6 +585,9 @@
     }
   }
 
+  KERN_TRACE(KernTraceSchedule, rq.currentTask.pid,
+             next ? next.pid : rq.currentTask.pid,
+             rq.realtimeTasks.count + rq.normalTasks.count, rq.clockTicks);
   if (next && next != rq.currentTask) {
     KernProcess *old = rq.currentTask;
     [self contextSwitch:old to:next];
@@ -513,6 +623,8 @@
 
   KernRunQueue *rq = self.internalState[@"runQueue_0"];
   rq.contextSwitchCount++;
+  KERN_TRACE(KernTraceContextSwitch, from.pid, to.pid, rq.contextSwitchCount,
+             0);
 }
 
 - (void)setSchedulingPolicy:(KernSchedulingPolicy)policy
@@ -556,12 +668,7 @@
 }
 
 - (KernProcess *)processForPID:(uint32_t)pid {
-  NSArray *processes = self.internalState[@"processes"];
-  for (KernProcess *proc in processes) {
-    if (proc.pid == pid)
-      return proc;
-  }
-  return nil;
+  return KernPidProcess(pid);
 }
 
 - (NSArray<KernProcess *> *)allProcesses {
@@ -590,10 +697,8 @@
     proc.state = KernProcReady;
   }
 
-  [self kernelLog:KernLogDebug
-         facility:KernLogProcess
-          message:[NSString stringWithFormat:@"Signal %ld sent to PID %u",
-                                             (long)signal, pid]];
+  KERN_LOG(KernLogDebug, KernLogProcess, "Signal %ld sent to PID %u",
+           (long)signal, pid);
 }
 
 // --- IPC: Pipes ---
@@ -623,11 +728,16 @@
 - (NSInteger)pipeWrite:(KernPipe *)pipe data:(NSData *)data {
   if (!pipe || pipe.writerClosed || !data)
     return -1;
-  if (pipe.bufferSize + data.length > pipe.maxBufferSize)
+  if (pipe.bufferSize + data.length > pipe.maxBufferSize) {
+    KERN_TRACE(KernTracePipeWrite, pipe.pipeID, data.length, pipe.bufferSize,
+               -1);
     return -1;
+  }
   [pipe.buffer appendData:data];
   pipe.bufferSize += data.length;
   pipe.writePosition += data.length;
+  KERN_TRACE(KernTracePipeWrite, pipe.pipeID, data.length, pipe.bufferSize,
+             data.length);
   return data.length;
 }
 
@@ -678,6 +788,7 @@
     self.internalState[@"messageQueues"] = queues;
   }
   [queues addObject:queue];
+  queue.namespaceID = KernIpcRegister(name, queue, false);
   return queue;
 }
 
@@ -720,6 +831,7 @@
 }
 
 - (void)destroyMessageQueue:(KernMessageQueue *)queue {
+  KernIpcUnregister(queue.namespaceID, queue.name, queue, false);
   NSMutableArray *queues = self.internalState[@"messageQueues"];
   [queues removeObject:queue];
 }
@@ -728,13 +840,91 @@
 
 - (KernSharedMemory *)createSharedMemory:(NSString *)name
                                     size:(NSUInteger)size {
+  return [self createSharedMemory:name size:size hugePages:NO];
+}
+
+// Create the host object backing a segment. Huge pages are attempted first
+// when requested (hugetlbfs memfd, then transparent huge pages); anything
+// that is not available silently falls back to 4 KB pages.
+- (BOOL)mapSharedMemoryBacking:(KernSharedMemory *)shm
+                     hugePages:(BOOL)hugePages {
+  int fd = -1;
+  NSUInteger pageSize = KERN_PAGE_SIZE;
+#if defined(__linux__)
+  const char *tag = shm.name.length ? shm.name.UTF8String : "kern-shm";
+#ifdef MFD_HUGETLB
+  if (hugePages) {
+    fd = memfd_create(tag, MFD_CLOEXEC | MFD_HUGETLB);
+    if (fd >= 0)
+      pageSize = KERN_PAGE_SIZE_2M;
+  }
+#endif
+  if (fd < 0)
+    fd = memfd_create(tag, MFD_CLOEXEC);
+  if (fd >= 0)
+    shm.backingPath =
+        [NSString stringWithFormat:@"/proc/%d/fd/%d", getpid(), fd];
+#else
+  // POSIX shm names are limited to PSHMNAMLEN (31) characters on Darwin
+  NSString *path =
+      [NSString stringWithFormat:@"/kshm.%d.%u", getpid(), shm.shmID];
+  fd = shm_open(path.UTF8String, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0)
+    shm.backingPath = path;
+#endif
+  if (fd < 0)
+    return NO;
+  shm.backingFD = fd;
+
+  NSUInteger align = hugePages ? KERN_PAGE_SIZE_2M : KERN_PAGE_SIZE;
+  NSUInteger mappedSize = (MAX(shm.size, 1) + align - 1) & ~(align - 1);
+  if (ftruncate(fd, (off_t)mappedSize) != 0)
+    return NO;
+  void *addr = KernMapAligned(fd, mappedSize, align);
+  if (addr == MAP_FAILED)
+    return NO;
+  shm.mapping = addr;
+  shm.mappedSize = mappedSize;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (hugePages && pageSize == KERN_PAGE_SIZE &&
+      madvise(addr, mappedSize, MADV_HUGEPAGE) == 0) {
+    // Transparent huge pages on shmem are best effort
+    pageSize = KERN_PAGE_SIZE_2M;
+  }
+#endif
+  // A huge page entry must start on a huge page in the backing too
+  if ((uintptr_t)addr & (pageSize - 1))
+    pageSize = KERN_PAGE_SIZE;
+  shm.pageSize = pageSize;
+  shm.hugePages = pageSize == KERN_PAGE_SIZE_2M;
+  return YES;
+}
+
+- (KernSharedMemory *)createSharedMemory:(NSString *)name
+                                    size:(NSUInteger)size
+                               hugePages:(BOOL)hugePages {
   static uint32_t nextShmID = 1;
   KernSharedMemory *shm = [[KernSharedMemory alloc] init];
   shm.shmID = nextShmID++;
   shm.name = name;
   shm.size = size;
-  shm.data = [NSMutableData dataWithLength:size];
   shm.createTime = mach_absolute_time();
+  if (![self mapSharedMemoryBacking:shm hugePages:hugePages]) {
+    [self kernelLog:KernLogError
+           facility:KernLogIPC
+            message:[NSString stringWithFormat:
+                                  @"shm '%@': cannot create host backing (%s)",
+                                  name, strerror(errno)]];
+    return nil;
+  }
+  if (hugePages && !shm.hugePages) {
+    [self kernelLog:KernLogNotice
+           facility:KernLogIPC
+            message:[NSString stringWithFormat:@"shm '%@': huge pages "
+                                               @"unavailable, using 4 KB pages",
+                                               name]];
+  }
 
   NSMutableArray *shmList = self.internalState[@"sharedMemory"];
   if (!shmList) {
@@ -742,29 +932,98 @@
     self.internalState[@"sharedMemory"] = shmList;
   }
   [shmList addObject:shm];
+  shm.namespaceID = KernIpcRegister(name, shm, true);
   return shm;
 }
 
+// Attaching maps the segment into the process's simulated page tables: a
+// shared VMA is placed in the highest free range below the stack and each
+// page (or 2 MB huge page) is mapped to the host address backing it, so
+// translateAddress: yields a pointer straight into the shared mapping.
 - (void *)attachSharedMemory:(KernSharedMemory *)shm forProcess:(uint32_t)pid {
-  if (!shm)
+  if (!shm || !shm.mapping || shm.markedForDeletion)
     return NULL;
-  [shm.attachedProcesses addObject:@(pid)];
-  shm.attachCount++;
+  KernProcess *proc = [self processForPID:pid];
+  NSNumber *existing = shm.attachAddresses[@(pid)];
+  if (proc && !existing) {
+    uint64_t va =
+        KernVMAPlacement(proc, proc.stackBottom - KERN_STACK_GAP,
+                         proc.heapEnd, shm.mappedSize, shm.pageSize);
+    if (!va)
+      return NULL;
+
+    KernMmapFlags flags = KernMmapShared | KernMmapFile;
+    if (shm.hugePages)
+      flags |= KernMmapHugePages;
+    KernVMA *vma = [self mmapForProcess:pid
+                                address:va
+                                 length:shm.mappedSize
+                             protection:KernMemProtRead | KernMemProtWrite |
+                                        KernMemProtShared | KernMemProtUser
+                                  flags:flags];
+    vma.name = [NSString stringWithFormat:@"shm:%@", shm.name];
+    vma.mappedFile = shm.backingPath;
+    vma.isAnonymous = NO;
+    vma.shm = shm;
+
+    NSString *key = [NSString stringWithFormat:@"pageTable_%u", pid];
+    for (uint64_t off = 0; off < shm.mappedSize; off += shm.pageSize) {
+      [self mapVirtualAddress:va + off
+                   toPhysical:(uint64_t)(uintptr_t)shm.mapping + off
+                   protection:KernMemProtRead | KernMemProtWrite |
+                              KernMemProtUser
+                   forProcess:pid];
+      if (shm.hugePages) {
+        KernPageTableEntry *pte =
+            self.internalState[key][@((va + off) / KERN_PAGE_SIZE)];
+        pte.flags |= PTE_HUGE_PAGE;
+      }
+    }
+    shm.attachAddresses[@(pid)] = @(va);
+  }
+  if (!existing) {
+    [shm.attachedProcesses addObject:@(pid)];
+    shm.attachCount++;
+  }
   shm.lastAttachTime = mach_absolute_time();
-  return shm.data.mutableBytes;
+  return shm.mapping;
 }
 
 - (void)detachSharedMemory:(KernSharedMemory *)shm fromProcess:(uint32_t)pid {
-  if (!shm)
+  if (!shm || ![shm.attachedProcesses containsObject:@(pid)])
     return;
+  NSNumber *vaNumber = shm.attachAddresses[@(pid)];
+  if (vaNumber) {
+    uint64_t va = vaNumber.unsignedLongLongValue;
+    for (uint64_t off = 0; off < shm.mappedSize; off += shm.pageSize)
+      [self unmapVirtualAddress:va + off forProcess:pid];
+    KernProcess *proc = [self processForPID:pid];
+    NSMutableArray *toRemove = [NSMutableArray array];
+    for (KernVMA *vma in proc.memoryMaps) {
+      if (vma.startAddress == va)
+        [toRemove addObject:vma];
+    }
+    [proc.memoryMaps removeObjectsInArray:toRemove];
+    [shm.attachAddresses removeObjectForKey:@(pid)];
+  }
   [shm.attachedProcesses removeObject:@(pid)];
+  shm.attachCount--;
   shm.lastDetachTime = mach_absolute_time();
   if (shm.attachedProcesses.count == 0 && shm.markedForDeletion) {
     [self destroySharedMemory:shm];
   }
 }
 
+// Like IPC_RMID: an attached segment is only marked, and its host mapping is
+// released once the last process detaches.
 - (void)destroySharedMemory:(KernSharedMemory *)shm {
+  if (!shm)
+    return;
+  KernIpcUnregister(shm.namespaceID, shm.name, shm, true);
+  if (shm.attachedProcesses.count > 0) {
+    shm.markedForDeletion = YES;
+    return;
+  }
   NSMutableArray *shmList = self.internalState[@"sharedMemory"];
   [shmList removeObject:shm];
 }
@@ -795,8 +1054,10 @@
   sem.waitCount++;
   if (sem.value > 0) {
     sem.value--;
+    KERN_LOCKDEP_ACQUIRED(sem, KernLockKindSemaphore);
     return YES;
   }
+  KERN_LOCKDEP_CONTENDED(sem, KernLockKindSemaphore);
   return NO; // Would block
 }
 
@@ -804,12 +1065,14 @@
   if (!sem || sem.value <= 0)
     return NO;
   sem.value--;
+  KERN_LOCKDEP_ACQUIRED(sem, KernLockKindSemaphore);
   return YES;
 }
 
 - (void)semaphorePost:(KernSemaphore *)sem {
   if (!sem)
     return;
+  KERN_LOCKDEP_RELEASED(sem, KernLockKindSemaphore);
   sem.value++;
   sem.postCount++;
 }
@@ -826,6 +1089,8 @@
                     priority:(int32_t)priority
                    stackSize:(uint64_t)stackSize {
   static uint32_t nextTID = 1;
+  if (!KernLandlockThreadCreate(processID))
+    return nil;
   KernThread *thread = [[KernThread alloc] init];
   thread.threadID = nextTID++;
   thread.processID = processID;
@@ -852,6 +1117,8 @@
   NSArray *threads = self.internalState[@"threads"];
   for (KernThread *t in threads) {
     if (t.threadID == threadID) {
+      if (t.state != KernThreadTerminated)
+        KernLandlockThreadExit(t.processID);
       t.state = KernThreadTerminated;
       t.exitCode = code;
       break;
@@ -892,6 +1159,7 @@
     mutex.locked = YES;
     mutex.lockCount++;
     mutex.recursionCount = 1;
+    KERN_LOCKDEP_ACQUIRED(mutex, KernLockKindMutex);
     return YES;
   }
   if (mutex.type == KernMutexRecursive) {
@@ -900,6 +1168,7 @@
     return YES;
   }
   mutex.contentionCount++;
+  KERN_LOCKDEP_CONTENDED(mutex, KernLockKindMutex);
   return NO; // Would block
 }
 
@@ -909,6 +1178,7 @@
   mutex.locked = YES;
   mutex.lockCount++;
   mutex.recursionCount = 1;
+  KERN_LOCKDEP_ACQUIRED(mutex, KernLockKindMutex);
   return YES;
 }
 
@@ -919,6 +1189,8 @@
     mutex.recursionCount--;
     return;
   }
+  if (mutex.locked)
+    KERN_LOCKDEP_RELEASED(mutex, KernLockKindMutex);
   mutex.locked = NO;
   mutex.ownerThreadID = 0;
   mutex.recursionCount = 0;
@@ -940,17 +1212,25 @@
 - (BOOL)rwlockReadLock:(KernRWLock *)lock {
   if (!lock)
     return NO;
-  if (lock.state == KernRWLockWriteLocked)
+  if (lock.state == KernRWLockWriteLocked) {
+    KERN_LOCKDEP_CONTENDED(lock, KernLockKindRWLockRead);
     return NO;
+  }
   lock.state = KernRWLockReadLocked;
   lock.readerCount++;
+  KERN_LOCKDEP_ACQUIRED(lock, KernLockKindRWLockRead);
   return YES;
 }
 
 - (BOOL)rwlockWriteLock:(KernRWLock *)lock {
-  if (!lock || lock.state != KernRWLockFree)
+  if (!lock)
     return NO;
+  if (lock.state != KernRWLockFree) {
+    KERN_LOCKDEP_CONTENDED(lock, KernLockKindRWLockWrite);
+    return NO;
+  }
   lock.state = KernRWLockWriteLocked;
+  KERN_LOCKDEP_ACQUIRED(lock, KernLockKindRWLockWrite);
   return YES;
 }
 
@@ -958,10 +1238,13 @@
   if (!lock)
     return;
   if (lock.state == KernRWLockReadLocked) {
+    KERN_LOCKDEP_RELEASED(lock, KernLockKindRWLockRead);
     lock.readerCount--;
     if (lock.readerCount == 0)
       lock.state = KernRWLockFree;
   } else {
+    if (lock.state == KernRWLockWriteLocked)
+      KERN_LOCKDEP_RELEASED(lock, KernLockKindRWLockWrite);
     lock.state = KernRWLockFree;
     lock.writerThreadID = 0;
   }
@@ -1031,4 +1314,91 @@
 - (void)destroyBarrier:(KernBarrier *)barrier { /* cleanup */
 }
 
+// --- Futex ---
+
+- (int32_t)futexWait:(uint32_t *)address
+            expected:(uint32_t)value
+           timeoutNs:(uint64_t)timeout {
+  if (!address)
+    return -EFAULT;
+  KernFutexBucket &bucket = KernFutexBucketFor(address);
+  std::unique_lock<std::mutex> guard(bucket.lock);
+  if (__atomic_load_n(address, __ATOMIC_SEQ_CST) != value)
+    return -EAGAIN;
+
+  KernFutexWaiter waiter;
+  waiter.address = address;
+  waiter.next = bucket.waiters;
+  bucket.waiters = &waiter;
+  auto woken = [&waiter] { return waiter.woken; };
+  if (timeout)
+    waiter.wakeup.wait_for(guard, std::chrono::nanoseconds(timeout), woken);
+  else
+    waiter.wakeup.wait(guard, woken);
+  if (waiter.woken)
+    return 0;
+
+  for (KernFutexWaiter **link = &bucket.waiters; *link;
+       link = &(*link)->next) {
+    if (*link == &waiter) {
+      *link = waiter.next;
+      break;
+    }
+  }
+  return -ETIMEDOUT;
+}
+
+- (int32_t)futexWake:(uint32_t *)address count:(uint32_t)count {
+  if (!address)
+    return -EFAULT;
+  KernFutexBucket &bucket = KernFutexBucketFor(address);
+  std::lock_guard<std::mutex> guard(bucket.lock);
+  int32_t woken = 0;
+  KernFutexWaiter **link = &bucket.waiters;
+  while (*link && (uint32_t)woken < count) {
+    KernFutexWaiter *waiter = *link;
+    if (waiter->address != address) {
+      link = &waiter->next;
+      continue;
+    }
+    *link = waiter->next;
+    waiter->woken = true;
+    waiter->wakeup.notify_one();
+    woken++;
+  }
+  return woken;
+}
+
+// --- Spinlock ---
+
+- (KernSpinlock *)createSpinlock:(NSString *)name {
+  static uint32_t nextSLID = 1;
+  KernSpinlock *lock = [[KernSpinlock alloc] init];
+  lock.spinlockID = nextSLID++;
+  lock.name = name;
+  return lock;
+}
+
+- (BOOL)spinlockLock:(KernSpinlock *)lock {
+  if (!lock)
+    return NO;
+  if (lock.locked) {
+    lock.spinCount++;
+    KERN_LOCKDEP_CONTENDED(lock, KernLockKindSpinlock);
+    return NO; // Would spin
+  }
+  lock.locked = YES;
+  lock.interruptsDisabled = YES;
+  KERN_LOCKDEP_ACQUIRED(lock, KernLockKindSpinlock);
+  return YES;
+}
+
+- (void)spinlockUnlock:(KernSpinlock *)lock {
+  if (!lock || !lock.locked)
+    return;
+  KERN_LOCKDEP_RELEASED(lock, KernLockKindSpinlock);
+  lock.locked = NO;
+  lock.interruptsDisabled = NO;
+}
+
 @end
@@ -0,0 +1,285 @@
+#import "AdvancedKernel.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Syscall Filters (seccomp-style)
+// ============================================================================
+//
+// A sandbox profile compiles into a flat filter: a bitmap of syscalls that
+// are always rejected, a second bitmap marking syscalls with argument
+// predicates, and the predicates themselves grouped by syscall number.
+// Filters are immutable once built. Installing one pushes it on top of the
+// process's existing stack, and every filter in the stack must pass.
+//
+// The entry path resolves the caller's stack through a thread-local cache
+// keyed by (pid, generation); any install, fork or exit bumps the
+// generation, so the common case is one compare and a few bit tests.
+
+#define KERN_SECCOMP_WORDS (KSYS_MAX_SYSCALL / 64)
+
+KernStaticKey gKernSeccompKey;
+
+namespace {
+
+enum class KernSeccompOp : uint8_t {
+  Equal,
+  NotEqual,
+  MaskedEqual, // (arg & mask) == value
+  Less,
+  GreaterEqual
+};
+
+struct KernSeccompPredicate {
+  uint8_t arg;
+  KernSeccompOp op;
+  int32_t error;
+  uint64_t mask;
+  uint64_t value;
+
+  bool matches(const uint64_t *args) const {
+    uint64_t v = args[arg];
+    switch (op) {
+    case KernSeccompOp::Equal:
+      return v == value;
+    case KernSeccompOp::NotEqual:
+      return v != value;
+    case KernSeccompOp::MaskedEqual:
+      return (v & mask) == value;
+    case KernSeccompOp::Less:
+      return v < value;
+    case KernSeccompOp::GreaterEqual:
+      return v >= value;
+    }
+    return false;
+  }
+};
+
+struct KernSeccompFilter {
+  uint64_t deny[KERN_SECCOMP_WORDS] = {};
+  uint64_t checked[KERN_SECCOMP_WORDS] = {};
+  int32_t error = EPERM;
+  // predicates[first[nr] .. first[nr + 1]) belong to syscall nr
+  std::vector<uint16_t> first;
+  std::vector<KernSeccompPredicate> predicates;
+  std::shared_ptr<const KernSeccompFilter> prev;
+  NSUInteger depth = 1;
+
+  bool reject(KernSyscallNumber nr, const uint64_t *args,
+              int64_t *ret) const {
+    uint64_t bit = 1ULL << (nr & 63);
+    if (deny[nr >> 6] & bit) {
+      *ret = -error;
+      return true;
+    }
+    if (checked[nr >> 6] & bit) {
+      for (uint16_t i = first[nr]; i < first[nr + 1]; i++) {
+        if (predicates[i].matches(args)) {
+          *ret = -predicates[i].error;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+};
+
+typedef std::shared_ptr<const KernSeccompFilter> KernSeccompStack;
+
+struct KernSeccompTaskCache {
+  uint32_t pid = 0;
+  uint64_t generation = 0;
+  KernSeccompStack stack;
+};
+
+std::mutex gSeccompLock;
+std::unordered_map<uint32_t, KernSeccompStack> gSeccompStacks;
+std::atomic<uint64_t> gSeccompGeneration{1};
+thread_local KernSeccompTaskCache tSeccompCache;
+
+// Caller holds gSeccompLock.
+void KernSeccompSetStack(uint32_t pid, KernSeccompStack stack) {
+  bool had = gSeccompStacks.count(pid) != 0;
+  if (stack) {
+    gSeccompStacks[pid] = std::move(stack);
+    if (!had)
+      KernStaticKeyEnable(gKernSeccompKey);
+  } else if (had) {
+    gSeccompStacks.erase(pid);
+    KernStaticKeyDisable(gKernSeccompKey);
+  }
+  gSeccompGeneration.fetch_add(1, std::memory_order_release);
+}
+
+// Pending predicates for one syscall, gathered before flattening
+struct KernSeccompBuilder {
+  KernSeccompFilter filter;
+  std::vector<std::vector<KernSeccompPredicate>> pending =
+      std::vector<std::vector<KernSeccompPredicate>>(KSYS_MAX_SYSCALL);
+
+  void deny(NSInteger nr) {
+    filter.deny[nr >> 6] |= 1ULL << (nr & 63);
+  }
+  void allow(NSInteger nr) {
+    filter.deny[nr >> 6] &= ~(1ULL << (nr & 63));
+  }
+  void denyRange(NSInteger from, NSInteger to) {
+    for (NSInteger nr = from; nr <= to; nr++)
+      deny(nr);
+  }
+  void predicate(NSInteger nr, KernSeccompPredicate p) {
+    pending[nr].push_back(p);
+  }
+
+  std::shared_ptr<KernSeccompFilter> build() {
+    auto out = std::make_shared<KernSeccompFilter>(filter);
+    out->first.assign(KSYS_MAX_SYSCALL + 1, 0);
+    for (NSInteger nr = 0; nr < KSYS_MAX_SYSCALL; nr++) {
+      out->first[nr] = (uint16_t)out->predicates.size();
+      if (pending[nr].empty())
+        continue;
+      out->checked[nr >> 6] |= 1ULL << (nr & 63);
+      out->predicates.insert(out->predicates.end(), pending[nr].begin(),
+                             pending[nr].end());
+    }
+    out->first[KSYS_MAX_SYSCALL] = (uint16_t)out->predicates.size();
+    return out;
+  }
+};
+
+} // namespace
+
+bool KernSeccompReject(uint32_t pid, KernSyscallNumber number,
+                       const uint64_t *args, int64_t *ret) {
+  KernSeccompTaskCache &cache = tSeccompCache;
+  uint64_t generation = gSeccompGeneration.load(std::memory_order_acquire);
+  if (cache.pid != pid || cache.generation != generation) {
+    std::lock_guard<std::mutex> guard(gSeccompLock);
+    auto it = gSeccompStacks.find(pid);
+    cache.stack = it != gSeccompStacks.end() ? it->second : nullptr;
+    cache.pid = pid;
+    cache.generation = generation;
+  }
+  for (const KernSeccompFilter *f = cache.stack.get(); f; f = f->prev.get()) {
+    if (f->reject(number, args, ret))
+      return true;
+  }
+  return false;
+}
+
+void KernSeccompFork(uint32_t ppid, uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gSeccompLock);
+  auto it = gSeccompStacks.find(ppid);
+  if (it != gSeccompStacks.end())
+    KernSeccompSetStack(pid, it->second);
+}
+
+void KernSeccompExit(uint32_t pid) {
+  std::lock_guard<std::mutex> guard(gSeccompLock);
+  KernSeccompSetStack(pid, nullptr);
+}
+
+// ============================================================================
+// AdvancedKernel — Sandbox Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Seccomp)
+
+- (NSInteger)syscallNumberForName:(NSString *)name {
+  for (NSInteger nr = 0; nr < KSYS_MAX_SYSCALL; nr++) {
+    if ([[self syscallName:(KernSyscallNumber)nr] isEqualToString:name])
+      return nr;
+  }
+  return -1;
+}
+
+// Compile a profile. A non-empty allowedSyscalls list turns the filter into
+// an allow-list; deniedSyscalls and the profile's capability switches are
+// applied on top of either mode.
+- (std::shared_ptr<KernSeccompFilter>)compileSandboxProfile:
+    (KernSandboxProfile *)profile {
+  KernSeccompBuilder builder;
+  if (profile.allowedSyscalls.count > 0) {
+    builder.denyRange(0, KSYS_MAX_SYSCALL - 1);
+    for (NSString *name in profile.allowedSyscalls) {
+      NSInteger nr = [self syscallNumberForName:name];
+      if (nr >= 0)
+        builder.allow(nr);
+    }
+  }
+  for (NSString *name in profile.deniedSyscalls) {
+    NSInteger nr = [self syscallNumberForName:name];
+    if (nr >= 0)
+      builder.deny(nr);
+  }
+  for (NSString *name in [profile.allowedSyscalls
+           arrayByAddingObjectsFromArray:profile.deniedSyscalls]) {
+    if ([self syscallNumberForName:name] < 0)
+      [self kernelLog:KernLogWarning
+             facility:KernLogSecurity
+              message:[NSString stringWithFormat:
+                                    @"Sandbox '%@': unknown syscall '%@'",
+                                    profile.name, name]];
+  }
+
+  if (!profile.allowNetworking)
+    builder.denyRange(KSYS_SOCKET, KSYS_SOCKETPAIR);
+  if (!profile.allowProcessCreation) {
+    builder.deny(KSYS_FORK);
+    builder.deny(KSYS_VFORK);
+    builder.deny(KSYS_CLONE);
+  }
+  if (!profile.allowFileCreation) {
+    const uint64_t creat = 0x0200; // O_CREAT
+    builder.predicate(KSYS_OPEN, {1, KernSeccompOp::MaskedEqual, EACCES,
+                                  creat, creat});
+    builder.predicate(KSYS_OPENAT, {2, KernSeccompOp::MaskedEqual, EACCES,
+                                    creat, creat});
+    builder.deny(KSYS_MKDIR);
+    builder.deny(KSYS_MKDIRAT);
+    builder.deny(KSYS_SYMLINK);
+    builder.deny(KSYS_LINK);
+  }
+  return builder.build();
+}
+
+- (void)applySandbox:(KernSandboxProfile *)profile toProcess:(uint32_t)pid {
+  if (!profile)
+    return;
+  std::shared_ptr<KernSeccompFilter> filter =
+      [self compileSandboxProfile:profile];
+  NSUInteger depth;
+  {
+    std::lock_guard<std::mutex> guard(gSeccompLock);
+    auto it = gSeccompStacks.find(pid);
+    if (it != gSeccompStacks.end()) {
+      filter->prev = it->second;
+      filter->depth = it->second->depth + 1;
+    }
+    depth = filter->depth;
+    KernSeccompSetStack(pid, std::move(filter));
+  }
+  [self applyPathRuleset:profile toProcess:pid];
+  [self kernelLog:KernLogInfo
+         facility:KernLogSecurity
+          message:[NSString stringWithFormat:@"Sandbox '%@' applied to PID %u "
+                                             @"(filter depth %lu)",
+                                             profile.name, pid,
+                                             (unsigned long)depth]];
+}
+
+- (NSUInteger)syscallFilterCountForProcess:(uint32_t)pid {
+  std::lock_guard<std::mutex> guard(gSeccompLock);
+  auto it = gSeccompStacks.find(pid);
+  return it != gSeccompStacks.end() ? it->second->depth : 0;
+}
+
+@end
@@ -0,0 +1,410 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <array>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Syscall Dispatch Table
+// ============================================================================
+//
+// One entry per KernSyscallNumber holding a plain C++ handler, its name and
+// the number of arguments it requires. Handlers take the argument registers
+// as raw words and return a value or -errno. Numbers without a handler
+// complete with 0, as they always have. The boxed entry knows how many
+// arguments the caller passed and fails short calls with -EINVAL; the raw
+// entry always supplies every register.
+
+typedef int64_t (*KernSyscallHandler)(__unsafe_unretained AdvancedKernel *k,
+                                      const uint64_t *args);
+
+struct KernSyscallEntry {
+  KernSyscallHandler handler;
+  const char *name;
+  uint8_t nargs;
+};
+
+static KernStaticKey gSyscallTraceKey;
+static thread_local uint32_t tCurrentPID = 1;
+
+namespace {
+
+int64_t sys_zero(__unsafe_unretained AdvancedKernel *, const uint64_t *) {
+  return 0;
+}
+
+// PIDs in arguments and results are numbers in the caller's PID namespace
+int64_t sys_getpid(__unsafe_unretained AdvancedKernel *, const uint64_t *) {
+  return KernPidNr(tCurrentPID, tCurrentPID) ?: tCurrentPID;
+}
+
+int64_t sys_getppid(__unsafe_unretained AdvancedKernel *, const uint64_t *) {
+  return KernPidParentNr(tCurrentPID);
+}
+
+// args: pid, exitCode
+int64_t sys_exit(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  uint32_t pid = KernPidFind((uint32_t)args[0], tCurrentPID);
+  if (!pid)
+    return -ESRCH;
+  [k terminateProcess:pid exitCode:(int32_t)args[1]];
+  return 0;
+}
+
+// args: parentPID
+int64_t sys_fork(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  KernProcess *parent =
+      [k processForPID:KernPidFind((uint32_t)args[0], tCurrentPID)];
+  if (!parent)
+    return -ESRCH;
+  KernProcess *child = [k createProcess:parent.name
+                         executablePath:parent.executablePath
+                              arguments:parent.arguments
+                              parentPID:parent.pid];
+  if (!child)
+    return -EAGAIN;
+  [k forkFileTable:parent toProcess:child share:NO];
+  return KernPidNr(child.pid, tCurrentPID);
+}
+
+// args: pid, signal
+int64_t sys_kill(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  uint32_t pid = KernPidFind((uint32_t)args[0], tCurrentPID);
+  if (!pid)
+    return -ESRCH;
+  [k sendSignal:(KernSignal)args[1] toProcess:pid];
+  return 0;
+}
+
+// args: path (C string), flags, mode
+int64_t sys_open(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  const char *path = (const char *)(uintptr_t)args[0];
+  if (!path)
+    return -EFAULT;
+  KernFileDescriptor *fd = [k openFile:@(path)
+                                 flags:(uint32_t)args[1]
+                                  mode:(uint32_t)args[2]];
+  return fd ? fd.fd : -ENOENT;
+}
+
+// args: fd
+int64_t sys_close(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k closeFD:(int32_t)args[0]];
+}
+
+// args: fd
+int64_t sys_dup(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k dupFD:(int32_t)args[0] minimum:0 closeOnExec:NO];
+}
+
+// args: fd, target
+int64_t sys_dup2(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k dup2FD:(int32_t)args[0] to:(int32_t)args[1] closeOnExec:NO];
+}
+
+// args: fd, cmd, arg. Descriptor commands only.
+int64_t sys_fcntl(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  int32_t fd = (int32_t)args[0];
+  switch (args[1]) {
+  case 0: // F_DUPFD
+    return [k dupFD:fd minimum:(int32_t)args[2] closeOnExec:NO];
+  case 67: // F_DUPFD_CLOEXEC
+    return [k dupFD:fd minimum:(int32_t)args[2] closeOnExec:YES];
+  case 1: // F_GETFD
+    return [k descriptorFlags:fd];
+  case 2: // F_SETFD
+    return [k setDescriptorFlags:(int32_t)args[2] forFD:fd];
+  default:
+    return -EINVAL;
+  }
+}
+
+// args: first, last, flags (CLOSE_RANGE_CLOEXEC = 4)
+int64_t sys_close_range(__unsafe_unretained AdvancedKernel *k,
+                        const uint64_t *args) {
+  if (args[2] & ~4ULL)
+    return -EINVAL;
+  return [k closeRangeFrom:(uint32_t)args[0]
+                        to:(uint32_t)MIN(args[1], (uint64_t)UINT32_MAX)
+               closeOnExec:(args[2] & 4) != 0];
+}
+
+// args: fd, buffer, length
+int64_t sys_read(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k readFD:(int32_t)args[0]
+              into:(void *)(uintptr_t)args[1]
+            length:(NSUInteger)args[2]
+            offset:UINT64_MAX];
+}
+
+int64_t sys_write(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k writeFD:(int32_t)args[0]
+               from:(const void *)(uintptr_t)args[1]
+             length:(NSUInteger)args[2]
+             offset:UINT64_MAX];
+}
+
+// args: fd
+int64_t sys_fsync(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k syncFD:(int32_t)args[0] dataOnly:NO];
+}
+
+int64_t sys_fdatasync(__unsafe_unretained AdvancedKernel *k,
+                      const uint64_t *args) {
+  return [k syncFD:(int32_t)args[0] dataOnly:YES];
+}
+
+int64_t sys_sync(__unsafe_unretained AdvancedKernel *k, const uint64_t *) {
+  for (KernMountPoint *mp in [k mountedFileSystems])
+    [k syncFileSystem:mp.superblock];
+  return 0;
+}
+
+// args: pid, addr, length, protection, flags, fd | pageOffset << 32
+// The last word is read only with KernMmapFile; like mmap2, the file offset
+// is in 4 KB pages so both fit.
+int64_t sys_mmap(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  if (args[4] & KernMmapFile)
+    return [k mmapFD:(int32_t)(uint32_t)args[5]
+          forProcess:(uint32_t)args[0]
+             address:args[1]
+              length:args[2]
+          protection:(KernMemoryProtection)args[3]
+               flags:(KernMmapFlags)args[4]
+              offset:(args[5] >> 32) * KERN_PAGE_SIZE];
+  KernVMA *vma = [k mmapForProcess:(uint32_t)args[0]
+                           address:args[1]
+                            length:args[2]
+                        protection:(KernMemoryProtection)args[3]
+                             flags:(KernMmapFlags)args[4]];
+  return vma ? (int64_t)vma.startAddress : -ENOMEM;
+}
+
+// args: pid, addr, length
+int64_t sys_munmap(__unsafe_unretained AdvancedKernel *k,
+                   const uint64_t *args) {
+  return [k munmapForProcess:(uint32_t)args[0] address:args[1] length:args[2]]
+             ? 0
+             : -EINVAL;
+}
+
+// args: pid, addr, length, flags (MS_SYNC 0x10)
+int64_t sys_msync(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  return [k msyncForProcess:(uint32_t)args[0]
+                    address:args[1]
+                     length:args[2]
+                       sync:(args[3] & 0x10) != 0];
+}
+
+// args: uaddr, op (0 = wait, 1 = wake), value, timeoutNs
+int64_t sys_futex(__unsafe_unretained AdvancedKernel *k, const uint64_t *args) {
+  uint32_t *uaddr = (uint32_t *)(uintptr_t)args[0];
+  if (args[1] == 0)
+    return [k futexWait:uaddr expected:(uint32_t)args[2] timeoutNs:args[3]];
+  return [k futexWake:uaddr count:(uint32_t)args[2]];
+}
+
+// args: entries, pid
+int64_t sys_io_uring_setup(__unsafe_unretained AdvancedKernel *k,
+                           const uint64_t *args) {
+  KernIORing *ring = [k ioRingSetup:(uint32_t)args[0]
+                         forProcess:(uint32_t)args[1]];
+  return ring ? ring.ringID : -EINVAL;
+}
+
+// args: ringID, toSubmit, minComplete
+int64_t sys_io_uring_enter(__unsafe_unretained AdvancedKernel *k,
+                           const uint64_t *args) {
+  KernIORing *ring = k.internalState[@"ioRings"][@(args[0])];
+  if (!ring)
+    return -EBADF;
+  return [k ioRingEnter:ring
+               toSubmit:(uint32_t)args[1]
+            minComplete:(uint32_t)args[2]];
+}
+
+int64_t sys_clock_gettime(__unsafe_unretained AdvancedKernel *,
+                          const uint64_t *) {
+  return (int64_t)mach_absolute_time();
+}
+
+int64_t sys_getrandom(__unsafe_unretained AdvancedKernel *, const uint64_t *) {
+  return arc4random();
+}
+
+std::array<KernSyscallEntry, KSYS_MAX_SYSCALL> KernBuildSyscallTable() {
+  std::array<KernSyscallEntry, KSYS_MAX_SYSCALL> table{};
+  auto set = [&](KernSyscallNumber nr, KernSyscallHandler handler,
+                 const char *name, uint8_t nargs = 0) {
+    table[nr] = {handler, name, nargs};
+  };
+
+  set(KSYS_EXIT, sys_exit, "exit", 2);
+  set(KSYS_FORK, sys_fork, "fork", 1);
+  set(KSYS_EXEC, nullptr, "execve");
+  set(KSYS_WAIT, nullptr, "wait");
+  set(KSYS_GETPID, sys_getpid, "getpid");
+  set(KSYS_GETPPID, sys_getppid, "getppid");
+  set(KSYS_GETUID, sys_zero, "getuid");
+  set(KSYS_GETGID, sys_zero, "getgid");
+  set(KSYS_KILL, sys_kill, "kill", 2);
+  set(KSYS_CLONE, nullptr, "clone");
+
+  set(KSYS_OPEN, sys_open, "open", 2);
+  set(KSYS_CLOSE, sys_close, "close", 1);
+  set(KSYS_DUP, sys_dup, "dup", 1);
+  set(KSYS_DUP2, sys_dup2, "dup2", 2);
+  set(KSYS_FCNTL, sys_fcntl, "fcntl", 2);
+  set(KSYS_CLOSE_RANGE, sys_close_range, "close_range", 2);
+  set(KSYS_READ, sys_read, "read", 3);
+  set(KSYS_WRITE, sys_write, "write", 3);
+  set(KSYS_FSYNC, sys_fsync, "fsync", 1);
+  set(KSYS_FDATASYNC, sys_fdatasync, "fdatasync", 1);
+  set(KSYS_SYNC, sys_sync, "sync");
+  set(KSYS_STAT, nullptr, "stat");
+  set(KSYS_FSTAT, nullptr, "fstat");
+  set(KSYS_PIPE, nullptr, "pipe");
+  set(KSYS_MKDIR, nullptr, "mkdir");
+  set(KSYS_RMDIR, nullptr, "rmdir");
+  set(KSYS_MOUNT, nullptr, "mount");
+  set(KSYS_UMOUNT, nullptr, "umount");
+
+  set(KSYS_MMAP, sys_mmap, "mmap", 5);
+  set(KSYS_MUNMAP, sys_munmap, "munmap", 3);
+  set(KSYS_MSYNC, sys_msync, "msync", 3);
+  set(KSYS_BRK, sys_zero, "brk");
+
+  set(KSYS_SOCKET, nullptr, "socket");
+  set(KSYS_BIND, nullptr, "bind");
+  set(KSYS_LISTEN, nullptr, "listen");
+  set(KSYS_ACCEPT, nullptr, "accept");
+  set(KSYS_CONNECT, nullptr, "connect");
+  set(KSYS_SEND, nullptr, "send");
+  set(KSYS_RECV, nullptr, "recv");
+
+  set(KSYS_CLOCK_GETTIME, sys_clock_gettime, "clock_gettime");
+  set(KSYS_UNAME, sys_zero, "uname");
+  set(KSYS_SYSINFO, sys_zero, "sysinfo");
+  set(KSYS_FUTEX, sys_futex, "futex", 3);
+  set(KSYS_REBOOT, nullptr, "reboot");
+  set(KSYS_GETRANDOM, sys_getrandom, "getrandom");
+  set(KSYS_IO_URING_SETUP, sys_io_uring_setup, "io_uring_setup", 2);
+  set(KSYS_IO_URING_ENTER, sys_io_uring_enter, "io_uring_enter", 3);
+  return table;
+}
+
+const std::array<KernSyscallEntry, KSYS_MAX_SYSCALL> kSyscallTable =
+    KernBuildSyscallTable();
+
+} // namespace
+
+uint32_t KernCurrentPID(void) { return tCurrentPID; }
+
+// Out of line so the formatting code stays off the dispatch fast path.
+static void __attribute__((noinline, cold))
+KernSyscallTrace(AdvancedKernel *k, KernSyscallNumber number, int64_t ret) {
+  if (!KernLogEnabled(KernLogTrace, KernLogSyscall))
+    return;
+  [k kernelLog:KernLogTrace
+      facility:KernLogSyscall
+       message:[NSString stringWithFormat:@"syscall %@ (#%ld) -> %lld",
+                                          [k syscallName:number],
+                                          (long)number, ret]];
+}
+
+@implementation AdvancedKernel (Syscall)
+
+- (int64_t)invokeSyscall:(KernSyscallNumber)number
+                    args:(const uint64_t *)args {
+  self.syscallCount++;
+  if ((NSUInteger)number >= KSYS_MAX_SYSCALL)
+    return -ENOSYS;
+  int64_t denied;
+  if (KERN_STATIC_BRANCH(gKernSeccompKey) &&
+      KernSeccompReject(tCurrentPID, number, args, &denied))
+    return denied;
+  KERN_TRACE(KernTraceSyscallEnter, number, args[0], args[1], args[2]);
+  uint64_t traceStart =
+      KERN_TRACE_ENABLED(KernTraceSyscallExit) ? mach_absolute_time() : 0;
+  KernSyscallHandler handler = kSyscallTable[number].handler;
+  int64_t ret = handler ? handler(self, args) : 0;
+  // 0 when the exit tracepoint came on during the call
+  KERN_TRACE(KernTraceSyscallExit, number, ret,
+             traceStart ? mach_absolute_time() - traceStart : 0, 0);
+  if (KERN_STATIC_BRANCH(gSyscallTraceKey))
+    KernSyscallTrace(self, number, ret);
+  return ret;
+}
+
+// Boxed compatibility entry: NSNumber arguments pass by value and NSString
+// arguments as C strings that live for the duration of the call.
+- (KernSyscallResult *)executeSyscall:(KernSyscallNumber)number
+                                 args:(NSArray *)args {
+  KernSyscallResult *result = [[KernSyscallResult alloc] init];
+  if ((NSUInteger)number < KSYS_MAX_SYSCALL &&
+      args.count < kSyscallTable[number].nargs) {
+    // Counted like any other call, but the handler never sees it
+    self.syscallCount++;
+    result.returnValue = -EINVAL;
+  } else {
+    uint64_t raw[KERN_SYSCALL_MAX_ARGS] = {0};
+    NSUInteger count = MIN(args.count, (NSUInteger)KERN_SYSCALL_MAX_ARGS);
+    for (NSUInteger i = 0; i < count; i++) {
+      id arg = args[i];
+      if ([arg isKindOfClass:[NSString class]])
+        raw[i] = (uintptr_t)[(NSString *)arg UTF8String];
+      else if ([arg isKindOfClass:[NSNumber class]])
+        raw[i] = [(NSNumber *)arg unsignedLongLongValue];
+    }
+    result.returnValue = [self invokeSyscall:number args:raw];
+  }
+  result.success = result.returnValue >= 0;
+  if (!result.success) {
+    result.errorCode = (int32_t)-result.returnValue;
+    result.errorMessage = @(strerror(result.errorCode));
+  }
+  return result;
+}
+
+- (NSString *)syscallName:(KernSyscallNumber)number {
+  const char *name = (NSUInteger)number < KSYS_MAX_SYSCALL
+                         ? kSyscallTable[number].name
+                         : NULL;
+  return name ? @(name)
+              : [NSString stringWithFormat:@"syscall_%ld", (long)number];
+}
+
+- (NSUInteger)totalSyscallCount {
+  return (NSUInteger)self.syscallCount;
+}
+
+- (void)setSyscallTracingEnabled:(BOOL)enabled {
+  @synchronized(self) {
+    if (enabled == [self isSyscallTracingEnabled])
+      return;
+    if (enabled)
+      KernStaticKeyEnable(gSyscallTraceKey);
+    else
+      KernStaticKeyDisable(gSyscallTraceKey);
+  }
+}
+
+- (BOOL)isSyscallTracingEnabled {
+  return gSyscallTraceKey.enabled.load(std::memory_order_relaxed) > 0;
+}
+
+- (uint32_t)currentPID {
+  return tCurrentPID;
+}
+
+- (void)setCurrentPID:(uint32_t)pid {
+  if (KERN_STATIC_BRANCH(gKernPerfKey) && pid != tCurrentPID)
+    KernPerfSwitchProcess(tCurrentPID);
+  tCurrentPID = pid;
+}
+
+@end
@@ -0,0 +1,399 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Static Tracepoints
+// ============================================================================
+//
+// A tracepoint is a KERN_TRACE site compiled into a hot path, guarded by its
+// own static key: while it is off the site costs one relaxed load on an
+// unlikely branch and its arguments are never evaluated. Switched on, the
+// site calls KernTraceEmit, which checks the tracepoint's filters and writes
+// a 64-byte binary event (timestamp, pid, CPU and four argument words) into
+// the calling CPU's trace ring. Programs attached to the tracepoint
+// (AdvancedKernel_BPF.mm) run on every event that passes the filters, even
+// while the tracepoint itself is not recording.
+//
+// Trace rings work like the log rings: a thread is bound to a ring on its
+// first event, writers claim slots by advancing the head, and an event's
+// sequence is its ring position plus one once it is complete, so a reader
+// can tell a finished event from one still being written or one from a
+// later lap. Readers consume: each ring remembers how far it has been read.
+// A full ring overwrites its oldest events, which are counted as lost.
+//
+// Filters are up to KERN_TRACE_MAX_FILTERS comparisons on an event field,
+// all of which must hold. They are replaced without stopping writers: the
+// count drops to zero while entries change, so an event racing with the
+// update may be checked against a mix of old and new entries.
+
+#define KERN_TRACE_MAX_RINGS 64
+#define KERN_TRACE_RING_EVENTS 4096 // Per ring, a power of two
+#define KERN_TRACE_RING_MASK (KERN_TRACE_RING_EVENTS - 1)
+#define KERN_TRACE_MAX_FILTERS 4
+
+KernStaticKey gKernTraceKeys[KernTracepointCount];
+
+namespace {
+
+const char *const kTracepointNames[KernTracepointCount] = {
+    "sched:schedule",      "sched:context_switch", "mm:allocate_page",
+    "mm:page_fault",       "ipc:pipe_write",       "vfs:dentry_lookup",
+    "syscalls:sys_enter",  "syscalls:sys_exit",
+};
+
+struct KernTraceFilterSlot {
+  std::atomic<uint8_t> field{0};
+  std::atomic<uint8_t> op{0};
+  std::atomic<uint64_t> value{0};
+};
+
+struct KernTracepointState {
+  std::atomic<bool> recording{false};
+  std::atomic<uint32_t> filterCount{0};
+  KernTraceFilterSlot filters[KERN_TRACE_MAX_FILTERS];
+};
+
+KernTracepointState gTracepoints[KernTracepointCount];
+std::mutex gTraceControlLock; // Serialises enable/disable and filter updates
+
+struct KernTraceRecord {
+  std::atomic<uint64_t> sequence{0}; // Ring position + 1 once written
+  uint64_t timestamp;
+  uint32_t pid;
+  uint16_t tracepoint;
+  uint16_t cpu;
+  uint64_t args[KERN_TRACE_ARGS];
+  uint64_t reserved;
+};
+static_assert(sizeof(KernTraceRecord) == 64, "trace events are a cache line");
+
+struct KernTraceRing {
+  alignas(64) std::atomic<uint64_t> head{0};
+  uint32_t cpu = 0;
+  uint64_t tail = 0; // Next position to read; under gTraceReadLock
+  std::atomic<uint64_t> hits[KernTracepointCount];
+  std::atomic<uint64_t> filtered[KernTracepointCount];
+  alignas(64) KernTraceRecord records[KERN_TRACE_RING_EVENTS];
+
+  KernTraceRing() {
+    for (auto &count : hits)
+      count.store(0, std::memory_order_relaxed);
+    for (auto &count : filtered)
+      count.store(0, std::memory_order_relaxed);
+  }
+};
+
+std::atomic<uint32_t> gTraceNextRing{0};
+std::atomic<KernTraceRing *> gTraceRings[KERN_TRACE_MAX_RINGS];
+thread_local KernTraceRing *tTraceRing = nullptr;
+std::mutex gTraceReadLock;
+uint64_t gTraceLost = 0; // Under gTraceReadLock
+
+KernTraceRing *KernTraceLocalRing() {
+  if (__builtin_expect(tTraceRing != nullptr, 1))
+    return tTraceRing;
+  uint32_t cpu = gTraceNextRing.fetch_add(1, std::memory_order_relaxed) %
+                 KERN_TRACE_MAX_RINGS;
+  KernTraceRing *ring = gTraceRings[cpu].load(std::memory_order_acquire);
+  if (!ring) {
+    KernTraceRing *fresh = new KernTraceRing();
+    fresh->cpu = cpu;
+    if (gTraceRings[cpu].compare_exchange_strong(ring, fresh,
+                                                 std::memory_order_acq_rel))
+      ring = fresh;
+    else
+      delete fresh;
+  }
+  tTraceRing = ring;
+  return ring;
+}
+
+uint64_t KernTraceFieldValue(KernTraceFieldSelector field, uint32_t pid,
+                             uint32_t cpu, const uint64_t *args) {
+  switch (field) {
+  case KernTraceFieldPID:
+    return pid;
+  case KernTraceFieldCPU:
+    return cpu;
+  case KernTraceFieldArg0:
+  case KernTraceFieldArg1:
+  case KernTraceFieldArg2:
+  case KernTraceFieldArg3:
+    return args[field - KernTraceFieldArg0];
+  }
+  return 0;
+}
+
+bool KernTraceCompare(KernTraceOp op, uint64_t lhs, uint64_t rhs) {
+  switch (op) {
+  case KernTraceEqual:
+    return lhs == rhs;
+  case KernTraceNotEqual:
+    return lhs != rhs;
+  case KernTraceLess:
+    return lhs < rhs;
+  case KernTraceGreaterEqual:
+    return lhs >= rhs;
+  case KernTraceMaskSet:
+    return (lhs & rhs) != 0;
+  }
+  return false;
+}
+
+bool KernTracePasses(KernTracepointState &state, uint32_t pid, uint32_t cpu,
+                     const uint64_t *args) {
+  uint32_t count = state.filterCount.load(std::memory_order_acquire);
+  for (uint32_t i = 0; i < count; i++) {
+    const KernTraceFilterSlot &filter = state.filters[i];
+    auto field =
+        (KernTraceFieldSelector)filter.field.load(std::memory_order_relaxed);
+    auto op = (KernTraceOp)filter.op.load(std::memory_order_relaxed);
+    if (!KernTraceCompare(op, KernTraceFieldValue(field, pid, cpu, args),
+                          filter.value.load(std::memory_order_relaxed)))
+      return false;
+  }
+  return true;
+}
+
+// A copied-out event with the ring it came from
+struct KernTraceCopy {
+  uint64_t position;
+  uint64_t timestamp;
+  uint32_t pid;
+  uint16_t tracepoint;
+  uint16_t cpu;
+  uint64_t args[KERN_TRACE_ARGS];
+  size_t ring;
+};
+
+} // namespace
+
+void KernTraceEmit(KernTracepoint tp, uint64_t a0, uint64_t a1, uint64_t a2,
+                   uint64_t a3) {
+  if ((NSUInteger)tp >= KernTracepointCount)
+    return;
+  KernTracepointState &state = gTracepoints[tp];
+  KernTraceRing *ring = KernTraceLocalRing();
+  uint64_t args[KERN_TRACE_ARGS] = {a0, a1, a2, a3};
+  uint32_t pid = KernCurrentPID();
+  ring->hits[tp].fetch_add(1, std::memory_order_relaxed);
+  if (!KernTracePasses(state, pid, ring->cpu, args)) {
+    ring->filtered[tp].fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (gKernBPFAttached[tp].load(std::memory_order_relaxed)) {
+    KernBPFContext ctx = {(uint64_t)tp, mach_absolute_time(), pid, ring->cpu,
+                          {a0, a1, a2, a3}};
+    KernBPFRun(tp, &ctx);
+  }
+  if (!state.recording.load(std::memory_order_relaxed))
+    return;
+
+  uint64_t pos = ring->head.fetch_add(1, std::memory_order_relaxed);
+  KernTraceRecord &record = ring->records[pos & KERN_TRACE_RING_MASK];
+  record.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.timestamp = mach_absolute_time();
+  record.pid = pid;
+  record.tracepoint = (uint16_t)tp;
+  record.cpu = (uint16_t)ring->cpu;
+  memcpy(record.args, args, sizeof(args));
+  record.sequence.store(pos + 1, std::memory_order_release);
+}
+
+// ============================================================================
+// KernTraceEvent
+// ============================================================================
+
+@implementation KernTraceEvent
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _tracepoint = KernTraceSchedule;
+    _name = @"";
+    _timestampNs = 0;
+    _processID = 0;
+    _cpuID = 0;
+    _args = @[];
+  }
+  return self;
+}
+@end
+
+// ============================================================================
+// AdvancedKernel — Tracepoint Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Trace)
+
+- (NSArray<NSString *> *)tracepointNames {
+  NSMutableArray *names = [NSMutableArray array];
+  for (const char *name : kTracepointNames)
+    [names addObject:@(name)];
+  return names;
+}
+
+- (void)setTracepoint:(KernTracepoint)tp enabled:(BOOL)enabled {
+  if ((NSUInteger)tp >= KernTracepointCount)
+    return;
+  std::lock_guard<std::mutex> guard(gTraceControlLock);
+  KernTracepointState &state = gTracepoints[tp];
+  if (state.recording.load(std::memory_order_relaxed) == (bool)enabled)
+    return;
+  state.recording.store(enabled, std::memory_order_relaxed);
+  if (enabled)
+    KernStaticKeyEnable(gKernTraceKeys[tp]);
+  else
+    KernStaticKeyDisable(gKernTraceKeys[tp]);
+}
+
+- (BOOL)isTracepointEnabled:(KernTracepoint)tp {
+  return (NSUInteger)tp < KernTracepointCount &&
+         gTracepoints[tp].recording.load(std::memory_order_relaxed);
+}
+
+- (BOOL)addTraceFilter:(KernTracepoint)tp
+                 field:(KernTraceFieldSelector)field
+                    op:(KernTraceOp)op
+                 value:(uint64_t)value {
+  if ((NSUInteger)tp >= KernTracepointCount ||
+      (NSUInteger)field > KernTraceFieldArg3 ||
+      (NSUInteger)op > KernTraceMaskSet)
+    return NO;
+  std::lock_guard<std::mutex> guard(gTraceControlLock);
+  KernTracepointState &state = gTracepoints[tp];
+  uint32_t count = state.filterCount.load(std::memory_order_relaxed);
+  if (count >= KERN_TRACE_MAX_FILTERS)
+    return NO;
+  KernTraceFilterSlot &slot = state.filters[count];
+  slot.field.store((uint8_t)field, std::memory_order_relaxed);
+  slot.op.store((uint8_t)op, std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  state.filterCount.store(count + 1, std::memory_order_release);
+  return YES;
+}
+
+- (void)clearTraceFilters:(KernTracepoint)tp {
+  if ((NSUInteger)tp >= KernTracepointCount)
+    return;
+  std::lock_guard<std::mutex> guard(gTraceControlLock);
+  gTracepoints[tp].filterCount.store(0, std::memory_order_release);
+}
+
+// Each ring is read in position order, so what is taken from it is always a
+// prefix and its tail moves just past it. Rings are merged by the timestamp
+// of their next event. Threads sharing a ring stamp events after claiming
+// slots, so the result is time ordered only up to those small inversions.
+- (NSArray<KernTraceEvent *> *)readTraceEvents:(NSUInteger)maximum {
+  std::lock_guard<std::mutex> guard(gTraceReadLock);
+  std::vector<std::vector<KernTraceCopy>> perRing;
+  for (size_t r = 0; r < KERN_TRACE_MAX_RINGS; r++) {
+    KernTraceRing *ring = gTraceRings[r].load(std::memory_order_acquire);
+    if (!ring)
+      continue;
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if (head > KERN_TRACE_RING_EVENTS &&
+        ring->tail < head - KERN_TRACE_RING_EVENTS) {
+      gTraceLost += head - KERN_TRACE_RING_EVENTS - ring->tail;
+      ring->tail = head - KERN_TRACE_RING_EVENTS;
+    }
+    std::vector<KernTraceCopy> events;
+    for (uint64_t pos = ring->tail; pos < head; pos++) {
+      KernTraceRecord &record = ring->records[pos & KERN_TRACE_RING_MASK];
+      if (record.sequence.load(std::memory_order_acquire) != pos + 1)
+        break; // Still being written, or already overwritten
+      KernTraceCopy copy;
+      copy.position = pos;
+      copy.timestamp = record.timestamp;
+      copy.pid = record.pid;
+      copy.tracepoint = record.tracepoint;
+      copy.cpu = record.cpu;
+      memcpy(copy.args, record.args, sizeof(copy.args));
+      copy.ring = r;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (record.sequence.load(std::memory_order_relaxed) != pos + 1)
+        break;
+      events.push_back(copy);
+    }
+    if (!events.empty())
+      perRing.push_back(std::move(events));
+  }
+
+  typedef std::pair<uint64_t, size_t> Cursor; // (timestamp, perRing index)
+  std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+  std::vector<size_t> next(perRing.size(), 0);
+  for (size_t i = 0; i < perRing.size(); i++)
+    heap.push({perRing[i][0].timestamp, i});
+  NSMutableArray<KernTraceEvent *> *results = [NSMutableArray array];
+  while (!heap.empty() && results.count < maximum) {
+    size_t i = heap.top().second;
+    heap.pop();
+    const KernTraceCopy &copy = perRing[i][next[i]];
+    if (++next[i] < perRing[i].size())
+      heap.push({perRing[i][next[i]].timestamp, i});
+    KernTraceRing *ring =
+        gTraceRings[copy.ring].load(std::memory_order_relaxed);
+    ring->tail = copy.position + 1;
+    KernTraceEvent *event = [[KernTraceEvent alloc] init];
+    event.tracepoint = (KernTracepoint)copy.tracepoint;
+    event.name = @(kTracepointNames[copy.tracepoint]);
+    event.timestampNs = copy.timestamp;
+    event.processID = copy.pid;
+    event.cpuID = copy.cpu;
+    event.args = @[
+      @(copy.args[0]), @(copy.args[1]), @(copy.args[2]), @(copy.args[3])
+    ];
+    [results addObject:event];
+  }
+  return results;
+}
+
+- (NSDictionary *)traceStatistics {
+  uint64_t hits[KernTracepointCount] = {};
+  uint64_t filtered[KernTracepointCount] = {};
+  uint64_t written = 0;
+  for (auto &slot : gTraceRings) {
+    KernTraceRing *ring = slot.load(std::memory_order_acquire);
+    if (!ring)
+      continue;
+    written += ring->head.load(std::memory_order_relaxed);
+    for (NSUInteger tp = 0; tp < KernTracepointCount; tp++) {
+      hits[tp] += ring->hits[tp].load(std::memory_order_relaxed);
+      filtered[tp] += ring->filtered[tp].load(std::memory_order_relaxed);
+    }
+  }
+  NSMutableDictionary *tracepoints = [NSMutableDictionary dictionary];
+  for (NSUInteger tp = 0; tp < KernTracepointCount; tp++) {
+    KernTracepointState &state = gTracepoints[tp];
+    tracepoints[@(kTracepointNames[tp])] = @{
+      @"enabled" : @(state.recording.load(std::memory_order_relaxed)),
+      @"hits" : @(hits[tp]),
+      @"filtered" : @(filtered[tp]),
+      @"filters" : @(state.filterCount.load(std::memory_order_relaxed))
+    };
+  }
+  uint64_t lost;
+  {
+    std::lock_guard<std::mutex> guard(gTraceReadLock);
+    lost = gTraceLost;
+  }
+  return @{
+    @"tracepoints" : tracepoints,
+    @"events_written" : @(written),
+    @"events_lost" : @(lost)
+  };
+}
+
+@end
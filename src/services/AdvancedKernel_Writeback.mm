@@ -0,0 +1,329 @@
+#import "AdvancedKernel.h"
+#include <mach/mach_time.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+@interface AdvancedKernel ()
+@property(nonatomic, strong) NSMutableDictionary *internalState;
+@property(nonatomic, assign) uint64_t bootTime;
+@property(nonatomic, assign) uint64_t syscallCount;
+@end
+
+// ============================================================================
+// Background Writeback
+// ============================================================================
+//
+// Each superblock has a KernWriteback: dirty and under-writeback page
+// counts, a queue of dirty inodes in the order they were first dirtied,
+// and a flusher, a serial dispatch queue driven by a periodic timer. A
+// periodic pass writes inodes that have been dirty for longer than the
+// expiry; a background pass, kicked by a writer once dirty pages pass the
+// background ratio, writes all of them. The page cache batches each
+// inode's contiguous dirty pages into single backing-store writes.
+//
+// Writers that push dirty pages past the hard ratio are paused in short
+// slices until flushers bring the total back down, up to a bounded delay.
+
+#define KERN_WRITEBACK_INTERVAL_MS 500
+#define KERN_DIRTY_EXPIRE_MS 3000
+#define KERN_DIRTY_PAUSE_SLICE_MS 10
+#define KERN_DIRTY_PAUSE_MAX_MS 200
+
+namespace {
+
+enum class KernFlushMode { Periodic, Background, Sync };
+
+struct KernWritebackState {
+  std::mutex lock;
+  std::deque<__weak KernInode *> dirtyInodes; // Oldest first
+  std::atomic<int64_t> dirty{0};
+  std::atomic<int64_t> writeback{0};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> wakeups{0};
+  std::atomic<uint64_t> throttledNs{0};
+  std::atomic<bool> kicked{false};
+};
+
+std::atomic<int64_t> gDirtyPages{0};
+std::atomic<uint32_t> gDirtyRatio{20};
+std::atomic<uint32_t> gDirtyBackgroundRatio{10};
+std::mutex gDirtyWaitLock;
+std::condition_variable gDirtyWait;
+
+uint64_t KernWritebackTicks(uint64_t ms) {
+  static mach_timebase_info_data_t timebase;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info(&timebase);
+  });
+  return ms * 1000000ULL * timebase.denom / timebase.numer;
+}
+
+uint64_t KernWritebackNs(uint64_t ticks) {
+  return ticks * 1000000ULL / KernWritebackTicks(1);
+}
+
+} // namespace
+
+// ============================================================================
+// KernWriteback
+// ============================================================================
+
+@interface KernWriteback ()
+- (instancetype)initWithName:(NSString *)name;
+- (KernWritebackState *)state;
+- (void)startFlusher;
+- (void)kick;
+- (NSInteger)flush:(KernFlushMode)mode;
+- (NSInteger)sync;
+@end
+
+@implementation KernWriteback {
+  KernWritebackState _state;
+  dispatch_queue_t _queue;
+  dispatch_source_t _timer; // Created with the first dirty inode
+  dispatch_once_t _timerOnce;
+}
+
+- (instancetype)initWithName:(NSString *)name {
+  self = [super init];
+  if (self) {
+    NSString *label = [NSString stringWithFormat:@"kern.writeback.%@", name];
+    _queue = dispatch_queue_create(label.UTF8String, DISPATCH_QUEUE_SERIAL);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (_timer)
+    dispatch_source_cancel(_timer);
+}
+
+- (KernWritebackState *)state {
+  return &_state;
+}
+
+- (void)startFlusher {
+  dispatch_once(&_timerOnce, ^{
+    uint64_t interval = KERN_WRITEBACK_INTERVAL_MS * NSEC_PER_MSEC;
+    dispatch_source_t timer =
+        dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self->_queue);
+    dispatch_source_set_timer(timer,
+                              dispatch_time(DISPATCH_TIME_NOW, interval),
+                              interval, interval / 5);
+    __weak KernWriteback *weakSelf = self;
+    dispatch_source_set_event_handler(timer, ^{
+      [weakSelf flush:KernFlushMode::Periodic];
+    });
+    dispatch_resume(timer);
+    self->_timer = timer;
+  });
+}
+
+- (void)kick {
+  if (_state.kicked.exchange(true))
+    return;
+  [self startFlusher];
+  dispatch_async(_queue, ^{
+    self->_state.kicked = false;
+    [self flush:KernFlushMode::Background];
+  });
+}
+
+// Runs on the flusher queue. Returns pages written.
+- (NSInteger)flush:(KernFlushMode)mode {
+  _state.wakeups.fetch_add(1, std::memory_order_relaxed);
+  uint64_t now = mach_absolute_time();
+  uint64_t expire = KernWritebackTicks(KERN_DIRTY_EXPIRE_MS);
+  std::vector<KernInode *> batch;
+  {
+    std::lock_guard<std::mutex> guard(_state.lock);
+    while (!_state.dirtyInodes.empty()) {
+      KernInode *inode = _state.dirtyInodes.front();
+      if (inode && mode == KernFlushMode::Periodic &&
+          now - inode.dirtiedWhen < expire)
+        break;
+      _state.dirtyInodes.pop_front();
+      if (inode)
+        batch.push_back(inode);
+    }
+  }
+
+  AdvancedKernel *kernel = [AdvancedKernel sharedInstance];
+  NSInteger written = 0;
+  for (KernInode *inode : batch) {
+    written += [kernel writebackInode:inode];
+    // Redirtied while being written, or a write failed: keep it queued
+    if (inode.dirtiedWhen) {
+      std::lock_guard<std::mutex> guard(_state.lock);
+      _state.dirtyInodes.push_back(inode);
+    }
+  }
+  {
+    // Order the wakeup after any writer's check of the dirty count
+    std::lock_guard<std::mutex> guard(gDirtyWaitLock);
+  }
+  gDirtyWait.notify_all();
+  return written;
+}
+
+- (NSInteger)sync {
+  __block NSInteger written = 0;
+  dispatch_sync(_queue, ^{
+    written = [self flush:KernFlushMode::Sync];
+  });
+  return written;
+}
+
+- (uint64_t)dirtyPages {
+  return (uint64_t)MAX(_state.dirty.load(), (int64_t)0);
+}
+
+- (uint64_t)writebackPages {
+  return (uint64_t)MAX(_state.writeback.load(), (int64_t)0);
+}
+
+- (uint64_t)writtenPages {
+  return _state.written.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)writeRequests {
+  return _state.requests.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)flusherWakeups {
+  return _state.wakeups.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)throttledNs {
+  return _state.throttledNs.load(std::memory_order_relaxed);
+}
+
+- (NSUInteger)dirtyInodes {
+  std::lock_guard<std::mutex> guard(_state.lock);
+  return _state.dirtyInodes.size();
+}
+
+@end
+
+// --- Page cache hooks ---
+
+KernWriteback *KernInodeWriteback(KernInode *inode) {
+  KernSuperblock *sb = inode.superblock;
+  if (!sb) {
+    static KernWriteback *anonymous;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+      anonymous = [[KernWriteback alloc] initWithName:@"anon"];
+    });
+    return anonymous;
+  }
+  KernWriteback *wb = sb.writeback;
+  if (!wb) {
+    @synchronized(sb) {
+      if (!sb.writeback)
+        sb.writeback = [[KernWriteback alloc] initWithName:sb.deviceName];
+      wb = sb.writeback;
+    }
+  }
+  return wb;
+}
+
+void KernWritebackAccount(KernWriteback *wb, int64_t dirty,
+                          int64_t writeback) {
+  KernWritebackState *state = [wb state];
+  if (dirty) {
+    state->dirty.fetch_add(dirty, std::memory_order_relaxed);
+    gDirtyPages.fetch_add(dirty, std::memory_order_relaxed);
+  }
+  if (writeback)
+    state->writeback.fetch_add(writeback, std::memory_order_relaxed);
+}
+
+void KernWritebackCompleted(KernWriteback *wb, uint64_t pages) {
+  KernWritebackState *state = [wb state];
+  state->written.fetch_add(pages, std::memory_order_relaxed);
+  state->requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Called under the inode's mapping lock, which also covers the flusher
+// clearing dirtiedWhen once the inode is clean.
+void KernWritebackInodeDirtied(KernWriteback *wb, KernInode *inode) {
+  if (inode.dirtiedWhen)
+    return;
+  inode.dirtiedWhen = mach_absolute_time();
+  KernWritebackState *state = [wb state];
+  {
+    std::lock_guard<std::mutex> guard(state->lock);
+    state->dirtyInodes.push_back(inode);
+  }
+  [wb startFlusher];
+}
+
+uint64_t KernWritebackDirtyPages(void) {
+  return (uint64_t)MAX(gDirtyPages.load(std::memory_order_relaxed),
+                       (int64_t)0);
+}
+
+void KernBalanceDirtyPages(KernWriteback *wb, uint64_t cachePages) {
+  int64_t dirty = gDirtyPages.load(std::memory_order_relaxed);
+  int64_t background = (int64_t)(cachePages * gDirtyBackgroundRatio / 100);
+  int64_t limit = (int64_t)(cachePages * gDirtyRatio / 100);
+  if (!wb || dirty <= background)
+    return;
+  [wb kick];
+  if (dirty <= limit)
+    return;
+
+  uint64_t start = mach_absolute_time();
+  {
+    std::unique_lock<std::mutex> lock(gDirtyWaitLock);
+    for (int slice = 0;
+         slice < KERN_DIRTY_PAUSE_MAX_MS / KERN_DIRTY_PAUSE_SLICE_MS &&
+         gDirtyPages.load(std::memory_order_relaxed) > limit;
+         slice++)
+      gDirtyWait.wait_for(
+          lock, std::chrono::milliseconds(KERN_DIRTY_PAUSE_SLICE_MS));
+  }
+  [wb state]->throttledNs.fetch_add(
+      KernWritebackNs(mach_absolute_time() - start),
+      std::memory_order_relaxed);
+}
+
+// ============================================================================
+// AdvancedKernel — Writeback Methods
+// ============================================================================
+
+@implementation AdvancedKernel (Writeback)
+
+- (void)setDirtyRatio:(NSUInteger)ratio
+      backgroundRatio:(NSUInteger)backgroundRatio {
+  ratio = MIN(MAX(ratio, (NSUInteger)1), (NSUInteger)100);
+  gDirtyRatio = (uint32_t)ratio;
+  gDirtyBackgroundRatio = (uint32_t)MIN(MAX(backgroundRatio, (NSUInteger)1),
+                                        ratio);
+}
+
+// Waits only on this file's pages: writing them takes the inode's mapping
+// lock, which a flusher already writing the same inode holds until done.
+// Inode metadata lives only in memory, so fdatasync behaves like fsync.
+- (int64_t)syncFD:(int32_t)fd dataOnly:(BOOL)dataOnly {
+  KernFileDescriptor *desc = [self fileDescriptorForNumber:fd];
+  if (!desc || !desc.inode)
+    return -EBADF;
+  if (desc.pipe)
+    return -EINVAL;
+  (void)dataOnly;
+  [self writebackInode:desc.inode];
+  return desc.inode.mapping.nrDirty ? -EIO : 0;
+}
+
+- (NSInteger)syncFileSystem:(KernSuperblock *)sb {
+  return [sb.writeback sync];
+}
+
+@end